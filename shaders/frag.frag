@@ -1,51 +1,148 @@
 #version 450
 #extension GL_EXT_nonuniform_qualifier : require // Required for variable indexing
+#extension GL_GOOGLE_include_directive : require
 
-layout(binding = 1) uniform sampler2D texSamplers[]; // All textures live here
+#include "scene_uniforms.glsl"
+#include "light_clusters.glsl"
 
-layout(std430, push_constant) uniform PC { int texture_id; } pc;
+// Matches GpuMaterial in MaterialBufferVk.h
+struct Material {
+    vec4 albedo_factor;
+    vec3 emissive;      // factor times strength
+    float metallic_factor;
+    float roughness_factor;
+    float normal_scale;
+    float alpha_cutoff; // 0 = opaque
+    int albedo_id;      // -1 = none
+    int normal_id;      // -1 = none
+    int metallic_roughness_id; // -1 = none, occlusion r, roughness g, metallic b
+    int occlusion_id;   // -1 = none, red channel
+    int emissive_id;    // -1 = none
+    float occlusion_strength;
+};
+
+layout(std430, binding = 1) readonly buffer Materials {
+    Material materials[];
+};
+
+layout(binding = 6) uniform sampler2D texSamplers[]; // All textures live here
+
+// Material features, see ShaderFeatures.h. The generic pipeline decides
+// per draw from the material, specialized variants have the answer baked
+// in and the branches compile away
+layout(constant_id = 0) const bool GENERIC = true;
+layout(constant_id = 1) const bool ALBEDO_TEXTURE = false;
+layout(constant_id = 2) const bool NORMAL_MAP = false;
+layout(constant_id = 3) const bool VERTEX_COLOR = false;
+layout(constant_id = 4) const bool ALPHA_TEST = false;
 
 layout(location = 0) in vec3 fragPos;
 layout(location = 1) in vec3 fragColor;
 layout(location = 2) in vec3 fragNorm;
 layout(location = 3) in vec2 fragTexCoord;
+layout(location = 4) flat in uint fragMaterial;
 
 layout(location = 0) out vec4 outColor;
 
-void main() {
-    // Material color: use albedo texture if available, otherwise fall back to vertex color
-    vec3 meshColor = (pc.texture_id < 0)
-        ? fragColor
-        : texture(texSamplers[nonuniformEXT(pc.texture_id)], fragTexCoord).rgb;
+bool has_albedo_texture(Material m) { return GENERIC ? m.albedo_id >= 0 : ALBEDO_TEXTURE; }
+bool has_normal_map(Material m) { return GENERIC ? m.normal_id >= 0 : NORMAL_MAP; }
+bool use_vertex_color(Material m) { return GENERIC ? m.albedo_id < 0 : VERTEX_COLOR; }
+bool alpha_test(Material m) { return GENERIC ? m.alpha_cutoff > 0.0 : ALPHA_TEST; }
+
+// Normal maps store x and y only. The vertices carry no tangents, so the
+// tangent frame comes from screen space derivatives of position and uv
+vec3 perturb_normal(Material m, vec3 N, vec3 pos, vec2 uv) {
+    vec2 xy = texture(texSamplers[nonuniformEXT(m.normal_id)], uv).rg * 2.0 - 1.0;
+    xy *= m.normal_scale;
+    vec3 tangentNormal = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
 
-    // Light properties
-    vec3 lightColor = vec3(1.0, 1.0, 1.0);
-    vec3 lightPos   = vec3(10.0, 10.0, 5.0);
+    vec3 dp1 = dFdx(pos);
+    vec3 dp2 = dFdy(pos);
+    vec2 duv1 = dFdx(uv);
+    vec2 duv2 = dFdy(uv);
+    vec3 dp2perp = cross(dp2, N);
+    vec3 dp1perp = cross(N, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invMax = inversesqrt(max(max(dot(T, T), dot(B, B)), 1e-12));
+    return normalize(mat3(T * invMax, B * invMax, N) * tangentNormal);
+}
 
-    // Camera at origin (view space) — approximate eye position in world space.
-    // For a proper solution, pass the camera position via a uniform.
-    vec3 viewPos = vec3(0.0, 1.0, 2.0);
+void main() {
+    Material material = materials[fragMaterial];
+
+    // Material color: albedo texture if available, otherwise vertex color
+    vec4 albedo = material.albedo_factor;
+    if (has_albedo_texture(material)) {
+        albedo *= texture(texSamplers[nonuniformEXT(material.albedo_id)], fragTexCoord);
+    }
+    if (alpha_test(material) && albedo.a < material.alpha_cutoff) {
+        discard;
+    }
+    vec3 meshColor = albedo.rgb;
+    if (use_vertex_color(material)) {
+        meshColor *= fragColor;
+    }
 
     vec3 N = normalize(fragNorm);
-    vec3 L = normalize(lightPos - fragPos);
-    vec3 V = normalize(viewPos - fragPos);
-    vec3 H = normalize(L + V);  // Blinn-Phong half-vector
+    if (has_normal_map(material)) {
+        N = perturb_normal(material, N, fragPos, fragTexCoord);
+    }
+    vec3 V = normalize(ubo.camera_position.xyz - fragPos);
+
+    // Metallic-roughness map: roughness in G, metallic in B. A packed ORM
+    // texture carries occlusion in R and is the same index, sampled once.
+    float metallic = material.metallic_factor;
+    float roughness = material.roughness_factor;
+    float occlusion = 1.0;
+    if (material.metallic_roughness_id >= 0) {
+        vec3 orm = texture(texSamplers[nonuniformEXT(material.metallic_roughness_id)], fragTexCoord).rgb;
+        roughness *= orm.g;
+        metallic *= orm.b;
+        if (material.occlusion_id == material.metallic_roughness_id) {
+            occlusion = orm.r;
+        }
+    }
+    if (material.occlusion_id >= 0 && material.occlusion_id != material.metallic_roughness_id) {
+        occlusion = texture(texSamplers[nonuniformEXT(material.occlusion_id)], fragTexCoord).r;
+    }
+    occlusion = mix(1.0, occlusion, material.occlusion_strength);
+
+    vec3 emissive = material.emissive;
+    if (material.emissive_id >= 0) {
+        emissive *= texture(texSamplers[nonuniformEXT(material.emissive_id)], fragTexCoord).rgb;
+    }
 
-    // Ambient
+    // Ambient, only it is occluded
     float ambientStrength = 0.15;
-    vec3 ambient = ambientStrength * lightColor;
+    vec3 lighting = ambientStrength * occlusion * meshColor;
+
+    // Blinn-Phong stand-in for metallic-roughness: rougher surfaces get a
+    // wider, dimmer highlight, metals lose their diffuse and tint the
+    // highlight with their color
+    float shininess = exp2(mix(8.0, 2.0, roughness));
+    vec3 diffuseColor = meshColor * (1.0 - metallic);
+    vec3 specularColor = mix(vec3(0.5), meshColor, metallic) * (1.0 - 0.75 * roughness);
+
+    // Only the lights whose range reaches this fragment's cluster
+    uvec2 lightRange = cluster_light_range(cluster_index(fragPos));
+    for (uint i = 0u; i < lightRange.y; ++i) {
+        Light light = cluster_light(lightRange.x + i);
+        vec3 toLight = light.position_range.xyz - fragPos;
+        float dist = length(toLight);
+        vec3 L = toLight / max(dist, 1e-4);
+        vec3 H = normalize(L + V);  // Blinn-Phong half-vector
 
-    // Diffuse (Lambertian)
-    float diff = max(dot(N, L), 0.0);
-    vec3 diffuse = diff * lightColor;
+        // Diffuse (Lambertian)
+        float diff = max(dot(N, L), 0.0);
+        // Specular (Blinn-Phong)
+        float spec = pow(max(dot(N, H), 0.0), shininess);
 
-    // Specular (Blinn-Phong)
-    float shininess = 32.0;
-    float spec = pow(max(dot(N, H), 0.0), shininess);
-    float specularStrength = 0.5;
-    vec3 specular = specularStrength * spec * lightColor;
+        float attenuation = light_attenuation(dist, light.position_range.w);
+        lighting += (diff * diffuseColor + spec * specularColor) * attenuation * light.color.rgb;
+    }
 
-    vec3 result = (ambient + diffuse + specular) * meshColor;
+    vec3 result = lighting + emissive;
     
     //outColor = vec4(N, 1.0);
     
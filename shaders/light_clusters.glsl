@@ -0,0 +1,45 @@
+// Clustered lights, binned on the CPU by LightClustersVk. Needs
+// scene_uniforms.glsl included first.
+
+// Matches GpuLight in LightClustersVk.h
+struct Light {
+    vec4 position_range; // world space xyz, range w
+    vec4 color;          // color times intensity
+};
+
+layout(std430, binding = 4) readonly buffer Lights {
+    Light lights[];
+};
+
+// An (offset, count) pair per cluster, then the light index lists they
+// point into
+layout(std430, binding = 5) readonly buffer LightGrid {
+    uint light_grid[];
+};
+
+// Same tiles and exponential depth slices the lights were binned into
+uint cluster_index(vec3 world_pos) {
+    uvec3 grid = ubo.cluster_grid.xyz;
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / ubo.cluster_params.xy), grid.xy - 1u);
+    float view_depth = max(-(ubo.view * vec4(world_pos, 1.0)).z, 1e-4);
+    float slice = floor(log(view_depth) * ubo.cluster_params.z + ubo.cluster_params.w);
+    uint z = uint(clamp(slice, 0.0, float(grid.z - 1u)));
+    return tile.x + grid.x * (tile.y + grid.y * z);
+}
+
+// Offset and count of the cluster's run in the index list
+uvec2 cluster_light_range(uint cluster) {
+    return uvec2(light_grid[cluster * 2u], light_grid[cluster * 2u + 1u]);
+}
+
+Light cluster_light(uint index) {
+    uvec3 grid = ubo.cluster_grid.xyz;
+    return lights[light_grid[grid.x * grid.y * grid.z * 2u + index]];
+}
+
+// Inverse square, windowed so it reaches exactly zero at the light's range
+float light_attenuation(float distance, float range) {
+    float ratio = distance / range;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window / (distance * distance + 1.0);
+}
@@ -0,0 +1,10 @@
+// Shared by the scene shaders, matches MVP_uniform_object in RendererVk.h
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    vec4 camera_position; // xyz
+    uvec4 cluster_grid;   // cluster counts xyz, see LightClustersVk.h
+    vec4 cluster_params;  // tile pixels xy, depth slice scale and bias zw
+} ubo;
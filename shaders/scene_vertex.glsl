@@ -0,0 +1,41 @@
+// Shared by vert.vert and vert_pulled.vert, everything after the vertex is
+// fetched
+
+#include "scene_uniforms.glsl"
+
+// Matches GpuDrawData in RendererVk.h. Draws are issued with
+// firstInstance = their index here and one instance.
+struct DrawData {
+    uint material_id;
+    uint vertex_format;  // VertexFormat in Mesh.h
+    uint padding0;
+    uint padding1;
+    vec4 position_min;   // quantized meshes, xyz
+    vec4 position_scale; // quantized meshes, xyz
+    vec4 uv_range;       // quantized meshes, min xy and scale zw
+};
+
+layout(std430, binding = 2) readonly buffer Draws {
+    DrawData draws[];
+};
+
+layout(location = 0) out vec3 fragPos;
+layout(location = 1) out vec3 fragColor;
+layout(location = 2) out vec3 fragNorm;
+layout(location = 3) out vec2 fragTexCoord;
+layout(location = 4) flat out uint fragMaterial;
+
+void emit_vertex(vec3 position, vec3 color, vec3 normal, vec2 uv) {
+    vec4 worldPos = ubo.model * vec4(position, 1.0);
+    fragPos = worldPos.xyz;
+
+    // Normal matrix: inverse-transpose of upper-left 3x3 of model
+    mat3 normalMatrix = transpose(inverse(mat3(ubo.model)));
+    fragNorm = normalMatrix * normal;
+
+    fragColor = color;
+    fragTexCoord = uv;
+    fragMaterial = draws[gl_InstanceIndex].material_id;
+
+    gl_Position = ubo.proj * ubo.view * worldPos;
+}
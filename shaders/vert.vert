@@ -1,31 +1,13 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
-} ubo;
+#include "scene_vertex.glsl"
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec3 inNorm;
 layout(location = 3) in vec2 inTexCoord;
 
-layout(location = 0) out vec3 fragPos;
-layout(location = 1) out vec3 fragColor;
-layout(location = 2) out vec3 fragNorm;
-layout(location = 3) out vec2 fragTexCoord;
-
 void main() {
-    vec4 worldPos = ubo.model * vec4(inPosition, 1.0);
-    fragPos = worldPos.xyz;
-
-    // Normal matrix: inverse-transpose of upper-left 3x3 of model
-    mat3 normalMatrix = transpose(inverse(mat3(ubo.model)));
-    fragNorm = normalMatrix * inNorm;
-
-    fragColor = inColor;
-    fragTexCoord = inTexCoord;
-
-    gl_Position = ubo.proj * ubo.view * worldPos;
-}
\ No newline at end of file
+    emit_vertex(inPosition, inColor, inNorm, inTexCoord);
+}
@@ -0,0 +1,58 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "scene_vertex.glsl"
+
+// The whole vertex buffer. gl_VertexIndex already includes the draw's
+// vertexOffset, which counts vertices of the mesh's own format.
+layout(std430, binding = 3) readonly buffer Geometry {
+    uint geometry[];
+};
+
+const uint VERTEX_FORMAT_FLOAT = 0;
+const uint VERTEX_FORMAT_QUANTIZED = 1;
+
+// Vertex and QuantizedVertex in Mesh.h, in words
+const uint FLOAT_STRIDE = 11;
+const uint QUANTIZED_STRIDE = 5;
+
+vec3 octahedral_decode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+vec3 read_vec3(uint word) {
+    return uintBitsToFloat(uvec3(geometry[word], geometry[word + 1],
+                                 geometry[word + 2]));
+}
+
+void main() {
+    DrawData draw = draws[gl_InstanceIndex];
+    uint index = uint(gl_VertexIndex);
+
+    vec3 position;
+    vec3 color;
+    vec3 normal;
+    vec2 uv;
+    if (draw.vertex_format == VERTEX_FORMAT_QUANTIZED) {
+        uint base = index * QUANTIZED_STRIDE;
+        vec3 unorm = vec3(unpackUnorm2x16(geometry[base]),
+                          unpackUnorm2x16(geometry[base + 1]).x);
+        position = draw.position_min.xyz + unorm * draw.position_scale.xyz;
+        normal = octahedral_decode(unpackSnorm2x16(geometry[base + 2]));
+        uv = draw.uv_range.xy +
+             unpackUnorm2x16(geometry[base + 3]) * draw.uv_range.zw;
+        color = unpackUnorm4x8(geometry[base + 4]).rgb;
+    } else {
+        uint base = index * FLOAT_STRIDE;
+        position = read_vec3(base);
+        color = read_vec3(base + 3);
+        normal = read_vec3(base + 6);
+        uv = uintBitsToFloat(uvec2(geometry[base + 9], geometry[base + 10]));
+    }
+
+    emit_vertex(position, color, normal, uv);
+}
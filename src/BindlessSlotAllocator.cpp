@@ -0,0 +1,42 @@
+#include "BindlessSlotAllocator.h"
+
+#include <cstddef>
+
+namespace Expectre {
+
+BindlessSlotAllocator::BindlessSlotAllocator(uint32_t capacity,
+                                             uint32_t frames_in_flight)
+    : m_capacity(capacity), m_frames_in_flight(frames_in_flight) {}
+
+uint32_t BindlessSlotAllocator::allocate() {
+  // Reuse before growing, keeps the written part of the array compact
+  if (!m_free_slots.empty()) {
+    const uint32_t slot = m_free_slots.back();
+    m_free_slots.pop_back();
+    return slot;
+  }
+  if (m_next_unused < m_capacity) {
+    return m_next_unused++;
+  }
+  return kInvalidBindlessSlot;
+}
+
+void BindlessSlotAllocator::release(uint32_t slot, uint64_t frame_number) {
+  if (slot >= m_next_unused) {
+    return;
+  }
+  m_released.push_back({frame_number, slot});
+}
+
+void BindlessSlotAllocator::begin_frame(uint64_t frame_number) {
+  size_t recycled = 0;
+  while (recycled < m_released.size() &&
+         m_released[recycled].released_frame + m_frames_in_flight <=
+             frame_number) {
+    m_free_slots.push_back(m_released[recycled].slot);
+    recycled++;
+  }
+  m_released.erase(m_released.begin(), m_released.begin() + recycled);
+}
+
+} // namespace Expectre
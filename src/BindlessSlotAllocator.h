@@ -0,0 +1,48 @@
+#ifndef BINDLESS_SLOT_ALLOCATOR_H
+#define BINDLESS_SLOT_ALLOCATOR_H
+
+#include <cstdint>
+#include <vector>
+
+namespace Expectre {
+
+static constexpr uint32_t kInvalidBindlessSlot = UINT32_MAX;
+
+/// Hands out indices into the bindless texture array. Released slots go
+/// back on the free list only once the frames in flight when they were
+/// released have finished, a slot a submitted frame may still sample is
+/// never given to another texture.
+class BindlessSlotAllocator {
+public:
+  BindlessSlotAllocator(uint32_t capacity, uint32_t frames_in_flight);
+
+  /// kInvalidBindlessSlot if every slot is taken
+  uint32_t allocate();
+  void release(uint32_t slot, uint64_t frame_number);
+
+  /// Recycles the slots released far enough back to be out of flight
+  void begin_frame(uint64_t frame_number);
+
+  uint32_t get_capacity() const { return m_capacity; }
+  /// One past the highest slot ever handed out
+  uint32_t get_high_water_mark() const { return m_next_unused; }
+
+private:
+  struct ReleasedSlot {
+    uint64_t released_frame = 0;
+    uint32_t slot = 0;
+  };
+
+  uint32_t m_capacity = 0;
+  uint32_t m_frames_in_flight = 0;
+  // Slots below this have been handed out at some point, the ones above
+  // are free without being on the free list
+  uint32_t m_next_unused = 0;
+  std::vector<uint32_t> m_free_slots;
+  // In release order, so recycling stops at the first one still in flight
+  std::vector<ReleasedSlot> m_released;
+};
+
+} // namespace Expectre
+
+#endif // BINDLESS_SLOT_ALLOCATOR_H
@@ -0,0 +1,350 @@
+#include "BlockCompression.h"
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+namespace Expectre {
+
+uint32_t bc_block_bytes(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+    return 8;
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+uint32_t format_texel_bytes(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_R8_UNORM:
+  case VK_FORMAT_R8_SRGB:
+    return 1;
+  case VK_FORMAT_R8G8_UNORM:
+  case VK_FORMAT_R8G8_SRGB:
+    return 2;
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+size_t format_level_byte_size(VkFormat format, uint32_t width,
+                              uint32_t height) {
+  const uint32_t block_bytes = bc_block_bytes(format);
+  if (block_bytes == 0) {
+    return static_cast<size_t>(width) * height * format_texel_bytes(format);
+  }
+  const size_t blocks_x = (width + 3) / 4;
+  const size_t blocks_y = (height + 3) / 4;
+  return blocks_x * blocks_y * block_bytes;
+}
+
+namespace {
+
+// Single channel block shared by BC4 and both halves of BC5
+void encode_bc4_channel(const uint8_t *rgba, uint32_t channel, uint8_t *out) {
+  uint8_t lo = 255;
+  uint8_t hi = 0;
+  for (uint32_t i = 0; i < 16; i++) {
+    lo = std::min(lo, rgba[i * 4 + channel]);
+    hi = std::max(hi, rgba[i * 4 + channel]);
+  }
+
+  // endpoint0 > endpoint1 selects the 8 value mode: index 0 = hi, 1 = lo and
+  // 2..7 step from hi towards lo
+  out[0] = hi;
+  out[1] = lo;
+
+  uint64_t indices = 0;
+  if (hi > lo) {
+    const float scale = 7.0f / static_cast<float>(hi - lo);
+    for (uint32_t i = 0; i < 16; i++) {
+      // Position between lo (0) and hi (7)
+      const auto step = static_cast<uint32_t>(
+          std::lround((rgba[i * 4 + channel] - lo) * scale));
+      uint64_t index;
+      if (step == 7) {
+        index = 0;
+      } else if (step == 0) {
+        index = 1;
+      } else {
+        index = 8 - step;
+      }
+      indices |= index << (3 * i);
+    }
+  }
+
+  for (uint32_t i = 0; i < 6; i++) {
+    out[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+  }
+}
+
+// Appends bits to a 128 bit block, least significant bit first
+struct BitWriter {
+  uint8_t *out;
+  uint32_t position = 0;
+
+  void write(uint32_t value, uint32_t bit_count) {
+    for (uint32_t i = 0; i < bit_count; i++, position++) {
+      if ((value >> i) & 1) {
+        out[position / 8] |= static_cast<uint8_t>(1u << (position % 8));
+      }
+    }
+  }
+};
+
+constexpr std::array<uint32_t, 16> kBc7Weights4 = {
+    0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+} // namespace
+
+void encode_bc4_block(const uint8_t *rgba, uint8_t *out) {
+  encode_bc4_channel(rgba, 0, out);
+}
+
+void encode_bc5_block(const uint8_t *rgba, uint8_t *out) {
+  encode_bc4_channel(rgba, 0, out);
+  encode_bc4_channel(rgba, 1, out + 8);
+}
+
+void encode_bc7_block(const uint8_t *rgba, uint8_t *out) {
+  // Endpoints: extremes of the block along its principal axis in RGBA space
+  float mean[4] = {};
+  for (uint32_t i = 0; i < 16; i++) {
+    for (uint32_t c = 0; c < 4; c++) {
+      mean[c] += rgba[i * 4 + c];
+    }
+  }
+  for (float &m : mean) {
+    m /= 16.0f;
+  }
+
+  float covariance[4][4] = {};
+  for (uint32_t i = 0; i < 16; i++) {
+    float d[4];
+    for (uint32_t c = 0; c < 4; c++) {
+      d[c] = rgba[i * 4 + c] - mean[c];
+    }
+    for (uint32_t a = 0; a < 4; a++) {
+      for (uint32_t b = 0; b < 4; b++) {
+        covariance[a][b] += d[a] * d[b];
+      }
+    }
+  }
+
+  // A few rounds of power iteration are plenty for a 4x4 matrix
+  float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  for (uint32_t iteration = 0; iteration < 8; iteration++) {
+    float next[4] = {};
+    for (uint32_t a = 0; a < 4; a++) {
+      for (uint32_t b = 0; b < 4; b++) {
+        next[a] += covariance[a][b] * axis[b];
+      }
+    }
+    float length = 0.0f;
+    for (float n : next) {
+      length += n * n;
+    }
+    if (length < 1e-8f) {
+      break; // flat block, any axis works
+    }
+    length = std::sqrt(length);
+    for (uint32_t c = 0; c < 4; c++) {
+      axis[c] = next[c] / length;
+    }
+  }
+
+  float min_t = 0.0f;
+  float max_t = 0.0f;
+  for (uint32_t i = 0; i < 16; i++) {
+    float t = 0.0f;
+    for (uint32_t c = 0; c < 4; c++) {
+      t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+    }
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+
+  float endpoint_f[2][4];
+  for (uint32_t c = 0; c < 4; c++) {
+    endpoint_f[0][c] = std::clamp(mean[c] + axis[c] * min_t, 0.0f, 255.0f);
+    endpoint_f[1][c] = std::clamp(mean[c] + axis[c] * max_t, 0.0f, 255.0f);
+  }
+
+  // Mode 6 endpoints are 7 bits plus a shared-per-endpoint p-bit, try all
+  // four p-bit combinations and keep the one with the least error
+  uint32_t best_error = UINT32_MAX;
+  uint32_t best_q[2][4] = {};
+  uint32_t best_p[2] = {};
+  uint32_t best_indices[16] = {};
+
+  for (uint32_t p_combo = 0; p_combo < 4; p_combo++) {
+    const uint32_t p[2] = {p_combo & 1, p_combo >> 1};
+    uint32_t q[2][4];
+    int32_t endpoint[2][4];
+    for (uint32_t e = 0; e < 2; e++) {
+      for (uint32_t c = 0; c < 4; c++) {
+        const float v = (endpoint_f[e][c] - static_cast<float>(p[e])) / 2.0f;
+        q[e][c] = static_cast<uint32_t>(std::clamp(std::lround(v), 0L, 127L));
+        endpoint[e][c] = static_cast<int32_t>((q[e][c] << 1) | p[e]);
+      }
+    }
+
+    int32_t palette[16][4];
+    for (uint32_t w = 0; w < 16; w++) {
+      for (uint32_t c = 0; c < 4; c++) {
+        palette[w][c] = ((64 - kBc7Weights4[w]) * endpoint[0][c] +
+                         kBc7Weights4[w] * endpoint[1][c] + 32) >>
+                        6;
+      }
+    }
+
+    uint32_t error = 0;
+    uint32_t indices[16];
+    for (uint32_t i = 0; i < 16; i++) {
+      uint32_t pixel_best = UINT32_MAX;
+      for (uint32_t w = 0; w < 16; w++) {
+        uint32_t pixel_error = 0;
+        for (uint32_t c = 0; c < 4; c++) {
+          const int32_t d = palette[w][c] - rgba[i * 4 + c];
+          pixel_error += static_cast<uint32_t>(d * d);
+        }
+        if (pixel_error < pixel_best) {
+          pixel_best = pixel_error;
+          indices[i] = w;
+        }
+      }
+      error += pixel_best;
+    }
+
+    if (error < best_error) {
+      best_error = error;
+      std::memcpy(best_q, q, sizeof(q));
+      best_p[0] = p[0];
+      best_p[1] = p[1];
+      std::memcpy(best_indices, indices, sizeof(indices));
+    }
+  }
+
+  // The first pixel's index is stored with its top bit implied zero, swap
+  // the endpoints if it would need it
+  if (best_indices[0] >= 8) {
+    for (uint32_t c = 0; c < 4; c++) {
+      std::swap(best_q[0][c], best_q[1][c]);
+    }
+    std::swap(best_p[0], best_p[1]);
+    for (uint32_t &index : best_indices) {
+      index = 15 - index;
+    }
+  }
+
+  std::memset(out, 0, 16);
+  BitWriter writer{out};
+  writer.write(1u << 6, 7); // mode 6
+  for (uint32_t c = 0; c < 4; c++) {
+    writer.write(best_q[0][c], 7);
+    writer.write(best_q[1][c], 7);
+  }
+  writer.write(best_p[0], 1);
+  writer.write(best_p[1], 1);
+  writer.write(best_indices[0], 3);
+  for (uint32_t i = 1; i < 16; i++) {
+    writer.write(best_indices[i], 4);
+  }
+}
+
+MipChain compress_mip_chain(const MipChain &rgba_chain, VkFormat format,
+                            ThreadPool &pool) {
+  using EncodeBlock = void (*)(const uint8_t *, uint8_t *);
+  EncodeBlock encode_block = nullptr;
+  switch (format) {
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+    encode_block = encode_bc4_block;
+    break;
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+    encode_block = encode_bc5_block;
+    break;
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    encode_block = encode_bc7_block;
+    break;
+  default:
+    spdlog::error("compress_mip_chain(): no encoder for format {}",
+                  static_cast<int>(format));
+    return {};
+  }
+  if (rgba_chain.channels != 4) {
+    spdlog::error("compress_mip_chain(): expected RGBA8 input, got {} "
+                  "channels",
+                  rgba_chain.channels);
+    return {};
+  }
+
+  MipChain chain{};
+  chain.format = format;
+  chain.levels.resize(rgba_chain.level_count());
+  size_t total_bytes = 0;
+  for (uint32_t level = 0; level < rgba_chain.level_count(); level++) {
+    MipLevel &mip = chain.levels[level];
+    mip.width = rgba_chain.levels[level].width;
+    mip.height = rgba_chain.levels[level].height;
+    mip.byte_offset = total_bytes;
+    mip.byte_size = format_level_byte_size(format, mip.width, mip.height);
+    total_bytes += mip.byte_size;
+  }
+  chain.pixels.resize(total_bytes);
+
+  const uint32_t block_bytes = bc_block_bytes(format);
+  for (uint32_t level = 0; level < rgba_chain.level_count(); level++) {
+    const MipLevel &src_mip = rgba_chain.levels[level];
+    const uint8_t *src = rgba_chain.level_data(level);
+    uint8_t *dst = chain.pixels.data() + chain.levels[level].byte_offset;
+    const uint32_t blocks_x = (src_mip.width + 3) / 4;
+    const uint32_t blocks_y = (src_mip.height + 3) / 4;
+
+    // One job per row of blocks, rows write disjoint parts of dst
+    for (uint32_t by = 0; by < blocks_y; by++) {
+      pool.submit([=]() {
+        uint8_t block[64];
+        for (uint32_t bx = 0; bx < blocks_x; bx++) {
+          // Gather the 4x4 block, clamping at the edges of small levels
+          for (uint32_t y = 0; y < 4; y++) {
+            const uint32_t sy = std::min(by * 4 + y, src_mip.height - 1);
+            for (uint32_t x = 0; x < 4; x++) {
+              const uint32_t sx = std::min(bx * 4 + x, src_mip.width - 1);
+              std::memcpy(block + (y * 4 + x) * 4,
+                          src + (static_cast<size_t>(sy) * src_mip.width + sx) *
+                                    4,
+                          4);
+            }
+          }
+          encode_block(block,
+                       dst + (static_cast<size_t>(by) * blocks_x + bx) *
+                                 block_bytes);
+        }
+      });
+    }
+  }
+  pool.wait_idle();
+
+  return chain;
+}
+
+} // namespace Expectre
@@ -0,0 +1,46 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include "MipChain.h"
+
+namespace Expectre {
+
+class ThreadPool;
+
+/// Bytes per 4x4 block of a BC format, 0 if the format isn't one we handle.
+uint32_t bc_block_bytes(VkFormat format);
+
+/// Bytes per texel of an uncompressed 8 bit R, RG or RGBA format, 0 for
+/// anything else.
+uint32_t format_texel_bytes(VkFormat format);
+
+/// Size of one mip level in format. Works for both BC formats (whole 4x4
+/// blocks) and the 8 bit formats above.
+size_t format_level_byte_size(VkFormat format, uint32_t width,
+                              uint32_t height);
+
+// Block encoders, each takes a 4x4 block of RGBA8 pixels (row major, 64
+// bytes) and writes one compressed block.
+
+/// BC4: red channel only, 8 bytes. Used for single channel maps (occlusion).
+void encode_bc4_block(const uint8_t *rgba, uint8_t *out);
+/// BC5: red and green as two BC4 blocks, 16 bytes. Used for tangent space
+/// normal maps, z is reconstructed in the shader.
+void encode_bc5_block(const uint8_t *rgba, uint8_t *out);
+/// BC7 mode 6: single subset RGBA with 4 bit indices, 16 bytes. Not the best
+/// BC7 can do, but a good quality/speed trade-off for albedo at cook time.
+void encode_bc7_block(const uint8_t *rgba, uint8_t *out);
+
+/// Compresses every level of an RGBA8 chain into format (one of the BC4,
+/// BC5 or BC7 formats). Rows of blocks are spread over pool, this waits for
+/// the pool to go idle before returning.
+MipChain compress_mip_chain(const MipChain &rgba_chain, VkFormat format,
+                            ThreadPool &pool);
+
+} // namespace Expectre
+
+#endif // BLOCK_COMPRESSION_H
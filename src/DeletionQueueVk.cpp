@@ -0,0 +1,102 @@
+#include "DeletionQueueVk.h"
+
+namespace Expectre {
+
+DeletionQueueVk::DeletionQueueVk(VkDevice device, VmaAllocator allocator,
+                                 uint32_t frames_in_flight)
+    : m_device(device), m_allocator(allocator),
+      m_frames_in_flight(frames_in_flight) {}
+
+DeletionQueueVk::~DeletionQueueVk() { flush(); }
+
+void DeletionQueueVk::begin_frame(uint64_t frame_number) {
+  m_frame_number = frame_number;
+  while (!m_retired.empty() &&
+         m_retired.front().retired_frame + m_frames_in_flight <=
+             frame_number) {
+    // Popped first, a destroy callback may retire something else
+    std::function<void()> destroy = std::move(m_retired.front().destroy);
+    m_retired.pop_front();
+    destroy();
+  }
+}
+
+void DeletionQueueVk::flush() {
+  while (!m_retired.empty()) {
+    std::function<void()> destroy = std::move(m_retired.front().destroy);
+    m_retired.pop_front();
+    destroy();
+  }
+}
+
+void DeletionQueueVk::retire_pipeline(VkPipeline pipeline,
+                                      uint64_t frame_number) {
+  if (pipeline == VK_NULL_HANDLE) {
+    return;
+  }
+  retire(
+      [device = m_device, pipeline]() {
+        vkDestroyPipeline(device, pipeline, nullptr);
+      },
+      frame_number);
+}
+
+void DeletionQueueVk::retire_framebuffer(VkFramebuffer framebuffer,
+                                         uint64_t frame_number) {
+  if (framebuffer == VK_NULL_HANDLE) {
+    return;
+  }
+  retire(
+      [device = m_device, framebuffer]() {
+        vkDestroyFramebuffer(device, framebuffer, nullptr);
+      },
+      frame_number);
+}
+
+void DeletionQueueVk::retire_image_view(VkImageView view,
+                                        uint64_t frame_number) {
+  if (view == VK_NULL_HANDLE) {
+    return;
+  }
+  retire(
+      [device = m_device, view]() {
+        vkDestroyImageView(device, view, nullptr);
+      },
+      frame_number);
+}
+
+void DeletionQueueVk::retire_image(VkImage image, VmaAllocation allocation,
+                                   uint64_t frame_number) {
+  if (image == VK_NULL_HANDLE) {
+    return;
+  }
+  retire(
+      [allocator = m_allocator, image, allocation]() {
+        vmaDestroyImage(allocator, image, allocation);
+      },
+      frame_number);
+}
+
+void DeletionQueueVk::retire_buffer(VkBuffer buffer, VmaAllocation allocation,
+                                    uint64_t frame_number) {
+  if (buffer == VK_NULL_HANDLE) {
+    return;
+  }
+  retire(
+      [allocator = m_allocator, buffer, allocation]() {
+        vmaDestroyBuffer(allocator, buffer, allocation);
+      },
+      frame_number);
+}
+
+void DeletionQueueVk::retire(std::function<void()> destroy,
+                             uint64_t frame_number) {
+  // Retiring against an older frame than the newest entry would break the
+  // ordering begin_frame() relies on, keep it at least as late
+  if (!m_retired.empty() && frame_number < m_retired.back().retired_frame) {
+    frame_number = m_retired.back().retired_frame;
+  }
+  m_retired.push_back({frame_number, std::move(destroy)});
+}
+
+} // namespace Expectre
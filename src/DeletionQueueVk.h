@@ -0,0 +1,63 @@
+#ifndef DELETION_QUEUE_VK_H
+#define DELETION_QUEUE_VK_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+#include <vma/vk_mem_alloc.h>
+#include <vulkan/vulkan.h>
+
+namespace Expectre {
+
+/// GPU objects that were replaced or released while frames using them may
+/// still be in flight. Each is tagged with the frame it was retired in and
+/// destroyed in a batch once the GPU is known to have finished it, so
+/// nothing needs vkDeviceWaitIdle to free a resource.
+class DeletionQueueVk {
+public:
+  DeletionQueueVk(VkDevice device, VmaAllocator allocator,
+                  uint32_t frames_in_flight);
+  /// Destroys everything still queued, the device must be idle
+  ~DeletionQueueVk();
+
+  DeletionQueueVk(const DeletionQueueVk &) = delete;
+  DeletionQueueVk &operator=(const DeletionQueueVk &) = delete;
+
+  /// Call once per frame after waiting for its frame slot. Frames before
+  /// frame_number - frames_in_flight + 1 have finished on the GPU.
+  void begin_frame(uint64_t frame_number);
+  /// Destroys everything now, only once the device is idle
+  void flush();
+
+  // The frame passed in is the last one that may have recorded a use,
+  // usually the current frame. Null handles are ignored.
+  void retire_pipeline(VkPipeline pipeline, uint64_t frame_number);
+  void retire_framebuffer(VkFramebuffer framebuffer, uint64_t frame_number);
+  void retire_image_view(VkImageView view, uint64_t frame_number);
+  void retire_image(VkImage image, VmaAllocation allocation,
+                    uint64_t frame_number);
+  void retire_buffer(VkBuffer buffer, VmaAllocation allocation,
+                     uint64_t frame_number);
+  /// Anything else, destroy runs on the render thread in begin_frame()
+  void retire(std::function<void()> destroy, uint64_t frame_number);
+
+  uint64_t get_frame_number() const { return m_frame_number; }
+
+private:
+  struct Retired {
+    uint64_t retired_frame = 0;
+    std::function<void()> destroy;
+  };
+
+  VkDevice m_device;
+  VmaAllocator m_allocator;
+  uint32_t m_frames_in_flight;
+  uint64_t m_frame_number = 0;
+  // Frame numbers only grow, so the queue is ordered by retired_frame
+  std::deque<Retired> m_retired;
+};
+
+} // namespace Expectre
+
+#endif // DELETION_QUEUE_VK_H
@@ -0,0 +1,23 @@
+#ifndef DEVICE_FEATURES_VK_H
+#define DEVICE_FEATURES_VK_H
+
+namespace Expectre {
+
+/// Optional device features that were found and enabled when the logical
+/// device was created. Code paths using them check here instead of querying
+/// the physical device, which only says what could have been enabled.
+struct DeviceFeaturesVk {
+  // VK_EXT_host_image_copy: textures can be written from host memory
+  // without a staging buffer or a queue submission
+  bool host_image_copy = false;
+  // pipelineStatisticsQuery: per pass shader invocation counts for the GPU
+  // profiler
+  bool pipeline_statistics_query = false;
+  // textureCompressionBC: cooked BC textures can be sampled, the importer
+  // loads the source images instead when it's missing
+  bool texture_compression_bc = false;
+};
+
+} // namespace Expectre
+
+#endif // DEVICE_FEATURES_VK_H
@@ -7,7 +7,8 @@
 #include <thread>
 
 namespace Expectre {
-Engine::Engine() : m_scene("Main Scene") {
+Engine::Engine(const FramePacingConfig &frame_pacing)
+    : m_frame_pacing(frame_pacing), m_scene("Main Scene") {
 
   if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO)) {
     SDL_Log("Unable to initialize SDL: %s", SDL_GetError());
@@ -29,14 +30,18 @@ Engine::Engine() : m_scene("Main Scene") {
 #elif defined(USE_DIRECTX)
   // m_render_context = std::make_unique<RenderContextDx>(m_window);
 #else
-  m_render_context =
-      std::make_unique<RenderContextVk>(m_window, m_input_manager);
+  m_render_context = std::make_unique<RenderContextVk>(
+      m_window, m_input_manager, m_frame_pacing);
+  m_scene.set_supports_bc(
+      m_render_context->get_device_features().texture_compression_bc);
 #endif
 
   m_render_commands_ready = SDL_CreateSemaphore(0);
   // Initialize to 2 since both commands buffers are available to the scene
-  // thread at start
-  m_render_command_buffer_available = SDL_CreateSemaphore(2);
+  // thread at start. Low latency keeps the scene thread at most one frame
+  // ahead of the render thread.
+  m_render_command_buffer_available =
+      SDL_CreateSemaphore(m_frame_pacing.wait_before_input ? 1 : 2);
   if (!m_render_commands_ready || !m_render_command_buffer_available) {
     throw std::runtime_error(
         std::string("Failed to create render semaphores: ") + SDL_GetError());
@@ -62,6 +67,12 @@ void Engine::run() {
 
   while (is_running()) {
 
+    // Low latency waits for the renderer first, input sampled after the
+    // wait is a frame fresher
+    if (m_frame_pacing.wait_before_input) {
+      SDL_WaitSemaphore(m_render_command_buffer_available);
+    }
+
     // Shifts "current" key state to "previous" key state, get mouse state
     m_input_manager.update();
 
@@ -72,7 +83,9 @@ void Engine::run() {
     }
 
     // Wait until a command buffer is avaible to write
-    SDL_WaitSemaphore(m_render_command_buffer_available);
+    if (!m_frame_pacing.wait_before_input) {
+      SDL_WaitSemaphore(m_render_command_buffer_available);
+    }
 
     if (!is_running()) {
       break;
@@ -188,6 +201,12 @@ void Engine::run_render_thread() {
     // clear command buffer
     commands.clear();
 
+    // Hand the buffer back only once the GPU can take the next frame, so
+    // the scene thread samples input right before that frame is recorded
+    if (m_frame_pacing.wait_before_input) {
+      m_render_context->wait_for_frame_slot();
+    }
+
     // signal a buffer is available for reuse
     SDL_SignalSemaphore(m_render_command_buffer_available);
 
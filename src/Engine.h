@@ -6,6 +6,7 @@
 #include <memory>
 #include <vector>
 
+#include "FramePacing.h"
 #include "RenderCommand.h"
 #include "RenderContextVk.h"
 #include "RingBuffer.h"
@@ -31,7 +32,7 @@ namespace Expectre {
 
 class Engine {
 public:
-  Engine();
+  explicit Engine(const FramePacingConfig &frame_pacing = {});
   void start();
   void run();
   void cleanup();
@@ -52,6 +53,7 @@ private:
   bool m_isIntialized{false};
   uint32_t m_frameNumber{0};
   SDL_Window *m_window{};
+  FramePacingConfig m_frame_pacing{};
   std::unique_ptr<RenderContextVk> m_render_context = nullptr;
   InputManager m_input_manager;
   Scene m_scene;
@@ -0,0 +1,97 @@
+#include "FramePacing.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <string_view>
+
+namespace Expectre {
+
+namespace {
+
+// Value of --name=value, or nothing if arg is a different option
+bool option_value(std::string_view arg, std::string_view name,
+                  std::string_view &value) {
+  if (arg.size() <= name.size() + 1 || arg.substr(0, name.size()) != name ||
+      arg[name.size()] != '=') {
+    return false;
+  }
+  value = arg.substr(name.size() + 1);
+  return true;
+}
+
+uint32_t parse_count(std::string_view value, uint32_t fallback) {
+  const std::string text(value);
+  char *end = nullptr;
+  const unsigned long count = std::strtoul(text.c_str(), &end, 10);
+  if (end == text.c_str() || *end != '\0' || count == 0) {
+    spdlog::warn("Ignoring frame count '{}'", text);
+    return fallback;
+  }
+  return static_cast<uint32_t>(count);
+}
+
+} // namespace
+
+FramePacingConfig FramePacingConfig::preset(LatencyMode mode) {
+  FramePacingConfig config{};
+  config.mode = mode;
+  switch (mode) {
+  case LatencyMode::LowLatency:
+    config.frames_in_flight = 1;
+    config.swapchain_images = 2;
+    config.vsync = true;
+    config.wait_before_input = true;
+    break;
+  case LatencyMode::Throughput:
+    config.frames_in_flight = 3;
+    config.swapchain_images = 3;
+    config.vsync = false;
+    config.wait_before_input = false;
+    break;
+  }
+  return config;
+}
+
+FramePacingConfig FramePacingConfig::from_args(int argc, char *argv[]) {
+  LatencyMode mode = LatencyMode::Throughput;
+  std::string_view frames_in_flight;
+  std::string_view swapchain_images;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    std::string_view value;
+    if (option_value(arg, "--latency", value)) {
+      if (value == "low") {
+        mode = LatencyMode::LowLatency;
+      } else if (value == "throughput") {
+        mode = LatencyMode::Throughput;
+      } else {
+        spdlog::warn("Unknown latency mode '{}', expected low or throughput",
+                     std::string(value));
+      }
+    } else if (option_value(arg, "--frames-in-flight", value)) {
+      frames_in_flight = value;
+    } else if (option_value(arg, "--swapchain-images", value)) {
+      swapchain_images = value;
+    }
+  }
+
+  // Overrides apply on top of the preset whatever order they were given in
+  FramePacingConfig config = preset(mode);
+  if (!frames_in_flight.empty()) {
+    config.frames_in_flight =
+        std::min(parse_count(frames_in_flight, config.frames_in_flight),
+                 kMaxFramesInFlight);
+  }
+  if (!swapchain_images.empty()) {
+    config.swapchain_images =
+        parse_count(swapchain_images, config.swapchain_images);
+  }
+  spdlog::info("Frame pacing: {}, {} frame(s) in flight, {} swapchain images",
+               mode == LatencyMode::LowLatency ? "low latency" : "throughput",
+               config.frames_in_flight, config.swapchain_images);
+  return config;
+}
+
+} // namespace Expectre
@@ -0,0 +1,44 @@
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include <cstdint>
+
+namespace Expectre {
+
+enum class LatencyMode {
+  // Vsync, one frame queued, input sampled once the GPU has room for the
+  // frame it feeds
+  LowLatency,
+  // Three frames queued, mailbox or immediate present, the CPU only waits
+  // when it is a full three frames ahead
+  Throughput,
+};
+
+/// How far the CPU may run ahead of the GPU and the display. Picked at
+/// startup, so deployments can trade latency for throughput without a
+/// rebuild.
+struct FramePacingConfig {
+  LatencyMode mode = LatencyMode::Throughput;
+  // Frames recorded and submitted before the CPU waits on the GPU
+  uint32_t frames_in_flight = 3;
+  // Images requested from the swapchain, clamped to what the surface allows
+  uint32_t swapchain_images = 3;
+  // FIFO only. Otherwise mailbox, then immediate, then FIFO if the surface
+  // supports neither
+  bool vsync = false;
+  // Wait for a free frame slot before sampling input rather than after, so
+  // the input a frame uses is as fresh as possible
+  bool wait_before_input = false;
+
+  static constexpr uint32_t kMaxFramesInFlight = 4;
+
+  static FramePacingConfig preset(LatencyMode mode);
+
+  /// Preset from --latency=low|throughput, with --frames-in-flight=N and
+  /// --swapchain-images=N overriding its counts. Anything else is ignored.
+  static FramePacingConfig from_args(int argc, char *argv[]);
+};
+
+} // namespace Expectre
+
+#endif // FRAME_PACING_H
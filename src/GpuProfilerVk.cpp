@@ -0,0 +1,284 @@
+#include "GpuProfilerVk.h"
+
+#include "ToolsVk.h"
+
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace Expectre {
+
+namespace {
+
+constexpr VkQueryPipelineStatisticFlags kStatisticFlags =
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+} // namespace
+
+GpuProfilerVk::GpuProfilerVk(VkDevice device, VkPhysicalDevice physical_device,
+                             uint32_t queue_family_index,
+                             bool pipeline_statistics,
+                             uint32_t frames_in_flight,
+                             uint32_t statistics_parts)
+    : m_device(device), m_pipeline_statistics(pipeline_statistics),
+      m_statistics_parts(std::max(statistics_parts, 1u)) {
+  uint32_t family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count,
+                                           nullptr);
+  std::vector<VkQueueFamilyProperties> families(family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count,
+                                           families.data());
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+  const uint32_t valid_bits =
+      queue_family_index < family_count
+          ? families[queue_family_index].timestampValidBits
+          : 0;
+  if (valid_bits > 0 && properties.limits.timestampPeriod > 0.0f) {
+    m_timestamp_period_ns = properties.limits.timestampPeriod;
+    m_timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+  }
+  m_statistics_query_count = kScopeCount * m_statistics_parts;
+  spdlog::info("GPU profiler: timestamps {}, pipeline statistics {}",
+               has_timestamps() ? "enabled" : "unavailable",
+               m_pipeline_statistics ? "enabled" : "unavailable");
+
+  m_slots.resize(frames_in_flight);
+  for (SlotQueries &slot : m_slots) {
+    if (has_timestamps()) {
+      VkQueryPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+      pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      pool_info.queryCount = 2 * kScopeCount;
+      VK_CHECK_RESULT(
+          vkCreateQueryPool(m_device, &pool_info, nullptr, &slot.timestamps));
+    }
+    if (m_pipeline_statistics) {
+      VkQueryPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+      pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+      pool_info.queryCount = m_statistics_query_count;
+      pool_info.pipelineStatistics = kStatisticFlags;
+      VK_CHECK_RESULT(
+          vkCreateQueryPool(m_device, &pool_info, nullptr, &slot.statistics));
+    }
+  }
+
+  for (History &history : m_history) {
+    history.samples.reserve(kHistoryFrames);
+  }
+  m_cpu_history.samples.reserve(kHistoryFrames);
+}
+
+GpuProfilerVk::~GpuProfilerVk() {
+  for (SlotQueries &slot : m_slots) {
+    vkDestroyQueryPool(m_device, slot.timestamps, nullptr);
+    vkDestroyQueryPool(m_device, slot.statistics, nullptr);
+  }
+}
+
+void GpuProfilerVk::begin_frame(VkCommandBuffer command_buffer,
+                                uint32_t slot) {
+  SlotQueries &queries = m_slots[slot];
+  if (queries.submitted) {
+    collect(slot);
+  }
+  // Queries the slot's frame does not write this time, such as scene chunks
+  // beyond the current chunk count, stay unavailable and are skipped
+  if (queries.timestamps != VK_NULL_HANDLE) {
+    vkCmdResetQueryPool(command_buffer, queries.timestamps, 0,
+                        2 * kScopeCount);
+  }
+  if (queries.statistics != VK_NULL_HANDLE) {
+    vkCmdResetQueryPool(command_buffer, queries.statistics, 0,
+                        m_statistics_query_count);
+  }
+  queries.submitted = true;
+}
+
+void GpuProfilerVk::add_cpu_frame_time(double milliseconds) {
+  Sample sample{};
+  sample.milliseconds = milliseconds;
+  std::lock_guard<std::mutex> lock(m_history_mutex);
+  m_cpu_history.push(sample);
+}
+
+void GpuProfilerVk::begin_timestamp(VkCommandBuffer command_buffer,
+                                    uint32_t slot, GpuScope scope) const {
+  if (!has_timestamps()) {
+    return;
+  }
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      m_slots[slot].timestamps,
+                      2 * static_cast<uint32_t>(scope));
+}
+
+void GpuProfilerVk::end_timestamp(VkCommandBuffer command_buffer,
+                                  uint32_t slot, GpuScope scope) const {
+  if (!has_timestamps()) {
+    return;
+  }
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                      m_slots[slot].timestamps,
+                      2 * static_cast<uint32_t>(scope) + 1);
+}
+
+void GpuProfilerVk::begin_statistics(VkCommandBuffer command_buffer,
+                                     uint32_t slot, GpuScope scope,
+                                     uint32_t part) const {
+  if (!m_pipeline_statistics) {
+    return;
+  }
+  vkCmdBeginQuery(command_buffer, m_slots[slot].statistics,
+                  statistics_query(scope, part), 0);
+}
+
+void GpuProfilerVk::end_statistics(VkCommandBuffer command_buffer,
+                                   uint32_t slot, GpuScope scope,
+                                   uint32_t part) const {
+  if (!m_pipeline_statistics) {
+    return;
+  }
+  vkCmdEndQuery(command_buffer, m_slots[slot].statistics,
+                statistics_query(scope, part));
+}
+
+uint32_t GpuProfilerVk::statistics_query(GpuScope scope, uint32_t part) const {
+  return static_cast<uint32_t>(scope) * m_statistics_parts +
+         std::min(part, m_statistics_parts - 1);
+}
+
+void GpuProfilerVk::collect(uint32_t slot) {
+  const SlotQueries &queries = m_slots[slot];
+  std::array<Sample, kScopeCount> samples{};
+  std::array<bool, kScopeCount> sampled{};
+
+  // No WAIT_BIT, the slot's frame has finished by the time it is reused.
+  // Each result is followed by its availability, NOT_READY only means some
+  // query was never written.
+  if (queries.timestamps != VK_NULL_HANDLE) {
+    std::array<uint64_t, 2 * kScopeCount * 2> results{};
+    const VkResult result = vkGetQueryPoolResults(
+        m_device, queries.timestamps, 0, 2 * kScopeCount,
+        sizeof(results), results.data(), 2 * sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result == VK_SUCCESS || result == VK_NOT_READY) {
+      for (uint32_t scope = 0; scope < kScopeCount; ++scope) {
+        const uint64_t *begin = &results[4 * scope];
+        const uint64_t *end = &results[4 * scope + 2];
+        if (!begin[1] || !end[1]) {
+          continue;
+        }
+        const uint64_t ticks = (end[0] - begin[0]) & m_timestamp_mask;
+        samples[scope].milliseconds = ticks * m_timestamp_period_ns * 1e-6;
+        sampled[scope] = true;
+      }
+    }
+  }
+
+  if (queries.statistics != VK_NULL_HANDLE) {
+    constexpr uint32_t kStride = kStatisticCount + 1;
+    std::vector<uint64_t> results(m_statistics_query_count * kStride);
+    const VkResult result = vkGetQueryPoolResults(
+        m_device, queries.statistics, 0, m_statistics_query_count,
+        results.size() * sizeof(uint64_t), results.data(),
+        kStride * sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result == VK_SUCCESS || result == VK_NOT_READY) {
+      for (uint32_t scope = 0; scope < kScopeCount; ++scope) {
+        for (uint32_t part = 0; part < m_statistics_parts; ++part) {
+          const uint64_t *query =
+              &results[(scope * m_statistics_parts + part) * kStride];
+          if (!query[kStatisticCount]) {
+            continue;
+          }
+          samples[scope].vertex_invocations += query[0];
+          samples[scope].clipping_primitives += query[1];
+          samples[scope].fragment_invocations += query[2];
+          sampled[scope] = true;
+        }
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(m_history_mutex);
+  for (uint32_t scope = 0; scope < kScopeCount; ++scope) {
+    if (sampled[scope]) {
+      m_history[scope].push(samples[scope]);
+    }
+  }
+}
+
+void GpuProfilerVk::History::push(const Sample &sample) {
+  if (samples.size() < kHistoryFrames) {
+    samples.push_back(sample);
+    return;
+  }
+  samples[next] = sample;
+  next = (next + 1) % kHistoryFrames;
+}
+
+TimingStats GpuProfilerVk::timing_stats(const std::vector<double> &values) {
+  TimingStats stats{};
+  stats.sample_count = values.size();
+  if (values.empty()) {
+    return stats;
+  }
+  double total = 0.0;
+  for (double value : values) {
+    total += value;
+  }
+  stats.average_ms = total / values.size();
+
+  std::vector<double> sorted = values;
+  auto percentile = [&](double fraction) {
+    const size_t index =
+        std::min(static_cast<size_t>(fraction * sorted.size()),
+                 sorted.size() - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+  };
+  stats.p50_ms = percentile(0.50);
+  stats.p95_ms = percentile(0.95);
+  stats.p99_ms = percentile(0.99);
+  return stats;
+}
+
+GpuScopeStats GpuProfilerVk::get_stats(GpuScope scope) const {
+  std::lock_guard<std::mutex> lock(m_history_mutex);
+  const History &history = m_history[static_cast<uint32_t>(scope)];
+  GpuScopeStats stats{};
+  if (history.samples.empty()) {
+    return stats;
+  }
+
+  std::vector<double> times;
+  times.reserve(history.samples.size());
+  for (const Sample &sample : history.samples) {
+    times.push_back(sample.milliseconds);
+    stats.vertex_invocations += sample.vertex_invocations;
+    stats.clipping_primitives += sample.clipping_primitives;
+    stats.fragment_invocations += sample.fragment_invocations;
+  }
+  const double count = static_cast<double>(history.samples.size());
+  stats.vertex_invocations /= count;
+  stats.clipping_primitives /= count;
+  stats.fragment_invocations /= count;
+  // Without timestamps the samples only carry statistics
+  if (has_timestamps()) {
+    stats.time = timing_stats(times);
+  }
+  return stats;
+}
+
+TimingStats GpuProfilerVk::get_cpu_frame_stats() const {
+  std::lock_guard<std::mutex> lock(m_history_mutex);
+  std::vector<double> times;
+  times.reserve(m_cpu_history.samples.size());
+  for (const Sample &sample : m_cpu_history.samples) {
+    times.push_back(sample.milliseconds);
+  }
+  return timing_stats(times);
+}
+
+} // namespace Expectre
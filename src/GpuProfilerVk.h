@@ -0,0 +1,130 @@
+#ifndef GPU_PROFILER_VK_H
+#define GPU_PROFILER_VK_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace Expectre {
+
+/// Parts of a frame timed on the GPU
+enum class GpuScope : uint32_t {
+  NoesisOffscreen, // Noesis PreRender, before the render pass
+  Scene,           // 3D draws, first chunk to last
+  Ui,              // Noesis overlay
+  Count,
+};
+
+struct TimingStats {
+  double average_ms = 0.0;
+  double p50_ms = 0.0;
+  double p95_ms = 0.0;
+  double p99_ms = 0.0;
+  size_t sample_count = 0;
+};
+
+struct GpuScopeStats {
+  TimingStats time;
+  // Per frame averages, zero without the pipelineStatisticsQuery feature
+  double vertex_invocations = 0.0;
+  double fragment_invocations = 0.0;
+  double clipping_primitives = 0.0;
+};
+
+/// Timestamp and pipeline statistics queries around each GpuScope, one set
+/// of query pools per frame slot. A slot's results are read when the slot
+/// comes round again, after its frame is known to have finished, so reading
+/// them never waits on the GPU. Keeps a rolling window of the last
+/// kHistoryFrames frames for averages and percentiles.
+class GpuProfilerVk {
+public:
+  /// statistics_parts is how many separately recorded pieces a scope may be
+  /// split into (scene chunks), each gets its own statistics query
+  GpuProfilerVk(VkDevice device, VkPhysicalDevice physical_device,
+                uint32_t queue_family_index, bool pipeline_statistics,
+                uint32_t frames_in_flight, uint32_t statistics_parts);
+  ~GpuProfilerVk();
+
+  GpuProfilerVk(const GpuProfilerVk &) = delete;
+  GpuProfilerVk &operator=(const GpuProfilerVk &) = delete;
+
+  /// Call first in the slot's primary command buffer, outside any render
+  /// pass, once the slot's previous frame has finished. Collects that
+  /// frame's results and resets the slot's queries.
+  void begin_frame(VkCommandBuffer command_buffer, uint32_t slot);
+  /// Render thread time spent on the frame, kept alongside the GPU scopes
+  void add_cpu_frame_time(double milliseconds);
+
+  // Recording helpers. They only read the profiler, so chunks recorded on
+  // other threads can call them. A scope's begin and end may be in different
+  // command buffers of the same frame, statistics must not.
+  void begin_timestamp(VkCommandBuffer command_buffer, uint32_t slot,
+                       GpuScope scope) const;
+  void end_timestamp(VkCommandBuffer command_buffer, uint32_t slot,
+                     GpuScope scope) const;
+  void begin_statistics(VkCommandBuffer command_buffer, uint32_t slot,
+                        GpuScope scope, uint32_t part = 0) const;
+  void end_statistics(VkCommandBuffer command_buffer, uint32_t slot,
+                      GpuScope scope, uint32_t part = 0) const;
+
+  // Safe to call from any thread
+  GpuScopeStats get_stats(GpuScope scope) const;
+  TimingStats get_cpu_frame_stats() const;
+
+  bool has_timestamps() const { return m_timestamp_period_ns > 0.0; }
+  bool has_statistics() const { return m_pipeline_statistics; }
+
+  static constexpr size_t kHistoryFrames = 240;
+
+private:
+  static constexpr uint32_t kScopeCount =
+      static_cast<uint32_t>(GpuScope::Count);
+  // Vertex shader invocations, clipping primitives, fragment shader
+  // invocations. Results come back in bit order, which is also this order.
+  static constexpr uint32_t kStatisticCount = 3;
+
+  struct Sample {
+    double milliseconds = 0.0;
+    uint64_t vertex_invocations = 0;
+    uint64_t clipping_primitives = 0;
+    uint64_t fragment_invocations = 0;
+  };
+
+  // Fixed size ring of the most recent samples
+  struct History {
+    std::vector<Sample> samples;
+    size_t next = 0;
+    void push(const Sample &sample);
+  };
+
+  void collect(uint32_t slot);
+  uint32_t statistics_query(GpuScope scope, uint32_t part) const;
+  static TimingStats timing_stats(const std::vector<double> &values);
+
+  VkDevice m_device;
+  double m_timestamp_period_ns = 0.0; // 0 = queue has no timestamps
+  uint64_t m_timestamp_mask = ~0ull;
+  bool m_pipeline_statistics = false;
+  uint32_t m_statistics_parts = 1;
+  uint32_t m_statistics_query_count = 0;
+
+  struct SlotQueries {
+    VkQueryPool timestamps = VK_NULL_HANDLE; // begin and end per scope
+    VkQueryPool statistics = VK_NULL_HANDLE; // per scope and part
+    bool submitted = false;
+  };
+  std::vector<SlotQueries> m_slots;
+
+  // Guards the histories, the getters may run off the render thread
+  mutable std::mutex m_history_mutex;
+  std::array<History, kScopeCount> m_history{};
+  History m_cpu_history;
+};
+
+} // namespace Expectre
+
+#endif // GPU_PROFILER_VK_H
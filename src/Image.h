@@ -2,11 +2,15 @@
 #define IMAGE_H
 #include <array>
 #include <filesystem>
+#include <memory>
 #include <spdlog/spdlog.h>
 #include <string>
 
 #include <stb_image.h>
 
+#include "MipChain.h"
+#include "TextureRole.h"
+
 namespace Expectre {
 
 struct Image {
@@ -15,7 +19,15 @@ struct Image {
   uint32_t width = 0;
   uint32_t height = 0;
   uint8_t channels = 0;
+  // Matches channels, UNORM or sRGB depending on the image's role
+  VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+  // xxHash of the pixels (or cooked levels) and their layout, identical
+  // images from different files share one entity by it
+  uint64_t content_hash = 0;
   std::string name;
+  // Mips loaded from the cook output or the asset cache (or packed at
+  // import), data stays null when this is set
+  std::shared_ptr<const MipChain> cooked_mips;
   Image() = default;
   ~Image() {
     if (data != nullptr)
@@ -26,8 +38,9 @@ struct Image {
   Image(Image &&other) noexcept
       : /* Resource(std::move(other)),*/
         data(std::exchange(other.data, nullptr)), width(other.width),
-        height(other.height), channels(other.channels),
-        name(std::move(other.name)) {}
+        height(other.height), channels(other.channels), format(other.format),
+        content_hash(other.content_hash), name(std::move(other.name)),
+        cooked_mips(std::move(other.cooked_mips)) {}
 
   // Move Assignment Operator (i.e. t2 = std::move(t1); )
   Image &operator=(Image &&other) noexcept {
@@ -39,7 +52,10 @@ struct Image {
       width = other.width;
       height = other.height;
       channels = other.channels;
+      format = other.format;
+      content_hash = other.content_hash;
       name = std::move(other.name);
+      cooked_mips = std::move(other.cooked_mips);
     }
     return *this;
   }
@@ -96,7 +112,40 @@ inline const Image &get_default_image() {
   return default_image;
 }
 
-inline Image import_from_file(const std::filesystem::path &path) {
+// Compacts RGBA8 pixels in place down to their first channels. stb can
+// decode to fewer channels itself, but it turns RGB into luminance, which
+// would mix the normal's z into x and y.
+inline void keep_leading_channels(uint8_t *pixels, size_t pixel_count,
+                                  uint32_t channels) {
+  if (channels >= 4) {
+    return;
+  }
+  for (size_t i = 0; i < pixel_count; i++) {
+    for (uint32_t c = 0; c < channels; c++) {
+      pixels[i * channels + c] = pixels[i * 4 + c];
+    }
+  }
+}
+
+// Fills in the size, channel count and format of freshly decoded RGBA8
+// pixels for the given role
+inline Image make_decoded_image(std::string name, stbi_uc *pixels, int width,
+                                int height, TextureRole role) {
+  Image out_image;
+  out_image.data = pixels;
+  out_image.width = static_cast<uint32_t>(width);
+  out_image.height = static_cast<uint32_t>(height);
+  out_image.channels = static_cast<uint8_t>(texture_role_channels(role));
+  out_image.format = texture_role_format(role);
+  out_image.name = std::move(name);
+  keep_leading_channels(pixels,
+                        static_cast<size_t>(out_image.width) * out_image.height,
+                        out_image.channels);
+  return out_image;
+}
+
+inline Image import_from_file(const std::filesystem::path &path,
+                              TextureRole role = TextureRole::Color) {
   int width = 0;
   int height = 0;
   int original_channels = 0;
@@ -112,17 +161,13 @@ inline Image import_from_file(const std::filesystem::path &path) {
     return Image();
   }
 
-  Image out_image;
-  out_image.data = pixels;
-  out_image.width = static_cast<uint32_t>(width);
-  out_image.height = static_cast<uint32_t>(height);
-  out_image.channels = static_cast<uint8_t>(desired_channels);
-  out_image.name = path.generic_string();
-  return out_image;
+  return make_decoded_image(path.generic_string(), pixels, width, height,
+                            role);
 }
 
 inline Image import_from_memory(std::string name, const uint8_t *bytes,
-                                size_t byte_count) {
+                                size_t byte_count,
+                                TextureRole role = TextureRole::Color) {
 
   if (!bytes || byte_count == 0) {
     spdlog::error("Cannot load texture '{}': image bytes are empty", name);
@@ -143,13 +188,7 @@ inline Image import_from_memory(std::string name, const uint8_t *bytes,
     return Image();
   }
 
-  Image out_image;
-  out_image.data = pixels;
-  out_image.width = static_cast<uint32_t>(width);
-  out_image.height = static_cast<uint32_t>(height);
-  out_image.channels = static_cast<uint8_t>(desired_channels);
-  out_image.name = std::move(name);
-  return out_image;
+  return make_decoded_image(std::move(name), pixels, width, height, role);
 }
 
 } // namespace Expectre
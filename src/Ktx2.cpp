@@ -0,0 +1,297 @@
+#include "Ktx2.h"
+
+#include "BlockCompression.h"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+namespace Expectre {
+
+namespace {
+
+constexpr std::array<uint8_t, 12> kKtx2Identifier = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+// File header up to and including the index, the level index follows it
+struct Ktx2Header {
+  uint8_t identifier[12];
+  uint32_t vk_format;
+  uint32_t type_size;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t layer_count;
+  uint32_t face_count;
+  uint32_t level_count;
+  uint32_t supercompression_scheme;
+  uint32_t dfd_byte_offset;
+  uint32_t dfd_byte_length;
+  uint32_t kvd_byte_offset;
+  uint32_t kvd_byte_length;
+  uint64_t sgd_byte_offset;
+  uint64_t sgd_byte_length;
+};
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must be 80 bytes");
+
+struct Ktx2LevelIndex {
+  uint64_t byte_offset;
+  uint64_t byte_length;
+  uint64_t uncompressed_byte_length;
+};
+
+// Khronos data format descriptor values, only what write_ktx2 needs
+constexpr uint8_t kDfdModelRgbsda = 1;
+constexpr uint8_t kDfdModelBc1a = 128;
+constexpr uint8_t kDfdModelBc3 = 130;
+constexpr uint8_t kDfdModelBc4 = 131;
+constexpr uint8_t kDfdModelBc5 = 132;
+constexpr uint8_t kDfdModelBc7 = 134;
+constexpr uint8_t kDfdPrimariesBt709 = 1;
+constexpr uint8_t kDfdTransferLinear = 1;
+constexpr uint8_t kDfdTransferSrgb = 2;
+constexpr uint8_t kDfdChannelAlpha = 15;
+constexpr uint8_t kDfdQualifierLinear = 0x10;
+
+bool is_srgb(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_R8_SRGB:
+  case VK_FORMAT_R8G8_SRGB:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    return true;
+  default:
+    return false;
+  }
+}
+
+struct DfdSample {
+  uint16_t bit_offset;
+  uint8_t bit_length; // minus one, as stored
+  uint8_t channel_type;
+};
+
+// Basic descriptor block (KDF section 5) for one of the formats we write.
+// Returns an empty vector for formats we don't know how to describe.
+std::vector<uint32_t> build_dfd(VkFormat format) {
+  uint8_t model = 0;
+  std::vector<DfdSample> samples;
+  const bool srgb = is_srgb(format);
+  const uint32_t block_bytes = bc_block_bytes(format);
+
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    model = kDfdModelBc1a;
+    samples.push_back({0, 63, 0});
+    break;
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+    model = kDfdModelBc3;
+    samples.push_back(
+        {0, 63, static_cast<uint8_t>(kDfdChannelAlpha | kDfdQualifierLinear)});
+    samples.push_back({64, 63, 0});
+    break;
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+    model = kDfdModelBc4;
+    samples.push_back({0, 63, 0});
+    break;
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+    model = kDfdModelBc5;
+    samples.push_back({0, 63, 0});
+    samples.push_back({64, 63, 1});
+    break;
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    model = kDfdModelBc7;
+    samples.push_back({0, 127, 0});
+    break;
+  default: {
+    const uint32_t texel_bytes = format_texel_bytes(format);
+    if (texel_bytes == 0) {
+      return {};
+    }
+    model = kDfdModelRgbsda;
+    for (uint32_t c = 0; c < texel_bytes; c++) {
+      uint8_t channel = static_cast<uint8_t>(c);
+      if (c == 3) {
+        // Alpha is never sRGB encoded
+        channel = kDfdChannelAlpha | (srgb ? kDfdQualifierLinear : 0);
+      }
+      samples.push_back({static_cast<uint16_t>(c * 8), 7, channel});
+    }
+    break;
+  }
+  }
+
+  const uint32_t block_size = 24 + 16 * static_cast<uint32_t>(samples.size());
+  std::vector<uint32_t> dfd(1 + block_size / 4, 0);
+  dfd[0] = 4 + block_size; // dfdTotalSize
+  dfd[1] = 0;              // vendorId = Khronos, descriptorType = basic
+  dfd[2] = 2 | (block_size << 16); // versionNumber = 1.3
+  dfd[3] = model | (kDfdPrimariesBt709 << 8) |
+           ((srgb ? kDfdTransferSrgb : kDfdTransferLinear) << 16);
+  // texelBlockDimension is stored minus one
+  dfd[4] = block_bytes ? (3 | (3 << 8)) : 0;
+  dfd[5] = block_bytes ? block_bytes : format_texel_bytes(format);
+
+  for (size_t i = 0; i < samples.size(); i++) {
+    uint32_t *sample = &dfd[7 + i * 4];
+    sample[0] = samples[i].bit_offset |
+                (static_cast<uint32_t>(samples[i].bit_length) << 16) |
+                (static_cast<uint32_t>(samples[i].channel_type) << 24);
+    sample[1] = 0; // sample position
+    sample[2] = 0; // lower
+    sample[3] = samples[i].bit_length == 7 ? 255 : UINT32_MAX; // upper
+  }
+  return dfd;
+}
+
+} // namespace
+
+bool read_ktx2(const std::filesystem::path &path, MipChain &chain) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    spdlog::error("read_ktx2(): failed to open {}", path.string());
+    return false;
+  }
+  const auto file_size = static_cast<uint64_t>(file.tellg());
+  file.seekg(0);
+
+  Ktx2Header header{};
+  if (file_size < sizeof(header) ||
+      !file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.identifier, kKtx2Identifier.data(),
+                  kKtx2Identifier.size()) != 0) {
+    spdlog::error("read_ktx2(): {} is not a KTX2 file", path.string());
+    return false;
+  }
+
+  const auto format = static_cast<VkFormat>(header.vk_format);
+  if (header.supercompression_scheme != 0 || header.pixel_depth > 1 ||
+      header.layer_count > 1 || header.face_count != 1 ||
+      format_level_byte_size(format, 1, 1) == 0) {
+    spdlog::error("read_ktx2(): {} uses an unsupported layout or format {}",
+                  path.string(), header.vk_format);
+    return false;
+  }
+
+  const uint32_t level_count = std::max(1u, header.level_count);
+  std::vector<Ktx2LevelIndex> level_index(level_count);
+  file.read(reinterpret_cast<char *>(level_index.data()),
+            static_cast<std::streamsize>(level_count * sizeof(Ktx2LevelIndex)));
+  if (!file) {
+    spdlog::error("read_ktx2(): {} is truncated", path.string());
+    return false;
+  }
+
+  chain = MipChain{};
+  chain.format = format;
+  chain.channels = format_texel_bytes(format);
+  chain.levels.resize(level_count);
+  size_t total_bytes = 0;
+  for (uint32_t level = 0; level < level_count; level++) {
+    MipLevel &mip = chain.levels[level];
+    mip.width = std::max(1u, header.pixel_width >> level);
+    mip.height = std::max(1u, header.pixel_height >> level);
+    mip.byte_offset = total_bytes;
+    mip.byte_size = format_level_byte_size(format, mip.width, mip.height);
+    total_bytes += mip.byte_size;
+
+    const Ktx2LevelIndex &index = level_index[level];
+    if (index.byte_length != mip.byte_size ||
+        index.byte_offset + index.byte_length > file_size) {
+      spdlog::error("read_ktx2(): {} has a bad index for level {}",
+                    path.string(), level);
+      return false;
+    }
+  }
+
+  chain.pixels.resize(total_bytes);
+  for (uint32_t level = 0; level < level_count; level++) {
+    file.seekg(static_cast<std::streamoff>(level_index[level].byte_offset));
+    file.read(reinterpret_cast<char *>(chain.pixels.data() +
+                                       chain.levels[level].byte_offset),
+              static_cast<std::streamsize>(chain.levels[level].byte_size));
+  }
+  if (!file) {
+    spdlog::error("read_ktx2(): failed to read levels of {}", path.string());
+    return false;
+  }
+  return true;
+}
+
+bool write_ktx2(const std::filesystem::path &path, const MipChain &chain) {
+  const std::vector<uint32_t> dfd = build_dfd(chain.format);
+  if (dfd.empty() || chain.levels.empty()) {
+    spdlog::error("write_ktx2(): can't describe format {} for {}",
+                  static_cast<int>(chain.format), path.string());
+    return false;
+  }
+
+  const uint32_t level_count = chain.level_count();
+  const uint32_t block_bytes = bc_block_bytes(chain.format);
+  // Levels are aligned to lcm(texel block size, 4)
+  const uint64_t alignment = block_bytes ? block_bytes : 4;
+
+  Ktx2Header header{};
+  std::memcpy(header.identifier, kKtx2Identifier.data(),
+              kKtx2Identifier.size());
+  header.vk_format = static_cast<uint32_t>(chain.format);
+  header.type_size = 1;
+  header.pixel_width = chain.levels[0].width;
+  header.pixel_height = chain.levels[0].height;
+  header.face_count = 1;
+  header.level_count = level_count;
+  header.dfd_byte_offset = static_cast<uint32_t>(
+      sizeof(Ktx2Header) + level_count * sizeof(Ktx2LevelIndex));
+  header.dfd_byte_length = static_cast<uint32_t>(dfd.size() * 4);
+
+  // Smallest level goes first so a partial read gets the mip tail
+  std::vector<Ktx2LevelIndex> level_index(level_count);
+  uint64_t offset = header.dfd_byte_offset + header.dfd_byte_length;
+  for (uint32_t level = level_count; level-- > 0;) {
+    offset = (offset + alignment - 1) / alignment * alignment;
+    level_index[level].byte_offset = offset;
+    level_index[level].byte_length = chain.levels[level].byte_size;
+    level_index[level].uncompressed_byte_length = chain.levels[level].byte_size;
+    offset += chain.levels[level].byte_size;
+  }
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    spdlog::error("write_ktx2(): failed to open {}", path.string());
+    return false;
+  }
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(level_index.data()),
+             static_cast<std::streamsize>(level_count *
+                                          sizeof(Ktx2LevelIndex)));
+  file.write(reinterpret_cast<const char *>(dfd.data()),
+             static_cast<std::streamsize>(dfd.size() * 4));
+
+  static const std::array<char, 16> padding{};
+  uint64_t written = header.dfd_byte_offset + header.dfd_byte_length;
+  for (uint32_t level = level_count; level-- > 0;) {
+    file.write(padding.data(),
+               static_cast<std::streamsize>(level_index[level].byte_offset -
+                                            written));
+    file.write(reinterpret_cast<const char *>(chain.level_data(level)),
+               static_cast<std::streamsize>(chain.levels[level].byte_size));
+    written = level_index[level].byte_offset + chain.levels[level].byte_size;
+  }
+
+  if (!file) {
+    spdlog::error("write_ktx2(): failed writing {}", path.string());
+    return false;
+  }
+  return true;
+}
+
+} // namespace Expectre
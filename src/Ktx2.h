@@ -0,0 +1,34 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <filesystem>
+
+#include "MipChain.h"
+
+namespace Expectre {
+
+/// Minimal KTX2 support for the textures we cook: 2D, one layer, one face, no
+/// supercompression, any number of mips. Levels are stored smallest first as
+/// the spec asks, MipChain keeps them finest first.
+
+/// Loads path into chain. Returns false (and logs why) if the file is missing
+/// or uses a KTX2 feature we don't support.
+bool read_ktx2(const std::filesystem::path &path, MipChain &chain);
+
+/// Writes chain to path with a basic data format descriptor matching
+/// chain.format. Returns false if the file can't be written.
+bool write_ktx2(const std::filesystem::path &path, const MipChain &chain);
+
+/// Where ExpectreCook puts the cooked version of an image a glTF references
+/// by uri: "<gltf dir>/cooked/<uri>.ktx2".
+inline std::filesystem::path
+cooked_texture_path(const std::filesystem::path &gltf_path,
+                    const std::filesystem::path &uri) {
+  std::filesystem::path cooked = gltf_path.parent_path() / "cooked" / uri;
+  cooked += ".ktx2";
+  return cooked;
+}
+
+} // namespace Expectre
+
+#endif // KTX2_H
@@ -0,0 +1,24 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+#include <glm/vec3.hpp>
+namespace Expectre {
+
+// ECS
+// Point light at its entity's Transform position. Falls off to exactly zero
+// at range, so it only costs the pixels in the clusters its range reaches.
+struct PointLight {
+  glm::vec3 color = glm::vec3(1.0f);
+  float intensity = 1.0f;
+  float range = 10.0f;
+};
+
+/// A light as the renderer gets it each frame, in world space
+struct LightInfo {
+  glm::vec3 position = glm::vec3(0.0f);
+  glm::vec3 color = glm::vec3(1.0f);
+  float intensity = 1.0f;
+  float range = 10.0f;
+};
+
+} // namespace Expectre
+#endif // LIGHT_H
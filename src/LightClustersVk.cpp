@@ -0,0 +1,283 @@
+#include "LightClustersVk.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+namespace Expectre {
+
+LightClustersVk::LightClustersVk(VmaAllocator allocator,
+                                 uint32_t frames_in_flight)
+    : m_allocator(allocator) {
+  m_slots.resize(frames_in_flight);
+  for (SlotBuffers &slot : m_slots) {
+    create_light_buffer(slot, kInitialLightCapacity);
+    create_grid_buffer(slot, kInitialIndexCapacity);
+  }
+}
+
+LightClustersVk::~LightClustersVk() {
+  for (SlotBuffers &slot : m_slots) {
+    destroy_buffer(slot.lights);
+    destroy_buffer(slot.grid);
+  }
+}
+
+void LightClustersVk::set_camera(const glm::mat4 &view,
+                                 const glm::mat4 &projection,
+                                 VkExtent2D extent, float near_plane,
+                                 float far_plane) {
+  m_view = view;
+  if (projection == m_projection && extent.width == m_extent.width &&
+      extent.height == m_extent.height && near_plane == m_near_plane &&
+      far_plane == m_far_plane) {
+    return;
+  }
+  m_projection = projection;
+  m_extent = extent;
+  m_near_plane = near_plane;
+  m_far_plane = far_plane;
+
+  // Tiles are rounded up, the last column and row reach past the edge
+  const float log_depth_ratio = std::log(far_plane / near_plane);
+  m_shader_params.x = static_cast<float>(
+      (extent.width + kClusterCountX - 1) / kClusterCountX);
+  m_shader_params.y = static_cast<float>(
+      (extent.height + kClusterCountY - 1) / kClusterCountY);
+  m_shader_params.z = kClusterCountZ / log_depth_ratio;
+  m_shader_params.w =
+      -(kClusterCountZ * std::log(near_plane)) / log_depth_ratio;
+  compute_cluster_bounds();
+}
+
+bool LightClustersVk::reserve(uint32_t slot_index, uint32_t light_count) {
+  SlotBuffers &slot = m_slots[slot_index];
+  bool replaced = false;
+  // The slot's frame has finished, nothing reads the old buffers anymore
+  if (light_count > slot.light_capacity) {
+    uint32_t capacity = slot.light_capacity;
+    while (capacity < light_count) {
+      capacity *= 2;
+    }
+    destroy_buffer(slot.lights);
+    create_light_buffer(slot, capacity);
+    replaced = true;
+  }
+  if (slot.required_indices > slot.index_capacity) {
+    uint32_t capacity = slot.index_capacity;
+    while (capacity < slot.required_indices) {
+      capacity *= 2;
+    }
+    destroy_buffer(slot.grid);
+    create_grid_buffer(slot, capacity);
+    replaced = true;
+  }
+  return replaced;
+}
+
+void LightClustersVk::build(uint32_t slot_index,
+                            const std::vector<LightInfo> &lights) {
+  SlotBuffers &slot = m_slots[slot_index];
+  const uint32_t light_count = static_cast<uint32_t>(lights.size());
+  const float p00 = m_projection[0][0];
+  const float p11 = m_projection[1][1];
+
+  m_cluster_lights.clear();
+  for (uint32_t i = 0; i < light_count; ++i) {
+    const LightInfo &light = lights[i];
+    GpuLight gpu_light{};
+    gpu_light.position_range = glm::vec4(light.position, light.range);
+    gpu_light.color = glm::vec4(light.color * light.intensity, 0.0f);
+    slot.lights_mapped[i] = gpu_light;
+
+    const float radius = light.range;
+    if (radius <= 0.0f) {
+      continue;
+    }
+    const glm::vec3 center = glm::vec3(m_view * glm::vec4(light.position, 1));
+    const float depth = -center.z;
+    if (depth + radius < m_near_plane || depth - radius > m_far_plane) {
+      continue;
+    }
+    const float nearest = std::max(depth - radius, m_near_plane);
+    const float farthest = std::min(depth + radius, m_far_plane);
+
+    // Screen rectangle of the sphere's bounding box, cut at the near plane.
+    // Which depth projects widest depends on the side of the axis, so the
+    // corners at both are projected.
+    glm::vec2 ndc_min(FLT_MAX);
+    glm::vec2 ndc_max(-FLT_MAX);
+    for (float corner_depth : {nearest, farthest}) {
+      for (float side : {-radius, radius}) {
+        const glm::vec2 ndc(p00 * (center.x + side) / corner_depth,
+                            p11 * (center.y + side) / corner_depth);
+        ndc_min = glm::min(ndc_min, ndc);
+        ndc_max = glm::max(ndc_max, ndc);
+      }
+    }
+    if (ndc_max.x < -1.0f || ndc_min.x > 1.0f || ndc_max.y < -1.0f ||
+        ndc_min.y > 1.0f) {
+      continue;
+    }
+
+    const uint32_t x_first = screen_tile(ndc_min.x, m_shader_params.x,
+                                         m_extent.width, kClusterCountX);
+    const uint32_t x_last = screen_tile(ndc_max.x, m_shader_params.x,
+                                        m_extent.width, kClusterCountX);
+    const uint32_t y_first = screen_tile(ndc_min.y, m_shader_params.y,
+                                         m_extent.height, kClusterCountY);
+    const uint32_t y_last = screen_tile(ndc_max.y, m_shader_params.y,
+                                        m_extent.height, kClusterCountY);
+    const uint32_t z_first = depth_slice(nearest);
+    const uint32_t z_last = depth_slice(farthest);
+
+    // The rectangle is loose around the sphere, each cluster in it is
+    // tested on its own
+    const float radius_squared = radius * radius;
+    for (uint32_t z = z_first; z <= z_last; ++z) {
+      for (uint32_t y = y_first; y <= y_last; ++y) {
+        for (uint32_t x = x_first; x <= x_last; ++x) {
+          const uint32_t cluster =
+              x + kClusterCountX * (y + kClusterCountY * z);
+          const ClusterBounds &bounds = m_cluster_bounds[cluster];
+          const glm::vec3 offset =
+              glm::clamp(center, bounds.min, bounds.max) - center;
+          if (glm::dot(offset, offset) <= radius_squared) {
+            m_cluster_lights.push_back({cluster, i});
+          }
+        }
+      }
+    }
+  }
+
+  // Counting sort by cluster. Lights were visited in order, so every
+  // cluster's list stays sorted.
+  m_cluster_offsets.assign(kClusterCount + 1, 0);
+  for (const ClusterLight &entry : m_cluster_lights) {
+    ++m_cluster_offsets[entry.cluster + 1];
+  }
+  for (uint32_t cluster = 1; cluster <= kClusterCount; ++cluster) {
+    m_cluster_offsets[cluster] += m_cluster_offsets[cluster - 1];
+  }
+  const uint32_t index_count = static_cast<uint32_t>(m_cluster_lights.size());
+  m_indices.resize(index_count);
+  // Moves each cluster's offset to its end, which is where the next one
+  // starts
+  for (const ClusterLight &entry : m_cluster_lights) {
+    m_indices[m_cluster_offsets[entry.cluster]++] = entry.light;
+  }
+
+  // Past the capacity the lists are cut short, reserve() grows the slot
+  // before its next build
+  const uint32_t capacity = slot.index_capacity;
+  slot.required_indices = index_count;
+  if (index_count > capacity) {
+    spdlog::debug("Light clusters: {} light indices, room for {}",
+                  index_count, capacity);
+  }
+  uint32_t *grid = slot.grid_mapped;
+  for (uint32_t cluster = 0; cluster < kClusterCount; ++cluster) {
+    const uint32_t start =
+        std::min(cluster == 0 ? 0 : m_cluster_offsets[cluster - 1], capacity);
+    const uint32_t end = std::min(m_cluster_offsets[cluster], capacity);
+    grid[cluster * 2] = start;
+    grid[cluster * 2 + 1] = end - start;
+  }
+  std::memcpy(grid + kClusterCount * 2, m_indices.data(),
+              std::min(index_count, capacity) * sizeof(uint32_t));
+}
+
+void LightClustersVk::compute_cluster_bounds() {
+  m_cluster_bounds.resize(kClusterCount);
+  const float p00 = m_projection[0][0];
+  const float p11 = m_projection[1][1];
+  const float depth_ratio = m_far_plane / m_near_plane;
+  const float width = static_cast<float>(m_extent.width);
+  const float height = static_cast<float>(m_extent.height);
+
+  for (uint32_t z = 0; z < kClusterCountZ; ++z) {
+    const float slice_depths[2] = {
+        m_near_plane *
+            std::pow(depth_ratio, static_cast<float>(z) / kClusterCountZ),
+        m_near_plane *
+            std::pow(depth_ratio, static_cast<float>(z + 1) / kClusterCountZ)};
+    for (uint32_t y = 0; y < kClusterCountY; ++y) {
+      const float ndc_y[2] = {y * m_shader_params.y / height * 2.0f - 1.0f,
+                              (y + 1) * m_shader_params.y / height * 2.0f -
+                                  1.0f};
+      for (uint32_t x = 0; x < kClusterCountX; ++x) {
+        const float ndc_x[2] = {x * m_shader_params.x / width * 2.0f - 1.0f,
+                                (x + 1) * m_shader_params.x / width * 2.0f -
+                                    1.0f};
+        // The tile's corners at the slice's near and far depth
+        ClusterBounds bounds{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+        for (float depth : slice_depths) {
+          for (float corner_x : ndc_x) {
+            for (float corner_y : ndc_y) {
+              const glm::vec3 corner(corner_x * depth / p00,
+                                     corner_y * depth / p11, -depth);
+              bounds.min = glm::min(bounds.min, corner);
+              bounds.max = glm::max(bounds.max, corner);
+            }
+          }
+        }
+        m_cluster_bounds[x + kClusterCountX * (y + kClusterCountY * z)] =
+            bounds;
+      }
+    }
+  }
+}
+
+uint32_t LightClustersVk::depth_slice(float view_depth) const {
+  const float slice =
+      std::floor(std::log(view_depth) * m_shader_params.z + m_shader_params.w);
+  return static_cast<uint32_t>(
+      std::clamp(slice, 0.0f, static_cast<float>(kClusterCountZ - 1)));
+}
+
+uint32_t LightClustersVk::screen_tile(float ndc, float tile_pixels,
+                                      uint32_t extent, uint32_t tile_count) {
+  const float pixel = (ndc * 0.5f + 0.5f) * extent;
+  const float tile = std::floor(pixel / tile_pixels);
+  return static_cast<uint32_t>(
+      std::clamp(tile, 0.0f, static_cast<float>(tile_count - 1)));
+}
+
+void LightClustersVk::create_light_buffer(SlotBuffers &slot,
+                                          uint32_t capacity) {
+  // Coherent, the writes are visible to the slot's next submit
+  slot.lights = ToolsVk::create_buffer(
+      m_allocator, capacity * sizeof(GpuLight),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU,
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  VK_CHECK_RESULT(vmaMapMemory(m_allocator, slot.lights.allocation,
+                               reinterpret_cast<void **>(&slot.lights_mapped)));
+  slot.light_capacity = capacity;
+}
+
+void LightClustersVk::create_grid_buffer(SlotBuffers &slot,
+                                         uint32_t index_capacity) {
+  slot.grid = ToolsVk::create_buffer(
+      m_allocator, grid_words(index_capacity) * sizeof(uint32_t),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU,
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  VK_CHECK_RESULT(vmaMapMemory(m_allocator, slot.grid.allocation,
+                               reinterpret_cast<void **>(&slot.grid_mapped)));
+  // Every cluster empty until the first build
+  std::memset(slot.grid_mapped, 0, kClusterCount * 2 * sizeof(uint32_t));
+  slot.index_capacity = index_capacity;
+}
+
+void LightClustersVk::destroy_buffer(AllocatedBuffer &buffer) {
+  if (buffer.buffer == VK_NULL_HANDLE) {
+    return;
+  }
+  vmaUnmapMemory(m_allocator, buffer.allocation);
+  vmaDestroyBuffer(m_allocator, buffer.buffer, buffer.allocation);
+  buffer = AllocatedBuffer{};
+}
+
+} // namespace Expectre
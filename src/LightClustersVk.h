@@ -0,0 +1,144 @@
+#ifndef LIGHT_CLUSTERS_VK_H
+#define LIGHT_CLUSTERS_VK_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vma/vk_mem_alloc.h>
+#include <vulkan/vulkan.h>
+
+#include "Light.h"
+#include "ToolsVk.h"
+
+namespace Expectre {
+
+/// One light as the shaders see it, matches Light in light_clusters.glsl
+/// (std430)
+struct GpuLight {
+  glm::vec4 position_range{0.0f}; // world space xyz, range w
+  glm::vec4 color{0.0f};          // color times intensity, w unused
+};
+static_assert(sizeof(GpuLight) == 32, "must match light_clusters.glsl");
+
+/// Clustered forward lighting. The view frustum is cut into a grid of
+/// clusters, screen tiles times depth slices spaced exponentially between
+/// the near and far plane. Every frame each light is binned into the
+/// clusters its sphere overlaps, and a fragment only walks the lights of
+/// its own cluster, so its cost follows how many lights reach it rather
+/// than how many there are.
+///
+/// Each frame slot has its own host visible buffers: the lights, and a grid
+/// buffer holding an (offset, count) pair per cluster followed by the
+/// compact light index list the pairs point into.
+class LightClustersVk {
+public:
+  static constexpr uint32_t kClusterCountX = 16;
+  static constexpr uint32_t kClusterCountY = 9;
+  static constexpr uint32_t kClusterCountZ = 24;
+  static constexpr uint32_t kClusterCount =
+      kClusterCountX * kClusterCountY * kClusterCountZ;
+
+  LightClustersVk(VmaAllocator allocator, uint32_t frames_in_flight);
+  ~LightClustersVk();
+
+  LightClustersVk(const LightClustersVk &) = delete;
+  LightClustersVk &operator=(const LightClustersVk &) = delete;
+
+  /// Camera for the next build(). The cluster bounds are only worked out
+  /// again when the projection or extent changes. Not while a build runs.
+  void set_camera(const glm::mat4 &view, const glm::mat4 &projection,
+                  VkExtent2D extent, float near_plane, float far_plane);
+
+  /// Grows the slot's buffers to light_count lights and to the index list
+  /// its last build() needed. Call once the slot's frame has finished and
+  /// before anything is recorded against its descriptors. True if a buffer
+  /// was replaced, the slot's descriptors then have to be written again.
+  bool reserve(uint32_t slot, uint32_t light_count);
+
+  /// Bins lights into the slot's buffers, after reserve() for as many
+  /// lights. Fine on a worker, one build at a time. A list longer than the
+  /// slot's index capacity is cut short for this frame and fits the next
+  /// time the slot comes around.
+  void build(uint32_t slot, const std::vector<LightInfo> &lights);
+
+  /// Cluster counts xyz, for the shaders
+  glm::uvec4 get_grid_size() const {
+    return glm::uvec4(kClusterCountX, kClusterCountY, kClusterCountZ, 0);
+  }
+  /// Tile size in pixels xy, depth slice scale and bias zw: a view depth d
+  /// falls into slice floor(log(d) * scale + bias)
+  glm::vec4 get_shader_params() const { return m_shader_params; }
+
+  VkBuffer get_light_buffer(uint32_t slot) const {
+    return m_slots[slot].lights.buffer;
+  }
+  VkDeviceSize get_light_buffer_size(uint32_t slot) const {
+    return m_slots[slot].light_capacity * sizeof(GpuLight);
+  }
+  VkBuffer get_grid_buffer(uint32_t slot) const {
+    return m_slots[slot].grid.buffer;
+  }
+  VkDeviceSize get_grid_buffer_size(uint32_t slot) const {
+    return grid_words(m_slots[slot].index_capacity) * sizeof(uint32_t);
+  }
+
+private:
+  struct SlotBuffers {
+    AllocatedBuffer lights{};
+    GpuLight *lights_mapped = nullptr;
+    uint32_t light_capacity = 0;
+    AllocatedBuffer grid{};
+    uint32_t *grid_mapped = nullptr;
+    uint32_t index_capacity = 0;
+    // Indices the slot's last build produced, more than index_capacity if
+    // some were cut
+    uint32_t required_indices = 0;
+  };
+
+  // View space, the camera looks down -z
+  struct ClusterBounds {
+    glm::vec3 min{0.0f};
+    glm::vec3 max{0.0f};
+  };
+
+  struct ClusterLight {
+    uint32_t cluster = 0;
+    uint32_t light = 0;
+  };
+
+  static uint32_t grid_words(uint32_t index_capacity) {
+    return kClusterCount * 2 + index_capacity;
+  }
+  void compute_cluster_bounds();
+  uint32_t depth_slice(float view_depth) const;
+  static uint32_t screen_tile(float ndc, float tile_pixels, uint32_t extent,
+                              uint32_t tile_count);
+  void create_light_buffer(SlotBuffers &slot, uint32_t capacity);
+  void create_grid_buffer(SlotBuffers &slot, uint32_t index_capacity);
+  void destroy_buffer(AllocatedBuffer &buffer);
+
+  VmaAllocator m_allocator;
+  std::vector<SlotBuffers> m_slots;
+
+  glm::mat4 m_view{1.0f};
+  glm::mat4 m_projection{0.0f};
+  VkExtent2D m_extent{0, 0};
+  float m_near_plane = 0.0f;
+  float m_far_plane = 0.0f;
+  glm::vec4 m_shader_params{0.0f};
+  std::vector<ClusterBounds> m_cluster_bounds;
+
+  // Scratch of build(), kept between frames so it doesn't allocate
+  std::vector<ClusterLight> m_cluster_lights;
+  std::vector<uint32_t> m_cluster_offsets;
+  std::vector<uint32_t> m_indices;
+
+  static constexpr uint32_t kInitialLightCapacity = 256;
+  // Room for an average of 8 lights per cluster before the first growth
+  static constexpr uint32_t kInitialIndexCapacity = kClusterCount * 8;
+};
+
+} // namespace Expectre
+
+#endif // LIGHT_CLUSTERS_VK_H
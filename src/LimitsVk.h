@@ -1,13 +1,48 @@
 #ifndef LIMITS_VK_H
 #define LIMITS_VK_H
+#include <algorithm>
 #include <cstdint>
 
+#include <vulkan/vulkan.h>
+
 namespace Expectre {
 // Based on GTX 780 capabilites
 static constexpr uint32_t kMaxDescriptorSetSamplers = 1048576;
 static constexpr uint32_t kMaxDescriptorSetUniformBuffers = 90;
 
-static constexpr uint32_t kMaxBindlessTextures = 1096; // Arbitrary
-static constexpr uint32_t kTextureArrayBindingIndex = 1;
+// Upper bound on the bindless texture array, keeps the descriptor pool small
+// on drivers that report huge limits. The device may allow fewer, see
+// bindless_texture_capacity()
+static constexpr uint32_t kMaxBindlessTextures = 16384;
+// Only the last binding can have a variable descriptor count, so the
+// texture array comes after the buffers
+static constexpr uint32_t kMaterialBufferBindingIndex = 1;
+static constexpr uint32_t kDrawDataBindingIndex = 2;
+static constexpr uint32_t kGeometryBufferBindingIndex = 3;
+static constexpr uint32_t kLightBufferBindingIndex = 4;
+static constexpr uint32_t kLightGridBindingIndex = 5;
+static constexpr uint32_t kTextureArrayBindingIndex = 6;
+
+/// Slots in the bindless texture array: what the device allows in one
+/// fragment shader stage and one UPDATE_AFTER_BIND set, capped at
+/// kMaxBindlessTextures
+inline uint32_t bindless_texture_capacity(VkPhysicalDevice physical_device) {
+  VkPhysicalDeviceDescriptorIndexingProperties indexing{
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES};
+  VkPhysicalDeviceProperties2 properties{
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  properties.pNext = &indexing;
+  vkGetPhysicalDeviceProperties2(physical_device, &properties);
+  const VkPhysicalDeviceLimits &limits = properties.properties.limits;
+  const uint32_t device_limit = std::min(
+      {limits.maxPerStageDescriptorSamplers,
+       limits.maxPerStageDescriptorSampledImages,
+       limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages,
+       indexing.maxPerStageDescriptorUpdateAfterBindSamplers,
+       indexing.maxPerStageDescriptorUpdateAfterBindSampledImages,
+       indexing.maxDescriptorSetUpdateAfterBindSamplers,
+       indexing.maxDescriptorSetUpdateAfterBindSampledImages});
+  return std::min(device_limit, kMaxBindlessTextures);
 }
-#endif
\ No newline at end of file
+} // namespace Expectre
+#endif
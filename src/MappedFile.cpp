@@ -0,0 +1,86 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Expectre {
+
+std::shared_ptr<const MappedFile>
+MappedFile::open(const std::filesystem::path &path) {
+  // Not make_shared, the constructor is private
+  std::shared_ptr<MappedFile> file(new MappedFile());
+
+#ifdef _WIN32
+  file->m_file =
+      CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file->m_file == INVALID_HANDLE_VALUE) {
+    file->m_file = nullptr;
+    return nullptr;
+  }
+  LARGE_INTEGER size{};
+  if (!GetFileSizeEx(file->m_file, &size) || size.QuadPart == 0) {
+    return nullptr;
+  }
+  file->m_mapping = CreateFileMappingW(file->m_file, nullptr, PAGE_READONLY,
+                                       0, 0, nullptr);
+  if (!file->m_mapping) {
+    return nullptr;
+  }
+  file->m_data = static_cast<const uint8_t *>(
+      MapViewOfFile(file->m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!file->m_data) {
+    return nullptr;
+  }
+  file->m_size = static_cast<size_t>(size.QuadPart);
+#else
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat file_stat {};
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+  void *mapped = mmap(nullptr, static_cast<size_t>(file_stat.st_size),
+                      PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return nullptr;
+  }
+  file->m_data = static_cast<const uint8_t *>(mapped);
+  file->m_size = static_cast<size_t>(file_stat.st_size);
+#endif
+
+  return file;
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file) {
+    CloseHandle(m_file);
+  }
+#else
+  if (m_data) {
+    munmap(const_cast<uint8_t *>(m_data), m_size);
+  }
+#endif
+}
+
+} // namespace Expectre
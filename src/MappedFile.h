@@ -0,0 +1,41 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+namespace Expectre {
+
+/// Read only memory mapping of a whole file. Pages are faulted in on first
+/// touch, so opening a large file is cheap and only what is read costs IO.
+/// Shared so views into the mapping (cached mip chains, ...) can keep it
+/// alive.
+class MappedFile {
+public:
+  /// Returns nullptr if the file doesn't exist, is empty or can't be mapped.
+  static std::shared_ptr<const MappedFile>
+  open(const std::filesystem::path &path);
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const uint8_t *data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  MappedFile() = default;
+
+  const uint8_t *m_data = nullptr;
+  size_t m_size = 0;
+#ifdef _WIN32
+  void *m_file = nullptr;
+  void *m_mapping = nullptr;
+#endif
+};
+
+} // namespace Expectre
+
+#endif // MAPPED_FILE_H
@@ -12,16 +12,19 @@ struct UsesMaterial {};
 struct Material {
   std::string name;
 
-  // entities are Images
+  // entities are Images, their format follows the slot (see TextureRole)
 
   // Color Data, Uses sRGB
-  flecs::entity normal;
+  flecs::entity albedo;
   flecs::entity emissive;
 
   // Non-Color Data (Linear / Doesn't use sRGB)
-  flecs::entity albedo;
-  flecs::entity metallic_roughness; // occlusion = red channel, metallic =
-  flecs::entity occlusion;
+  flecs::entity normal; // RG, z is rebuilt from x and y
+  // occlusion = red channel, roughness = green, metallic = blue. When the
+  // glTF has both maps they end up in one texture and these are the same
+  // entity.
+  flecs::entity metallic_roughness;
+  flecs::entity occlusion; // red channel
 
   glm::vec4 albedo_factor = glm::vec4(1.0f);
   float metallic_factor = 1.0f;
@@ -30,6 +33,11 @@ struct Material {
   float occlusion_strength = 1.0f;
   glm::vec3 emissive_factor = glm::vec3(0.0f);
   float emissive_strength = 1.0f;
+
+  // glTF MASK alpha mode, fragments with albedo alpha below the cutoff are
+  // discarded
+  bool alpha_test = false;
+  float alpha_cutoff = 0.5f;
 };
 
 } // namespace Expectre
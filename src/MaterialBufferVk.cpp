@@ -0,0 +1,92 @@
+#include "MaterialBufferVk.h"
+
+namespace Expectre {
+
+MaterialBufferVk::MaterialBufferVk(VmaAllocator allocator,
+                                   uint32_t frames_in_flight)
+    : m_allocator(allocator) {
+  m_slots.resize(frames_in_flight);
+  for (SlotBuffer &slot : m_slots) {
+    create_slot_buffer(slot, kInitialCapacity);
+  }
+}
+
+MaterialBufferVk::~MaterialBufferVk() {
+  for (SlotBuffer &slot : m_slots) {
+    destroy_slot_buffer(slot);
+  }
+}
+
+uint32_t MaterialBufferVk::add(const GpuMaterial &material) {
+  const uint32_t id = static_cast<uint32_t>(m_materials.size());
+  m_materials.push_back(material);
+  for (SlotBuffer &slot : m_slots) {
+    slot.pending.insert(id);
+  }
+  return id;
+}
+
+void MaterialBufferVk::update(uint32_t id, const GpuMaterial &material) {
+  if (m_materials[id] == material) {
+    return;
+  }
+  m_materials[id] = material;
+  for (SlotBuffer &slot : m_slots) {
+    slot.pending.insert(id);
+  }
+}
+
+bool MaterialBufferVk::flush(uint32_t slot_index) {
+  SlotBuffer &slot = m_slots[slot_index];
+  const uint32_t count = size();
+  if (count > slot.capacity) {
+    // The slot's frame has finished, nothing reads the old buffer anymore
+    uint32_t capacity = slot.capacity;
+    while (capacity < count) {
+      capacity *= 2;
+    }
+    destroy_slot_buffer(slot);
+    create_slot_buffer(slot, capacity);
+    std::memcpy(slot.mapped, m_materials.data(), count * sizeof(GpuMaterial));
+    slot.pending.clear();
+    return true;
+  }
+
+  // Consecutive IDs go in one copy
+  auto it = slot.pending.begin();
+  while (it != slot.pending.end()) {
+    const uint32_t first = *it;
+    uint32_t last = first;
+    while (++it != slot.pending.end() && *it == last + 1) {
+      last = *it;
+    }
+    std::memcpy(slot.mapped + first, &m_materials[first],
+                (last - first + 1) * sizeof(GpuMaterial));
+  }
+  slot.pending.clear();
+  return false;
+}
+
+void MaterialBufferVk::create_slot_buffer(SlotBuffer &slot,
+                                          uint32_t capacity) {
+  // Coherent, the writes are visible to the slot's next submit
+  slot.buffer = ToolsVk::create_buffer(
+      m_allocator, capacity * sizeof(GpuMaterial),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU,
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  VK_CHECK_RESULT(vmaMapMemory(m_allocator, slot.buffer.allocation,
+                               reinterpret_cast<void **>(&slot.mapped)));
+  slot.capacity = capacity;
+}
+
+void MaterialBufferVk::destroy_slot_buffer(SlotBuffer &slot) {
+  if (slot.buffer.buffer == VK_NULL_HANDLE) {
+    return;
+  }
+  vmaUnmapMemory(m_allocator, slot.buffer.allocation);
+  vmaDestroyBuffer(m_allocator, slot.buffer.buffer, slot.buffer.allocation);
+  slot.buffer = AllocatedBuffer{};
+  slot.mapped = nullptr;
+}
+
+} // namespace Expectre
@@ -0,0 +1,110 @@
+#ifndef MATERIAL_BUFFER_VK_H
+#define MATERIAL_BUFFER_VK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <vma/vk_mem_alloc.h>
+#include <vulkan/vulkan.h>
+
+#include "ToolsVk.h"
+
+namespace Expectre {
+
+/// One material as the shaders see it, matches Material in frag.frag
+/// (std430). Compared and hashed bytewise, so build it value-initialized.
+struct GpuMaterial {
+  glm::vec4 albedo_factor = glm::vec4(1.0f);
+  glm::vec3 emissive = glm::vec3(0.0f); // factor times strength
+  float metallic_factor = 1.0f;
+  float roughness_factor = 1.0f;
+  float normal_scale = 1.0f;
+  float alpha_cutoff = 0.0f; // 0 = opaque
+  int32_t albedo_idx = -1;   // bindless slot, -1 = vertex color
+  int32_t normal_idx = -1;   // bindless slot, -1 = vertex normals
+  // Bindless slots, -1 = none. Occlusion is the red channel, roughness
+  // green and metallic blue. Packed into one texture, both are its slot.
+  int32_t metallic_roughness_idx = -1;
+  int32_t occlusion_idx = -1;
+  int32_t emissive_idx = -1; // multiplies emissive
+  float occlusion_strength = 1.0f;
+  int32_t padding[3]{};
+
+  bool operator==(const GpuMaterial &other) const {
+    return std::memcmp(this, &other, sizeof(GpuMaterial)) == 0;
+  }
+  bool operator!=(const GpuMaterial &other) const { return !(*this == other); }
+};
+static_assert(sizeof(GpuMaterial) == 80, "must match Material in frag.frag");
+
+struct GpuMaterialHash {
+  size_t operator()(const GpuMaterial &material) const {
+    uint32_t words[sizeof(GpuMaterial) / sizeof(uint32_t)];
+    std::memcpy(words, &material, sizeof(words));
+    size_t hash = 0;
+    for (uint32_t word : words) {
+      hash = hash * 31 + word;
+    }
+    return hash;
+  }
+};
+
+/// Every material in one storage buffer, indexed by material ID. Each frame
+/// slot has its own host visible copy, written only once the slot's frame
+/// has finished, and catches up on just the entries that changed since it
+/// was last written.
+class MaterialBufferVk {
+public:
+  MaterialBufferVk(VmaAllocator allocator, uint32_t frames_in_flight);
+  ~MaterialBufferVk();
+
+  MaterialBufferVk(const MaterialBufferVk &) = delete;
+  MaterialBufferVk &operator=(const MaterialBufferVk &) = delete;
+
+  /// Returns the new entry's material ID
+  uint32_t add(const GpuMaterial &material);
+  /// Only queues a write if the entry actually changed
+  void update(uint32_t id, const GpuMaterial &material);
+  const GpuMaterial &get(uint32_t id) const { return m_materials[id]; }
+  uint32_t size() const { return static_cast<uint32_t>(m_materials.size()); }
+
+  /// Writes the slot's pending entries, call once its frame has finished.
+  /// True if the slot's buffer had to grow, its descriptor then has to be
+  /// written again.
+  bool flush(uint32_t slot);
+
+  VkBuffer get_buffer(uint32_t slot) const {
+    return m_slots[slot].buffer.buffer;
+  }
+  VkDeviceSize get_size(uint32_t slot) const {
+    return m_slots[slot].capacity * sizeof(GpuMaterial);
+  }
+
+private:
+  struct SlotBuffer {
+    AllocatedBuffer buffer{};
+    GpuMaterial *mapped = nullptr;
+    uint32_t capacity = 0;
+    // Material IDs still to be written, in order so runs go in one copy
+    std::set<uint32_t> pending;
+  };
+
+  void create_slot_buffer(SlotBuffer &slot, uint32_t capacity);
+  void destroy_slot_buffer(SlotBuffer &slot);
+
+  VmaAllocator m_allocator;
+  std::vector<GpuMaterial> m_materials;
+  std::vector<SlotBuffer> m_slots;
+
+  // Never empty, a zero sized buffer can't be bound
+  static constexpr uint32_t kInitialCapacity = 256;
+};
+
+} // namespace Expectre
+
+#endif // MATERIAL_BUFFER_VK_H
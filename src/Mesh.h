@@ -4,6 +4,7 @@
 #include <assimp/Importer.hpp>
 #include <assimp/defs.h>
 #include <assimp/mesh.h>
+#include <cstdint>
 #include <flecs.h>
 #include <glm/glm.hpp>
 #include <string>
@@ -18,9 +19,39 @@ struct Vertex {
   glm::vec2 tex_coord = glm::vec2(0.0f);
 };
 
+/// How a mesh's vertices are laid out in the vertex buffer. With vertex
+/// pulling the vertex shader decodes every format itself, so meshes of
+/// different formats are drawn with the same pipeline.
+enum class VertexFormat : uint32_t {
+  Float = 0,     // Vertex as is
+  Quantized = 1, // QuantizedVertex, vertex pulling only
+};
+
+/// Vertex packed to 20 bytes. Positions and uvs are relative to the mesh's
+/// own ranges, which are passed to the shader with each draw.
+struct QuantizedVertex {
+  uint32_t position_xy = 0; // unorm16 x, y within the position range
+  uint32_t position_z = 0;  // unorm16 z, high half unused
+  uint32_t normal = 0;      // octahedral, snorm16 x, y
+  uint32_t tex_coord = 0;   // unorm16 u, v within the uv range
+  uint32_t color = 0;       // unorm8 r, g, b, alpha unused
+};
+
+// Strides vert_pulled.vert decodes with
+static_assert(sizeof(Vertex) == 44, "vert_pulled.vert reads 11 words");
+static_assert(sizeof(QuantizedVertex) == 20, "vert_pulled.vert reads 5 words");
+
+inline uint32_t vertex_stride(VertexFormat format) {
+  return format == VertexFormat::Quantized ? sizeof(QuantizedVertex)
+                                           : sizeof(Vertex);
+}
+
 // ECS
 struct Node {};
 struct UsesMesh {};
+// Primitive -> shared entity holding its vertices and indices. Identical
+// geometry from any number of files points at the same one.
+struct UsesGeometry {};
 
 // sub-mesh that has one material
 // gltf describes as "one draw call"
@@ -34,13 +65,14 @@ struct Primitive {
 struct PendingPrimitiveUpload {
   std::vector<Vertex> vertices;
   std::vector<uint32_t> indices;
+  uint64_t content_hash = 0; // xxHash of vertices and indices
 };
 
 struct Mesh {
   std::string name; // Name of the mesh
 };
 
-void compute_vertex_normals(PendingPrimitiveUpload &mesh) {
+inline void compute_vertex_normals(PendingPrimitiveUpload &mesh) {
 
   // Initialize all normals to zero
   for (auto &vertex : mesh.vertices) {
@@ -0,0 +1,240 @@
+#ifndef MIP_CHAIN_H
+#define MIP_CHAIN_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EXPECTRE_MIP_CHAIN_SSE2 1
+#endif
+
+namespace Expectre {
+
+class MappedFile;
+
+inline uint32_t compute_mip_level_count(uint32_t width, uint32_t height) {
+  uint32_t levels = 1;
+  uint32_t largest = std::max(width, height);
+  while (largest > 1) {
+    largest >>= 1;
+    levels++;
+  }
+  return levels;
+}
+
+struct MipLevel {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  size_t byte_offset = 0; // into MipChain::pixels
+  size_t byte_size = 0;
+};
+
+/// CPU copy of every mip level of a texture, finest first, tightly packed in
+/// one allocation. The texture streamer uploads ranges of this chain so a
+/// texture can become resident at any mip without touching the source image.
+/// Cooked textures hold block compressed levels, format says which.
+struct MipChain {
+  std::vector<uint8_t> pixels;
+  std::vector<MipLevel> levels;
+  uint32_t channels = 0; // 0 for block compressed chains
+  VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+
+  // Chains loaded from the asset cache leave pixels empty and point into the
+  // mapped cache file instead, which they keep alive
+  std::shared_ptr<const MappedFile> mapping;
+  const uint8_t *mapped_pixels = nullptr;
+  size_t mapped_byte_size = 0;
+
+  const uint8_t *data() const {
+    return mapped_pixels ? mapped_pixels : pixels.data();
+  }
+  size_t byte_size() const {
+    return mapped_pixels ? mapped_byte_size : pixels.size();
+  }
+  uint32_t level_count() const { return static_cast<uint32_t>(levels.size()); }
+  // Every level down to 1x1, chains cut short hold just their top levels
+  bool is_complete() const {
+    return !levels.empty() &&
+           level_count() == compute_mip_level_count(levels[0].width,
+                                                    levels[0].height);
+  }
+  const uint8_t *level_data(uint32_t level) const {
+    return data() + levels[level].byte_offset;
+  }
+  // Bytes of all levels from first_level down to the smallest one
+  size_t byte_size_from(uint32_t first_level) const {
+    return byte_size() - levels[first_level].byte_offset;
+  }
+};
+
+inline bool is_srgb_format(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_R8_SRGB:
+  case VK_FORMAT_R8G8_SRGB:
+  case VK_FORMAT_R8G8B8_SRGB:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+  case VK_FORMAT_B8G8R8A8_SRGB:
+    return true;
+  default:
+    return false;
+  }
+}
+
+inline float srgb_to_linear(float c) {
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+/// Linear value of every sRGB byte, 16 bit fixed point
+inline const std::array<uint16_t, 256> &srgb_decode_table() {
+  static const std::array<uint16_t, 256> table = [] {
+    std::array<uint16_t, 256> decoded{};
+    for (uint32_t i = 0; i < 256; i++) {
+      decoded[i] = static_cast<uint16_t>(
+          std::lround(srgb_to_linear(i / 255.0f) * 65535.0f));
+    }
+    return decoded;
+  }();
+  return table;
+}
+
+/// Nearest sRGB byte of a 16 bit fixed point linear value. The thresholds
+/// are the linear values halfway between neighbouring bytes in sRGB, the
+/// byte is how many of them lie at or below the value.
+inline uint8_t linear_to_srgb_byte(uint32_t linear) {
+  static const std::array<uint16_t, 255> thresholds = [] {
+    std::array<uint16_t, 255> midpoints{};
+    for (uint32_t i = 0; i < 255; i++) {
+      midpoints[i] = static_cast<uint16_t>(
+          std::lround(srgb_to_linear((i + 0.5f) / 255.0f) * 65535.0f));
+    }
+    return midpoints;
+  }();
+  return static_cast<uint8_t>(
+      std::upper_bound(thresholds.begin(), thresholds.end(), linear) -
+      thresholds.begin());
+}
+
+/// Averages 2x2 blocks of src into dst (one level down). Odd sized levels
+/// clamp at the edge, so the last row/column gets counted twice instead of
+/// being dropped. With srgb the color channels are averaged in linear space
+/// and encoded again, alpha (the fourth channel) is always linear.
+inline void downsample_2x2(const uint8_t *src, const MipLevel &src_mip,
+                           uint8_t *dst, const MipLevel &dst_mip,
+                           uint32_t channels, bool srgb = false) {
+  const std::array<uint16_t, 256> &decode = srgb_decode_table();
+  const uint32_t srgb_channels = srgb ? std::min(channels, 3u) : 0;
+  for (uint32_t y = 0; y < dst_mip.height; y++) {
+    const uint32_t y0 = std::min(y * 2, src_mip.height - 1);
+    const uint32_t y1 = std::min(y * 2 + 1, src_mip.height - 1);
+    const size_t src_stride = static_cast<size_t>(src_mip.width) * channels;
+    const size_t dst_stride = static_cast<size_t>(dst_mip.width) * channels;
+    const uint8_t *row0 = src + y0 * src_stride;
+    const uint8_t *row1 = src + y1 * src_stride;
+    uint8_t *dst_row = dst + y * dst_stride;
+
+    uint32_t x = 0;
+#ifdef EXPECTRE_MIP_CHAIN_SSE2
+    if (channels == 4 && !srgb) {
+      // Two output pixels per iteration: 4 source pixels (16 bytes) from each
+      // row, widened to 16 bits so the 4-way sums can't overflow
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i round = _mm_set1_epi16(2);
+      for (; x * 2 + 3 < src_mip.width && x + 1 < dst_mip.width; x += 2) {
+        const __m128i r0 =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8));
+        const __m128i r1 =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8));
+
+        // Vertical sums, pixels 0,1 in lo and 2,3 in hi
+        const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(r0, zero),
+                                         _mm_unpacklo_epi8(r1, zero));
+        const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(r0, zero),
+                                         _mm_unpackhi_epi8(r1, zero));
+        // Horizontal sums, fold the upper pixel of each pair onto the lower
+        const __m128i sum_lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+        const __m128i sum_hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+        __m128i average = _mm_unpacklo_epi64(sum_lo, sum_hi);
+        average = _mm_srli_epi16(_mm_add_epi16(average, round), 2);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst_row + x * 4),
+                         _mm_packus_epi16(average, zero));
+      }
+    }
+#endif
+
+    // Scalar path for sRGB, other channel counts, the clamped right edge and
+    // the odd pixel left over by the SIMD loop
+    for (; x < dst_mip.width; x++) {
+      const uint32_t x0 = std::min(x * 2, src_mip.width - 1);
+      const uint32_t x1 = std::min(x * 2 + 1, src_mip.width - 1);
+      for (uint32_t c = 0; c < channels; c++) {
+        const uint8_t p00 = row0[x0 * channels + c];
+        const uint8_t p01 = row0[x1 * channels + c];
+        const uint8_t p10 = row1[x0 * channels + c];
+        const uint8_t p11 = row1[x1 * channels + c];
+        if (c < srgb_channels) {
+          const uint32_t sum =
+              decode[p00] + decode[p01] + decode[p10] + decode[p11];
+          dst_row[x * channels + c] = linear_to_srgb_byte((sum + 2) / 4);
+        } else {
+          const uint32_t sum = p00 + p01 + p10 + p11;
+          dst_row[x * channels + c] = static_cast<uint8_t>((sum + 2) / 4);
+        }
+      }
+    }
+  }
+}
+
+/// Builds the full mip chain for 8 bit per channel pixels with a 2x2 box
+/// filter, in linear space for sRGB formats. Slow enough on large images
+/// that it should run on a worker thread. format has to match channels.
+/// max_levels cuts the chain short, 1 just copies the image for the GPU to
+/// build the rest.
+inline MipChain
+build_mip_chain(const uint8_t *pixels, uint32_t width, uint32_t height,
+                uint32_t channels,
+                VkFormat format = VK_FORMAT_R8G8B8A8_SRGB,
+                uint32_t max_levels = UINT32_MAX) {
+  MipChain chain{};
+  chain.channels = channels;
+  chain.format = format;
+
+  const uint32_t level_count =
+      std::min(compute_mip_level_count(width, height), max_levels);
+  chain.levels.resize(level_count);
+
+  size_t total_bytes = 0;
+  for (uint32_t level = 0; level < level_count; level++) {
+    MipLevel &mip = chain.levels[level];
+    mip.width = std::max(1u, width >> level);
+    mip.height = std::max(1u, height >> level);
+    mip.byte_offset = total_bytes;
+    mip.byte_size = static_cast<size_t>(mip.width) * mip.height * channels;
+    total_bytes += mip.byte_size;
+  }
+  chain.pixels.resize(total_bytes);
+  std::memcpy(chain.pixels.data(), pixels, chain.levels[0].byte_size);
+
+  for (uint32_t level = 1; level < level_count; level++) {
+    const MipLevel &src_mip = chain.levels[level - 1];
+    const MipLevel &dst_mip = chain.levels[level];
+    downsample_2x2(chain.pixels.data() + src_mip.byte_offset, src_mip,
+                   chain.pixels.data() + dst_mip.byte_offset, dst_mip,
+                   channels, is_srgb_format(format));
+  }
+
+  return chain;
+}
+
+} // namespace Expectre
+
+#endif // MIP_CHAIN_H
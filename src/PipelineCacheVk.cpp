@@ -0,0 +1,152 @@
+#include "PipelineCacheVk.h"
+
+#include "MappedFile.h"
+#include "ToolsVk.h"
+
+#include <SDL3/SDL.h>
+#include <cstring>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <vector>
+#include <xxhash.h>
+
+namespace Expectre {
+
+namespace {
+
+constexpr char kPipelineCacheMagic[4] = {'E', 'X', 'P', 'P'};
+constexpr uint32_t kPipelineCacheHeaderVersion = 1;
+
+} // namespace
+
+PipelineCacheVk::PipelineCacheVk(VkDevice device,
+                                 VkPhysicalDevice physical_device,
+                                 std::filesystem::path path)
+    : m_device(device), m_path(std::move(path)) {
+  vkGetPhysicalDeviceProperties(physical_device, &m_properties);
+
+  VkPipelineCacheCreateInfo cache_info{
+      VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+
+  std::shared_ptr<const MappedFile> file = MappedFile::open(m_path);
+  if (file && file->size() >= sizeof(FileHeader)) {
+    FileHeader stored{};
+    std::memcpy(&stored, file->data(), sizeof(stored));
+    const FileHeader expected = make_header();
+    const uint8_t *data = file->data() + sizeof(FileHeader);
+
+    // A driver update or a different GPU invalidates the cache, so does a
+    // truncated or corrupted file
+    const char *reject_reason = nullptr;
+    if (std::memcmp(stored.magic, expected.magic, sizeof(stored.magic)) != 0 ||
+        stored.header_version != expected.header_version) {
+      reject_reason = "unknown format";
+    } else if (stored.vendor_id != expected.vendor_id ||
+               stored.device_id != expected.device_id ||
+               std::memcmp(stored.pipeline_cache_uuid,
+                           expected.pipeline_cache_uuid, VK_UUID_SIZE) != 0) {
+      reject_reason = "written by another device";
+    } else if (stored.driver_version != expected.driver_version) {
+      reject_reason = "written by another driver version";
+    } else if (stored.data_size != file->size() - sizeof(FileHeader) ||
+               XXH3_64bits(data, stored.data_size) != stored.data_hash) {
+      reject_reason = "checksum mismatch";
+    }
+
+    if (reject_reason) {
+      spdlog::info("Ignoring pipeline cache {}: {}", m_path.string(),
+                   reject_reason);
+    } else {
+      cache_info.initialDataSize = stored.data_size;
+      cache_info.pInitialData = data;
+    }
+  }
+
+  VK_CHECK_RESULT(
+      vkCreatePipelineCache(m_device, &cache_info, nullptr, &m_cache));
+  if (cache_info.initialDataSize > 0) {
+    spdlog::info("Loaded pipeline cache {} ({} KiB)", m_path.string(),
+                 cache_info.initialDataSize / 1024);
+  }
+}
+
+PipelineCacheVk::~PipelineCacheVk() {
+  save();
+  vkDestroyPipelineCache(m_device, m_cache, nullptr);
+}
+
+std::filesystem::path PipelineCacheVk::default_path() {
+  char *pref_path = SDL_GetPrefPath("Expectre", "Expectre");
+  if (!pref_path) {
+    spdlog::warn("No user pref path ({}), keeping the pipeline cache in the "
+                 "temp dir",
+                 SDL_GetError());
+    return std::filesystem::temp_directory_path() /
+           "expectre_pipeline_cache.bin";
+  }
+  std::filesystem::path path =
+      std::filesystem::path(pref_path) / "pipeline_cache.bin";
+  SDL_free(pref_path);
+  return path;
+}
+
+PipelineCacheVk::FileHeader PipelineCacheVk::make_header() const {
+  FileHeader header{};
+  std::memcpy(header.magic, kPipelineCacheMagic, sizeof(header.magic));
+  header.header_version = kPipelineCacheHeaderVersion;
+  header.vendor_id = m_properties.vendorID;
+  header.device_id = m_properties.deviceID;
+  header.driver_version = m_properties.driverVersion;
+  std::memcpy(header.pipeline_cache_uuid, m_properties.pipelineCacheUUID,
+              VK_UUID_SIZE);
+  return header;
+}
+
+bool PipelineCacheVk::save() const {
+  size_t data_size = 0;
+  VK_CHECK_RESULT(
+      vkGetPipelineCacheData(m_device, m_cache, &data_size, nullptr));
+  std::vector<uint8_t> data(data_size);
+  VK_CHECK_RESULT(
+      vkGetPipelineCacheData(m_device, m_cache, &data_size, data.data()));
+  data.resize(data_size);
+
+  FileHeader header = make_header();
+  header.data_size = data.size();
+  header.data_hash = XXH3_64bits(data.data(), data.size());
+
+  std::error_code error;
+  std::filesystem::create_directories(m_path.parent_path(), error);
+
+  // Same temp file and rename as the asset cache, a crash mid write never
+  // leaves a torn cache behind
+  std::filesystem::path temp_path = m_path;
+  temp_path += ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      spdlog::warn("Failed to open {}", temp_path.string());
+      return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(data.data()),
+               static_cast<std::streamsize>(data.size()));
+    if (!file) {
+      spdlog::warn("Failed writing {}", temp_path.string());
+      return false;
+    }
+  }
+
+  std::filesystem::rename(temp_path, m_path, error);
+  if (error) {
+    spdlog::warn("Failed to move {} into place: {}", m_path.string(),
+                 error.message());
+    std::filesystem::remove(temp_path, error);
+    return false;
+  }
+  spdlog::info("Wrote pipeline cache {} ({} KiB)", m_path.string(),
+               data.size() / 1024);
+  return true;
+}
+
+} // namespace Expectre
@@ -0,0 +1,57 @@
+#ifndef PIPELINE_CACHE_VK_H
+#define PIPELINE_CACHE_VK_H
+
+#include <cstdint>
+#include <filesystem>
+
+#include <vulkan/vulkan.h>
+
+namespace Expectre {
+
+/// VkPipelineCache persisted between runs. The file is only used when it
+/// was written by the same device and driver and its checksum matches,
+/// anything else starts an empty cache rather than handing the driver data
+/// it might not validate itself.
+class PipelineCacheVk {
+public:
+  PipelineCacheVk(VkDevice device, VkPhysicalDevice physical_device,
+                  std::filesystem::path path = default_path());
+  /// Saves the cache, the device must still be alive
+  ~PipelineCacheVk();
+
+  PipelineCacheVk(const PipelineCacheVk &) = delete;
+  PipelineCacheVk &operator=(const PipelineCacheVk &) = delete;
+
+  /// Pass to every vkCreate*Pipelines call
+  VkPipelineCache get() const { return m_cache; }
+
+  /// Writes the cache to disk now, returns false if it couldn't
+  bool save() const;
+
+  static std::filesystem::path default_path();
+
+private:
+  // Prefix of the file on disk, followed by data_size bytes of cache data
+  struct FileHeader {
+    char magic[4];
+    uint32_t header_version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+    uint32_t reserved;
+    uint64_t data_size;
+    uint64_t data_hash; // XXH3 of the cache data
+  };
+
+  FileHeader make_header() const;
+
+  VkDevice m_device;
+  VkPhysicalDeviceProperties m_properties{};
+  std::filesystem::path m_path;
+  VkPipelineCache m_cache = VK_NULL_HANDLE;
+};
+
+} // namespace Expectre
+
+#endif // PIPELINE_CACHE_VK_H
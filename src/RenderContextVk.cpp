@@ -20,7 +20,8 @@
 namespace Expectre {
 
 RenderContextVk::RenderContextVk(SDL_Window *window,
-                                 InputManager &input_manager)
+                                 InputManager &input_manager,
+                                 const FramePacingConfig &frame_pacing)
     : m_window{window} {
   // SDL_Vulkan_LoadLibrary();
   create_instance();
@@ -36,7 +37,8 @@ RenderContextVk::RenderContextVk(SDL_Window *window,
   m_renderer = std::make_shared<RendererVk>(
       m_instance, m_physical_device, m_device, m_allocator, m_surface,
       m_graphics_queue, m_graphics_queue_index, m_present_queue,
-      m_present_queue_index, uint_width, uint_height, input_manager);
+      m_present_queue_index, uint_width, uint_height, m_device_features,
+      frame_pacing, input_manager);
   m_ready = true;
 }
 
@@ -158,6 +160,11 @@ void RenderContextVk::create_device() {
   features_1_2.runtimeDescriptorArray = VK_TRUE;
   features_1_2.descriptorBindingVariableDescriptorCount = VK_TRUE;
   features_1_2.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+  // Texture slots are written while recorded secondaries still use the set
+  features_1_2.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+  features_1_2.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+  // Frame pacing waits on one timeline instead of a fence per frame
+  features_1_2.timelineSemaphore = VK_TRUE;
 
   VkPhysicalDeviceFeatures2 required_features{
       VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
@@ -167,10 +174,41 @@ void RenderContextVk::create_device() {
   required_features.features.geometryShader = VK_TRUE;
   required_features.features.samplerAnisotropy = VK_TRUE;
   required_features.features.fillModeNonSolid = VK_TRUE;
+  // Cooked textures are BC compressed, without it the importer skips them
+  // and decodes the source images
+  required_features.features.textureCompressionBC =
+      supportedFeatures.textureCompressionBC;
+  m_device_features.texture_compression_bc =
+      supportedFeatures.textureCompressionBC == VK_TRUE;
+  // Only used by the GPU profiler, which falls back to timestamps alone
+  required_features.features.pipelineStatisticsQuery =
+      supportedFeatures.pipelineStatisticsQuery;
+  m_device_features.pipeline_statistics_query =
+      supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
   required_features.pNext = &features_1_2;
 
   std::vector<const char *> extensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
+  // Host image copy lets textures be written straight from the CPU chain,
+  // skipping the staging buffer. Optional, uploads fall back to staging.
+  VkPhysicalDeviceHostImageCopyFeaturesEXT host_image_copy_features{
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT};
+  if (ToolsVk::device_supports_extension(
+          m_physical_device, VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 supported_features2{
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    supported_features2.pNext = &host_image_copy_features;
+    vkGetPhysicalDeviceFeatures2(m_physical_device, &supported_features2);
+    if (host_image_copy_features.hostImageCopy) {
+      extensions.push_back(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+      host_image_copy_features.pNext = required_features.pNext;
+      required_features.pNext = &host_image_copy_features;
+      m_device_features.host_image_copy = true;
+    }
+  }
+  spdlog::info("Host image copy {}",
+               m_device_features.host_image_copy ? "enabled" : "unavailable");
+
   VkDeviceCreateInfo device_create_info{};
   device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
   // device_create_info.pEnabledFeatures = &required_features;
@@ -214,11 +252,13 @@ void RenderContextVk::create_memory_allocator() {
 
 void RenderContextVk::update_and_render(uint64_t delta_time, Scene &scene) {
 
+  m_renderer->release_assets(scene.consume_released_renderables());
   const auto &pending = scene.consume_pending_renderables();
   m_renderer->upload_pending_assets(pending);
 
   m_renderer->update(delta_time);
 
+  m_renderer->set_lights(scene.gather_lights());
   const auto &renderables = scene.gather_renderables();
   m_renderer->draw_frame(scene.get_camera(), renderables);
 }
@@ -226,4 +266,8 @@ void RenderContextVk::update_and_render(uint64_t delta_time, Scene &scene) {
 void RenderContextVk::OnWindowResize(glm::uvec2 new_dims) {
   m_renderer->OnWindowResize(new_dims);
 }
+
+void RenderContextVk::wait_for_frame_slot() {
+  m_renderer->wait_for_frame_slot();
+}
 } // namespace Expectre
\ No newline at end of file
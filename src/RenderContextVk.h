@@ -6,6 +6,8 @@
 #include <vma/vk_mem_alloc.h> // for VmaAllocator
 #include <vulkan/vulkan.h>
 
+#include "DeviceFeaturesVk.h"
+#include "FramePacing.h"
 #include "RendererVk.h"
 
 namespace Expectre {
@@ -18,7 +20,8 @@ class InputManager;
 class RenderContextVk {
 public:
   RenderContextVk() = delete;
-  RenderContextVk(SDL_Window *window, InputManager &input_manager);
+  RenderContextVk(SDL_Window *window, InputManager &input_manager,
+                  const FramePacingConfig &frame_pacing);
   ~RenderContextVk();
 
   const VkDevice &get_device() { return m_device; }
@@ -27,9 +30,13 @@ public:
   uint32_t present_queue_index() { return m_present_queue_index; }
   const VmaAllocator &get_allocator() { return m_allocator; }
   const VkSurfaceKHR &get_surface() { return m_surface; }
+  const DeviceFeaturesVk &get_device_features() { return m_device_features; }
   void update_and_render(uint64_t delta_time, Scene &scene);
   bool is_ready() { return m_ready; }
   void OnWindowResize(glm::uvec2 new_dims);
+  /// Blocks until the GPU has finished the frame whose resources the next
+  /// frame reuses
+  void wait_for_frame_slot();
 
 private:
   void create_instance();
@@ -43,6 +50,7 @@ private:
   VmaAllocator m_allocator{};
   VkPhysicalDevice m_physical_device{};
   VkDevice m_device = VK_NULL_HANDLE;
+  DeviceFeaturesVk m_device_features{};
   std::shared_ptr<RendererVk> m_renderer = nullptr;
 
   // make queues/indeces part of a device class?
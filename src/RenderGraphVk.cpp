@@ -0,0 +1,784 @@
+#include "RenderGraphVk.h"
+
+#include "ToolsVk.h"
+
+#include <algorithm>
+#include <set>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace Expectre {
+
+namespace {
+
+struct AccessInfo {
+  VkPipelineStageFlags stages;
+  VkAccessFlags read_access;
+  VkAccessFlags write_access;
+  VkImageLayout layout;
+  VkImageUsageFlags usage;
+};
+
+AccessInfo access_info(ImageAccess access) {
+  switch (access) {
+  case ImageAccess::ColorAttachment:
+    return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+  case ImageAccess::DepthStencilAttachment:
+    // Depth tests read whatever the pass itself wrote, so a write is both
+    return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+  case ImageAccess::FragmentSampled:
+    return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+            0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_IMAGE_USAGE_SAMPLED_BIT};
+  case ImageAccess::ComputeSampled:
+    return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+            0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_IMAGE_USAGE_SAMPLED_BIT};
+  case ImageAccess::ComputeStorage:
+    return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_USAGE_STORAGE_BIT};
+  case ImageAccess::TransferSrc:
+    return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_SRC_BIT};
+  case ImageAccess::TransferDst:
+    return {VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT};
+  }
+  return {};
+}
+
+constexpr VkAccessFlags kWriteAccess =
+    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+    VK_ACCESS_TRANSFER_WRITE_BIT;
+
+constexpr VkImageUsageFlags kAttachmentUsage =
+    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+    VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+bool has_stencil(VkFormat format) {
+  return format == VK_FORMAT_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT ||
+         format == VK_FORMAT_D24_UNORM_S8_UINT ||
+         format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+VkImageAspectFlags aspect_flags(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_D16_UNORM:
+  case VK_FORMAT_X8_D24_UNORM_PACK32:
+  case VK_FORMAT_D32_SFLOAT:
+    return VK_IMAGE_ASPECT_DEPTH_BIT;
+  case VK_FORMAT_S8_UINT:
+    return VK_IMAGE_ASPECT_STENCIL_BIT;
+  case VK_FORMAT_D16_UNORM_S8_UINT:
+  case VK_FORMAT_D24_UNORM_S8_UINT:
+  case VK_FORMAT_D32_SFLOAT_S8_UINT:
+    return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+  default:
+    return VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+}
+
+} // namespace
+
+RenderGraphVk::RenderGraphVk(VkDevice device, VmaAllocator allocator,
+                             DeletionQueueVk &deletion_queue)
+    : m_device(device), m_allocator(allocator),
+      m_deletion_queue(deletion_queue) {}
+
+RenderGraphVk::~RenderGraphVk() {
+  for (const CompiledPass &compiled : m_compiled) {
+    for (VkFramebuffer framebuffer : compiled.framebuffers) {
+      vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+    }
+  }
+  for (ImageResource &image : m_images) {
+    if (image.imported) {
+      continue;
+    }
+    for (VkImageView view : image.views) {
+      vkDestroyImageView(m_device, view, nullptr);
+    }
+    for (VkImage vk_image : image.images) {
+      vkDestroyImage(m_device, vk_image, nullptr);
+    }
+  }
+  for (const MemoryBlock &block : m_memory_blocks) {
+    vmaFreeMemory(m_allocator, block.allocation);
+  }
+  for (const auto &[key, render_pass] : m_render_passes) {
+    vkDestroyRenderPass(m_device, render_pass, nullptr);
+  }
+}
+
+RenderGraphImage RenderGraphVk::create_image(std::string name,
+                                             const TransientImageDesc &desc) {
+  ImageResource image{};
+  image.name = std::move(name);
+  image.format = desc.format;
+  image.transient = desc;
+  m_images.push_back(std::move(image));
+  return static_cast<RenderGraphImage>(m_images.size() - 1);
+}
+
+RenderGraphImage RenderGraphVk::import_image(std::string name,
+                                             const ImportedImageDesc &desc) {
+  ImageResource image{};
+  image.name = std::move(name);
+  image.format = desc.format;
+  image.imported = true;
+  image.imported_desc = desc;
+  m_images.push_back(std::move(image));
+  return static_cast<RenderGraphImage>(m_images.size() - 1);
+}
+
+void RenderGraphVk::set_imported_images(RenderGraphImage image,
+                                        std::vector<VkImage> images,
+                                        std::vector<VkImageView> views) {
+  ImageResource &resource = m_images[image];
+  if (!resource.imported) {
+    throw std::runtime_error("Render graph image " + resource.name +
+                             " is not imported");
+  }
+  resource.images = std::move(images);
+  resource.views = std::move(views);
+}
+
+RenderGraphPass RenderGraphVk::add_pass(RenderGraphPassDesc desc) {
+  m_passes.push_back(std::move(desc));
+  return static_cast<RenderGraphPass>(m_passes.size() - 1);
+}
+
+std::vector<RenderGraphVk::Use>
+RenderGraphVk::uses_of(const RenderGraphPassDesc &desc) const {
+  std::vector<Use> uses;
+  for (const RenderGraphAttachment &attachment : desc.color_attachments) {
+    uses.push_back({attachment.image, ImageAccess::ColorAttachment,
+                    attachment.load_op == VK_ATTACHMENT_LOAD_OP_LOAD, true});
+  }
+  const RenderGraphAttachment &depth = desc.depth_stencil_attachment;
+  if (depth.image != kInvalidRenderGraphHandle) {
+    uses.push_back({depth.image, ImageAccess::DepthStencilAttachment,
+                    depth.load_op == VK_ATTACHMENT_LOAD_OP_LOAD, true});
+  }
+  for (const RenderGraphImageUse &read : desc.reads) {
+    uses.push_back({read.image, read.access, true, false});
+  }
+  for (const RenderGraphImageUse &write : desc.writes) {
+    uses.push_back({write.image, write.access, false, true});
+  }
+  return uses;
+}
+
+void RenderGraphVk::cull(std::vector<std::vector<bool>> &stores) {
+  // Images whose current contents a later pass still needs, walking back
+  // from the outputs
+  std::set<RenderGraphImage> live;
+  for (RenderGraphImage i = 0; i < m_images.size(); ++i) {
+    if (m_images[i].imported && m_images[i].imported_desc.output) {
+      live.insert(i);
+    }
+  }
+
+  m_pass_culled.assign(m_passes.size(), true);
+  stores.assign(m_passes.size(), {});
+  for (size_t p = m_passes.size(); p-- > 0;) {
+    const RenderGraphPassDesc &desc = m_passes[p];
+    const std::vector<Use> uses = uses_of(desc);
+    bool needed = desc.side_effects;
+    for (const Use &use : uses) {
+      needed = needed || (use.writes && live.count(use.image) > 0);
+    }
+    if (!needed) {
+      continue;
+    }
+    m_pass_culled[p] = false;
+
+    for (const RenderGraphAttachment &attachment : desc.color_attachments) {
+      stores[p].push_back(live.count(attachment.image) > 0);
+    }
+    if (desc.depth_stencil_attachment.image != kInvalidRenderGraphHandle) {
+      stores[p].push_back(live.count(desc.depth_stencil_attachment.image) >
+                          0);
+    }
+
+    // Attachments that aren't loaded are overwritten over the whole render
+    // area, earlier contents are dead. Other writes may be partial.
+    for (const Use &use : uses) {
+      const bool attachment = use.access == ImageAccess::ColorAttachment ||
+                              use.access == ImageAccess::DepthStencilAttachment;
+      if (attachment && !use.reads) {
+        live.erase(use.image);
+      }
+    }
+    for (const Use &use : uses) {
+      if (use.reads) {
+        live.insert(use.image);
+      }
+    }
+  }
+}
+
+void RenderGraphVk::create_transients() {
+  for (ImageResource &image : m_images) {
+    image.usage = 0;
+    image.first_pass = kInvalidRenderGraphHandle;
+    image.last_pass = 0;
+    image.previous_occupant = kInvalidRenderGraphHandle;
+  }
+  for (uint32_t p = 0; p < m_passes.size(); ++p) {
+    if (m_pass_culled[p]) {
+      continue;
+    }
+    for (const Use &use : uses_of(m_passes[p])) {
+      ImageResource &image = m_images[use.image];
+      image.usage |= access_info(use.access).usage;
+      image.first_pass = std::min(image.first_pass, p);
+      image.last_pass = std::max(image.last_pass, p);
+    }
+  }
+
+  std::vector<RenderGraphImage> transients;
+  for (RenderGraphImage i = 0; i < m_images.size(); ++i) {
+    const ImageResource &image = m_images[i];
+    if (!image.imported && image.first_pass != kInvalidRenderGraphHandle) {
+      transients.push_back(i);
+    }
+  }
+  std::sort(transients.begin(), transients.end(),
+            [this](RenderGraphImage a, RenderGraphImage b) {
+              return m_images[a].first_pass < m_images[b].first_pass;
+            });
+
+  std::vector<VkMemoryRequirements> requirements(m_images.size());
+  for (RenderGraphImage i : transients) {
+    ImageResource &image = m_images[i];
+    // Never stored and only ever an attachment, tilers can keep it in tile
+    // memory and back it with lazily allocated memory
+    const bool lazily_allocated =
+        (image.usage & ~kAttachmentUsage) == 0 && !image.stored;
+    if (lazily_allocated) {
+      image.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.extent.width = image.transient.extent.width
+                                  ? image.transient.extent.width
+                                  : m_extent.width;
+    image_info.extent.height = image.transient.extent.height
+                                   ? image.transient.extent.height
+                                   : m_extent.height;
+    image_info.extent.depth = 1;
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.format = image.format;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_info.usage = image.usage;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    VkImage vk_image = VK_NULL_HANDLE;
+    VK_CHECK_RESULT(vkCreateImage(m_device, &image_info, nullptr, &vk_image));
+    image.images = {vk_image};
+    vkGetImageMemoryRequirements(m_device, vk_image, &requirements[i]);
+
+    // First fit into a block whose images are all dead by this one's first
+    // pass. The barrier in front of that pass discards the old contents.
+    const VkMemoryRequirements &required = requirements[i];
+    MemoryBlock *fit = nullptr;
+    for (MemoryBlock &block : m_memory_blocks) {
+      if (block.last_pass < image.first_pass &&
+          block.lazily_allocated == lazily_allocated &&
+          (block.requirements.memoryTypeBits & required.memoryTypeBits)) {
+        fit = &block;
+        break;
+      }
+    }
+    if (fit == nullptr) {
+      m_memory_blocks.emplace_back();
+      fit = &m_memory_blocks.back();
+      fit->requirements = required;
+      fit->lazily_allocated = lazily_allocated;
+    }
+    fit->requirements.size = std::max(fit->requirements.size, required.size);
+    fit->requirements.alignment =
+        std::max(fit->requirements.alignment, required.alignment);
+    fit->requirements.memoryTypeBits &= required.memoryTypeBits;
+    if (!fit->images.empty()) {
+      image.previous_occupant = fit->images.back();
+    }
+    fit->images.push_back(i);
+    fit->last_pass = image.last_pass;
+  }
+
+  for (MemoryBlock &block : m_memory_blocks) {
+    // The first image follows the last one of the previous frame, the
+    // transients are shared by every frame in flight
+    m_images[block.images.front()].previous_occupant = block.images.back();
+
+    VmaAllocationCreateInfo alloc_info{};
+    alloc_info.usage = block.lazily_allocated
+                           ? VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED
+                           : VMA_MEMORY_USAGE_GPU_ONLY;
+    VkResult result = vmaAllocateMemory(m_allocator, &block.requirements,
+                                        &alloc_info, &block.allocation,
+                                        nullptr);
+    if (result != VK_SUCCESS && block.lazily_allocated) {
+      // Desktop GPUs have no lazily allocated memory type
+      alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+      result = vmaAllocateMemory(m_allocator, &block.requirements,
+                                 &alloc_info, &block.allocation, nullptr);
+    }
+    VK_CHECK_RESULT(result);
+
+    for (RenderGraphImage i : block.images) {
+      ImageResource &image = m_images[i];
+      VK_CHECK_RESULT(
+          vmaBindImageMemory(m_allocator, block.allocation, image.images[0]));
+      image.views = {ToolsVk::create_image_view(
+          m_device, image.images[0], image.format, aspect_flags(image.format))};
+    }
+  }
+}
+
+RenderGraphVk::ImageState
+RenderGraphVk::initial_state(RenderGraphImage image) const {
+  const ImageResource &resource = m_images[image];
+  ImageState state{};
+  if (resource.imported) {
+    state.layout = resource.imported_desc.initial_layout;
+    state.write_stages = resource.imported_desc.initial_stage;
+    return state;
+  }
+  // Whatever last used the memory has to be done before it is reused
+  if (resource.previous_occupant != kInvalidRenderGraphHandle) {
+    const ImageState &previous =
+        m_images[resource.previous_occupant].final_state;
+    state.write_stages = previous.write_stages;
+    state.write_access = previous.write_access;
+    state.read_stages = previous.read_stages;
+  }
+  return state;
+}
+
+void RenderGraphVk::simulate(RenderGraphImage image, bool record,
+                             std::vector<BarrierBatch> *batches) {
+  ImageResource &resource = m_images[image];
+  ImageState state = initial_state(image);
+
+  for (uint32_t p = 0; p < m_passes.size(); ++p) {
+    if (m_pass_culled[p]) {
+      continue;
+    }
+    for (const Use &use : uses_of(m_passes[p])) {
+      if (use.image != image) {
+        continue;
+      }
+      const AccessInfo info = access_info(use.access);
+      const VkAccessFlags dst_access =
+          (use.reads ? info.read_access : 0) |
+          (use.writes ? info.write_access : 0);
+      const bool layout_change = state.layout != info.layout;
+      // Write after write or read, read after a write this stage hasn't
+      // waited for yet. Reads after reads in the same layout need nothing.
+      const bool hazard =
+          use.writes ? (state.write_stages | state.read_stages) != 0
+                     : state.write_stages != 0 &&
+                           (info.stages & ~state.read_stages) != 0;
+
+      if (layout_change || hazard) {
+        VkPipelineStageFlags src_stages =
+            (layout_change || use.writes)
+                ? state.write_stages | state.read_stages
+                : state.write_stages;
+        if (src_stages == 0) {
+          src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        }
+        if (record) {
+          BarrierBatch &batch = (*batches)[p];
+          batch.src_stages |= src_stages;
+          batch.dst_stages |= info.stages;
+          batch.barriers.push_back({image, state.layout, info.layout,
+                                    state.write_access, dst_access});
+        }
+      }
+
+      if (use.writes) {
+        state.write_stages = info.stages;
+        state.write_access = info.write_access & kWriteAccess;
+        state.read_stages = 0;
+      } else if (layout_change) {
+        // Later readers in other stages wait on the transition
+        state.write_stages = info.stages;
+        state.write_access = 0;
+        state.read_stages = info.stages;
+      } else {
+        state.read_stages |= info.stages;
+      }
+      state.layout = info.layout;
+    }
+  }
+
+  const ImportedImageDesc &imported = resource.imported_desc;
+  if (record && resource.imported && imported.output &&
+      imported.final_layout != VK_IMAGE_LAYOUT_UNDEFINED &&
+      imported.final_layout != state.layout) {
+    VkPipelineStageFlags src_stages = state.write_stages | state.read_stages;
+    if (src_stages == 0) {
+      src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    }
+    m_final_barriers.src_stages |= src_stages;
+    m_final_barriers.dst_stages |= imported.final_stage;
+    m_final_barriers.barriers.push_back(
+        {image, state.layout, imported.final_layout, state.write_access, 0});
+    state.layout = imported.final_layout;
+  }
+  resource.final_state = state;
+}
+
+VkRenderPass
+RenderGraphVk::get_or_create_render_pass(const RenderGraphPassDesc &desc,
+                                         const std::vector<bool> &stores) {
+  std::vector<VkAttachmentDescription> attachments;
+  std::vector<VkAttachmentReference> color_refs;
+  VkAttachmentReference depth_ref{};
+  auto add_attachment = [&](const RenderGraphAttachment &attachment,
+                            ImageAccess access) {
+    const VkFormat format = m_images[attachment.image].format;
+    const bool store = stores[attachments.size()];
+    const VkImageLayout layout = access_info(access).layout;
+    VkAttachmentDescription description{};
+    description.format = format;
+    description.samples = VK_SAMPLE_COUNT_1_BIT;
+    description.loadOp = attachment.load_op;
+    description.storeOp =
+        store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    const bool stencil = has_stencil(format);
+    description.stencilLoadOp =
+        stencil ? attachment.load_op : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    description.stencilStoreOp =
+        stencil ? description.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    // Layouts are changed by the graph's barriers, not by the pass
+    description.initialLayout = layout;
+    description.finalLayout = layout;
+    attachments.push_back(description);
+    return VkAttachmentReference{
+        static_cast<uint32_t>(attachments.size() - 1), layout};
+  };
+  for (const RenderGraphAttachment &attachment : desc.color_attachments) {
+    color_refs.push_back(
+        add_attachment(attachment, ImageAccess::ColorAttachment));
+  }
+  const bool has_depth =
+      desc.depth_stencil_attachment.image != kInvalidRenderGraphHandle;
+  if (has_depth) {
+    depth_ref = add_attachment(desc.depth_stencil_attachment,
+                               ImageAccess::DepthStencilAttachment);
+  }
+
+  // Compatibility only depends on formats and counts, but ops are part of
+  // the object. Equal descriptions share one.
+  std::vector<uint32_t> key{static_cast<uint32_t>(color_refs.size())};
+  for (const VkAttachmentDescription &description : attachments) {
+    key.insert(key.end(),
+               {static_cast<uint32_t>(description.format),
+                static_cast<uint32_t>(description.loadOp),
+                static_cast<uint32_t>(description.storeOp),
+                static_cast<uint32_t>(description.initialLayout)});
+  }
+  auto cached = m_render_passes.find(key);
+  if (cached != m_render_passes.end()) {
+    return cached->second;
+  }
+
+  VkSubpassDescription subpass{};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = static_cast<uint32_t>(color_refs.size());
+  subpass.pColorAttachments = color_refs.data();
+  subpass.pDepthStencilAttachment = has_depth ? &depth_ref : nullptr;
+
+  VkRenderPassCreateInfo render_pass_info{
+      VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
+  render_pass_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+  render_pass_info.pAttachments = attachments.data();
+  render_pass_info.subpassCount = 1;
+  render_pass_info.pSubpasses = &subpass;
+  VkRenderPass render_pass = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(
+      vkCreateRenderPass(m_device, &render_pass_info, nullptr, &render_pass));
+  m_render_passes.emplace(std::move(key), render_pass);
+  return render_pass;
+}
+
+void RenderGraphVk::create_framebuffers(CompiledPass &compiled,
+                                        const RenderGraphPassDesc &desc) {
+  std::vector<RenderGraphImage> attachments;
+  for (const RenderGraphAttachment &attachment : desc.color_attachments) {
+    attachments.push_back(attachment.image);
+  }
+  if (desc.depth_stencil_attachment.image != kInvalidRenderGraphHandle) {
+    attachments.push_back(desc.depth_stencil_attachment.image);
+  }
+
+  // As many as the imported attachment with the most images
+  size_t framebuffer_count = 1;
+  compiled.extent = m_extent;
+  for (RenderGraphImage i : attachments) {
+    const ImageResource &image = m_images[i];
+    if (image.views.empty()) {
+      throw std::runtime_error("Render graph attachment " + image.name +
+                               " has no image views");
+    }
+    framebuffer_count = std::max(framebuffer_count, image.views.size());
+  }
+  const ImageResource &first = m_images[attachments.front()];
+  if (!first.imported && first.transient.extent.width != 0) {
+    compiled.extent = first.transient.extent;
+  }
+
+  for (size_t index = 0; index < framebuffer_count; ++index) {
+    std::vector<VkImageView> views;
+    for (RenderGraphImage i : attachments) {
+      const ImageResource &image = m_images[i];
+      views.push_back(image.views[index % image.views.size()]);
+    }
+    VkFramebufferCreateInfo framebuffer_info{};
+    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_info.renderPass = compiled.render_pass;
+    framebuffer_info.attachmentCount = static_cast<uint32_t>(views.size());
+    framebuffer_info.pAttachments = views.data();
+    framebuffer_info.width = compiled.extent.width;
+    framebuffer_info.height = compiled.extent.height;
+    framebuffer_info.layers = 1;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    VK_CHECK_RESULT(vkCreateFramebuffer(m_device, &framebuffer_info, nullptr,
+                                        &framebuffer));
+    compiled.framebuffers.push_back(framebuffer);
+  }
+}
+
+void RenderGraphVk::retire_compiled() {
+  // Called between frames, the deletion queue's frame may still be the last
+  // recorded one
+  const uint64_t frame_number = m_deletion_queue.get_frame_number();
+  for (const CompiledPass &compiled : m_compiled) {
+    for (VkFramebuffer framebuffer : compiled.framebuffers) {
+      m_deletion_queue.retire_framebuffer(framebuffer, frame_number);
+    }
+  }
+  m_compiled.clear();
+
+  for (ImageResource &image : m_images) {
+    if (image.imported) {
+      continue;
+    }
+    for (VkImageView view : image.views) {
+      m_deletion_queue.retire_image_view(view, frame_number);
+    }
+    // Bound to a block's memory, which goes after its images
+    for (VkImage vk_image : image.images) {
+      m_deletion_queue.retire_image(vk_image, VK_NULL_HANDLE, frame_number);
+    }
+    image.views.clear();
+    image.images.clear();
+  }
+  for (const MemoryBlock &block : m_memory_blocks) {
+    m_deletion_queue.retire(
+        [allocator = m_allocator, allocation = block.allocation]() {
+          vmaFreeMemory(allocator, allocation);
+        },
+        frame_number);
+  }
+  m_memory_blocks.clear();
+}
+
+void RenderGraphVk::compile(VkExtent2D extent) {
+  retire_compiled();
+  m_extent = extent;
+
+  std::vector<std::vector<bool>> stores;
+  cull(stores);
+  for (ImageResource &image : m_images) {
+    image.stored = false;
+  }
+  for (uint32_t p = 0; p < m_passes.size(); ++p) {
+    const RenderGraphPassDesc &desc = m_passes[p];
+    size_t attachment = 0;
+    for (const RenderGraphAttachment &color : desc.color_attachments) {
+      if (!m_pass_culled[p] && stores[p][attachment++]) {
+        m_images[color.image].stored = true;
+      }
+    }
+    const RenderGraphImage depth = desc.depth_stencil_attachment.image;
+    if (depth != kInvalidRenderGraphHandle && !m_pass_culled[p] &&
+        stores[p][attachment]) {
+      m_images[depth].stored = true;
+    }
+  }
+
+  create_transients();
+
+  // Each image's end state only depends on its own uses, so a first run
+  // gives every transient the state its memory is handed over in
+  for (RenderGraphImage i = 0; i < m_images.size(); ++i) {
+    simulate(i, false, nullptr);
+  }
+  std::vector<BarrierBatch> batches(m_passes.size());
+  m_final_barriers = {};
+  for (RenderGraphImage i = 0; i < m_images.size(); ++i) {
+    simulate(i, true, &batches);
+  }
+
+  m_compiled_index.assign(m_passes.size(), kInvalidRenderGraphHandle);
+  for (uint32_t p = 0; p < m_passes.size(); ++p) {
+    if (m_pass_culled[p]) {
+      continue;
+    }
+    const RenderGraphPassDesc &desc = m_passes[p];
+    CompiledPass compiled{};
+    compiled.pass = p;
+    compiled.barriers = std::move(batches[p]);
+    compiled.extent = m_extent;
+    const bool raster =
+        !desc.color_attachments.empty() ||
+        desc.depth_stencil_attachment.image != kInvalidRenderGraphHandle;
+    if (raster) {
+      compiled.render_pass = get_or_create_render_pass(desc, stores[p]);
+      create_framebuffers(compiled, desc);
+      for (const RenderGraphAttachment &color : desc.color_attachments) {
+        compiled.clear_values.push_back(color.clear_value);
+      }
+      if (desc.depth_stencil_attachment.image != kInvalidRenderGraphHandle) {
+        compiled.clear_values.push_back(
+            desc.depth_stencil_attachment.clear_value);
+      }
+    }
+    m_compiled_index[p] = static_cast<uint32_t>(m_compiled.size());
+    m_compiled.push_back(std::move(compiled));
+  }
+
+  size_t transient_count = 0;
+  for (const MemoryBlock &block : m_memory_blocks) {
+    transient_count += block.images.size();
+  }
+  spdlog::info("Render graph: {} of {} passes, {} transient images in {} "
+               "memory blocks",
+               m_compiled.size(), m_passes.size(), transient_count,
+               m_memory_blocks.size());
+}
+
+void RenderGraphVk::record_barriers(VkCommandBuffer command_buffer,
+                                    const BarrierBatch &batch,
+                                    uint32_t image_index) const {
+  if (batch.barriers.empty()) {
+    return;
+  }
+  std::vector<VkImageMemoryBarrier> barriers;
+  barriers.reserve(batch.barriers.size());
+  for (const Barrier &barrier : batch.barriers) {
+    VkImageMemoryBarrier image_barrier{};
+    image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    image_barrier.srcAccessMask = barrier.src_access;
+    image_barrier.dstAccessMask = barrier.dst_access;
+    image_barrier.oldLayout = barrier.old_layout;
+    image_barrier.newLayout = barrier.new_layout;
+    image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.image = resolve_image(barrier.image, image_index);
+    image_barrier.subresourceRange.aspectMask =
+        aspect_flags(m_images[barrier.image].format);
+    image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    barriers.push_back(image_barrier);
+  }
+  vkCmdPipelineBarrier(command_buffer, batch.src_stages, batch.dst_stages, 0,
+                       0, nullptr, 0, nullptr,
+                       static_cast<uint32_t>(barriers.size()),
+                       barriers.data());
+}
+
+void RenderGraphVk::execute(VkCommandBuffer command_buffer,
+                            uint32_t image_index) const {
+  for (const CompiledPass &compiled : m_compiled) {
+    const RenderGraphPassDesc &desc = m_passes[compiled.pass];
+    record_barriers(command_buffer, compiled.barriers, image_index);
+
+    RenderGraphContext context{};
+    context.command_buffer = command_buffer;
+    context.render_pass = compiled.render_pass;
+    context.extent = compiled.extent;
+    context.image_index = image_index;
+    if (compiled.render_pass != VK_NULL_HANDLE) {
+      context.framebuffer =
+          compiled.framebuffers[image_index % compiled.framebuffers.size()];
+      VkRenderPassBeginInfo begin_info{};
+      begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      begin_info.renderPass = compiled.render_pass;
+      begin_info.framebuffer = context.framebuffer;
+      begin_info.renderArea.extent = compiled.extent;
+      begin_info.clearValueCount =
+          static_cast<uint32_t>(compiled.clear_values.size());
+      begin_info.pClearValues = compiled.clear_values.data();
+      vkCmdBeginRenderPass(command_buffer, &begin_info,
+                           desc.secondary_command_buffers
+                               ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                               : VK_SUBPASS_CONTENTS_INLINE);
+    }
+    if (desc.execute) {
+      desc.execute(context);
+    }
+    if (compiled.render_pass != VK_NULL_HANDLE) {
+      vkCmdEndRenderPass(command_buffer);
+    }
+  }
+  record_barriers(command_buffer, m_final_barriers, image_index);
+}
+
+VkRenderPass RenderGraphVk::get_render_pass(RenderGraphPass pass) const {
+  if (pass >= m_compiled_index.size() ||
+      m_compiled_index[pass] == kInvalidRenderGraphHandle) {
+    return VK_NULL_HANDLE;
+  }
+  return m_compiled[m_compiled_index[pass]].render_pass;
+}
+
+VkFramebuffer RenderGraphVk::get_framebuffer(RenderGraphPass pass,
+                                             uint32_t image_index) const {
+  if (pass >= m_compiled_index.size() ||
+      m_compiled_index[pass] == kInvalidRenderGraphHandle) {
+    return VK_NULL_HANDLE;
+  }
+  const CompiledPass &compiled = m_compiled[m_compiled_index[pass]];
+  if (compiled.framebuffers.empty()) {
+    return VK_NULL_HANDLE;
+  }
+  return compiled.framebuffers[image_index % compiled.framebuffers.size()];
+}
+
+bool RenderGraphVk::is_culled(RenderGraphPass pass) const {
+  return pass >= m_pass_culled.size() || m_pass_culled[pass];
+}
+
+VkImage RenderGraphVk::resolve_image(RenderGraphImage image,
+                                     uint32_t image_index) const {
+  const std::vector<VkImage> &images = m_images[image].images;
+  return images[image_index % images.size()];
+}
+
+} // namespace Expectre
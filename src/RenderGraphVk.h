@@ -0,0 +1,244 @@
+#ifndef RENDER_GRAPH_VK_H
+#define RENDER_GRAPH_VK_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <vma/vk_mem_alloc.h>
+#include <vulkan/vulkan.h>
+
+#include "DeletionQueueVk.h"
+
+namespace Expectre {
+
+using RenderGraphImage = uint32_t;
+using RenderGraphPass = uint32_t;
+constexpr uint32_t kInvalidRenderGraphHandle = UINT32_MAX;
+
+/// How a pass uses an image. Decides the layout, stages and access masks of
+/// the barriers in front of the pass and the usage flags of transients.
+enum class ImageAccess {
+  ColorAttachment,
+  DepthStencilAttachment,
+  FragmentSampled,
+  ComputeSampled,
+  ComputeStorage,
+  TransferSrc,
+  TransferDst,
+};
+
+/// Image created and owned by the graph. Only alive between its first and
+/// last use in a frame, images whose lifetimes don't overlap share memory.
+struct TransientImageDesc {
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  // Zero uses the extent the graph was compiled with
+  VkExtent2D extent{0, 0};
+};
+
+/// Image owned outside the graph, such as the swapchain. One image and view
+/// per index given to execute(), or a single one used for every index.
+struct ImportedImageDesc {
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  // State the image is in when the frame's command buffer starts, the stage
+  // is what the graph's first barrier waits on (the acquire semaphore's
+  // wait stage for a swapchain image)
+  VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VkPipelineStageFlags initial_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  // Outputs keep alive every pass contributing to them and are moved to
+  // final_layout at the end of the frame
+  bool output = false;
+  VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VkPipelineStageFlags final_stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+};
+
+struct RenderGraphAttachment {
+  RenderGraphImage image = kInvalidRenderGraphHandle;
+  // LOAD reads what earlier passes left in the image. Whether it is stored
+  // is worked out from the passes after this one.
+  VkAttachmentLoadOp load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  VkClearValue clear_value{};
+};
+
+struct RenderGraphImageUse {
+  RenderGraphImage image = kInvalidRenderGraphHandle;
+  ImageAccess access = ImageAccess::FragmentSampled;
+};
+
+/// What execute() hands each pass. Raster passes are already inside their
+/// render pass.
+struct RenderGraphContext {
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+  VkRenderPass render_pass = VK_NULL_HANDLE;
+  VkFramebuffer framebuffer = VK_NULL_HANDLE;
+  VkExtent2D extent{0, 0};
+  uint32_t image_index = 0;
+};
+
+/// A pass and every image it touches, each image at most once. Passes run
+/// in the order they were added. One with attachments is a raster pass, the
+/// graph begins and ends its render pass around execute.
+struct RenderGraphPassDesc {
+  std::string name;
+  std::vector<RenderGraphAttachment> color_attachments;
+  RenderGraphAttachment depth_stencil_attachment{};
+  std::vector<RenderGraphImageUse> reads;
+  std::vector<RenderGraphImageUse> writes;
+  // execute only records vkCmdExecuteCommands
+  bool secondary_command_buffers = false;
+  // Kept even if nothing reads what it writes, for work the graph can't see
+  // into (Noesis offscreen rendering, readbacks)
+  bool side_effects = false;
+  std::function<void(const RenderGraphContext &)> execute;
+};
+
+/// Passes declared with the images they read and write. compile() culls the
+/// passes no output or side effect depends on, works out the barriers and
+/// attachment load/store ops between the rest, and places transient images
+/// in shared memory by lifetime. Declared once, compiled again when the
+/// extent or the imported images change.
+class RenderGraphVk {
+public:
+  RenderGraphVk(VkDevice device, VmaAllocator allocator,
+                DeletionQueueVk &deletion_queue);
+  /// Destroys everything at once, the device must be idle
+  ~RenderGraphVk();
+
+  RenderGraphVk(const RenderGraphVk &) = delete;
+  RenderGraphVk &operator=(const RenderGraphVk &) = delete;
+
+  RenderGraphImage create_image(std::string name,
+                                const TransientImageDesc &desc);
+  RenderGraphImage import_image(std::string name,
+                                const ImportedImageDesc &desc);
+  /// Views are only needed for images used as attachments
+  void set_imported_images(RenderGraphImage image,
+                           std::vector<VkImage> images,
+                           std::vector<VkImageView> views);
+  RenderGraphPass add_pass(RenderGraphPassDesc desc);
+
+  /// Rebuilds transients and framebuffers, the old ones are retired to the
+  /// deletion queue. Render passes are cached by their attachments, so
+  /// pipelines built against get_render_pass() stay valid.
+  void compile(VkExtent2D extent);
+  /// Records every pass that survived culling with its barriers.
+  /// image_index picks the imported image to use.
+  void execute(VkCommandBuffer command_buffer, uint32_t image_index) const;
+
+  /// Null before compile() and for passes without attachments
+  VkRenderPass get_render_pass(RenderGraphPass pass) const;
+  VkFramebuffer get_framebuffer(RenderGraphPass pass,
+                                uint32_t image_index) const;
+  bool is_culled(RenderGraphPass pass) const;
+
+private:
+  struct ImageState {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // Last write, or the layout transition that stands in for one
+    VkPipelineStageFlags write_stages = 0;
+    VkAccessFlags write_access = 0;
+    // Reads since then, a write has to wait for them
+    VkPipelineStageFlags read_stages = 0;
+  };
+
+  struct ImageResource {
+    std::string name;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    bool imported = false;
+    TransientImageDesc transient{};
+    ImportedImageDesc imported_desc{};
+    std::vector<VkImage> images;
+    std::vector<VkImageView> views;
+    // Compiled
+    VkImageUsageFlags usage = 0;
+    // Some attachment use stores it for a later pass
+    bool stored = false;
+    uint32_t first_pass = kInvalidRenderGraphHandle;
+    uint32_t last_pass = 0;
+    ImageState final_state{};
+    // Transient that last used this image's memory, itself if none
+    RenderGraphImage previous_occupant = kInvalidRenderGraphHandle;
+  };
+
+  struct Barrier {
+    RenderGraphImage image = kInvalidRenderGraphHandle;
+    VkImageLayout old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageLayout new_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkAccessFlags src_access = 0;
+    VkAccessFlags dst_access = 0;
+  };
+
+  struct BarrierBatch {
+    VkPipelineStageFlags src_stages = 0;
+    VkPipelineStageFlags dst_stages = 0;
+    std::vector<Barrier> barriers;
+  };
+
+  struct CompiledPass {
+    RenderGraphPass pass = kInvalidRenderGraphHandle;
+    BarrierBatch barriers;
+    VkRenderPass render_pass = VK_NULL_HANDLE;
+    // One per imported image index, or a single one
+    std::vector<VkFramebuffer> framebuffers;
+    std::vector<VkClearValue> clear_values;
+    VkExtent2D extent{0, 0};
+  };
+
+  // Shared by transients whose lifetimes don't overlap
+  struct MemoryBlock {
+    VkMemoryRequirements requirements{};
+    bool lazily_allocated = false;
+    uint32_t last_pass = 0;
+    std::vector<RenderGraphImage> images;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+  };
+
+  struct Use {
+    RenderGraphImage image = kInvalidRenderGraphHandle;
+    ImageAccess access = ImageAccess::FragmentSampled;
+    bool reads = false;
+    bool writes = false;
+  };
+
+  std::vector<Use> uses_of(const RenderGraphPassDesc &desc) const;
+  // Marks culled passes, and per pass and attachment whether a later pass
+  // still needs what it wrote (colors first, then depth)
+  void cull(std::vector<std::vector<bool>> &stores);
+  void create_transients();
+  // Barriers for one image's uses in pass order, from its initial state
+  void simulate(RenderGraphImage image, bool record,
+                std::vector<BarrierBatch> *batches);
+  ImageState initial_state(RenderGraphImage image) const;
+  VkRenderPass get_or_create_render_pass(const RenderGraphPassDesc &desc,
+                                         const std::vector<bool> &stores);
+  void create_framebuffers(CompiledPass &compiled,
+                           const RenderGraphPassDesc &desc);
+  void retire_compiled();
+  void record_barriers(VkCommandBuffer command_buffer,
+                       const BarrierBatch &batch, uint32_t image_index) const;
+  VkImage resolve_image(RenderGraphImage image, uint32_t image_index) const;
+
+  VkDevice m_device;
+  VmaAllocator m_allocator;
+  DeletionQueueVk &m_deletion_queue;
+  VkExtent2D m_extent{0, 0};
+
+  std::vector<ImageResource> m_images;
+  std::vector<RenderGraphPassDesc> m_passes;
+  std::vector<bool> m_pass_culled;
+
+  std::vector<CompiledPass> m_compiled;
+  // Pass index -> index into m_compiled
+  std::vector<uint32_t> m_compiled_index;
+  BarrierBatch m_final_barriers;
+  std::vector<MemoryBlock> m_memory_blocks;
+  // Attachment formats, ops and layouts -> render pass, never destroyed
+  // before the graph
+  std::map<std::vector<uint32_t>, VkRenderPass> m_render_passes;
+};
+
+} // namespace Expectre
+
+#endif // RENDER_GRAPH_VK_H
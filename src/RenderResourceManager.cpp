@@ -1,25 +1,66 @@
 
 #include <RenderResourceManager.h>
 
+#include "BlockCompression.h"
+#include "LimitsVk.h"
 #include "TextureManager.h"
+#include "ThreadPool.h"
 #include "ToolsVk.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
 #include <spdlog/spdlog.h>
 
 namespace Expectre {
 
+namespace {
+
+// Octahedral mapping of a unit vector to [-1, 1]^2, decoded in
+// vert_pulled.vert
+glm::vec2 octahedral_encode(glm::vec3 n) {
+  const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if (l1 == 0.0f) {
+    return glm::vec2(0.0f);
+  }
+  n /= l1;
+  glm::vec2 encoded(n.x, n.y);
+  if (n.z < 0.0f) {
+    const glm::vec2 sign(encoded.x >= 0.0f ? 1.0f : -1.0f,
+                         encoded.y >= 0.0f ? 1.0f : -1.0f);
+    encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * sign;
+  }
+  return encoded;
+}
+
+QuantizedVertex quantize_vertex(const Vertex &vertex,
+                                const MeshAllocation &alloc) {
+  const glm::vec3 position =
+      (vertex.pos - alloc.position_min) / alloc.position_scale;
+  const glm::vec2 uv = (vertex.tex_coord - alloc.uv_min) / alloc.uv_scale;
+  QuantizedVertex quantized{};
+  quantized.position_xy = glm::packUnorm2x16(glm::vec2(position));
+  quantized.position_z = glm::packUnorm2x16(glm::vec2(position.z, 0.0f));
+  quantized.normal = glm::packSnorm2x16(octahedral_encode(vertex.normal));
+  quantized.tex_coord = glm::packUnorm2x16(uv);
+  quantized.color = glm::packUnorm4x8(glm::vec4(vertex.color, 1.0f));
+  return quantized;
+}
+
+} // namespace
+
 RenderResourceManager::~RenderResourceManager() {
-  destroy_depth_stencil_texture();
+  // Mip chain jobs hold a pointer back to us
+  ThreadPool::Instance().wait_idle();
+  SDL_DestroyMutex(m_finished_mips_mutex);
 
   for (auto &[handle, texture_allocation] : m_texture_allocations) {
-    if (texture_allocation.view != VK_NULL_HANDLE) {
-      vkDestroyImageView(m_device, texture_allocation.view, nullptr);
-    }
-    if (texture_allocation.image != VK_NULL_HANDLE) {
-      vmaDestroyImage(m_allocator, texture_allocation.image,
-                      texture_allocation.allocation);
-    }
+    destroy_texture(texture_allocation);
   }
 
+  if (m_upload_ring.buffer != VK_NULL_HANDLE) {
+    vmaDestroyBuffer(m_allocator, m_upload_ring.buffer,
+                     m_upload_ring.allocation);
+  }
   if (m_transfer_cmd_pool != VK_NULL_HANDLE) {
     vkDestroyCommandPool(m_device, m_transfer_cmd_pool, nullptr);
   }
@@ -31,15 +72,195 @@ RenderResourceManager::~RenderResourceManager() {
     vmaDestroyBuffer(m_allocator, m_index_buffer.buffer,
                      m_index_buffer.allocation);
   }
+  // Virtual blocks assert if they still hold allocations when destroyed
+  if (m_vertex_buffer.virtual_block != VK_NULL_HANDLE) {
+    vmaClearVirtualBlock(m_vertex_buffer.virtual_block);
+    vmaDestroyVirtualBlock(m_vertex_buffer.virtual_block);
+  }
+  if (m_index_buffer.virtual_block != VK_NULL_HANDLE) {
+    vmaClearVirtualBlock(m_index_buffer.virtual_block);
+    vmaDestroyVirtualBlock(m_index_buffer.virtual_block);
+  }
 }
 
 RenderResourceManager::RenderResourceManager(
     VkDevice device, VkPhysicalDevice phys_device, VmaAllocator allocator,
-    uint32_t graphics_queue_family_index, VkQueue queue)
+    uint32_t graphics_queue_family_index, VkQueue queue,
+    const DeviceFeaturesVk &device_features, DeletionQueueVk &deletion_queue,
+    const ResidencyConfig &residency_config,
+    const TextureStreamingConfig &streaming_config,
+    const GeometryConfig &geometry_config)
     : m_device(device), m_phys_device(phys_device), m_allocator(allocator),
-      m_graphics_queue(queue) {
+      m_graphics_queue(queue), m_geometry_config(geometry_config),
+      m_deletion_queue(deletion_queue),
+      m_frames_in_flight(residency_config.frames_in_flight) {
   create_transfer_command_pool(graphics_queue_family_index);
   m_depth_format = pick_depth_format();
+  m_residency =
+      std::make_unique<ResidencyManagerVk>(allocator, residency_config);
+  m_streamer = std::make_unique<TextureStreamer>(streaming_config);
+  m_bindless_slots = std::make_unique<BindlessSlotAllocator>(
+      bindless_texture_capacity(phys_device), m_frames_in_flight);
+
+  m_finished_mips_mutex = SDL_CreateMutex();
+  if (!m_finished_mips_mutex) {
+    throw std::runtime_error(std::string("Failed to create mip mutex: ") +
+                             SDL_GetError());
+  }
+
+  VkFormatProperties format_properties{};
+  vkGetPhysicalDeviceFormatProperties(m_phys_device, VK_FORMAT_R8G8B8A8_SRGB,
+                                      &format_properties);
+  constexpr VkFormatFeatureFlags blit_features =
+      VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  m_gpu_mip_blits = (format_properties.optimalTilingFeatures &
+                     blit_features) == blit_features;
+  spdlog::info("Texture mips generated on the {}",
+               m_gpu_mip_blits ? "GPU (linear blits)" : "CPU");
+
+  VkPhysicalDeviceFeatures features{};
+  vkGetPhysicalDeviceFeatures(m_phys_device, &features);
+  m_supports_bc = features.textureCompressionBC == VK_TRUE;
+
+  if (device_features.host_image_copy) {
+    // Only worth it if the image can be written directly in the layout it is
+    // sampled in, and if host access doesn't push it out of device local
+    // memory
+    VkPhysicalDeviceHostImageCopyPropertiesEXT host_copy_properties{
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT};
+    VkPhysicalDeviceProperties2 properties{
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+    properties.pNext = &host_copy_properties;
+    vkGetPhysicalDeviceProperties2(m_phys_device, &properties);
+    std::vector<VkImageLayout> dst_layouts(
+        host_copy_properties.copyDstLayoutCount);
+    host_copy_properties.pCopyDstLayouts = dst_layouts.data();
+    vkGetPhysicalDeviceProperties2(m_phys_device, &properties);
+
+    const bool writes_shader_read_only =
+        std::find(dst_layouts.begin(), dst_layouts.end(),
+                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) !=
+        dst_layouts.end();
+    if (writes_shader_read_only &&
+        host_copy_properties.identicalMemoryTypeRequirements) {
+      m_transition_image_layout =
+          reinterpret_cast<PFN_vkTransitionImageLayoutEXT>(
+              vkGetDeviceProcAddr(m_device, "vkTransitionImageLayoutEXT"));
+      m_copy_memory_to_image = reinterpret_cast<PFN_vkCopyMemoryToImageEXT>(
+          vkGetDeviceProcAddr(m_device, "vkCopyMemoryToImageEXT"));
+    }
+  }
+  spdlog::info("Textures uploaded {}",
+               m_copy_memory_to_image ? "from host memory (host image copy)"
+                                      : "through a staging buffer");
+}
+
+VkDeviceSize
+RenderResourceManager::reserve_upload_ring(VkDeviceSize byte_count) {
+  // Keeps every copy's buffer offset a multiple of the texel block size
+  constexpr VkDeviceSize kAlignment = 16;
+  byte_count = (byte_count + kAlignment - 1) & ~(kAlignment - 1);
+
+  // Reservations don't wrap, the rest of the ring is skipped instead
+  VkDeviceSize padding = 0;
+  if (m_upload_ring_size > 0) {
+    const VkDeviceSize offset = m_upload_ring_head % m_upload_ring_size;
+    if (offset + byte_count > m_upload_ring_size) {
+      padding = m_upload_ring_size - offset;
+    }
+  }
+  if (m_upload_ring_head + padding + byte_count - m_upload_ring_tail >
+      m_upload_ring_size) {
+    // Uploads already submitted still read the old ring
+    m_deletion_queue.retire_buffer(m_upload_ring.buffer,
+                                   m_upload_ring.allocation, m_frame_number);
+
+    VkDeviceSize new_size =
+        std::max<VkDeviceSize>(m_upload_ring_size * 2, 16u << 20);
+    while (new_size < byte_count) {
+      new_size *= 2;
+    }
+
+    VkBufferCreateInfo buffer_info{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_info.size = new_size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo alloc_info{};
+    alloc_info.usage = VMA_MEMORY_USAGE_AUTO;
+    alloc_info.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                       VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    VmaAllocationInfo allocation_info{};
+    VK_CHECK_RESULT(vmaCreateBuffer(m_allocator, &buffer_info, &alloc_info,
+                                    &m_upload_ring.buffer,
+                                    &m_upload_ring.allocation,
+                                    &allocation_info));
+    m_upload_ring_mapped =
+        static_cast<uint8_t *>(allocation_info.pMappedData);
+    m_upload_ring_size = new_size;
+    m_upload_ring_head = 0;
+    m_upload_ring_tail = 0;
+    m_upload_ring_generation++;
+    padding = 0;
+  }
+
+  m_upload_ring_head += padding;
+  const VkDeviceSize offset = m_upload_ring_head % m_upload_ring_size;
+  m_upload_ring_head += byte_count;
+  return offset;
+}
+
+void RenderResourceManager::submit_upload(VkCommandBuffer cmd_buffer) {
+  VK_CHECK_RESULT(vkEndCommandBuffer(cmd_buffer));
+
+  VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &cmd_buffer;
+  VK_CHECK_RESULT(
+      vkQueueSubmit(m_graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
+
+  // The frame is submitted to the same queue after the upload, so once it
+  // has finished the upload has too
+  const uint64_t ring_head = m_upload_ring_head;
+  const uint64_t ring_generation = m_upload_ring_generation;
+  m_deletion_queue.retire(
+      [this, cmd_buffer, ring_head, ring_generation]() {
+        vkFreeCommandBuffers(m_device, m_transfer_cmd_pool, 1, &cmd_buffer);
+        if (ring_generation == m_upload_ring_generation) {
+          m_upload_ring_tail = ring_head;
+        }
+      },
+      m_frame_number);
+}
+
+void RenderResourceManager::begin_frame(uint64_t frame_number) {
+  m_frame_number = frame_number;
+
+  m_bindless_slots->begin_frame(frame_number);
+  finish_texture_uploads();
+  m_residency->begin_frame(frame_number);
+  m_streamer->update(frame_number);
+}
+
+void RenderResourceManager::destroy_texture(TextureAllocation &allocation) {
+  if (allocation.view != VK_NULL_HANDLE) {
+    vkDestroyImageView(m_device, allocation.view, nullptr);
+    allocation.view = VK_NULL_HANDLE;
+  }
+  if (allocation.image != VK_NULL_HANDLE) {
+    vmaDestroyImage(m_allocator, allocation.image, allocation.allocation);
+    allocation.image = VK_NULL_HANDLE;
+    allocation.allocation = VK_NULL_HANDLE;
+  }
+}
+
+void RenderResourceManager::retire_texture(
+    const TextureAllocation &allocation) {
+  m_deletion_queue.retire_image_view(allocation.view, m_frame_number);
+  m_deletion_queue.retire_image(allocation.image, allocation.allocation,
+                                m_frame_number);
 }
 
 void RenderResourceManager::create_transfer_command_pool(
@@ -55,15 +276,21 @@ void RenderResourceManager::create_transfer_command_pool(
 }
 
 void RenderResourceManager::create_vertex_buffer(uint32_t size_bytes) {
+  // Storage as well, vertex pulling reads it as one array of words
   auto buf = ToolsVk::create_buffer(
       m_allocator, size_bytes,
-      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+          VK_BUFFER_USAGE_TRANSFER_DST_BIT,
       VMA_MEMORY_USAGE_GPU_ONLY, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
   m_vertex_buffer.buffer = buf.buffer;
   m_vertex_buffer.allocation = buf.allocation;
-  m_vertex_buffer.byte_offset = 0;
   m_vertex_buffer.byte_size = size_bytes;
+
+  VmaVirtualBlockCreateInfo block_info{};
+  block_info.size = size_bytes;
+  VK_CHECK_RESULT(
+      vmaCreateVirtualBlock(&block_info, &m_vertex_buffer.virtual_block));
 }
 
 void RenderResourceManager::create_index_buffer(uint32_t size_bytes) {
@@ -74,217 +301,277 @@ void RenderResourceManager::create_index_buffer(uint32_t size_bytes) {
 
   m_index_buffer.buffer = buf.buffer;
   m_index_buffer.allocation = buf.allocation;
-  m_index_buffer.byte_offset = 0;
   m_index_buffer.byte_size = size_bytes;
+
+  VmaVirtualBlockCreateInfo block_info{};
+  block_info.size = size_bytes;
+  VK_CHECK_RESULT(
+      vmaCreateVirtualBlock(&block_info, &m_index_buffer.virtual_block));
 }
 
-TextureAllocation RenderResourceManager::create_texture_allocation(
-    uint32_t width, uint32_t height, const uint8_t *pixel_data,
-    uint32_t channels, uint32_t mip_levels, VkImageUsageFlags extra_usage,
-    VkImageLayout final_layout) {
+MeshAllocation
+RenderResourceManager::upload_mesh_to_gpu(MeshHandle mesh_handle) {
+  auto existing = m_mesh_indices.find(mesh_handle);
+  if (existing != m_mesh_indices.end()) {
+    m_mesh_refs[mesh_handle]++;
+    return m_mesh_allocations[existing->second];
+  }
 
-  VkImageAspectFlags aspect_mask = ToolsVk::choose_aspect_flags(channels);
+  const uint32_t mesh_index =
+      static_cast<uint32_t>(m_mesh_allocations.size());
+  m_mesh_indices[mesh_handle] = mesh_index;
+  m_mesh_refs[mesh_handle] = 1;
+  m_mesh_handles.push_back(mesh_handle);
+  m_mesh_allocations.emplace_back();
+  MeshAllocation &alloc = m_mesh_allocations[mesh_index];
+  alloc.mesh_index = mesh_index;
 
-  const bool uses_color = (aspect_mask & VK_IMAGE_ASPECT_COLOR_BIT) != 0;
-  if (width == 0 || height == 0 || (uses_color && pixel_data == nullptr)) {
-    spdlog::warn("Cannot populate texture GPU data: invalid texture inputs");
-    return {};
+  // Bounds and UV density for texture streaming. The density is the ratio of
+  // total UV area to total surface area, i.e. how many UV units one unit of
+  // surface covers on average.
+  const auto &mesh = MeshManager::Instance().get_mesh(mesh_handle);
+  if (!mesh.vertices.empty()) {
+    glm::vec3 bounds_min = mesh.vertices[0].pos;
+    glm::vec3 bounds_max = mesh.vertices[0].pos;
+    glm::vec2 uv_min = mesh.vertices[0].tex_coord;
+    glm::vec2 uv_max = mesh.vertices[0].tex_coord;
+    for (const Vertex &vertex : mesh.vertices) {
+      bounds_min = glm::min(bounds_min, vertex.pos);
+      bounds_max = glm::max(bounds_max, vertex.pos);
+      uv_min = glm::min(uv_min, vertex.tex_coord);
+      uv_max = glm::max(uv_max, vertex.tex_coord);
+    }
+    alloc.bounds_center = (bounds_min + bounds_max) * 0.5f;
+    alloc.bounds_radius = glm::length(bounds_max - bounds_min) * 0.5f;
+
+    // Quantized only where the ranges keep the error small, anything else
+    // stays float and is drawn by the same pipeline
+    const glm::vec3 extent = bounds_max - bounds_min;
+    const glm::vec2 uv_extent = uv_max - uv_min;
+    const GeometryConfig &config = m_geometry_config;
+    const bool fits =
+        glm::all(glm::lessThanEqual(
+            extent, glm::vec3(config.max_quantized_extent))) &&
+        glm::all(glm::lessThanEqual(
+            uv_extent, glm::vec2(config.max_quantized_uv_extent)));
+    if (config.vertex_pulling && fits) {
+      alloc.vertex_format = VertexFormat::Quantized;
+      alloc.position_min = bounds_min;
+      alloc.position_scale = glm::mix(extent, glm::vec3(1.0f),
+                                      glm::equal(extent, glm::vec3(0.0f)));
+      alloc.uv_min = uv_min;
+      alloc.uv_scale = glm::mix(uv_extent, glm::vec2(1.0f),
+                                glm::equal(uv_extent, glm::vec2(0.0f)));
+    }
   }
 
-  VkImage image = VK_NULL_HANDLE;
-  VkImageView image_view = VK_NULL_HANDLE;
-  VmaAllocation image_allocation = VK_NULL_HANDLE;
+  if (!write_mesh_to_gpu(mesh_index)) {
+    spdlog::warn("upload_mesh_to_gpu(): geometry buffers are full, mesh {} "
+                 "will be uploaded once space frees up",
+                 mesh_index);
+  }
 
-  // 1. Create GPU texture image
-  VkImageCreateInfo image_info{};
-  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-  image_info.imageType = VK_IMAGE_TYPE_2D;
-  image_info.extent.width = width;
-  image_info.extent.height = height;
-  image_info.extent.depth = 1;
-  image_info.mipLevels = mip_levels;
-  image_info.arrayLayers = 1;
-  image_info.format = uses_color ? VK_FORMAT_R8G8B8A8_SRGB : m_depth_format;
-  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  image_info.usage =
-      uses_color ? (VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-                    VK_IMAGE_USAGE_SAMPLED_BIT | extra_usage)
-                 : (VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | extra_usage);
-  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
-  image_info.flags = 0;
+  double surface_area = 0.0;
+  double uv_area = 0.0;
+  for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+    const Vertex &v0 = mesh.vertices[mesh.indices[i]];
+    const Vertex &v1 = mesh.vertices[mesh.indices[i + 1]];
+    const Vertex &v2 = mesh.vertices[mesh.indices[i + 2]];
 
-  VmaAllocationCreateInfo image_alloc_info{};
-  image_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    surface_area +=
+        0.5 * glm::length(glm::cross(v1.pos - v0.pos, v2.pos - v0.pos));
 
-  VK_CHECK_RESULT(vmaCreateImage(m_allocator, &image_info, &image_alloc_info,
-                                 &image, &image_allocation, nullptr));
-
-  if (aspect_mask & VK_IMAGE_ASPECT_COLOR_BIT) {
-    // 2. Upload pixel data via staging buffer
-    size_t imageSize = static_cast<size_t>(width) * height * channels;
-
-    // Create staging buffer
-    AllocatedBuffer staging = ToolsVk::create_buffer(
-        m_allocator, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VMA_MEMORY_USAGE_CPU_ONLY, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-
-    // Copy pixel data to staging buffer
-    void *mapped_data = nullptr;
-    VK_CHECK_RESULT(
-        vmaMapMemory(m_allocator, staging.allocation, &mapped_data));
-    memcpy(mapped_data, pixel_data, imageSize);
-    vmaUnmapMemory(m_allocator, staging.allocation);
-
-    // 3. Transition image to transfer destination layout
-    ToolsVk::transition_image_layout(
-        m_device, m_transfer_cmd_pool, m_graphics_queue, image, aspect_mask,
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-    // 4. Copy from staging buffer to image
-    ToolsVk::copy_buffer_to_image(m_device, m_transfer_cmd_pool,
-                                  m_graphics_queue, staging.buffer, image,
-                                  width, height);
-
-    // 5. Transition to shader readable layout
-    ToolsVk::transition_image_layout(
-        m_device, m_transfer_cmd_pool, m_graphics_queue, image, aspect_mask,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, final_layout);
-
-    // 6. Cleanup staging buffer
-    vmaDestroyBuffer(m_allocator, staging.buffer, staging.allocation);
-  } else {
-    // Depth textures don't need pixel upload, just layout transition
-    ToolsVk::transition_image_layout(m_device, m_transfer_cmd_pool,
-                                     m_graphics_queue, image, aspect_mask,
-                                     VK_IMAGE_LAYOUT_UNDEFINED, final_layout);
+    const glm::vec2 uv_edge1 = v1.tex_coord - v0.tex_coord;
+    const glm::vec2 uv_edge2 = v2.tex_coord - v0.tex_coord;
+    uv_area +=
+        0.5 * std::abs(uv_edge1.x * uv_edge2.y - uv_edge1.y * uv_edge2.x);
+  }
+  if (surface_area > 0.0) {
+    alloc.uv_density = static_cast<float>(std::sqrt(uv_area / surface_area));
   }
 
-  // 7. Create image view via shared helper so aspect selection stays
-  // consistent with the rest of the Vulkan utilities.
-  image_view = ToolsVk::create_image_view(m_device, image, image_info.format,
-                                          aspect_mask);
+  const VkDeviceSize size_bytes =
+      static_cast<VkDeviceSize>(alloc.vertex_count) *
+          vertex_stride(alloc.vertex_format) +
+      static_cast<VkDeviceSize>(alloc.index_count) * sizeof(uint32_t);
 
-  TextureAllocation allocation{};
-  allocation.image = image;
-  allocation.view = image_view;
-  allocation.allocation = image_allocation;
-  allocation.format = image_info.format;
+  ResidencyCallbacks callbacks{};
+  callbacks.evict = [this, mesh_index]() { evict_mesh(mesh_index); };
+  callbacks.restore = [this, mesh_index]() {
+    return write_mesh_to_gpu(mesh_index);
+  };
+  // A mesh that didn't fit starts out evicted and is retried on first use
+  const bool resident = alloc.vertex_allocation != VK_NULL_HANDLE;
+  alloc.residency_id =
+      m_residency->track(ResidencyPool::GeometryArena, size_bytes,
+                         std::move(callbacks), resident);
 
-  return allocation;
+  return alloc;
 }
 
-void RenderResourceManager::create_depth_stencil_texture(uint32_t width,
-                                                         uint32_t height) {
-  destroy_depth_stencil_texture();
+void RenderResourceManager::release_mesh(MeshHandle mesh_handle) {
+  auto ref = m_mesh_refs.find(mesh_handle);
+  if (ref == m_mesh_refs.end() || --ref->second > 0) {
+    return;
+  }
+  m_mesh_refs.erase(ref);
+
+  auto index = m_mesh_indices.find(mesh_handle);
+  const uint32_t mesh_index = index->second;
+  m_mesh_indices.erase(index);
 
-  m_depth_stencil = create_texture_allocation(
-      width, height, nullptr, 1 /*channels*/, 1 /*mip levels*/,
-      0 /*extra usage*/, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+  MeshAllocation &alloc = m_mesh_allocations[mesh_index];
+  m_residency->untrack(alloc.residency_id);
+  alloc.residency_id = kInvalidResidencyId;
+  evict_mesh(mesh_index);
 }
 
-void RenderResourceManager::destroy_depth_stencil_texture() {
-  if (m_depth_stencil.view != VK_NULL_HANDLE) {
-    vkDestroyImageView(m_device, m_depth_stencil.view, nullptr);
-    m_depth_stencil.view = VK_NULL_HANDLE;
-  }
-  if (m_depth_stencil.image != VK_NULL_HANDLE) {
-    vmaDestroyImage(m_allocator, m_depth_stencil.image,
-                    m_depth_stencil.allocation);
-    m_depth_stencil.image = VK_NULL_HANDLE;
-    m_depth_stencil.allocation = VK_NULL_HANDLE;
+const MeshAllocation *RenderResourceManager::use_mesh(uint32_t mesh_index) {
+  const MeshAllocation &alloc = m_mesh_allocations[mesh_index];
+  if (!m_residency->use(alloc.residency_id)) {
+    return nullptr;
   }
-  m_depth_stencil.format = VK_FORMAT_UNDEFINED;
+  return &alloc;
 }
 
-MeshAllocation
-RenderResourceManager::upload_mesh_to_gpu(MeshHandle mesh_handle) {
-  // if (mesh.vertices.empty() || mesh.indices.empty()) {
-  //   spdlog::warn("Attempted to upload empty mesh to GPU");
-  //   return {};
-  // }
+bool RenderResourceManager::allocate_geometry(VmaVirtualBlock block,
+                                              VkDeviceSize size,
+                                              VmaVirtualAllocation &allocation,
+                                              VkDeviceSize &offset) {
+  VmaVirtualAllocationCreateInfo alloc_info{};
+  alloc_info.size = size;
+  // vkCmdBindIndexBuffer offset must be multiple of index type size AND 4.
+  // For uint32 it's 4.
+  alloc_info.alignment = 4;
 
-  const auto &mesh = MeshManager::Instance().get_mesh(mesh_handle);
+  if (vmaVirtualAllocate(block, &alloc_info, &allocation, &offset) ==
+      VK_SUCCESS) {
+    return true;
+  }
 
-  // Sizes
-  uint32_t vertex_bytes =
-      static_cast<uint32_t>(sizeof(Vertex) * mesh.vertices.size());
-  uint32_t index_bytes =
-      static_cast<uint32_t>(sizeof(uint32_t) * mesh.indices.size());
+  // Buffer is full (or too fragmented): push out meshes that haven't been
+  // drawn recently and try again. Their ranges are only freed once the
+  // frames in flight are done with them, until then the retry can still
+  // fail and the mesh is restored on a later use.
+  m_residency->evict_lru(ResidencyPool::GeometryArena, size);
+  return vmaVirtualAllocate(block, &alloc_info, &allocation, &offset) ==
+         VK_SUCCESS;
+}
 
-  // Alignments:
-  // - vkCmdBindIndexBuffer offset must be multiple of index type size AND 4.
-  // For uint32 it's 4.
-  // - Keep vertex staging region aligned to 4 so index region starts aligned.
-  vertex_bytes = AlignUp(vertex_bytes, 4);
-  index_bytes = AlignUp(index_bytes, 4);
+bool RenderResourceManager::write_mesh_to_gpu(uint32_t mesh_index) {
+  const auto &mesh =
+      MeshManager::Instance().get_mesh(m_mesh_handles[mesh_index]);
+  MeshAllocation &alloc = m_mesh_allocations[mesh_index];
+
+  // Sizes
+  const uint32_t stride = vertex_stride(alloc.vertex_format);
+  const uint32_t vertex_bytes =
+      static_cast<uint32_t>(stride * mesh.vertices.size());
+  const uint32_t index_bytes =
+      AlignUp(static_cast<uint32_t>(sizeof(uint32_t) * mesh.indices.size()), 4);
 
-  // Ensure capacity in destination buffers (you’ll eventually want
-  // growth/realloc here)
   assert(m_vertex_buffer.buffer && m_index_buffer.buffer);
-  assert(m_vertex_buffer.byte_offset + vertex_bytes <=
-         m_vertex_buffer.byte_size);
-  m_index_buffer.byte_offset = AlignUp(m_index_buffer.byte_offset, 4);
-  assert(m_index_buffer.byte_offset + index_bytes <= m_index_buffer.byte_size);
-
-  // Record starting offsets BEFORE increment
-  const uint32_t vertex_dst_start_bytes = m_vertex_buffer.byte_offset;
-  const uint32_t index_dst_start_bytes = m_index_buffer.byte_offset;
-
-  // Single staging buffer containing [vertices][indices]
-  const uint32_t staging_bytes = vertex_bytes + index_bytes;
-
-  AllocatedBuffer staging = ToolsVk::create_buffer(
-      m_allocator, staging_bytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VMA_MEMORY_USAGE_CPU_ONLY,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-  void *mapped = nullptr;
-  VK_CHECK_RESULT(vmaMapMemory(m_allocator, staging.allocation, &mapped));
-  auto *dst = static_cast<uint8_t *>(mapped);
-
-  std::memcpy(dst, mesh.vertices.data(), sizeof(Vertex) * mesh.vertices.size());
-  std::memcpy(dst + vertex_bytes, mesh.indices.data(),
+
+  // vkCmdDrawIndexed's vertexOffset counts whole vertices, so the vertex
+  // region has to start on a multiple of the stride. Virtual blocks only
+  // take power of two alignments, so over-allocate by one vertex and round
+  // the start up inside the allocation.
+  VkDeviceSize vertex_alloc_start = 0;
+  if (!allocate_geometry(m_vertex_buffer.virtual_block, vertex_bytes + stride,
+                         alloc.vertex_allocation, vertex_alloc_start)) {
+    return false;
+  }
+  VkDeviceSize index_dst_start_bytes = 0;
+  if (!allocate_geometry(m_index_buffer.virtual_block, index_bytes,
+                         alloc.index_allocation, index_dst_start_bytes)) {
+    vmaVirtualFree(m_vertex_buffer.virtual_block, alloc.vertex_allocation);
+    alloc.vertex_allocation = VK_NULL_HANDLE;
+    return false;
+  }
+  const VkDeviceSize vertex_dst_start_bytes =
+      (vertex_alloc_start + stride - 1) / stride * stride;
+
+  // One upload ring reservation containing [vertices][indices]. Restoring
+  // an evicted mesh happens mid-frame, so the copies aren't waited on.
+  const uint32_t vertex_staging_bytes = AlignUp(vertex_bytes, 4);
+  const uint32_t staging_bytes = vertex_staging_bytes + index_bytes;
+
+  const VkDeviceSize ring_offset = reserve_upload_ring(staging_bytes);
+  uint8_t *dst = m_upload_ring_mapped + ring_offset;
+  if (alloc.vertex_format == VertexFormat::Quantized) {
+    auto *quantized = reinterpret_cast<QuantizedVertex *>(dst);
+    for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+      quantized[i] = quantize_vertex(mesh.vertices[i], alloc);
+    }
+  } else {
+    std::memcpy(dst, mesh.vertices.data(),
+                sizeof(Vertex) * mesh.vertices.size());
+  }
+  std::memcpy(dst + vertex_staging_bytes, mesh.indices.data(),
               sizeof(uint32_t) * mesh.indices.size());
+  VK_CHECK_RESULT(vmaFlushAllocation(m_allocator, m_upload_ring.allocation,
+                                     ring_offset, staging_bytes));
 
-  vmaUnmapMemory(m_allocator, staging.allocation);
+  VkCommandBuffer cmd_buffer =
+      ToolsVk::begin_single_time_commands(m_device, m_transfer_cmd_pool);
 
   // Copy vertices
   VkBufferCopy vcopy{};
-  vcopy.srcOffset = 0;
-  vcopy.dstOffset = static_cast<VkDeviceSize>(vertex_dst_start_bytes);
+  vcopy.srcOffset = ring_offset;
+  vcopy.dstOffset = vertex_dst_start_bytes;
   vcopy.size = static_cast<VkDeviceSize>(vertex_bytes);
-
-  ToolsVk::copy_buffer(m_device, m_transfer_cmd_pool, m_graphics_queue,
-                       staging.buffer, m_vertex_buffer.buffer, vcopy);
+  vkCmdCopyBuffer(cmd_buffer, m_upload_ring.buffer, m_vertex_buffer.buffer, 1,
+                  &vcopy);
 
   // Copy indices
   VkBufferCopy icopy{};
-  icopy.srcOffset = static_cast<VkDeviceSize>(vertex_bytes);
-  icopy.dstOffset = static_cast<VkDeviceSize>(index_dst_start_bytes);
+  icopy.srcOffset = ring_offset + vertex_staging_bytes;
+  icopy.dstOffset = index_dst_start_bytes;
   icopy.size = static_cast<VkDeviceSize>(index_bytes);
+  vkCmdCopyBuffer(cmd_buffer, m_upload_ring.buffer, m_index_buffer.buffer, 1,
+                  &icopy);
 
-  ToolsVk::copy_buffer(m_device, m_transfer_cmd_pool, m_graphics_queue,
-                       staging.buffer, m_index_buffer.buffer, icopy);
-
-  // Advance allocators
-  m_vertex_buffer.byte_offset += vertex_bytes;
-  m_index_buffer.byte_offset += index_bytes;
+  // Draws submitted after this read the ranges as vertex input, or pull
+  // the vertices in the vertex shader
+  VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDEX_READ_BIT |
+                          VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+                          VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                           VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                       0, 1, &barrier, 0, nullptr, 0, nullptr);
+  submit_upload(cmd_buffer);
 
   // Track allocation in ELEMENT offsets (what vkCmdDrawIndexed expects)
-  MeshAllocation alloc{};
   alloc.vertex_count = static_cast<uint32_t>(mesh.vertices.size());
   alloc.index_count = static_cast<uint32_t>(mesh.indices.size());
-  alloc.vertex_offset = vertex_dst_start_bytes / sizeof(Vertex);
-  alloc.index_offset = index_dst_start_bytes / sizeof(uint32_t);
-  m_mesh_allocations.push_back(alloc);
+  alloc.vertex_offset = static_cast<uint32_t>(vertex_dst_start_bytes / stride);
+  alloc.index_offset =
+      static_cast<uint32_t>(index_dst_start_bytes / sizeof(uint32_t));
 
-  // Destroy staging
-  vmaDestroyBuffer(m_allocator, staging.buffer, staging.allocation);
+  return true;
+}
 
-  return alloc;
+void RenderResourceManager::evict_mesh(uint32_t mesh_index) {
+  MeshAllocation &alloc = m_mesh_allocations[mesh_index];
+  // Frames in flight may still draw from the ranges, they are freed (and
+  // can be written over) once those frames have finished
+  const VmaVirtualAllocation vertex_allocation = alloc.vertex_allocation;
+  const VmaVirtualAllocation index_allocation = alloc.index_allocation;
+  alloc.vertex_allocation = VK_NULL_HANDLE;
+  alloc.index_allocation = VK_NULL_HANDLE;
+  m_deletion_queue.retire(
+      [this, vertex_allocation, index_allocation]() {
+        if (vertex_allocation != VK_NULL_HANDLE) {
+          vmaVirtualFree(m_vertex_buffer.virtual_block, vertex_allocation);
+        }
+        if (index_allocation != VK_NULL_HANDLE) {
+          vmaVirtualFree(m_index_buffer.virtual_block, index_allocation);
+        }
+      },
+      m_frame_number);
 }
 
 TextureAllocation
@@ -298,6 +585,7 @@ RenderResourceManager::upload_texture_to_gpu(TextureHandle texture_handle) {
   // multiple meshes share the same texture handle.
   auto it = m_texture_allocations.find(texture_handle);
   if (it != m_texture_allocations.end()) {
+    m_texture_refs[texture_handle]++;
     return it->second;
   }
 
@@ -307,12 +595,515 @@ RenderResourceManager::upload_texture_to_gpu(TextureHandle texture_handle) {
   //   return {};
   // }
 
-  const uint32_t texture_map_index = m_texture_allocations.size();
+  const uint32_t texture_map_index = m_bindless_slots->allocate();
+  if (texture_map_index == kInvalidBindlessSlot) {
+    spdlog::warn("Bindless texture array is full ({} slots), drawing "
+                 "without the texture",
+                 m_bindless_slots->get_capacity());
+    return {};
+  }
+
+  TextureAllocation &allocation = m_texture_allocations[texture_handle];
+  allocation.texture_map_idx = static_cast<int32_t>(texture_map_index);
+  if (texture_map_index >= m_texture_handles.size()) {
+    m_texture_handles.resize(texture_map_index + 1);
+  }
+  m_texture_handles[texture_map_index] = texture_handle;
+  m_texture_refs[texture_handle] = 1;
+
+  // Cooked textures come with their chain, it only has to be uploaded. The
+  // asset cache stores decoded images as just their top level, those still
+  // get the rest of their chain built below.
+  const std::shared_ptr<const MipChain> &cooked = texture.cooked_mips;
+  if (cooked && cooked->is_complete()) {
+    if (bc_block_bytes(cooked->format) == 0 || m_supports_bc) {
+      SDL_LockMutex(m_finished_mips_mutex);
+      m_finished_mips.emplace_back(texture_handle, cooked);
+      SDL_UnlockMutex(m_finished_mips_mutex);
+      return allocation;
+    }
+    // The importer only keeps cooked BC images when the device has BC
+    // support, getting here means it wasn't told
+    spdlog::error("Texture {} is BC compressed but the device can't sample "
+                  "BC formats, it is left unloaded",
+                  texture.name);
+    return allocation;
+  }
+
+  // When the GPU blits the mips only the top level is needed, a cached top
+  // level is used as it is
+  const VkFormat format = cooked ? cooked->format : texture.format;
+  const bool gpu_mips = gpu_generates_mips(format);
+  if (cooked && gpu_mips) {
+    SDL_LockMutex(m_finished_mips_mutex);
+    m_finished_mips.emplace_back(texture_handle, cooked);
+    SDL_UnlockMutex(m_finished_mips_mutex);
+    return allocation;
+  }
+
+  // Building the chain of a large image takes a while, so it runs on a
+  // worker. TextureManager keeps the decoded pixels alive for us, a cached
+  // top level is kept alive by the job holding its chain.
+  const uint8_t *pixels = cooked ? cooked->level_data(0) : texture.data;
+  const uint32_t width = texture.width;
+  const uint32_t height = texture.height;
+  const uint32_t channels = cooked ? cooked->channels : texture.channels;
+  const uint32_t max_levels = gpu_mips ? 1 : UINT32_MAX;
+  ThreadPool::Instance().submit([this, texture_handle, cooked, pixels, width,
+                                 height, channels, format, max_levels]() {
+    auto chain = std::make_shared<const MipChain>(build_mip_chain(
+        pixels, width, height, channels, format, max_levels));
+
+    SDL_LockMutex(m_finished_mips_mutex);
+    m_finished_mips.emplace_back(texture_handle, std::move(chain));
+    SDL_UnlockMutex(m_finished_mips_mutex);
+  });
+
+  return allocation;
+}
+
+void RenderResourceManager::finish_texture_uploads() {
+  std::vector<std::pair<TextureHandle, std::shared_ptr<const MipChain>>>
+      finished;
+  SDL_LockMutex(m_finished_mips_mutex);
+  finished.swap(m_finished_mips);
+  SDL_UnlockMutex(m_finished_mips_mutex);
+
+  for (auto &[texture_handle, finished_chain] : finished) {
+    finish_texture_upload(texture_handle, std::move(finished_chain));
+  }
+}
+
+void RenderResourceManager::finish_texture_upload(
+    TextureHandle texture_handle,
+    std::shared_ptr<const MipChain> finished_chain) {
+  if (m_texture_allocations.count(texture_handle) == 0) {
+    return; // released while its chain was being built
+  }
+
+  // Keep the whole chain on the CPU, the streamer uploads whichever part of
+  // it is needed. Only the low mips are uploaded now so loading doesn't
+  // spike the upload bandwidth.
+  const MipChain &chain = *(m_texture_mips[texture_handle] =
+                                std::move(finished_chain));
+  const MipLevel &base = chain.levels[0];
+  // A chain the GPU completes has nothing on the CPU to stream from, it is
+  // resident with every mip from the start
+  const bool streamed = chain.is_complete();
+  const uint32_t first_mip =
+      streamed ? m_streamer->initial_mip(base.width, base.height,
+                                         chain.level_count())
+               : 0;
+
+  TextureAllocation &allocation = m_texture_allocations[texture_handle];
+  const int32_t texture_map_index = allocation.texture_map_idx;
+  allocation = create_mip_chain_texture(chain, first_mip);
+  allocation.texture_map_idx = texture_map_index;
+  if (allocation.image == VK_NULL_HANDLE) {
+    return;
+  }
+
+  VmaAllocationInfo alloc_info{};
+  vmaGetAllocationInfo(m_allocator, allocation.allocation, &alloc_info);
+
+  if (streamed) {
+    std::vector<VkDeviceSize> mip_bytes;
+    for (const MipLevel &level : chain.levels) {
+      mip_bytes.push_back(level.byte_size);
+    }
+    allocation.stream_id = m_streamer->track(
+        base.width, base.height, std::move(mip_bytes), first_mip,
+        alloc_info.size, [this, texture_handle](uint32_t mip) {
+          return stream_texture(texture_handle, mip);
+        });
+  }
+
+  // The mip chain is the CPU copy an evicted texture gets reloaded from
+  ResidencyCallbacks callbacks{};
+  callbacks.evict = [this, texture_handle]() {
+    evict_texture(texture_handle);
+  };
+  callbacks.restore = [this, texture_handle]() {
+    return restore_texture(texture_handle);
+  };
+  allocation.residency_id = m_residency->track(
+      ResidencyPool::DeviceMemory, alloc_info.size, std::move(callbacks));
+
+  m_updated_textures.push_back(allocation);
+}
+
+bool RenderResourceManager::use_texture(int32_t texture_map_idx) {
+  auto it = m_texture_allocations.find(m_texture_handles[texture_map_idx]);
+  if (it == m_texture_allocations.end() ||
+      it->second.residency_id == kInvalidResidencyId) {
+    return false; // released, or mip chain still being built
+  }
+  return m_residency->use(it->second.residency_id);
+}
+
+void RenderResourceManager::request_texture_footprint(int32_t texture_map_idx,
+                                                      float uv_per_pixel) {
+  auto it = m_texture_allocations.find(m_texture_handles[texture_map_idx]);
+  if (it == m_texture_allocations.end() ||
+      it->second.stream_id == kInvalidStreamId) {
+    return;
+  }
+  m_streamer->request_footprint(it->second.stream_id, uv_per_pixel);
+}
+
+void RenderResourceManager::release_texture(TextureHandle texture_handle) {
+  auto ref = m_texture_refs.find(texture_handle);
+  if (ref == m_texture_refs.end() || --ref->second > 0) {
+    return;
+  }
+  m_texture_refs.erase(ref);
+
+  auto it = m_texture_allocations.find(texture_handle);
+  TextureAllocation &allocation = it->second;
+  if (allocation.residency_id != kInvalidResidencyId) {
+    m_residency->untrack(allocation.residency_id);
+  }
+  if (allocation.stream_id != kInvalidStreamId) {
+    m_streamer->untrack(allocation.stream_id);
+  }
+  if (allocation.image != VK_NULL_HANDLE) {
+    retire_texture(allocation);
+  }
+  // Recycled once the frames that may still sample it are done
+  m_texture_handles[allocation.texture_map_idx] = {};
+  m_bindless_slots->release(allocation.texture_map_idx, m_frame_number);
+  m_texture_allocations.erase(it);
+  m_texture_mips.erase(texture_handle);
+}
+
+void RenderResourceManager::evict_texture(TextureHandle texture_handle) {
+  TextureAllocation &allocation = m_texture_allocations[texture_handle];
+  // The bindless slot is kept so the texture comes back at the same index.
+  // Draws stop sampling it while it's evicted (see use_texture()), frames
+  // already in flight may still, so the image goes once they are done.
+  retire_texture(allocation);
+  allocation.view = VK_NULL_HANDLE;
+  allocation.image = VK_NULL_HANDLE;
+  allocation.allocation = VK_NULL_HANDLE;
+}
+
+bool RenderResourceManager::restore_texture(TextureHandle texture_handle) {
+  TextureAllocation &allocation = m_texture_allocations[texture_handle];
+
+  // Comes back with the mips it had when it was evicted
+  TextureAllocation restored = create_mip_chain_texture(
+      *m_texture_mips[texture_handle], allocation.first_mip);
+  if (restored.image == VK_NULL_HANDLE) {
+    return false;
+  }
+
+  restored.texture_map_idx = allocation.texture_map_idx;
+  restored.residency_id = allocation.residency_id;
+  restored.stream_id = allocation.stream_id;
+  allocation = restored;
+  m_updated_textures.push_back(restored);
+  return true;
+}
+
+VkDeviceSize
+RenderResourceManager::stream_texture(TextureHandle texture_handle,
+                                      uint32_t first_mip) {
+  TextureAllocation &allocation = m_texture_allocations[texture_handle];
+  if (allocation.image == VK_NULL_HANDLE) {
+    // Evicted, it is restored at whatever first_mip it had
+    return 0;
+  }
+
+  // Mip ranges can't be added to an existing image, so a new one holding
+  // exactly the resident levels is swapped in. The view then covers only
+  // what is resident, which is what clamps sampling to those mips. Levels
+  // both images hold are copied on the GPU, only new ones are uploaded.
+  const MipChain &chain = *m_texture_mips[texture_handle];
+  const bool host_copy = can_host_copy(chain.format);
+  TextureAllocation streamed =
+      allocate_mip_chain_image(chain, first_mip, host_copy);
+  if (streamed.image == VK_NULL_HANDLE) {
+    return 0;
+  }
+  if (host_copy) {
+    host_copy_mip_chain(chain, first_mip, streamed.image);
+  } else {
+    upload_mip_levels(chain, streamed, &allocation);
+  }
+  streamed.view = ToolsVk::create_image_view(
+      m_device, streamed.image, streamed.format, VK_IMAGE_ASPECT_COLOR_BIT,
+      streamed.mip_levels);
+
+  streamed.texture_map_idx = allocation.texture_map_idx;
+  streamed.residency_id = allocation.residency_id;
+  streamed.stream_id = allocation.stream_id;
+  // Retired after the upload that copies from it, which is submitted first
+  retire_texture(allocation);
+  allocation = streamed;
+
+  VmaAllocationInfo alloc_info{};
+  vmaGetAllocationInfo(m_allocator, allocation.allocation, &alloc_info);
+  m_residency->resize(allocation.residency_id, alloc_info.size);
+
+  m_updated_textures.push_back(streamed);
+  return alloc_info.size;
+}
+
+TextureAllocation
+RenderResourceManager::create_mip_chain_texture(const MipChain &chain,
+                                                uint32_t first_mip) {
+  if (chain.levels.empty() || first_mip >= chain.level_count()) {
+    spdlog::warn("Cannot create texture: mip {} is not in the chain",
+                 first_mip);
+    return {};
+  }
+
+  // With host image copy the levels go straight from the CPU chain into the
+  // image. A chain cut short needs the GPU to blit the rest.
+  const bool host_copy = chain.is_complete() && can_host_copy(chain.format);
+  TextureAllocation allocation =
+      allocate_mip_chain_image(chain, first_mip, host_copy);
+  if (allocation.image == VK_NULL_HANDLE) {
+    return {};
+  }
+  if (host_copy) {
+    host_copy_mip_chain(chain, first_mip, allocation.image);
+  } else {
+    upload_mip_levels(chain, allocation);
+  }
+
+  allocation.view = ToolsVk::create_image_view(
+      m_device, allocation.image, allocation.format, VK_IMAGE_ASPECT_COLOR_BIT,
+      allocation.mip_levels);
+  return allocation;
+}
+
+TextureAllocation
+RenderResourceManager::allocate_mip_chain_image(const MipChain &chain,
+                                                uint32_t first_mip,
+                                                bool host_copy) {
+  const MipLevel &top = chain.levels[first_mip];
+  const uint32_t mip_levels =
+      chain.is_complete() ? chain.level_count() - first_mip
+                          : compute_mip_level_count(top.width, top.height);
+
+  VkImageCreateInfo image_info{};
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.extent.width = top.width;
+  image_info.extent.height = top.height;
+  image_info.extent.depth = 1;
+  image_info.mipLevels = mip_levels;
+  image_info.arrayLayers = 1;
+  image_info.format = chain.format;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  // Staged images are also a copy source, for blits and for the image that
+  // replaces them when streaming
+  image_info.usage =
+      VK_IMAGE_USAGE_SAMPLED_BIT |
+      (host_copy ? VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT
+                 : VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                       VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+
+  VmaAllocationCreateInfo image_alloc_info{};
+  image_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+  TextureAllocation allocation{};
+  if (vmaCreateImage(m_allocator, &image_info, &image_alloc_info,
+                     &allocation.image, &allocation.allocation,
+                     nullptr) != VK_SUCCESS) {
+    spdlog::warn("Failed to allocate {}x{} texture", top.width, top.height);
+    return {};
+  }
+  allocation.format = image_info.format;
+  allocation.first_mip = first_mip;
+  allocation.mip_levels = mip_levels;
+  return allocation;
+}
+
+void RenderResourceManager::upload_mip_levels(
+    const MipChain &chain, const TextureAllocation &allocation,
+    const TextureAllocation *tail) {
+  const uint32_t first_mip = allocation.first_mip;
+  const uint32_t end_mip = first_mip + allocation.mip_levels;
+  // A chain cut short only has its top level to upload, the GPU blits the
+  // rest. Otherwise the levels finer than the tail come from the CPU.
+  const bool gpu_mip_blits = !chain.is_complete();
+  const uint32_t upload_end =
+      gpu_mip_blits ? first_mip + 1
+      : tail        ? std::clamp(tail->first_mip, first_mip, end_mip)
+                    : end_mip;
+
+  VkCommandBuffer cmd_buffer =
+      ToolsVk::begin_single_time_commands(m_device, m_transfer_cmd_pool);
+  ToolsVk::record_image_layout_transition(
+      cmd_buffer, allocation.image, VK_IMAGE_ASPECT_COLOR_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+      allocation.mip_levels);
+
+  if (upload_end > first_mip) {
+    // The levels are contiguous in the chain, they are staged in one go with
+    // one copy region per level
+    const MipLevel &first = chain.levels[first_mip];
+    const MipLevel &last = chain.levels[upload_end - 1];
+    const size_t byte_count =
+        last.byte_offset + last.byte_size - first.byte_offset;
+    const VkDeviceSize ring_offset = reserve_upload_ring(byte_count);
+    std::memcpy(m_upload_ring_mapped + ring_offset,
+                chain.level_data(first_mip), byte_count);
+    VK_CHECK_RESULT(vmaFlushAllocation(m_allocator, m_upload_ring.allocation,
+                                       ring_offset, byte_count));
+
+    std::vector<VkBufferImageCopy> regions(upload_end - first_mip);
+    for (uint32_t i = 0; i < regions.size(); i++) {
+      const MipLevel &level = chain.levels[first_mip + i];
+      VkBufferImageCopy &region = regions[i];
+      region.bufferOffset =
+          ring_offset + level.byte_offset - first.byte_offset;
+      region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      region.imageSubresource.mipLevel = i;
+      region.imageSubresource.baseArrayLayer = 0;
+      region.imageSubresource.layerCount = 1;
+      region.imageExtent = {level.width, level.height, 1};
+    }
+    vkCmdCopyBufferToImage(cmd_buffer, m_upload_ring.buffer, allocation.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(regions.size()),
+                           regions.data());
+  }
+
+  if (tail != nullptr && upload_end < end_mip) {
+    // Frames already submitted may still sample the old image, the barrier
+    // waits for them. It is retired afterwards, so it stays a copy source.
+    const uint32_t tail_first = upload_end - tail->first_mip;
+    ToolsVk::record_image_layout_transition(
+        cmd_buffer, tail->image, VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, tail_first,
+        end_mip - upload_end);
+
+    std::vector<VkImageCopy> copies(end_mip - upload_end);
+    for (uint32_t i = 0; i < copies.size(); i++) {
+      const MipLevel &level = chain.levels[upload_end + i];
+      VkImageCopy &copy = copies[i];
+      copy.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      copy.srcSubresource.mipLevel = tail_first + i;
+      copy.srcSubresource.layerCount = 1;
+      copy.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      copy.dstSubresource.mipLevel = upload_end - first_mip + i;
+      copy.dstSubresource.layerCount = 1;
+      copy.extent = {level.width, level.height, 1};
+    }
+    vkCmdCopyImage(cmd_buffer, tail->image,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, allocation.image,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   static_cast<uint32_t>(copies.size()), copies.data());
+  }
+
+  if (gpu_mip_blits) {
+    const MipLevel &top = chain.levels[first_mip];
+    ToolsVk::record_mip_blits(cmd_buffer, allocation.image, top.width,
+                              top.height, allocation.mip_levels);
+  } else {
+    ToolsVk::record_image_layout_transition(
+        cmd_buffer, allocation.image, VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, allocation.mip_levels);
+  }
+  submit_upload(cmd_buffer);
+}
+
+bool RenderResourceManager::gpu_generates_mips(VkFormat format) {
+  // Block compressed formats can't be blit targets, and host image copy
+  // writes whole chains without a queue submit to blit in
+  return m_gpu_mip_blits && format == VK_FORMAT_R8G8B8A8_SRGB &&
+         !can_host_copy(format);
+}
+
+bool RenderResourceManager::can_host_copy(VkFormat format) {
+  if (m_copy_memory_to_image == nullptr) {
+    return false;
+  }
+  auto it = m_host_copy_formats.find(format);
+  if (it != m_host_copy_formats.end()) {
+    return it->second;
+  }
+
+  VkFormatProperties3 format_properties3{
+      VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3};
+  VkFormatProperties2 format_properties{
+      VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2};
+  format_properties.pNext = &format_properties3;
+  vkGetPhysicalDeviceFormatProperties2(m_phys_device, format,
+                                       &format_properties);
+  bool supported = (format_properties3.optimalTilingFeatures &
+                    VK_FORMAT_FEATURE_2_HOST_IMAGE_TRANSFER_BIT_EXT) != 0;
+
+  if (supported) {
+    // Some drivers can host copy a format but then store it in a layout the
+    // GPU samples more slowly, staging is the better trade there
+    VkPhysicalDeviceImageFormatInfo2 image_format_info{
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2};
+    image_format_info.format = format;
+    image_format_info.type = VK_IMAGE_TYPE_2D;
+    image_format_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_format_info.usage =
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT;
+    VkHostImageCopyDevicePerformanceQueryEXT performance{
+        VK_STRUCTURE_TYPE_HOST_IMAGE_COPY_DEVICE_PERFORMANCE_QUERY_EXT};
+    VkImageFormatProperties2 image_format_properties{
+        VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2};
+    image_format_properties.pNext = &performance;
+    supported = vkGetPhysicalDeviceImageFormatProperties2(
+                    m_phys_device, &image_format_info,
+                    &image_format_properties) == VK_SUCCESS &&
+                performance.optimalDeviceAccess;
+  }
+
+  m_host_copy_formats[format] = supported;
+  return supported;
+}
+
+void RenderResourceManager::host_copy_mip_chain(const MipChain &chain,
+                                                uint32_t first_mip,
+                                                VkImage image) {
+  const uint32_t mip_levels = chain.level_count() - first_mip;
+
+  // The image is brand new, nothing on the GPU can be using it yet
+  VkHostImageLayoutTransitionInfoEXT transition{
+      VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT};
+  transition.image = image;
+  transition.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  transition.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  transition.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  transition.subresourceRange.levelCount = mip_levels;
+  transition.subresourceRange.layerCount = 1;
+  VK_CHECK_RESULT(m_transition_image_layout(m_device, 1, &transition));
+
+  // Levels are read in place, for cached and cooked textures that is the
+  // file mapping itself
+  std::vector<VkMemoryToImageCopyEXT> regions(mip_levels);
+  for (uint32_t i = 0; i < mip_levels; i++) {
+    const MipLevel &level = chain.levels[first_mip + i];
+    VkMemoryToImageCopyEXT &region = regions[i];
+    region.sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT;
+    region.pHostPointer = chain.level_data(first_mip + i);
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = i;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {level.width, level.height, 1};
+  }
 
-  m_texture_allocations[texture_handle] = create_texture_allocation(
-      texture.width, texture.height, texture.data, texture.channels);
-  m_texture_allocations[texture_handle].texture_map_idx = texture_map_index;
-  return m_texture_allocations[texture_handle];
+  VkCopyMemoryToImageInfoEXT copy_info{
+      VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT};
+  copy_info.dstImage = image;
+  copy_info.dstImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  copy_info.regionCount = mip_levels;
+  copy_info.pRegions = regions.data();
+  VK_CHECK_RESULT(m_copy_memory_to_image(m_device, &copy_info));
 }
 
 } // namespace Expectre
@@ -2,10 +2,19 @@
 #ifndef RENDER_RESOURCE_MANAGER_H
 #define RENDER_RESOURCE_MANAGER_H
 
+#include "BindlessSlotAllocator.h"
+#include "DeletionQueueVk.h"
+#include "DeviceFeaturesVk.h"
 #include "Mesh.h"
 #include "MeshManager.h"
+#include "MipChain.h"
 #include "RenderableInfo.h"
+#include "ResidencyManagerVk.h"
+#include "TextureStreamer.h"
+#include "ToolsVk.h"
 
+#include <SDL3/SDL.h>
+#include <memory>
 #include <spdlog/spdlog.h>
 #include <stdexcept>
 #include <unordered_map>
@@ -13,11 +22,41 @@
 #include <vulkan/vulkan.h>
 namespace Expectre {
 
+struct GeometryConfig {
+  // vert_pulled.vert fetches vertices from the vertex buffer as a storage
+  // buffer instead of through vertex input bindings, and meshes may use any
+  // VertexFormat
+  bool vertex_pulling = true;
+  // With vertex pulling, meshes whose bounds fit in this on every axis are
+  // stored quantized, positions then snap to extent / 65535
+  float max_quantized_extent = 64.0f;
+  // Same for the uv range, a step is then at most a quarter texel at 4096
+  float max_quantized_uv_extent = 4.0f;
+};
+
 struct MeshAllocation {
-  uint32_t vertex_offset; // in vertices (not bytes)
+  uint32_t vertex_offset; // in vertices of vertex_format (not bytes)
   uint32_t vertex_count;
   uint32_t index_offset; // in indices (not bytes)
   uint32_t index_count;
+  uint32_t mesh_index = 0; // position in RenderResourceManager's mesh list
+  // Sub-allocations inside the shared vertex/index buffers, null while the
+  // mesh is evicted
+  VmaVirtualAllocation vertex_allocation = VK_NULL_HANDLE;
+  VmaVirtualAllocation index_allocation = VK_NULL_HANDLE;
+  ResidencyId residency_id = kInvalidResidencyId;
+  // Object space bounding sphere and average UV units per object space unit,
+  // used to work out how many texels of a texture land on each pixel
+  glm::vec3 bounds_center = glm::vec3(0.0f);
+  float bounds_radius = 0.0f;
+  float uv_density = 0.0f;
+  // Layout in the vertex buffer. Quantized meshes decode as
+  // min + unorm * scale, zero extents have a scale of 1.
+  VertexFormat vertex_format = VertexFormat::Float;
+  glm::vec3 position_min = glm::vec3(0.0f);
+  glm::vec3 position_scale = glm::vec3(1.0f);
+  glm::vec2 uv_min = glm::vec2(0.0f);
+  glm::vec2 uv_scale = glm::vec2(1.0f);
 };
 
 struct MaterialAllocation {
@@ -32,14 +71,16 @@ struct MaterialAllocation {
 struct VertexBuffer {
   VkBuffer buffer = VK_NULL_HANDLE;
   VmaAllocation allocation = VK_NULL_HANDLE;
-  uint32_t byte_offset = 0; // current "end" of used region in bytes
-  uint32_t byte_size = 0;   // total buffer size in bytes
+  // Tracks which byte ranges of the buffer are in use, so evicted meshes
+  // can hand their space back
+  VmaVirtualBlock virtual_block = VK_NULL_HANDLE;
+  uint32_t byte_size = 0; // total buffer size in bytes
 };
 
 struct IndexBuffer {
   VkBuffer buffer = VK_NULL_HANDLE;
   VmaAllocation allocation = VK_NULL_HANDLE;
-  uint32_t byte_offset = 0;
+  VmaVirtualBlock virtual_block = VK_NULL_HANDLE;
   uint32_t byte_size = 0;
 };
 
@@ -49,6 +90,12 @@ struct TextureAllocation {
   VmaAllocation allocation = VK_NULL_HANDLE;
   VkFormat format = VK_FORMAT_UNDEFINED;
   int32_t texture_map_idx = -1;
+  ResidencyId residency_id = kInvalidResidencyId;
+  StreamId stream_id = kInvalidStreamId;
+  // Finest level of the texture's mip chain held by image, everything finer
+  // is still on the CPU only
+  uint32_t first_mip = 0;
+  uint32_t mip_levels = 1;
 };
 
 class RenderResourceManager {
@@ -56,18 +103,63 @@ public:
   RenderResourceManager() = delete;
   RenderResourceManager(VkDevice device, VkPhysicalDevice phys_device,
                         VmaAllocator allocator,
-                        uint32_t graphics_queue_family_index, VkQueue queue);
+                        uint32_t graphics_queue_family_index, VkQueue queue,
+                        const DeviceFeaturesVk &device_features,
+                        DeletionQueueVk &deletion_queue,
+                        const ResidencyConfig &residency_config,
+                        const TextureStreamingConfig &streaming_config,
+                        const GeometryConfig &geometry_config);
 
   ~RenderResourceManager();
 
+  /// Call once per frame after the frame's slot is free on the GPU and after
+  /// draw preparation. Evicts least-recently-used resources when over the
+  /// VRAM budget, reloads evicted resources that were requested by earlier
+  /// frames and streams texture mips in/out.
+  void begin_frame(uint64_t frame_number);
+
+  /// Returns the mesh's current allocation if it is resident, or nullptr
+  /// (and queues a reload) if it has been evicted.
+  const MeshAllocation *use_mesh(uint32_t mesh_index);
+
+  /// Returns true if the texture in the given bindless slot is resident and
+  /// may be sampled this frame. False while its mip chain is still being
+  /// built or while it is evicted.
+  bool use_texture(int32_t texture_map_idx);
+
+  /// Reports how many UV units one pixel covers for a draw sampling the
+  /// texture this frame, see TextureStreamer::request_footprint().
+  void request_texture_footprint(int32_t texture_map_idx, float uv_per_pixel);
+
+  /// Textures that finished uploading, were reloaded or re-streamed since the
+  /// last call, their bindless descriptors need to be (re)written.
+  std::vector<TextureAllocation> consume_updated_textures() {
+    return std::move(m_updated_textures);
+  }
+
+  /// Size of the bindless texture array, from the device limits
+  uint32_t get_bindless_capacity() const {
+    return m_bindless_slots->get_capacity();
+  }
+
   void create_vertex_buffer(uint32_t size_bytes);
   void create_index_buffer(uint32_t size_bytes);
   const IndexBuffer &get_index_buffer() { return m_index_buffer; }
   const VertexBuffer &get_vertex_buffer() { return m_vertex_buffer; }
+  /// Uploads the mesh, or returns its existing allocation if it was already
+  /// uploaded. Every call takes a reference, see release_mesh().
   MeshAllocation upload_mesh_to_gpu(MeshHandle mesh_hanlde);
+  /// Reserves the texture's bindless slot and starts building its mip chain
+  /// on a worker. The GPU image is created in a later begin_frame() and
+  /// reported through consume_updated_textures(). Uploading a texture again
+  /// returns the same allocation and takes another reference. The slot is -1
+  /// if the bindless array is full.
   TextureAllocation upload_texture_to_gpu(TextureHandle texture_handle);
-  void create_depth_stencil_texture(uint32_t width, uint32_t height);
-  void destroy_depth_stencil_texture();
+  /// Drop a reference taken by upload_*_to_gpu(). The last one frees the GPU
+  /// memory once the frames in flight are done with it, draws using it must
+  /// be gone by then.
+  void release_mesh(MeshHandle mesh_handle);
+  void release_texture(TextureHandle texture_handle);
 
   const std::vector<MeshAllocation> &get_mesh_allocations() const {
     return m_mesh_allocations;
@@ -82,10 +174,13 @@ public:
     return std::nullopt;
   }
 
-  const TextureAllocation &get_depth_stencil_texture() const {
-    return m_depth_stencil;
+  const GeometryConfig &get_geometry_config() const {
+    return m_geometry_config;
   }
 
+  /// Depth-stencil format the device supports, for depth attachments
+  VkFormat get_depth_format() const { return m_depth_format; }
+
   void register_renderable_as_draw_call(const RenderableInfo &info);
 
 private:
@@ -99,6 +194,55 @@ private:
 
   void create_transfer_command_pool(uint32_t graphics_queue_family_index);
 
+  // Sub-allocates from a geometry buffer, evicting least-recently-used
+  // meshes if the buffer is full
+  bool allocate_geometry(VmaVirtualBlock block, VkDeviceSize size,
+                         VmaVirtualAllocation &allocation,
+                         VkDeviceSize &offset);
+
+  // (Re)uploads the CPU copy of a mesh into the geometry buffers
+  bool write_mesh_to_gpu(uint32_t mesh_index);
+  void evict_mesh(uint32_t mesh_index);
+
+  bool restore_texture(TextureHandle texture_handle);
+  void evict_texture(TextureHandle texture_handle);
+
+  // Creates the GPU images of textures whose mip chains finished building
+  void finish_texture_uploads();
+  void finish_texture_upload(TextureHandle texture_handle,
+                             std::shared_ptr<const MipChain> chain);
+
+  // Replaces the GPU texture with one holding the chain from first_mip
+  // down. Returns the new allocation's size, 0 if none was made.
+  VkDeviceSize stream_texture(TextureHandle texture_handle,
+                              uint32_t first_mip);
+  TextureAllocation create_mip_chain_texture(const MipChain &chain,
+                                             uint32_t first_mip);
+  // Image (no view) for the chain from first_mip down. A chain cut short
+  // to its top level gets every level, the GPU blits the rest.
+  TextureAllocation allocate_mip_chain_image(const MipChain &chain,
+                                             uint32_t first_mip,
+                                             bool host_copy);
+  // Fills every level of the allocation's image in one submit that isn't
+  // waited on. Levels tail holds are copied from its image on the GPU, the
+  // others come from the chain through the upload ring.
+  void upload_mip_levels(const MipChain &chain,
+                         const TextureAllocation &allocation,
+                         const TextureAllocation *tail = nullptr);
+  // Writes the chain straight into the image from host memory (the CPU
+  // chain or the asset cache mapping), no staging buffer or queue submit.
+  // Leaves every level SHADER_READ_ONLY_OPTIMAL.
+  void host_copy_mip_chain(const MipChain &chain, uint32_t first_mip,
+                           VkImage image);
+  // Whether textures of this format can be written with host_copy_mip_chain
+  bool can_host_copy(VkFormat format);
+  // Whether textures of this format only get their top level built on the
+  // CPU and have the rest of the chain blitted on the GPU
+  bool gpu_generates_mips(VkFormat format);
+  void destroy_texture(TextureAllocation &allocation);
+  // Destroys the texture once no frame in flight can still be sampling it
+  void retire_texture(const TextureAllocation &allocation);
+
   VkFormat pick_depth_format() const {
     constexpr VkFormat candidates[] = {
         VK_FORMAT_D32_SFLOAT_S8_UINT,
@@ -115,11 +259,13 @@ private:
     throw std::runtime_error("No supported depth-stencil format found");
   }
 
-  TextureAllocation create_texture_allocation(
-      uint32_t width, uint32_t height, const uint8_t *pixel_data,
-      uint32_t channels = 4, uint32_t mip_levels = 1,
-      VkImageUsageFlags extra_usage = 0,
-      VkImageLayout final_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  // Offset of byte_count free bytes in the upload ring. A full ring is
+  // replaced by a larger one, the old one goes once its uploads are done.
+  VkDeviceSize reserve_upload_ring(VkDeviceSize byte_count);
+  // Ends and submits an upload without waiting for it. The command buffer
+  // and the ring space reserved so far are freed once the current frame,
+  // which is submitted after it, has finished.
+  void submit_upload(VkCommandBuffer cmd_buffer);
 
   VkDevice m_device = VK_NULL_HANDLE;
   VkPhysicalDevice m_phys_device = VK_NULL_HANDLE;
@@ -129,14 +275,66 @@ private:
   VkCommandPool m_transfer_cmd_pool = VK_NULL_HANDLE;
   VkFormat m_depth_format = VK_FORMAT_UNDEFINED;
 
+  GeometryConfig m_geometry_config{};
   VertexBuffer m_vertex_buffer{};
   IndexBuffer m_index_buffer{};
   std::vector<MeshAllocation> m_mesh_allocations;
-  TextureAllocation m_depth_stencil{};
+  // Source of each entry in m_mesh_allocations, used to reload evicted meshes
+  std::vector<MeshHandle> m_mesh_handles;
+  // Index into m_mesh_allocations of each uploaded mesh
+  std::unordered_map<MeshHandle, uint32_t> m_mesh_indices;
+  // References taken by upload_*_to_gpu(), shared content is uploaded once
+  // however many entities use it
+  std::unordered_map<MeshHandle, uint32_t> m_mesh_refs;
+  std::unordered_map<TextureHandle, uint32_t> m_texture_refs;
   std::unordered_map<TextureHandle, TextureAllocation> m_texture_allocations;
   // map that provide the indices of the textures within the shader's Sampler2D
   // array
   std::unordered_map<TextureHandle, uint32_t> m_texture_shader_indices;
+
+  // Source of each bindless slot, indexed by texture_map_idx. Released
+  // slots hold a default handle until they are handed out again
+  std::vector<TextureHandle> m_texture_handles;
+  std::unique_ptr<BindlessSlotAllocator> m_bindless_slots;
+  // CPU mip chains the streamer uploads from. Cooked chains are shared with
+  // the Texture they were loaded into.
+  std::unordered_map<TextureHandle, std::shared_ptr<const MipChain>>
+      m_texture_mips;
+  // Chains finished by workers, waiting for the render thread to upload them
+  SDL_Mutex *m_finished_mips_mutex = nullptr;
+  std::vector<std::pair<TextureHandle, std::shared_ptr<const MipChain>>>
+      m_finished_mips;
+  // Whether the texture format can be linearly blitted, in which case only
+  // the top level is uploaded and the GPU builds the rest
+  bool m_gpu_mip_blits = false;
+  // Whether cooked BC textures can be sampled
+  bool m_supports_bc = false;
+
+  // Persistently mapped ring for mesh and texture uploads, which aren't
+  // waited on. Space is handed out in order and comes back in order as
+  // frames finish.
+  AllocatedBuffer m_upload_ring{};
+  uint8_t *m_upload_ring_mapped = nullptr;
+  VkDeviceSize m_upload_ring_size = 0;
+  uint64_t m_upload_ring_head = 0; // bytes ever handed out
+  uint64_t m_upload_ring_tail = 0; // bytes ever given back
+  // Bumped when the ring is replaced, space of an old ring isn't given back
+  uint64_t m_upload_ring_generation = 0;
+
+  // VK_EXT_host_image_copy, null when the device doesn't have it
+  PFN_vkTransitionImageLayoutEXT m_transition_image_layout = nullptr;
+  PFN_vkCopyMemoryToImageEXT m_copy_memory_to_image = nullptr;
+  // Per format result of can_host_copy()
+  std::unordered_map<VkFormat, bool> m_host_copy_formats;
+
+  // Replaced textures and released meshes wait here for their frames
+  DeletionQueueVk &m_deletion_queue;
+  uint64_t m_frame_number = 0;
+  uint32_t m_frames_in_flight = 0;
+
+  std::unique_ptr<ResidencyManagerVk> m_residency;
+  std::unique_ptr<TextureStreamer> m_streamer;
+  std::vector<TextureAllocation> m_updated_textures;
 };
 } // namespace Expectre
 
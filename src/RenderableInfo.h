@@ -15,6 +15,8 @@
 //   MeshHandle mesh{};
 //   Material material{};
 //   glm::mat4 transform{1.0f};
+//   // Entity it came from, identifies its draw when it is released
+//   flecs::entity_t entity = 0;
 // };
 
 // } // namespace Expectre
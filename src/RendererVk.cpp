@@ -3,10 +3,14 @@
 // #define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
 #include "RendererVk.h"
 
+#include <algorithm>
 #include <array>
 #include <bitset>
 #include <cassert>
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <set>
 
 #include <SDL3/SDL.h>
@@ -18,8 +22,10 @@
 #include "Mesh.h"
 #include "MeshManager.h"
 #include "RenderableInfo.h"
+#include "ShaderCache.h"
 #include "ShaderFileWatcher.h"
 #include "TextureManager.h"
+#include "ThreadPool.h"
 #include "ToolsVk.h"
 #include "scene/TransformComponent.h"
 
@@ -34,14 +40,20 @@ RendererVk::RendererVk(VkInstance &instance, VkPhysicalDevice &physical_device,
                        VkSurfaceKHR &surface, VkQueue &graphics_queue,
                        uint32_t &graphics_queue_index, VkQueue &present_queue,
                        uint32_t &present_queue_index, uint32_t width,
-                       uint32_t height, InputManager &input_manager)
+                       uint32_t height,
+                       const DeviceFeaturesVk &device_features,
+                       const FramePacingConfig &frame_pacing,
+                       InputManager &input_manager)
     : m_instance{instance}, m_physical_device{physical_device},
       m_device{device}, m_allocator{allocator}, m_surface{surface},
       m_graphics_queue{graphics_queue},
       m_graphics_queue_index{graphics_queue_index},
       m_present_queue{present_queue},
       m_present_queue_index{present_queue_index}, m_extent{width, height},
-      m_pending_extent{width, height}, m_input_manager{input_manager} {
+      m_pending_extent{width, height}, m_frame_pacing{frame_pacing},
+      m_input_manager{input_manager} {
+  m_frames_in_flight = std::clamp(frame_pacing.frames_in_flight, 1u,
+                                  FramePacingConfig::kMaxFramesInFlight);
 
   // Command buffers and swapchain
   create_swapchain();
@@ -53,61 +65,78 @@ RendererVk::RendererVk(VkInstance &instance, VkPhysicalDevice &physical_device,
         VK_IMAGE_ASPECT_COLOR_BIT);
   }
   m_cmd_pool = create_command_pool(device, graphics_queue_index);
+  ResidencyConfig residency_config{};
+  residency_config.frames_in_flight = m_frames_in_flight;
+  TextureStreamingConfig streaming_config{};
+  GeometryConfig geometry_config{};
+  m_vertex_pulling = geometry_config.vertex_pulling;
+  m_deletion_queue = std::make_unique<DeletionQueueVk>(device, allocator,
+                                                       m_frames_in_flight);
   m_resource_manager = std::make_unique<RenderResourceManager>(
-      device, physical_device, allocator, graphics_queue_index, graphics_queue);
-
-  m_resource_manager->create_depth_stencil_texture(m_extent.width,
-                                                   m_extent.height);
-  const auto &depth_stencil = m_resource_manager->get_depth_stencil_texture();
-  RenderPassConfig rp_config{};
-  rp_config.colorFormat = m_swapchain_image_format,
-  rp_config.depthFormat = depth_stencil.format,
-  rp_config.colorLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-  rp_config.colorInitialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-  rp_config.colorFinalLayout =
-      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, // For UI overlay
-      rp_config.depthLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-  rp_config.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-  rp_config.depthInitialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-  // 3D render pass: outputs to COLOR_ATTACHMENT_OPTIMAL for UI to overlay on
-      m_render_pass = create_renderpass(device, rp_config);
-
-  // Create separate UI render pass (loads 3D output, presents)
-  // NOTE: Must include depth attachment for framebuffer compatibility
-  // (even though UI doesn't use it)
-  RenderPassConfig ui_rp_config{};
-  ui_rp_config.colorFormat = m_swapchain_image_format,
-  ui_rp_config.depthFormat = depth_stencil.format,
-  ui_rp_config.colorLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD, // Load from 3D pass
-      ui_rp_config.colorInitialLayout =
-          VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-  ui_rp_config.colorFinalLayout =
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, // Ready to present
-      ui_rp_config.depthLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-  ui_rp_config.stencilLoadOp =
-      VK_ATTACHMENT_LOAD_OP_CLEAR, // Noesis uses stencil for clipping
-      ui_rp_config.depthInitialLayout =
-          VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-  ui_rp_config.depthFinalLayout =
-      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-  m_ui_render_pass = create_renderpass(device, ui_rp_config);
+      device, physical_device, allocator, graphics_queue_index, graphics_queue,
+      device_features, *m_deletion_queue, residency_config, streaming_config,
+      geometry_config);
+
+  create_render_graph();
 
   // === DESCRIPTOR SET LAYOUT BINDINGS ===
-  // Binding 0: MVP uniform buffer
+  // Binding 0: MVP uniform buffer, with the camera and cluster parameters
   VkDescriptorSetLayoutBinding ubo_layout_binding{};
   ubo_layout_binding.binding = 0;
   ubo_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
   ubo_layout_binding.descriptorCount = 1;
-  ubo_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  ubo_layout_binding.stageFlags =
+      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
   ubo_layout_binding.pImmutableSamplers = nullptr;
 
-  // Binding 1: Bindless texture array
+  // Binding 1: Material buffer, indexed by the draw's material ID
+  VkDescriptorSetLayoutBinding material_layout_binding{};
+  material_layout_binding.binding = kMaterialBufferBindingIndex;
+  material_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  material_layout_binding.descriptorCount = 1;
+  material_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  material_layout_binding.pImmutableSamplers = nullptr;
+
+  // Binding 2: Per draw data, indexed by firstInstance
+  VkDescriptorSetLayoutBinding draw_data_layout_binding{};
+  draw_data_layout_binding.binding = kDrawDataBindingIndex;
+  draw_data_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  draw_data_layout_binding.descriptorCount = 1;
+  draw_data_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  draw_data_layout_binding.pImmutableSamplers = nullptr;
+
+  // Binding 3: The vertex buffer, for vertex pulling
+  VkDescriptorSetLayoutBinding geometry_layout_binding{};
+  geometry_layout_binding.binding = kGeometryBufferBindingIndex;
+  geometry_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  geometry_layout_binding.descriptorCount = 1;
+  geometry_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  geometry_layout_binding.pImmutableSamplers = nullptr;
+
+  // Binding 4: Lights, indexed by the cluster light lists
+  VkDescriptorSetLayoutBinding light_layout_binding{};
+  light_layout_binding.binding = kLightBufferBindingIndex;
+  light_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  light_layout_binding.descriptorCount = 1;
+  light_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  light_layout_binding.pImmutableSamplers = nullptr;
+
+  // Binding 5: Per cluster light lists
+  VkDescriptorSetLayoutBinding light_grid_layout_binding{};
+  light_grid_layout_binding.binding = kLightGridBindingIndex;
+  light_grid_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  light_grid_layout_binding.descriptorCount = 1;
+  light_grid_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  light_grid_layout_binding.pImmutableSamplers = nullptr;
+
+  // Binding 6: Bindless texture array
   // Large descriptor count enables dynamic texture indexing in shaders
   // Paired with UPDATE_AFTER_BIND + PARTIALLY_BOUND flags for bindless support
   VkDescriptorSetLayoutBinding sampler_layout_binding{};
-  sampler_layout_binding.binding = 1;
-  // Define and upper bound for the descriptor
-  sampler_layout_binding.descriptorCount = kMaxBindlessTextures;
+  sampler_layout_binding.binding = kTextureArrayBindingIndex;
+  // Upper bound for the descriptor, as many as the device allows
+  m_bindless_capacity = m_resource_manager->get_bindless_capacity();
+  sampler_layout_binding.descriptorCount = m_bindless_capacity;
   sampler_layout_binding.descriptorType =
       VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
   sampler_layout_binding.pImmutableSamplers = nullptr;
@@ -116,8 +145,11 @@ RendererVk::RendererVk(VkInstance &instance, VkPhysicalDevice &physical_device,
   // Descriptor flags, describes bindings if they need to be partially bound,
   // or have variable descriptor counts
   std::vector<VkDescriptorBindingFlags> descriptor_binding_flags{
-      0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
-             VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT};
+      0, 0, 0, 0, 0, 0,
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+          VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT |
+          VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+          VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT};
 
   // Descriptor flags CI
   VkDescriptorSetLayoutBindingFlagsCreateInfo set_layout_binding_flags{};
@@ -127,23 +159,18 @@ RendererVk::RendererVk(VkInstance &instance, VkPhysicalDevice &physical_device,
   set_layout_binding_flags.pBindingFlags = descriptor_binding_flags.data();
 
   m_descriptor_set_layout = create_descriptor_set_layout(
-      {ubo_layout_binding, sampler_layout_binding}, set_layout_binding_flags);
+      {ubo_layout_binding, material_layout_binding, draw_data_layout_binding,
+       geometry_layout_binding, light_layout_binding,
+       light_grid_layout_binding, sampler_layout_binding},
+      set_layout_binding_flags);
   m_pipeline_layout = create_pipeline_layout(device, m_descriptor_set_layout);
+  // Seeded from the previous run, most pipelines below skip compilation
+  m_pipeline_cache = std::make_unique<PipelineCacheVk>(device, physical_device);
+  m_shader_cache = std::make_unique<ShaderCache>();
   m_pipeline = create_pipeline(device, m_render_pass, m_pipeline_layout);
-  m_swapchain_framebuffers.resize(m_swapchain_image_views.size());
-  for (auto i = 0; i < m_swapchain_image_views.size(); i++) {
-    m_swapchain_framebuffers[i] = create_framebuffer(
-        device, m_render_pass, m_swapchain_image_views[i], depth_stencil.view);
-  }
-
-  // Create UI-specific framebuffers (also compatible with both render passes)
-  m_ui_swapchain_framebuffers.resize(m_swapchain_image_views.size());
-  for (auto i = 0; i < m_swapchain_image_views.size(); i++) {
-    m_ui_swapchain_framebuffers[i] =
-        create_framebuffer(device, m_ui_render_pass, m_swapchain_image_views[i],
-                           depth_stencil.view);
+  if (m_pipeline == VK_NULL_HANDLE) {
+    throw std::runtime_error("Failed to compile shaders");
   }
-
   m_texture_sampler =
       ToolsVk::create_texture_sampler(m_physical_device, device);
   m_resource_manager->create_vertex_buffer(1024 * 1024 *
@@ -151,15 +178,24 @@ RendererVk::RendererVk(VkInstance &instance, VkPhysicalDevice &physical_device,
   m_resource_manager->create_index_buffer(1024 * 1024 *
                                           16); // 16 MB for indices
 
-  std::vector<VkDescriptorPoolSize> pool_sizes(2);
+  std::vector<VkDescriptorPoolSize> pool_sizes(3);
   pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  pool_sizes[0].descriptorCount = static_cast<uint32_t>(MAX_CONCURRENT_FRAMES);
-  pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  pool_sizes[1].descriptorCount = kMaxBindlessTextures * MAX_CONCURRENT_FRAMES;
+  pool_sizes[0].descriptorCount = m_frames_in_flight;
+  pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  pool_sizes[1].descriptorCount = 5 * m_frames_in_flight;
+  pool_sizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  pool_sizes[2].descriptorCount = m_bindless_capacity * m_frames_in_flight;
   m_descriptor_pool =
-      create_descriptor_pool(device, pool_sizes, MAX_CONCURRENT_FRAMES);
-
-  for (auto i = 0; i < MAX_CONCURRENT_FRAMES; i++) {
+      create_descriptor_pool(device, pool_sizes, m_frames_in_flight);
+
+  m_uniform_buffers.resize(m_frames_in_flight);
+  m_cmd_buffers.resize(m_frames_in_flight);
+  m_pending_bindless_writes.resize(m_frames_in_flight);
+  m_material_buffer =
+      std::make_unique<MaterialBufferVk>(allocator, m_frames_in_flight);
+  m_light_clusters =
+      std::make_unique<LightClustersVk>(allocator, m_frames_in_flight);
+  for (uint32_t i = 0; i < m_frames_in_flight; i++) {
     auto &uniform_buffer = m_uniform_buffers[i];
     uniform_buffer =
         create_uniform_buffer(allocator, sizeof(MVP_uniform_object));
@@ -167,17 +203,51 @@ RendererVk::RendererVk(VkInstance &instance, VkPhysicalDevice &physical_device,
     uniform_buffer.descriptorSet = create_descriptor_set(
         device, m_descriptor_pool, m_descriptor_set_layout,
         m_uniform_buffers[i].allocated_buffer.buffer);
+    write_storage_buffer_descriptor(i, kMaterialBufferBindingIndex,
+                                    m_material_buffer->get_buffer(i),
+                                    m_material_buffer->get_size(i));
+    write_storage_buffer_descriptor(
+        i, kGeometryBufferBindingIndex,
+        m_resource_manager->get_vertex_buffer().buffer, VK_WHOLE_SIZE);
+    write_storage_buffer_descriptor(i, kLightBufferBindingIndex,
+                                    m_light_clusters->get_light_buffer(i),
+                                    m_light_clusters->get_light_buffer_size(i));
+    write_storage_buffer_descriptor(i, kLightGridBindingIndex,
+                                    m_light_clusters->get_grid_buffer(i),
+                                    m_light_clusters->get_grid_buffer_size(i));
 
     m_cmd_buffers[i] = create_command_buffer(device, m_cmd_pool);
   }
 
+  // The render thread records the first chunk itself, workers the rest
+  const uint32_t recording_threads = static_cast<uint32_t>(
+      std::clamp(SDL_GetNumLogicalCPUCores() - 2, 1,
+                 static_cast<int>(kMaxRecordingThreads)));
+  m_recording_pool =
+      std::make_unique<ThreadPool>(recording_threads, "Command Recorder");
+  create_frame_recordings(recording_threads + 1);
+  m_gpu_profiler = std::make_unique<GpuProfilerVk>(
+      device, physical_device, m_graphics_queue_index,
+      device_features.pipeline_statistics_query, m_frames_in_flight,
+      recording_threads + 1);
+
   // Synchronization
   create_sync_objects();
 
-  m_frag_shader_watcher = std::make_unique<ShaderFileWatcher>(
-      ShaderFileWatcher(std::string(WORKSPACE_DIR) + "/shaders/frag.frag"));
-  m_vert_shader_watcher = std::make_unique<ShaderFileWatcher>(
-      ShaderFileWatcher(std::string(WORKSPACE_DIR) + "/shaders/vert.vert"));
+  // Hot reload: compiling and building the pipeline happen on workers, the
+  // render thread only swaps the finished pipeline in
+  m_pending_pipeline_mutex = SDL_CreateMutex();
+  m_shader_reload_mutex = SDL_CreateMutex();
+  m_shader_watcher = std::make_unique<ShaderFileWatcher>(
+      std::vector<std::filesystem::path>{std::string(WORKSPACE_DIR) +
+                                         "/shaders"},
+      [this](const std::filesystem::path &changed) {
+        // Only files a shader actually read, the source or an #include
+        if (m_shader_cache->is_dependency(changed)) {
+          ThreadPool::Instance().submit(
+              [this, changed]() { reload_shader(changed); });
+        }
+      });
 
   NoesisUI::InitInfo nsInit{};
   nsInit.instance = m_instance;
@@ -185,11 +255,11 @@ RendererVk::RendererVk(VkInstance &instance, VkPhysicalDevice &physical_device,
   nsInit.device = m_device;
   nsInit.graphicsQueue = m_graphics_queue;
   nsInit.queueFamilyIndex = m_graphics_queue_index;
-  nsInit.renderPass = m_ui_render_pass; // Use UI render pass for Noesis
+  nsInit.renderPass = m_render_pass; // Drawn after the scene, same pass
   nsInit.sampleCount = VK_SAMPLE_COUNT_1_BIT;
   nsInit.width = m_extent.width;
   nsInit.height = m_extent.height;
-  nsInit.maxFramesInFlight = MAX_CONCURRENT_FRAMES;
+  nsInit.maxFramesInFlight = m_frames_in_flight;
 
   m_noesisUI = std::make_unique<NoesisUI>(nsInit);
 
@@ -199,23 +269,12 @@ RendererVk::RendererVk(VkInstance &instance, VkPhysicalDevice &physical_device,
   m_ns_input_adapter = m_noesisUI->CreateInputAdapter();
   input_manager.AddObserver(m_ns_input_adapter);
 
-  // Update NoesisUI to use the UI render pass (separate from 3D scene)
-  // This requires calling WarmUpRenderPass with the UI-specific render pass
-  // (This is handled in the NoesisUI constructor via InitInfo)
+  // NoesisUI warms up its pipelines for m_render_pass in its constructor
+  // (via InitInfo)
   m_ready = true;
 }
 
-void RendererVk::cleanup_swapchain_and_depth_stencil() {
-  m_resource_manager->destroy_depth_stencil_texture();
-
-  for (auto framebuffer : m_swapchain_framebuffers) {
-    vkDestroyFramebuffer(m_device, framebuffer, nullptr);
-  }
-
-  for (auto framebuffer : m_ui_swapchain_framebuffers) {
-    vkDestroyFramebuffer(m_device, framebuffer, nullptr);
-  }
-
+void RendererVk::cleanup_swapchain() {
   for (auto imageView : m_swapchain_image_views) {
     vkDestroyImageView(m_device, imageView, nullptr);
   }
@@ -224,17 +283,26 @@ void RendererVk::cleanup_swapchain_and_depth_stencil() {
 }
 
 RendererVk::~RendererVk() {
+  // No new reloads, and the ones already queued finish before the pipeline
+  // layout and render pass they build against are destroyed
+  m_shader_watcher.reset();
+  ThreadPool::Instance().wait_idle();
 
   vkDeviceWaitIdle(m_device);
+  m_gpu_profiler.reset();
+  // Retired objects may reference the resource manager (mesh ranges)
+  m_deletion_queue->flush();
 
   // Noesis cleanup (before Vulkan resource destruction)
   m_noesisUI.reset();
+  // Transients, framebuffers and render passes, m_render_pass with them
+  m_render_graph.reset();
 
   // Destroy synchronization objects
-  for (size_t i = 0; i < MAX_CONCURRENT_FRAMES; ++i) {
-    vkDestroySemaphore(m_device, m_available_image_semaphores[i], nullptr);
-    vkDestroyFence(m_device, m_in_flight_fences[i], nullptr);
+  for (VkSemaphore semaphore : m_available_image_semaphores) {
+    vkDestroySemaphore(m_device, semaphore, nullptr);
   }
+  vkDestroySemaphore(m_device, m_frame_timeline, nullptr);
   for (size_t i = 0; i < m_swapchain_images.size(); i++) {
     vkDestroySemaphore(m_device, m_finished_render_semaphores[i], nullptr);
   }
@@ -250,6 +318,8 @@ RendererVk::~RendererVk() {
     vmaUnmapMemory(m_allocator, ub.allocated_buffer.allocation);
     vmaFreeMemory(m_allocator, ub.allocated_buffer.allocation);
   }
+  m_material_buffer.reset();
+  m_light_clusters.reset();
 
   // Destroy vertex and index buffer
 
@@ -258,22 +328,35 @@ RendererVk::~RendererVk() {
 
   // Destroy pipeline and related layouts
   vkDestroyPipeline(m_device, m_pipeline, nullptr);
+  vkDestroyPipeline(m_device, m_pending_pipeline, nullptr);
+  for (const auto &[features, variant] : m_pipeline_variants) {
+    vkDestroyPipeline(m_device, variant, nullptr);
+  }
+  for (const FinishedVariant &finished : m_finished_variants) {
+    vkDestroyPipeline(m_device, finished.pipeline, nullptr);
+  }
+  SDL_DestroyMutex(m_pending_pipeline_mutex);
+  SDL_DestroyMutex(m_shader_reload_mutex);
   vkDestroyPipelineLayout(m_device, m_pipeline_layout, nullptr);
-  vkDestroyRenderPass(m_device, m_render_pass, nullptr);
-  vkDestroyRenderPass(m_device, m_ui_render_pass,
-                      nullptr); // Clean up UI render pass
-
-  // Destroy command pool
+  // Written back to disk with everything compiled this run
+  m_pipeline_cache.reset();
+
+  // Destroy command pools, their command buffers go with them
+  m_recording_pool.reset();
+  for (const FrameRecording &recording : m_frame_recordings) {
+    for (VkCommandPool pool : recording.chunk_pools) {
+      vkDestroyCommandPool(m_device, pool, nullptr);
+    }
+    vmaUnmapMemory(m_allocator, recording.draw_data.allocation);
+    vmaDestroyBuffer(m_allocator, recording.draw_data.buffer,
+                     recording.draw_data.allocation);
+  }
   vkDestroyCommandPool(m_device, m_cmd_pool, nullptr);
 
-  // vkDestroyImageView(m_device, m_depth_stencil.view, nullptr);
-  // vmaDestroyImage(m_allocator, m_depth_stencil.image,
-  //                 m_depth_stencil.allocation);
-
-  cleanup_swapchain_and_depth_stencil();
+  cleanup_swapchain();
 }
 
-void RendererVk::create_swapchain() {
+void RendererVk::create_swapchain(VkSwapchainKHR old_swapchain) {
   ToolsVk::SwapChainSupportDetails swapchain_support_details =
       ToolsVk::query_swap_chain_support(m_physical_device, m_surface);
 
@@ -292,10 +375,9 @@ void RendererVk::create_swapchain() {
       std::min(m_extent.height,
                swapchain_support_details.capabilities.maxImageExtent.height));
 
-  // uint32_t image_count =
-  // swapchain_support_details.capabilities.minImageCount
-  // + 1;
-  uint32_t image_count = MAX_CONCURRENT_FRAMES;
+  uint32_t image_count =
+      std::max(m_frame_pacing.swapchain_images,
+               swapchain_support_details.capabilities.minImageCount);
   if (swapchain_support_details.capabilities.maxImageCount > 0 &&
       image_count > swapchain_support_details.capabilities.maxImageCount) {
     image_count = swapchain_support_details.capabilities.maxImageCount;
@@ -327,8 +409,10 @@ void RendererVk::create_swapchain() {
   create_info.preTransform =
       swapchain_support_details.capabilities.currentTransform;
   create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-  create_info.presentMode = PRESENT_MODE;
+  create_info.presentMode = ToolsVk::choose_swap_present_mode(
+      swapchain_support_details.present_modes, m_frame_pacing.vsync);
   create_info.clipped = VK_TRUE;
+  create_info.oldSwapchain = old_swapchain;
 
   VK_CHECK_RESULT(
       vkCreateSwapchainKHR(m_device, &create_info, nullptr, &m_swapchain));
@@ -351,89 +435,92 @@ VkImageView RendererVk::create_swapchain_and_image_views(
   return image_view;
 }
 
-VkRenderPass RendererVk::create_renderpass(VkDevice device,
-                                           const RenderPassConfig &config) {
-  VkAttachmentDescription color{};
-  color.format = config.colorFormat;
-  color.samples = VK_SAMPLE_COUNT_1_BIT;
-  color.loadOp = config.colorLoadOp;
-  color.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-  color.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  color.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  color.initialLayout = config.colorInitialLayout;
-  color.finalLayout = config.colorFinalLayout;
-
-  VkAttachmentDescription depth{};
-  depth.format = config.depthFormat;
-  depth.samples = VK_SAMPLE_COUNT_1_BIT;
-  depth.loadOp = config.depthLoadOp;
-  depth.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  depth.stencilLoadOp = config.stencilLoadOp;
-  depth.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  depth.initialLayout = config.depthInitialLayout;
-  depth.finalLayout = config.depthFinalLayout;
-
-  VkAttachmentReference colorRef{0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
-  VkAttachmentReference depthRef{
-      1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
-
-  VkSubpassDescription sub{};
-  sub.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-  sub.colorAttachmentCount = 1;
-  sub.pColorAttachments = &colorRef;
-  sub.pDepthStencilAttachment =
-      (config.depthFormat != VK_FORMAT_UNDEFINED) ? &depthRef : nullptr;
-
-  std::vector<VkAttachmentDescription> atts = {color};
-  if (config.depthFormat != VK_FORMAT_UNDEFINED)
-    atts.push_back(depth);
-
-  // Subpass dependencies for proper synchronization with external operations
-  VkSubpassDependency deps[2] = {};
-
-  // Dependency at the start: external → subpass 0
-  deps[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-  deps[0].dstSubpass = 0;
-  deps[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  deps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  deps[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-  deps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
-                          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
-                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-  deps[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-  // Dependency at the end: subpass 0 → external
-  deps[1].srcSubpass = 0;
-  deps[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-  deps[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  deps[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-  deps[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
-                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-  deps[1].dstAccessMask = 0;
-  deps[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-  VkRenderPass render_pass;
-  VkRenderPassCreateInfo rpci{VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
-  rpci.attachmentCount = (uint32_t)atts.size();
-  rpci.pAttachments = atts.data();
-  rpci.subpassCount = 1;
-  rpci.pSubpasses = &sub;
-  rpci.dependencyCount = 2;
-  rpci.pDependencies = deps;
-  VK_CHECK_RESULT(vkCreateRenderPass(device, &rpci, nullptr, &render_pass));
-  return render_pass;
+void RendererVk::create_render_graph() {
+  m_render_graph = std::make_unique<RenderGraphVk>(m_device, m_allocator,
+                                                   *m_deletion_queue);
+
+  // The submit waits for the acquire at color output, the first barrier
+  // waits there too
+  ImportedImageDesc swapchain_desc{};
+  swapchain_desc.format = m_swapchain_image_format;
+  swapchain_desc.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  swapchain_desc.initial_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  swapchain_desc.output = true;
+  swapchain_desc.final_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  m_swapchain_target =
+      m_render_graph->import_image("swapchain", swapchain_desc);
+  m_render_graph->set_imported_images(m_swapchain_target, m_swapchain_images,
+                                      m_swapchain_image_views);
+
+  TransientImageDesc depth_desc{};
+  depth_desc.format = m_resource_manager->get_depth_format();
+  const RenderGraphImage depth =
+      m_render_graph->create_image("depth", depth_desc);
+
+  // === Noesis pre-pass (offscreen effects, texture uploads) ===
+  // Must run BEFORE the render pass so Noesis can do its offscreen work. The
+  // graph can't see what it renders, so it is never culled.
+  RenderGraphPassDesc noesis_offscreen{};
+  noesis_offscreen.name = "noesis offscreen";
+  noesis_offscreen.side_effects = true;
+  noesis_offscreen.execute = [this](const RenderGraphContext &context) {
+    if (!m_noesisUI) {
+      return;
+    }
+    VkCommandBuffer cmd = context.command_buffer;
+    m_gpu_profiler->begin_timestamp(cmd, m_current_frame,
+                                    GpuScope::NoesisOffscreen);
+    m_gpu_profiler->begin_statistics(cmd, m_current_frame,
+                                     GpuScope::NoesisOffscreen);
+    m_noesisUI->PreRender(cmd, m_frameCounter, m_totalTimeSeconds);
+    m_gpu_profiler->end_statistics(cmd, m_current_frame,
+                                   GpuScope::NoesisOffscreen);
+    m_gpu_profiler->end_timestamp(cmd, m_current_frame,
+                                  GpuScope::NoesisOffscreen);
+  };
+  m_render_graph->add_pass(std::move(noesis_offscreen));
+
+  // === Single render pass: 3D scene + UI overlay ===
+  // The swapchain image is only written out once. Depth and stencil are
+  // cleared on load and never read later, so the graph doesn't store them
+  // and backs them with transient memory tilers keep on chip. Noesis clips
+  // with the stencil, the scene leaves it at its cleared 0.
+  RenderGraphPassDesc scene{};
+  scene.name = "scene";
+  RenderGraphAttachment color{};
+  color.image = m_swapchain_target;
+  color.load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  color.clear_value.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+  scene.color_attachments.push_back(color);
+  scene.depth_stencil_attachment.image = depth;
+  scene.depth_stencil_attachment.load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  scene.depth_stencil_attachment.clear_value.depthStencil = {1.0f, 0};
+  scene.secondary_command_buffers = true;
+  scene.execute = [this](const RenderGraphContext &context) {
+    execute_scene_pass(context);
+  };
+  m_scene_pass = m_render_graph->add_pass(std::move(scene));
+
+  m_render_graph->compile(m_extent);
+  m_render_pass = m_render_graph->get_render_pass(m_scene_pass);
 }
 
 VkPipeline RendererVk::create_pipeline(VkDevice device, VkRenderPass renderpass,
-                                       VkPipelineLayout pipeline_layout) {
-  VkShaderModule vert_shader_module = ToolsVk::createShaderModule(
-      device, (WORKSPACE_DIR + std::string("/shaders/vert.spv")));
-  VkShaderModule frag_shader_module = ToolsVk::createShaderModule(
-      device, (WORKSPACE_DIR + std::string("/shaders/frag.spv")));
+                                       VkPipelineLayout pipeline_layout,
+                                       std::optional<ShaderFeatures> features) {
+  // Straight from the shader cache unless a source or an include changed
+  const auto vert_spirv = m_shader_cache->get_spirv(
+      std::string(WORKSPACE_DIR) +
+      (m_vertex_pulling ? "/shaders/vert_pulled.vert" : "/shaders/vert.vert"));
+  const auto frag_spirv = m_shader_cache->get_spirv(
+      std::string(WORKSPACE_DIR) + "/shaders/frag.frag");
+  if (!vert_spirv || !frag_spirv) {
+    return VK_NULL_HANDLE;
+  }
+  VkShaderModule vert_shader_module =
+      ToolsVk::createShaderModule(device, *vert_spirv);
+  VkShaderModule frag_shader_module =
+      ToolsVk::createShaderModule(device, *frag_spirv);
 
   VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
   vert_shader_stage_info.sType =
@@ -449,6 +536,25 @@ VkPipeline RendererVk::create_pipeline(VkDevice device, VkRenderPass renderpass,
   frag_shader_stage_info.module = frag_shader_module;
   frag_shader_stage_info.pName = "main";
 
+  // Constant 0 selects the generic path, constants 1.. are the feature bits
+  std::array<VkBool32, kShaderFeatureCount + 1> spec_values{};
+  std::array<VkSpecializationMapEntry, kShaderFeatureCount + 1> spec_entries{};
+  spec_values[0] = features.has_value() ? VK_FALSE : VK_TRUE;
+  for (uint32_t i = 0; i < spec_entries.size(); i++) {
+    if (i > 0 && features.has_value()) {
+      spec_values[i] = (*features & (1u << (i - 1))) ? VK_TRUE : VK_FALSE;
+    }
+    spec_entries[i].constantID = i;
+    spec_entries[i].offset = i * sizeof(VkBool32);
+    spec_entries[i].size = sizeof(VkBool32);
+  }
+  VkSpecializationInfo spec_info{};
+  spec_info.mapEntryCount = static_cast<uint32_t>(spec_entries.size());
+  spec_info.pMapEntries = spec_entries.data();
+  spec_info.dataSize = sizeof(spec_values);
+  spec_info.pData = spec_values.data();
+  frag_shader_stage_info.pSpecializationInfo = &spec_info;
+
   VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_info,
                                                      frag_shader_stage_info};
 
@@ -479,15 +585,18 @@ VkPipeline RendererVk::create_pipeline(VkDevice device, VkRenderPass renderpass,
   vertex_attribute_description[3].format = VK_FORMAT_R32G32_SFLOAT;
   vertex_attribute_description[3].offset = offsetof(Vertex, tex_coord);
 
+  // Pulled vertices have no vertex input state, the shader fetches them
   VkPipelineVertexInputStateCreateInfo vertex_input_info{};
   vertex_input_info.sType =
       VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertex_input_info.vertexBindingDescriptionCount = 1;
-  vertex_input_info.vertexAttributeDescriptionCount =
-      static_cast<uint32_t>(vertex_attribute_description.size());
-  vertex_input_info.pVertexBindingDescriptions = &binding_description;
-  vertex_input_info.pVertexAttributeDescriptions =
-      vertex_attribute_description.data();
+  if (!m_vertex_pulling) {
+    vertex_input_info.vertexBindingDescriptionCount = 1;
+    vertex_input_info.vertexAttributeDescriptionCount =
+        static_cast<uint32_t>(vertex_attribute_description.size());
+    vertex_input_info.pVertexBindingDescriptions = &binding_description;
+    vertex_input_info.pVertexAttributeDescriptions =
+        vertex_attribute_description.data();
+  }
 
   VkPipelineInputAssemblyStateCreateInfo input_assembly{};
   input_assembly.sType =
@@ -570,7 +679,8 @@ VkPipeline RendererVk::create_pipeline(VkDevice device, VkRenderPass renderpass,
 
   VkPipeline pipeline;
   VK_CHECK_RESULT(vkCreateGraphicsPipelines(
-      device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline));
+      device, m_pipeline_cache->get(), 1, &pipeline_info, nullptr,
+      &pipeline));
 
   vkDestroyShaderModule(device, frag_shader_module, nullptr);
   vkDestroyShaderModule(device, vert_shader_module, nullptr);
@@ -580,11 +690,12 @@ VkPipeline RendererVk::create_pipeline(VkDevice device, VkRenderPass renderpass,
 
 VkCommandPool
 RendererVk::create_command_pool(VkDevice device,
-                                uint32_t graphics_queue_family_index) {
+                                uint32_t graphics_queue_family_index,
+                                VkCommandPoolCreateFlags flags) {
 
   VkCommandPoolCreateInfo pool_info{};
   pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.flags = flags;
   pool_info.queueFamilyIndex = graphics_queue_family_index;
 
   VkCommandPool command_pool{};
@@ -594,11 +705,12 @@ RendererVk::create_command_pool(VkDevice device,
 }
 
 VkCommandBuffer RendererVk::create_command_buffer(VkDevice device,
-                                                  VkCommandPool command_pool) {
+                                                  VkCommandPool command_pool,
+                                                  VkCommandBufferLevel level) {
   VkCommandBufferAllocateInfo cmd_buf_info{};
   cmd_buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
   cmd_buf_info.commandPool = command_pool;
-  cmd_buf_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmd_buf_info.level = level;
   cmd_buf_info.commandBufferCount = 1;
 
   VkCommandBuffer command_buffer{};
@@ -637,7 +749,7 @@ VkDescriptorSet RendererVk::create_descriptor_set(
   variable_descriptor_count_info.descriptorSetCount = 1;
   // Tells vulkan the maximum number of descriptors in the descriptor sets
   // unbounded arrays
-  variable_descriptor_count_info.pDescriptorCounts = &kMaxBindlessTextures;
+  variable_descriptor_count_info.pDescriptorCounts = &m_bindless_capacity;
 
   VkDescriptorSetAllocateInfo alloc_info{};
   alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -674,71 +786,46 @@ VkDescriptorSet RendererVk::create_descriptor_set(
   return descriptor_set;
 }
 
-VkFramebuffer RendererVk::create_framebuffer(VkDevice device,
-                                             VkRenderPass renderpass,
-                                             VkImageView view,
-                                             VkImageView depth_view) {
-  VkResult err;
-  VkFramebuffer framebuffer;
-  std::vector<VkImageView> attachments{view};
-
-  if (depth_view != VK_NULL_HANDLE) {
-    attachments.push_back(depth_view);
-  }
-
-  VkFramebufferCreateInfo framebuffer_info{};
-  framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-  framebuffer_info.renderPass = renderpass; // Use provided render pass
-  framebuffer_info.attachmentCount = static_cast<uint32_t>(attachments.size());
-  framebuffer_info.pAttachments = attachments.data();
-  framebuffer_info.width = m_extent.width;
-  framebuffer_info.height = m_extent.height;
-  framebuffer_info.layers = 1;
-
-  // Create framebuffer
-  VK_CHECK_RESULT(
-      vkCreateFramebuffer(device, &framebuffer_info, nullptr, &framebuffer));
-  return framebuffer;
-}
-
 void RendererVk::create_sync_objects() {
   // === SYNCHRONIZATION PRIMITIVE COUNTS ===
   // Different counts because they serve different purposes:
   //
-  // Frames-in-flight (typically 2): CPU can prepare frame N+1 while GPU
-  // renders frame N Swapchain images (typically 2-3): The actual framebuffers
-  // we render into
+  // Frames-in-flight (1-4, from the frame pacing config): CPU can prepare
+  // frame N+1 while GPU renders frame N. Swapchain images (typically 2-3):
+  // The actual framebuffers we render into
   //
   // We need:
-  // - Fences per frame-in-flight (CPU waits for GPU to finish frame N before
-  // reusing resources)
+  // - One timeline semaphore for all frames (CPU waits for GPU to finish
+  // frame N before reusing its resources)
   // - Acquire semaphores per frame-in-flight (signals when we get an image
   // from swapchain)
   // - Render finished semaphores per swapchain IMAGE (each image needs its
   // own to prevent reuse)
 
   m_finished_render_semaphores.resize(m_swapchain_images.size()); // Per image
-  m_available_image_semaphores.resize(MAX_CONCURRENT_FRAMES);     // Per frame
-  m_in_flight_fences.resize(MAX_CONCURRENT_FRAMES);               // Per frame
+  m_available_image_semaphores.resize(m_frames_in_flight);        // Per frame
 
   VkSemaphoreCreateInfo semaphore_info{};
   semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-  VkFenceCreateInfo fence_info{};
-  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT; // Start signaled so first
-                                                   // frame doesn't wait
+  // Timeline: starts at 0, frame N signals N + 1, so the first
+  // frames_in_flight frames don't wait
+  VkSemaphoreTypeCreateInfo timeline_type_info{};
+  timeline_type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  timeline_type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  timeline_type_info.initialValue = 0;
+  VkSemaphoreCreateInfo timeline_info{};
+  timeline_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  timeline_info.pNext = &timeline_type_info;
+  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &timeline_info, nullptr,
+                                    &m_frame_timeline));
 
   // Create per-frame synchronization objects
-  for (auto i = 0; i < MAX_CONCURRENT_FRAMES; i++) {
+  for (uint32_t i = 0; i < m_frames_in_flight; i++) {
     // Acquire semaphore: Signaled when swapchain gives us an image
     auto avail = vkCreateSemaphore(m_device, &semaphore_info, nullptr,
                                    &m_available_image_semaphores[i]);
-    // Fence: CPU waits on this to know when frame is completely done
-    auto fences =
-        vkCreateFence(m_device, &fence_info, nullptr, &m_in_flight_fences[i]);
     VK_CHECK_RESULT(avail);
-    VK_CHECK_RESULT(fences);
   }
 
   // Create per-swapchain-image synchronization objects
@@ -763,34 +850,100 @@ void RendererVk::record_draw_commands(
   begin_info.pInheritanceInfo = nullptr;
 
   VK_CHECK_RESULT(vkBeginCommandBuffer(command_buffer, &begin_info));
+  // Collects what this slot measured last time and resets its queries
+  m_gpu_profiler->begin_frame(command_buffer, m_current_frame);
+
+  // Pick up residency and variants on this thread, the chunks only read.
+  // New draws, evictions, texture fallbacks and pipeline swaps all show up
+  // as a different resolved list.
+  resolve_draws();
+  if (m_resolved_draws != m_last_resolved_draws) {
+    m_last_resolved_draws = m_resolved_draws;
+    ++m_draw_version;
+  }
 
-  // === Noesis pre-pass (offscreen effects, texture uploads) ===
-  // Must run BEFORE the render pass so Noesis can do its offscreen work.
-  if (m_noesisUI) {
-    m_noesisUI->PreRender(command_buffer, m_frameCounter, m_totalTimeSeconds);
+  // A static scene re-executes what this slot recorded last time, the
+  // uniform buffer it binds is rewritten every frame anyway and the
+  // material buffer only gets the entries that changed
+  FrameRecording &recording = m_frame_recordings[m_current_frame];
+  if (m_material_buffer->flush(m_current_frame)) {
+    // A new buffer means a descriptor write, which invalidates the
+    // secondaries recorded against the set
+    write_storage_buffer_descriptor(
+        m_current_frame, kMaterialBufferBindingIndex,
+        m_material_buffer->get_buffer(m_current_frame),
+        m_material_buffer->get_size(m_current_frame));
+    recording.draw_version = 0;
+  }
+  // Same for the light buffers, grown to this frame's lights and to the
+  // cluster lists the slot's last build needed
+  if (m_light_clusters->reserve(m_current_frame,
+                                static_cast<uint32_t>(m_lights.size()))) {
+    write_storage_buffer_descriptor(
+        m_current_frame, kLightBufferBindingIndex,
+        m_light_clusters->get_light_buffer(m_current_frame),
+        m_light_clusters->get_light_buffer_size(m_current_frame));
+    write_storage_buffer_descriptor(
+        m_current_frame, kLightGridBindingIndex,
+        m_light_clusters->get_grid_buffer(m_current_frame),
+        m_light_clusters->get_grid_buffer_size(m_current_frame));
+    recording.draw_version = 0;
+  }
+  // Lights move every frame, they are binned again even when the chunks
+  // are reused. Queued first so a worker picks it up before the chunks.
+  const uint32_t light_slot = m_current_frame;
+  m_recording_pool->submit([this, light_slot]() {
+    m_light_clusters->build(light_slot, m_lights);
+  });
+  const bool rerecord = recording.draw_version != m_draw_version;
+  if (rerecord) {
+    // This slot's previous frame has finished, its secondaries can go
+    for (VkCommandPool pool : recording.chunk_pools) {
+      VK_CHECK_RESULT(vkResetCommandPool(m_device, pool, 0));
+    }
+    write_draw_data(m_current_frame);
+
+    const size_t draw_count = m_resolved_draws.size();
+    const size_t max_chunks = std::min<size_t>(
+        recording.chunk_buffers.size(),
+        (draw_count + kMinDrawsPerChunk - 1) / kMinDrawsPerChunk);
+    const size_t chunk_size =
+        max_chunks > 0 ? (draw_count + max_chunks - 1) / max_chunks : 0;
+    // Rounding up the size can leave the last chunks empty, drop them
+    const size_t chunk_count =
+        chunk_size > 0 ? (draw_count + chunk_size - 1) / chunk_size : 0;
+
+    // Workers take every chunk but the first, which is recorded here while
+    // they run
+    for (size_t chunk = 1; chunk < chunk_count; ++chunk) {
+      const size_t first = chunk * chunk_size;
+      const size_t count = std::min(chunk_size, draw_count - first);
+      VkCommandBuffer chunk_buffer = recording.chunk_buffers[chunk];
+      const bool last_chunk = chunk + 1 == chunk_count;
+      m_recording_pool->submit(
+          [this, chunk_buffer, first, count, chunk, last_chunk]() {
+            record_draw_chunk(chunk_buffer, first, count,
+                              static_cast<uint32_t>(chunk), last_chunk);
+          });
+    }
+    if (chunk_count > 0) {
+      record_draw_chunk(recording.chunk_buffers[0], 0,
+                        std::min(chunk_size, draw_count), 0,
+                        chunk_count == 1);
+    }
+    recording.chunk_count = chunk_count;
+    recording.draw_version = m_draw_version;
   }
 
-  // === Single render pass: 3D scene + UI overlay ===
-  std::array<VkClearValue, 2> clear_col;
-  clear_col[0] = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-  clear_col[1].depthStencil = {1.0f, 0};
-  VkRenderPassBeginInfo renderpass_info = {};
-  renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  renderpass_info.pNext = nullptr;
-  renderpass_info.renderPass = m_render_pass;
-  renderpass_info.framebuffer = m_swapchain_framebuffers[image_index];
-  renderpass_info.renderArea.offset.x = 0;
-  renderpass_info.renderArea.offset.y = 0;
-  renderpass_info.renderArea.extent.width = m_extent.width;
-  renderpass_info.renderArea.extent.height = m_extent.height;
-  renderpass_info.clearValueCount = 2;
-  renderpass_info.pClearValues = clear_col.data();
-
-  vkCmdBeginRenderPass(command_buffer, &renderpass_info,
-                       VK_SUBPASS_CONTENTS_INLINE);
-
-  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    m_pipeline);
+  // Noesis pre-pass, then the scene and the UI overlay, with the barriers
+  // between them. The chunks are still recording on the workers.
+  m_render_graph->execute(command_buffer, image_index);
+
+  VK_CHECK_RESULT(vkEndCommandBuffer(command_buffer));
+}
+
+void RendererVk::execute_scene_pass(const RenderGraphContext &context) {
+  FrameRecording &recording = m_frame_recordings[m_current_frame];
 
   VkViewport viewport{};
   viewport.x = 0.0f;
@@ -800,6 +953,173 @@ void RendererVk::record_draw_commands(
   viewport.minDepth = 0.0f;
   viewport.maxDepth = 1.0f;
 
+  VkRect2D scissor{};
+  scissor.offset.x = 0;
+  scissor.offset.y = 0;
+  scissor.extent.width = m_extent.width;
+  scissor.extent.height = m_extent.height;
+
+  // === UI overlay, same pass ===
+  // Drawn straight over the scene while it is still in the attachment, no
+  // store and reload of the swapchain image in between. Recorded here
+  // because Render() replays what the pre-pass just set up.
+  if (m_noesisUI) {
+    VkCommandBufferInheritanceInfo inheritance{};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.renderPass = context.render_pass;
+    inheritance.subpass = 0;
+    inheritance.framebuffer = context.framebuffer;
+
+    VkCommandBufferBeginInfo ui_begin_info{};
+    ui_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    ui_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                          VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    ui_begin_info.pInheritanceInfo = &inheritance;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(recording.ui_buffer, &ui_begin_info));
+
+    // Dynamic state isn't inherited by secondaries
+    vkCmdSetViewport(recording.ui_buffer, 0, 1, &viewport);
+    vkCmdSetScissor(recording.ui_buffer, 0, 1, &scissor);
+    // Queries inside the pass have to be in the secondaries, the primary
+    // can only execute them there
+    m_gpu_profiler->begin_timestamp(recording.ui_buffer, m_current_frame,
+                                    GpuScope::Ui);
+    m_gpu_profiler->begin_statistics(recording.ui_buffer, m_current_frame,
+                                     GpuScope::Ui);
+    m_noesisUI->Render(recording.ui_buffer);
+    m_gpu_profiler->end_statistics(recording.ui_buffer, m_current_frame,
+                                   GpuScope::Ui);
+    m_gpu_profiler->end_timestamp(recording.ui_buffer, m_current_frame,
+                                  GpuScope::Ui);
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(recording.ui_buffer));
+  }
+
+  // Nothing queued if the slot reuses its chunks, returns at once then
+  m_recording_pool->wait_idle();
+
+  // Executed in draw order, the UI last so it lands on top
+  std::vector<VkCommandBuffer> secondaries(
+      recording.chunk_buffers.begin(),
+      recording.chunk_buffers.begin() + recording.chunk_count);
+  if (m_noesisUI) {
+    secondaries.push_back(recording.ui_buffer);
+  }
+
+  // The graph began the pass with SECONDARY_COMMAND_BUFFERS contents
+  if (!secondaries.empty()) {
+    vkCmdExecuteCommands(context.command_buffer,
+                         static_cast<uint32_t>(secondaries.size()),
+                         secondaries.data());
+  }
+}
+
+void RendererVk::resolve_draws() {
+  m_resolved_draws.clear();
+  m_resolved_draws.reserve(m_draw_calls.size());
+  // Materials are resolved once per frame, by the first draw using them.
+  // Feature bits plus one, 0 = not resolved yet.
+  std::vector<uint32_t> material_features(m_imported_materials.size(), 0);
+  for (const DrawCall &draw : m_draw_calls) {
+    // Evicted meshes are skipped this frame, the residency manager reloads
+    // them over the next few frames
+    const MeshAllocation *mesh_alloc =
+        m_resource_manager->use_mesh(draw.mesh_index);
+    if (mesh_alloc == nullptr) {
+      continue;
+    }
+
+    // Textures that are still loading or evicted fall back to vertex color
+    // and vertex normals, which picks another variant until they arrive.
+    // Only the material's entry changes, the buffer gets it on flush.
+    uint32_t &resolved_features = material_features[draw.material_id];
+    if (resolved_features == 0) {
+      const GpuMaterial &imported = m_imported_materials[draw.material_id];
+      GpuMaterial material = imported;
+      ShaderFeatures features = 0;
+      material.albedo_idx = -1;
+      material.normal_idx = -1;
+      material.metallic_roughness_idx = -1;
+      material.occlusion_idx = -1;
+      material.emissive_idx = -1;
+      material.alpha_cutoff = 0.0f;
+      if (imported.albedo_idx >= 0 &&
+          m_resource_manager->use_texture(imported.albedo_idx)) {
+        material.albedo_idx = imported.albedo_idx;
+        features |= kShaderFeatureAlbedoTexture;
+        if (imported.alpha_cutoff > 0.0f) {
+          material.alpha_cutoff = imported.alpha_cutoff;
+          features |= kShaderFeatureAlphaTest;
+        }
+      } else {
+        features |= kShaderFeatureVertexColor;
+      }
+      if (imported.normal_idx >= 0 &&
+          m_resource_manager->use_texture(imported.normal_idx)) {
+        material.normal_idx = imported.normal_idx;
+        features |= kShaderFeatureNormalMap;
+      }
+      // Read whenever present in every variant, frag.frag checks the index
+      if (imported.metallic_roughness_idx >= 0 &&
+          m_resource_manager->use_texture(imported.metallic_roughness_idx)) {
+        material.metallic_roughness_idx = imported.metallic_roughness_idx;
+      }
+      if (imported.occlusion_idx >= 0 &&
+          m_resource_manager->use_texture(imported.occlusion_idx)) {
+        material.occlusion_idx = imported.occlusion_idx;
+      }
+      if (imported.emissive_idx >= 0 &&
+          m_resource_manager->use_texture(imported.emissive_idx)) {
+        material.emissive_idx = imported.emissive_idx;
+      }
+      m_material_buffer->update(draw.material_id, material);
+      resolved_features = features + 1;
+    }
+
+    ResolvedDraw resolved{};
+    resolved.pipeline = get_pipeline_variant(resolved_features - 1);
+    resolved.material_id = draw.material_id;
+    resolved.mesh_index = draw.mesh_index;
+    resolved.index_count = mesh_alloc->index_count;
+    resolved.index_offset = mesh_alloc->index_offset;
+    resolved.vertex_offset = mesh_alloc->vertex_offset;
+    m_resolved_draws.push_back(resolved);
+  }
+
+  // Nothing changes between draws but the pipeline, grouping by it leaves
+  // one bind per variant in each chunk. Opaque and alpha tested draws only,
+  // so the order doesn't matter otherwise.
+  std::stable_sort(m_resolved_draws.begin(), m_resolved_draws.end(),
+                   [](const ResolvedDraw &a, const ResolvedDraw &b) {
+                     return std::less<VkPipeline>()(a.pipeline, b.pipeline);
+                   });
+}
+
+void RendererVk::record_draw_chunk(VkCommandBuffer command_buffer,
+                                   size_t first, size_t count, uint32_t chunk,
+                                   bool last_chunk) {
+  // No framebuffer, so the recording is valid for whichever swapchain image
+  // the slot renders to next. Submitted again until the draws change.
+  VkCommandBufferInheritanceInfo inheritance{};
+  inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritance.renderPass = m_render_pass;
+  inheritance.subpass = 0;
+  inheritance.framebuffer = VK_NULL_HANDLE;
+
+  VkCommandBufferBeginInfo begin_info{};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  begin_info.pInheritanceInfo = &inheritance;
+  VK_CHECK_RESULT(vkBeginCommandBuffer(command_buffer, &begin_info));
+
+  // Secondaries inherit no state, every chunk binds its own
+  VkViewport viewport{};
+  viewport.x = 0.0f;
+  viewport.y = 0.0f;
+  viewport.width = (float)m_extent.width;
+  viewport.height = (float)m_extent.height;
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
   vkCmdSetViewport(command_buffer, 0, 1, &viewport);
 
   VkRect2D scissor{};
@@ -807,15 +1127,26 @@ void RendererVk::record_draw_commands(
   scissor.offset.y = 0;
   scissor.extent.width = m_extent.width;
   scissor.extent.height = m_extent.height;
-
   vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
-  VkDeviceSize offsets[] = {0};
+  // Chunks execute in order, so the scene spans the first one's begin to
+  // the last one's end. Statistics can't span command buffers, each chunk
+  // counts its own and the profiler sums them.
+  if (chunk == 0) {
+    m_gpu_profiler->begin_timestamp(command_buffer, m_current_frame,
+                                    GpuScope::Scene);
+  }
+  m_gpu_profiler->begin_statistics(command_buffer, m_current_frame,
+                                   GpuScope::Scene, chunk);
+
+  // Pulled vertices come through the set, only indices are fixed function
+  if (!m_vertex_pulling) {
+    VkDeviceSize offsets[] = {0};
+    const auto &vertex_buffer = m_resource_manager->get_vertex_buffer();
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer.buffer,
+                           offsets);
+  }
   const auto &index_buffer = m_resource_manager->get_index_buffer();
-  const auto &vertex_buffer = m_resource_manager->get_vertex_buffer();
-
-  vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer.buffer, offsets);
-
   vkCmdBindIndexBuffer(command_buffer, index_buffer.buffer, 0 /*offset*/,
                        VK_INDEX_TYPE_UINT32);
 
@@ -823,73 +1154,93 @@ void RendererVk::record_draw_commands(
       command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1,
       &m_uniform_buffers[m_current_frame].descriptorSet, 0, nullptr);
 
-  for (auto const &[mesh_alloc, texture_idx] : m_draw_calls) {
-    vkCmdPushConstants(command_buffer, m_pipeline_layout,
-                       VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(int32_t),
-                       &texture_idx);
-    vkCmdDrawIndexed(command_buffer, mesh_alloc.index_count, 1,
-                     mesh_alloc.index_offset, mesh_alloc.vertex_offset,
-                     0 /* first instance */);
+  VkPipeline bound_pipeline = VK_NULL_HANDLE;
+  for (size_t i = first; i < first + count; ++i) {
+    const ResolvedDraw &draw = m_resolved_draws[i];
+    if (draw.pipeline != bound_pipeline) {
+      vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        draw.pipeline);
+      bound_pipeline = draw.pipeline;
+    }
+    // The draw's index reaches the shaders as gl_InstanceIndex, they find
+    // its material and vertex format with it. No state changes between
+    // draws of the same variant, whatever their mesh or material.
+    vkCmdDrawIndexed(command_buffer, draw.index_count, 1, draw.index_offset,
+                     draw.vertex_offset, static_cast<uint32_t>(i));
   }
 
-  vkCmdEndRenderPass(command_buffer);
+  m_gpu_profiler->end_statistics(command_buffer, m_current_frame,
+                                 GpuScope::Scene, chunk);
+  if (last_chunk) {
+    m_gpu_profiler->end_timestamp(command_buffer, m_current_frame,
+                                  GpuScope::Scene);
+  }
 
-  // === Separate UI Render Pass ===
-  if (m_noesisUI) {
-    // Dummy clear values (not used because render pass uses LOAD_OP_LOAD)
-    std::array<VkClearValue, 2> ui_clear_val;
-    ui_clear_val[0] = {{{0.0f, 0.0f, 0.0f, 0.0f}}};
-    ui_clear_val[1].depthStencil = {1.0f, 0};
-
-    VkRenderPassBeginInfo ui_renderpass_info{};
-    ui_renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    ui_renderpass_info.pNext = nullptr;
-    ui_renderpass_info.renderPass = m_ui_render_pass;
-    ui_renderpass_info.framebuffer = m_ui_swapchain_framebuffers[image_index];
-    ui_renderpass_info.renderArea.offset.x = 0;
-    ui_renderpass_info.renderArea.offset.y = 0;
-    ui_renderpass_info.renderArea.extent.width = m_extent.width;
-    ui_renderpass_info.renderArea.extent.height = m_extent.height;
-    ui_renderpass_info.clearValueCount =
-        2; // Must provide values even with LOAD_OP_LOAD
-    ui_renderpass_info.pClearValues = ui_clear_val.data();
-
-    vkCmdBeginRenderPass(command_buffer, &ui_renderpass_info,
-                         VK_SUBPASS_CONTENTS_INLINE);
-
-    static bool ui_pass_logged = false;
-    if (!ui_pass_logged) {
-      spdlog::info(
-          "[RendererVk] UI render pass begun: rp={:#x} fb={:#x} extent={}x{}",
-          (uint64_t)m_ui_render_pass,
-          (uint64_t)m_ui_swapchain_framebuffers[image_index], m_extent.width,
-          m_extent.height);
-      ui_pass_logged = true;
+  VK_CHECK_RESULT(vkEndCommandBuffer(command_buffer));
+}
+
+void RendererVk::create_frame_recordings(uint32_t chunk_count) {
+  m_frame_recordings.resize(m_frames_in_flight);
+  for (FrameRecording &recording : m_frame_recordings) {
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+      // Reset as a whole on re-record, never buffer by buffer
+      VkCommandPool pool = create_command_pool(
+          m_device, m_graphics_queue_index,
+          VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+      recording.chunk_pools.push_back(pool);
+      recording.chunk_buffers.push_back(create_command_buffer(
+          m_device, pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY));
     }
+    recording.ui_buffer = create_command_buffer(
+        m_device, m_cmd_pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+  }
+  for (uint32_t frame = 0; frame < m_frames_in_flight; ++frame) {
+    write_draw_data(frame);
+  }
+}
 
-    // Set up viewport and scissor for UI render pass
-    VkViewport ui_viewport{};
-    ui_viewport.x = 0.0f;
-    ui_viewport.y = 0.0f;
-    ui_viewport.width = (float)m_extent.width;
-    ui_viewport.height = (float)m_extent.height;
-    ui_viewport.minDepth = 0.0f;
-    ui_viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(command_buffer, 0, 1, &ui_viewport);
-
-    VkRect2D ui_scissor{};
-    ui_scissor.offset.x = 0;
-    ui_scissor.offset.y = 0;
-    ui_scissor.extent.width = m_extent.width;
-    ui_scissor.extent.height = m_extent.height;
-    vkCmdSetScissor(command_buffer, 0, 1, &ui_scissor);
-
-    m_noesisUI->Render();
-
-    vkCmdEndRenderPass(command_buffer);
+void RendererVk::write_draw_data(uint32_t frame) {
+  FrameRecording &recording = m_frame_recordings[frame];
+  const uint32_t draw_count = static_cast<uint32_t>(m_resolved_draws.size());
+  // Never empty, a zero sized buffer can't be bound
+  if (draw_count > recording.draw_data_capacity ||
+      recording.draw_data.buffer == VK_NULL_HANDLE) {
+    // Only called once the frame's previous submit has finished, and the
+    // chunks about to be recorded use the new descriptor
+    if (recording.draw_data.buffer != VK_NULL_HANDLE) {
+      vmaUnmapMemory(m_allocator, recording.draw_data.allocation);
+      vmaDestroyBuffer(m_allocator, recording.draw_data.buffer,
+                       recording.draw_data.allocation);
+    }
+    uint32_t capacity = std::max(recording.draw_data_capacity, 256u);
+    while (capacity < draw_count) {
+      capacity *= 2;
+    }
+    recording.draw_data = ToolsVk::create_buffer(
+        m_allocator, capacity * sizeof(GpuDrawData),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU,
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    VK_CHECK_RESULT(
+        vmaMapMemory(m_allocator, recording.draw_data.allocation,
+                     reinterpret_cast<void **>(&recording.draw_data_mapped)));
+    recording.draw_data_capacity = capacity;
+    write_storage_buffer_descriptor(frame, kDrawDataBindingIndex,
+                                    recording.draw_data.buffer,
+                                    capacity * sizeof(GpuDrawData));
   }
 
-  VK_CHECK_RESULT(vkEndCommandBuffer(command_buffer));
+  const auto &mesh_allocations = m_resource_manager->get_mesh_allocations();
+  for (uint32_t i = 0; i < draw_count; ++i) {
+    const ResolvedDraw &draw = m_resolved_draws[i];
+    const MeshAllocation &mesh = mesh_allocations[draw.mesh_index];
+    GpuDrawData data{};
+    data.material_id = draw.material_id;
+    data.vertex_format = static_cast<uint32_t>(mesh.vertex_format);
+    data.position_min = glm::vec4(mesh.position_min, 0.0f);
+    data.position_scale = glm::vec4(mesh.position_scale, 0.0f);
+    data.uv_range = glm::vec4(mesh.uv_min, mesh.uv_scale);
+    recording.draw_data_mapped[i] = data;
+  }
 }
 
 void RendererVk::draw_frame(const Camera &camera,
@@ -909,11 +1260,24 @@ void RendererVk::draw_frame(const Camera &camera,
    */
 
   // Wait for the GPU to finish rendering frame N before we start frame
-  // N+MAX_CONCURRENT_FRAMES (e.g., with MAX_CONCURRENT_FRAMES=2: wait for
-  // frame 0 before starting frame 2) This prevents us from overwriting
-  // command buffers/uniforms that GPU is still using
-  vkWaitForFences(m_device, 1, &m_in_flight_fences[m_current_frame], VK_TRUE,
-                  UINT64_MAX);
+  // N+frames_in_flight (e.g., with 2 frames in flight: wait for frame 0
+  // before starting frame 2) This prevents us from overwriting command
+  // buffers/uniforms that GPU is still using. Returns at once in low latency
+  // mode, the engine already waited before sampling input.
+  wait_for_frame_slot();
+  // CPU side of the frame, without the wait above
+  const uint64_t cpu_frame_start = SDL_GetPerformanceCounter();
+
+  // Everything retired by the frame that last used this slot can go now
+  m_deletion_queue->begin_frame(m_frameCounter);
+  apply_pending_pipeline();
+
+  // Resize events only record the new size, the swapchain is rebuilt here
+  // once they stop coming
+  if (m_window_resize_is_pending &&
+      SDL_GetTicks() - m_resize_requested_ms >= kResizeSettleMs) {
+    recreate_swapchain();
+  }
 
   // Get the next available image from the swapchain to render into
   // The presentation engine signals available_image_semaphore when image is
@@ -926,9 +1290,12 @@ void RendererVk::draw_frame(const Camera &camera,
                             VK_NULL_HANDLE, &image_index);
 
   if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-    recreate_swapchain_and_depth_stencil();
+    // Nothing can be presented to it anymore, don't wait for resizes to
+    // settle
+    recreate_swapchain();
     return;
-  } else {
+  } else if (result != VK_SUBOPTIMAL_KHR) {
+    // Suboptimal still presents, present() reports it again below
     VK_CHECK_RESULT(result);
   }
 
@@ -937,12 +1304,19 @@ void RendererVk::draw_frame(const Camera &camera,
          "image_index exceeds m_finished_render_semaphores — "
          "swapchain image count mismatch");
 
-  // UPDATE RESOURCES (now safe because we waited on fence)
+  // UPDATE RESOURCES (now safe because we waited on the frame timeline)
   update_uniform_buffer(camera);
 
-  // Reset fence to unsignaled state - GPU will signal it when this frame
-  // completes
-  vkResetFences(m_device, 1, &m_in_flight_fences[m_current_frame]);
+  request_texture_mips(camera);
+
+  // Evict/reload GPU resources against the VRAM budget and stream texture
+  // mips. Safe here for the same reason: nothing that gets freed was used by
+  // a frame that may still be in flight
+  m_resource_manager->begin_frame(m_frameCounter);
+  update_bindless_descriptors(
+      m_resource_manager->consume_updated_textures());
+  // This frame's set is no longer read by the GPU, catch it up
+  flush_bindless_descriptors(m_current_frame);
 
   // Prepare command buffer for recording
   vkResetCommandBuffer(m_cmd_buffers[m_current_frame], 0);
@@ -970,23 +1344,38 @@ void RendererVk::draw_frame(const Camera &camera,
   // semaphore IMPORTANT: Indexed by image_index (not m_current_frame) because
   // semaphores are tied to swapchain images, and same image could be rendered
   // multiple times
-  VkSemaphore signal_semaphores[] = {m_finished_render_semaphores[image_index]};
-  submit_info.signalSemaphoreCount = 1;
+  // The timeline is signaled alongside it with this frame's value
+  VkSemaphore signal_semaphores[] = {m_finished_render_semaphores[image_index],
+                                     m_frame_timeline};
+  submit_info.signalSemaphoreCount = 2;
   submit_info.pSignalSemaphores = signal_semaphores;
 
+  // Binary semaphores ignore their value
+  const uint64_t wait_values[] = {0};
+  const uint64_t signal_values[] = {0, m_frameCounter + 1};
+  VkTimelineSemaphoreSubmitInfo timeline_submit_info{};
+  timeline_submit_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timeline_submit_info.waitSemaphoreValueCount = 1;
+  timeline_submit_info.pWaitSemaphoreValues = wait_values;
+  timeline_submit_info.signalSemaphoreValueCount = 2;
+  timeline_submit_info.pSignalSemaphoreValues = signal_values;
+  submit_info.pNext = &timeline_submit_info;
+
   // Submit work to GPU queue
   // - Waits on: available_image_semaphore (image ready)
   // - Signals: finished_render_semaphore (rendering done)
-  // - Signals: in_flight_fence (entire frame done, CPU can reuse resources)
-  VK_CHECK_RESULT(vkQueueSubmit(m_graphics_queue, 1, &submit_info,
-                                m_in_flight_fences[m_current_frame]));
+  // - Signals: frame timeline = frame + 1 (entire frame done, CPU can reuse
+  // resources)
+  VK_CHECK_RESULT(
+      vkQueueSubmit(m_graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
 
   VkPresentInfoKHR present_info{};
   present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
   // PRESENTATION WAIT: Don't display image until rendering is complete
   present_info.waitSemaphoreCount = 1;
-  present_info.pWaitSemaphores = signal_semaphores; // Same as submit's signal
+  present_info.pWaitSemaphores =
+      &m_finished_render_semaphores[image_index]; // Submit's binary signal
 
   VkSwapchainKHR swapchains[] = {m_swapchain};
   present_info.swapchainCount = 1;
@@ -997,13 +1386,18 @@ void RendererVk::draw_frame(const Camera &camera,
   result = vkQueuePresentKHR(m_present_queue, &present_info);
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
       m_input_manager.resize_pending()) {
-    recreate_swapchain_and_depth_stencil();
+    // Rebuilt at the start of the next frame, after its timeline wait
+    m_window_resize_is_pending = true;
   } else {
     VK_CHECK_RESULT(result);
   }
 
+  m_gpu_profiler->add_cpu_frame_time(
+      1000.0 * (SDL_GetPerformanceCounter() - cpu_frame_start) /
+      SDL_GetPerformanceFrequency());
+
   // Move to next frame (0 -> 1 -> 0 -> 1 ...)
-  m_current_frame = (m_current_frame + 1) % MAX_CONCURRENT_FRAMES;
+  m_current_frame = (m_current_frame + 1) % m_frames_in_flight;
   m_frameCounter++;
 }
 
@@ -1015,6 +1409,9 @@ VkDescriptorSetLayout RendererVk::create_descriptor_set_layout(
   layout_info.bindingCount = static_cast<uint32_t>(layout_bindings.size());
   layout_info.pBindings = layout_bindings.data();
   layout_info.pNext = &set_layout_bindings_flags_CI;
+  // Allocated from the UPDATE_AFTER_BIND pool for the bindless texture array
+  layout_info.flags =
+      VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
 
   VkDescriptorSetLayout layout;
   VK_CHECK_RESULT(
@@ -1024,19 +1421,14 @@ VkDescriptorSetLayout RendererVk::create_descriptor_set_layout(
 
 VkPipelineLayout RendererVk::create_pipeline_layout(
     VkDevice device, VkDescriptorSetLayout descriptor_set_layout) {
-  // Push constant: uint useTexture for per-mesh material differentiation
-  VkPushConstantRange push_range{};
-  push_range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-  push_range.offset = 0;
-  push_range.size = sizeof(uint32_t);
-
+  // No push constants, per draw material data is in the material buffer
   VkPipelineLayoutCreateInfo pipeline_layout_info{};
   pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
   pipeline_layout_info.pNext = nullptr;
   pipeline_layout_info.setLayoutCount = 1;
   pipeline_layout_info.pSetLayouts = &descriptor_set_layout;
-  pipeline_layout_info.pushConstantRangeCount = 1;
-  pipeline_layout_info.pPushConstantRanges = &push_range;
+  pipeline_layout_info.pushConstantRangeCount = 0;
+  pipeline_layout_info.pPushConstantRanges = nullptr;
 
   VkPipelineLayout pipeline_layout{};
   VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr,
@@ -1088,93 +1480,367 @@ void RendererVk::update_uniform_buffer(const Camera &camera) {
                          camera.get_position() + camera.get_forward_dir(),
                          glm::vec3(0.0f, 1.0f, 0.0f));
   ubo.projection = glm::perspective(
-      glm::radians(45.0f), static_cast<float>(m_extent.width) / m_extent.height,
-      0.1f, 1000.0f);
+      glm::radians(kFieldOfViewDegrees),
+      static_cast<float>(m_extent.width) / m_extent.height, kNearPlane,
+      kFarPlane);
 
   ubo.projection[1][1] *= -1;
+  ubo.camera_position = glm::vec4(camera.get_position(), 1.0f);
+
+  // Clusters are cut from the same projection the scene is drawn with
+  m_light_clusters->set_camera(ubo.view, ubo.projection, m_extent, kNearPlane,
+                               kFarPlane);
+  ubo.cluster_grid = m_light_clusters->get_grid_size();
+  ubo.cluster_params = m_light_clusters->get_shader_params();
 
   memcpy(m_uniform_buffers[m_current_frame].mapped, &ubo, sizeof(ubo));
 }
 
+void RendererVk::request_texture_mips(const Camera &camera) {
+  // Pixels one world unit covers at distance 1 from the camera, it falls off
+  // linearly with distance
+  const float pixels_per_unit_at_1 =
+      static_cast<float>(m_extent.height) /
+      (2.0f * std::tan(glm::radians(kFieldOfViewDegrees) * 0.5f));
+
+  const auto &mesh_allocations = m_resource_manager->get_mesh_allocations();
+  for (const DrawCall &draw : m_draw_calls) {
+    const GpuMaterial &material = m_imported_materials[draw.material_id];
+    const int32_t texture_indices[] = {
+        material.albedo_idx, material.normal_idx,
+        material.metallic_roughness_idx, material.occlusion_idx,
+        material.emissive_idx};
+    if (std::none_of(std::begin(texture_indices), std::end(texture_indices),
+                     [](int32_t idx) { return idx >= 0; })) {
+      continue;
+    }
+    const MeshAllocation &mesh = mesh_allocations[draw.mesh_index];
+
+    // Model matrix is identity, so the object space bounds are world space
+    const glm::vec3 to_mesh = mesh.bounds_center - camera.get_position();
+    if (glm::dot(to_mesh, camera.get_forward_dir()) < -mesh.bounds_radius) {
+      continue; // entirely behind the camera
+    }
+
+    // Closest point of the bounds decides, that's where texels are largest
+    const float distance =
+        std::max(glm::length(to_mesh) - mesh.bounds_radius, kNearPlane);
+    const float pixels_per_unit = pixels_per_unit_at_1 / distance;
+
+    // All maps share the mesh's uvs, so they need the same mips. A packed
+    // texture used twice just asks twice for the same footprint.
+    for (int32_t texture_idx : texture_indices) {
+      if (texture_idx >= 0) {
+        m_resource_manager->request_texture_footprint(
+            texture_idx, mesh.uv_density / pixels_per_unit);
+      }
+    }
+  }
+}
+
 void RendererVk::update(uint64_t delta_t) {
   m_totalTimeSeconds += delta_t / 1000.0;
+}
+
+void RendererVk::reload_shader(const std::filesystem::path &changed) {
+  SDL_LockMutex(m_shader_reload_mutex);
+  // The render pass and layout live as long as the renderer, and the
+  // pipeline cache can be used from several threads. A shader that doesn't
+  // compile leaves the current pipeline in place
+  VkPipeline pipeline =
+      create_pipeline(m_device, m_render_pass, m_pipeline_layout);
+  SDL_UnlockMutex(m_shader_reload_mutex);
+  if (pipeline == VK_NULL_HANDLE) {
+    return;
+  }
+
+  SDL_LockMutex(m_pending_pipeline_mutex);
+  // Superseded before any frame picked it up, so never used by the GPU
+  vkDestroyPipeline(m_device, m_pending_pipeline, nullptr);
+  m_pending_pipeline = pipeline;
+  SDL_UnlockMutex(m_pending_pipeline_mutex);
+  spdlog::info("Reloaded shaders after {} changed",
+               changed.filename().string());
+}
 
-  // Check if shader files have changed, if so, create a new pipeline
-  // This allow for hot reloading of shaders while the app is running!
-  const bool frag_shader_changed = m_frag_shader_watcher->check_for_changes();
-  const bool vert_shader_changed = m_vert_shader_watcher->check_for_changes();
-  if (frag_shader_changed || vert_shader_changed) {
-    vkDeviceWaitIdle(m_device);
-    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+void RendererVk::apply_pending_pipeline() {
+  SDL_LockMutex(m_pending_pipeline_mutex);
+  VkPipeline pipeline = m_pending_pipeline;
+  m_pending_pipeline = VK_NULL_HANDLE;
+  std::vector<FinishedVariant> finished_variants =
+      std::move(m_finished_variants);
+  m_finished_variants.clear();
+  SDL_UnlockMutex(m_pending_pipeline_mutex);
+
+  if (pipeline != VK_NULL_HANDLE) {
+    // Frames before this one were submitted with the old pipelines, they go
+    // once the frame timeline has passed them
+    m_deletion_queue->retire_pipeline(m_pipeline, m_frameCounter);
+    m_pipeline = pipeline;
+    // Variants are rebuilt from the new shaders as draws ask for them
+    m_shader_version++;
+    for (const auto &[features, variant] : m_pipeline_variants) {
+      m_deletion_queue->retire_pipeline(variant, m_frameCounter);
+    }
+    m_pipeline_variants.clear();
+    m_compiling_variants.clear();
+  }
 
-    m_pipeline = create_pipeline(m_device, m_render_pass, m_pipeline_layout);
+  for (const FinishedVariant &finished : finished_variants) {
+    if (finished.shader_version != m_shader_version) {
+      // Built from shaders that were reloaded since, never bound
+      vkDestroyPipeline(m_device, finished.pipeline, nullptr);
+      continue;
+    }
+    // A failed build stays marked as compiling so it isn't retried
+    if (finished.pipeline != VK_NULL_HANDLE) {
+      m_compiling_variants.erase(finished.features);
+      m_pipeline_variants[finished.features] = finished.pipeline;
+    }
   }
 }
 
+VkPipeline RendererVk::get_pipeline_variant(ShaderFeatures features) {
+  auto variant = m_pipeline_variants.find(features);
+  if (variant != m_pipeline_variants.end()) {
+    return variant->second;
+  }
+  // Requested once, a variant that failed to build stays on the generic
+  // pipeline until the next shader reload
+  if (m_compiling_variants.insert(features).second) {
+    const uint32_t shader_version = m_shader_version;
+    ThreadPool::Instance().submit([this, features, shader_version]() {
+      // Reloads rewrite the shader cache entries, build against one state
+      SDL_LockMutex(m_shader_reload_mutex);
+      VkPipeline pipeline = create_pipeline(m_device, m_render_pass,
+                                            m_pipeline_layout, features);
+      SDL_UnlockMutex(m_shader_reload_mutex);
+
+      SDL_LockMutex(m_pending_pipeline_mutex);
+      m_finished_variants.push_back({shader_version, features, pipeline});
+      SDL_UnlockMutex(m_pending_pipeline_mutex);
+    });
+  }
+  return m_pipeline;
+}
+
 void RendererVk::upload_pending_assets(
     const std::vector<RenderableInfo> &pending_renderables) {
-  std::vector<TextureAllocation> uploaded_textures_that_need_descriptor;
-
+  // Textures get their descriptors once their mip chains are built and
+  // uploaded, see consume_updated_textures() in draw_frame()
   for (const auto &info : pending_renderables) {
     auto mesh_alloc = m_resource_manager->upload_mesh_to_gpu(info.mesh);
 
+    // Packed the way frag.frag reads it. Texture uploads are deduplicated
+    // by the resource manager, so identical materials pack identically.
+    GpuMaterial material{};
+    material.albedo_factor = info.material.albedo_factor;
+    material.emissive =
+        info.material.emissive_factor * info.material.emissive_strength;
+    material.metallic_factor = info.material.metallic_factor;
+    material.roughness_factor = info.material.roughness_factor;
+    material.normal_scale = info.material.normal_scale;
+    material.occlusion_strength = info.material.occlusion_strength;
     if (info.material.albedo) {
       auto texture_alloc =
           m_resource_manager->upload_texture_to_gpu(info.material.albedo);
-      m_draw_calls.emplace_back(
-          mesh_alloc, static_cast<int32_t>(texture_alloc.texture_map_idx));
-      uploaded_textures_that_need_descriptor.push_back(texture_alloc);
-    } else {
-      m_draw_calls.emplace_back(
-          mesh_alloc, -1); // no texture — shader falls back to vertex color
+      material.albedo_idx =
+          static_cast<int32_t>(texture_alloc.texture_map_idx);
+    } // else no texture — shader falls back to vertex color
+    if (info.material.normal) {
+      auto texture_alloc =
+          m_resource_manager->upload_texture_to_gpu(info.material.normal);
+      material.normal_idx =
+          static_cast<int32_t>(texture_alloc.texture_map_idx);
+    }
+    if (info.material.metallic_roughness) {
+      auto texture_alloc = m_resource_manager->upload_texture_to_gpu(
+          info.material.metallic_roughness);
+      material.metallic_roughness_idx =
+          static_cast<int32_t>(texture_alloc.texture_map_idx);
+    }
+    // The importer packs occlusion into the metallic-roughness texture when
+    // it can, both then name the same entity and it's uploaded once
+    if (info.material.occlusion == info.material.metallic_roughness) {
+      material.occlusion_idx = material.metallic_roughness_idx;
+    } else if (info.material.occlusion) {
+      auto texture_alloc =
+          m_resource_manager->upload_texture_to_gpu(info.material.occlusion);
+      material.occlusion_idx =
+          static_cast<int32_t>(texture_alloc.texture_map_idx);
+    }
+    if (info.material.emissive) {
+      auto texture_alloc =
+          m_resource_manager->upload_texture_to_gpu(info.material.emissive);
+      material.emissive_idx =
+          static_cast<int32_t>(texture_alloc.texture_map_idx);
+    }
+    if (info.material.alpha_test) {
+      material.alpha_cutoff = info.material.alpha_cutoff;
     }
-  }
-
-  update_bindless_descriptors(uploaded_textures_that_need_descriptor);
-}
-
-void RendererVk::update_bindless_descriptors(
-    std::vector<TextureAllocation> allocs) {
 
-  if (allocs.empty()) {
-    return;
+    DrawCall draw{};
+    draw.mesh_index = mesh_alloc.mesh_index;
+    auto [it, inserted] = m_material_ids.try_emplace(
+        material, static_cast<uint32_t>(m_imported_materials.size()));
+    if (inserted) {
+      m_imported_materials.push_back(material);
+      // Nothing is resident yet, resolve_draws() fills in the textures
+      GpuMaterial fallback = material;
+      fallback.albedo_idx = -1;
+      fallback.normal_idx = -1;
+      fallback.metallic_roughness_idx = -1;
+      fallback.occlusion_idx = -1;
+      fallback.emissive_idx = -1;
+      fallback.alpha_cutoff = 0.0f;
+      m_material_buffer->add(fallback);
+    }
+    draw.material_id = it->second;
+    draw.entity = info.entity;
+    m_draw_call_indices[info.entity] = m_draw_calls.size();
+    m_draw_calls.push_back(draw);
   }
+}
 
-  std::vector<VkDescriptorImageInfo> image_infos(allocs.size());
+void RendererVk::release_assets(
+    const std::vector<RenderableInfo> &released_renderables) {
+  for (const auto &info : released_renderables) {
+    auto index = m_draw_call_indices.find(info.entity);
+    if (index == m_draw_call_indices.end()) {
+      continue;
+    }
+    // Draw order doesn't matter, resolve_draws() sorts by pipeline. The
+    // changed draw list makes every frame slot re-record.
+    const size_t draw_index = index->second;
+    m_draw_call_indices.erase(index);
+    if (draw_index + 1 != m_draw_calls.size()) {
+      m_draw_calls[draw_index] = m_draw_calls.back();
+      m_draw_call_indices[m_draw_calls[draw_index].entity] = draw_index;
+    }
+    m_draw_calls.pop_back();
 
-  for (auto i = 0; i < allocs.size(); i++) {
-    image_infos[i].sampler = m_texture_sampler;
-    image_infos[i].imageView = allocs[i].view;
-    image_infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    // One reference each, as taken in upload_pending_assets(). The GPU
+    // copies are retired once the last one goes.
+    m_resource_manager->release_mesh(info.mesh);
+    if (info.material.albedo) {
+      m_resource_manager->release_texture(info.material.albedo);
+    }
+    if (info.material.normal) {
+      m_resource_manager->release_texture(info.material.normal);
+    }
+    if (info.material.metallic_roughness) {
+      m_resource_manager->release_texture(info.material.metallic_roughness);
+    }
+    if (info.material.occlusion &&
+        info.material.occlusion != info.material.metallic_roughness) {
+      m_resource_manager->release_texture(info.material.occlusion);
+    }
+    if (info.material.emissive) {
+      m_resource_manager->release_texture(info.material.emissive);
+    }
   }
+}
 
-  for (auto i = 0; i < MAX_CONCURRENT_FRAMES; i++) {
+void RendererVk::set_lights(std::vector<LightInfo> lights) {
+  m_lights = std::move(lights);
+}
 
-    VkWriteDescriptorSet write{};
-    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.dstSet = m_uniform_buffers[i].descriptorSet;
-    write.dstBinding = kTextureArrayBindingIndex;
-    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    write.descriptorCount = allocs.size();
-    write.dstArrayElement = allocs[0].texture_map_idx;
-    write.pImageInfo = image_infos.data();
+void RendererVk::write_storage_buffer_descriptor(uint32_t frame,
+                                                 uint32_t binding,
+                                                 VkBuffer buffer,
+                                                 VkDeviceSize range) {
+  VkDescriptorBufferInfo buffer_info{};
+  buffer_info.buffer = buffer;
+  buffer_info.offset = 0;
+  buffer_info.range = range;
+
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = m_uniform_buffers[frame].descriptorSet;
+  write.dstBinding = binding;
+  write.dstArrayElement = 0;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write.descriptorCount = 1;
+  write.pBufferInfo = &buffer_info;
+  vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+}
 
-    vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+void RendererVk::update_bindless_descriptors(
+    const std::vector<TextureAllocation> &allocs) {
+  // Sets of frames still in flight can't be written yet, every set keeps
+  // its own queue and is caught up when its frame comes around. A slot
+  // written twice before that only keeps the latest view
+  for (auto &pending : m_pending_bindless_writes) {
+    for (const TextureAllocation &alloc : allocs) {
+      if (alloc.texture_map_idx >= 0) {
+        pending[static_cast<uint32_t>(alloc.texture_map_idx)] = alloc.view;
+      }
+    }
   }
 }
 
-void RendererVk::recreate_swapchain_and_depth_stencil() {
-  vkDeviceWaitIdle(m_device);
+void RendererVk::flush_bindless_descriptors(uint32_t frame) {
+  std::map<uint32_t, VkImageView> &pending = m_pending_bindless_writes[frame];
+  if (pending.empty()) {
+    return;
+  }
+  // The texture binding is UPDATE_AFTER_BIND, secondaries recorded against
+  // the set stay valid and pick up the new views when executed
+
+  // Slots come from a free list and aren't contiguous. Runs of consecutive
+  // slots share a write, all writes go in one call
+  std::vector<VkDescriptorImageInfo> image_infos;
+  image_infos.reserve(pending.size());
+  std::vector<VkWriteDescriptorSet> writes;
+  uint32_t previous_slot = 0;
+  for (const auto &[slot, view] : pending) {
+    if (writes.empty() || slot != previous_slot + 1) {
+      VkWriteDescriptorSet write{};
+      write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write.dstSet = m_uniform_buffers[frame].descriptorSet;
+      write.dstBinding = kTextureArrayBindingIndex;
+      write.dstArrayElement = slot;
+      write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      writes.push_back(write);
+    }
+    writes.back().descriptorCount++;
+
+    VkDescriptorImageInfo image_info{};
+    image_info.sampler = m_texture_sampler;
+    image_info.imageView = view;
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    image_infos.push_back(image_info);
+    previous_slot = slot;
+  }
 
-  // CHANGED: Destroy old per-image semaphores — count may change with new
-  // swapchain
-  for (auto &sem : m_finished_render_semaphores) {
-    vkDestroySemaphore(m_device, sem, nullptr);
+  // image_infos is complete now, point each write at its run
+  size_t first_info = 0;
+  for (VkWriteDescriptorSet &write : writes) {
+    write.pImageInfo = &image_infos[first_info];
+    first_info += write.descriptorCount;
   }
-  m_finished_render_semaphores.clear();
 
-  cleanup_swapchain_and_depth_stencil();
+  vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()),
+                         writes.data(), 0, nullptr);
+  pending.clear();
+}
+
+void RendererVk::wait_for_frame_slot() {
+  // Frame N signals N + 1, so frame m_frameCounter - frames_in_flight is
+  // done once the timeline reaches m_frameCounter - frames_in_flight + 1
+  if (m_frameCounter < m_frames_in_flight) {
+    return;
+  }
+  const uint64_t value = m_frameCounter - m_frames_in_flight + 1;
+  VkSemaphoreWaitInfo wait_info{};
+  wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.semaphoreCount = 1;
+  wait_info.pSemaphores = &m_frame_timeline;
+  wait_info.pValues = &value;
+  VK_CHECK_RESULT(vkWaitSemaphores(m_device, &wait_info, UINT64_MAX));
+}
 
+void RendererVk::recreate_swapchain() {
   // Query surface capabilities and clamp pending extent
   VkSurfaceCapabilitiesKHR capabilities;
   vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physical_device, m_surface,
@@ -1186,9 +1852,43 @@ void RendererVk::recreate_swapchain_and_depth_stencil() {
       capabilities.minImageExtent.height,
       std::min(m_pending_extent.height, capabilities.maxImageExtent.height));
 
+  // Minimized, there is no valid swapchain size until the window comes back
+  if (m_pending_extent.width == 0 || m_pending_extent.height == 0) {
+    m_window_resize_is_pending = true;
+    return;
+  }
+
   m_extent = m_pending_extent;
+  // Recorded secondaries have the old viewport and scissor baked in
+  ++m_draw_version;
+
+  // No device wait, frames still in flight finish against the old swapchain
+  // and everything built on it is destroyed once the timeline passes them.
+  // Presents have no fence of their own, they are queued behind the frame's
+  // submit and done by the time the frames in flight have cycled.
+  const uint64_t frame_number = m_frameCounter;
+  for (VkImageView image_view : m_swapchain_image_views) {
+    m_deletion_queue->retire_image_view(image_view, frame_number);
+  }
 
-  create_swapchain();
+  // Per-image semaphores, the count may change with the new swapchain
+  m_deletion_queue->retire(
+      [device = m_device,
+       semaphores = std::move(m_finished_render_semaphores)]() {
+        for (VkSemaphore semaphore : semaphores) {
+          vkDestroySemaphore(device, semaphore, nullptr);
+        }
+      },
+      frame_number);
+  m_finished_render_semaphores.clear();
+
+  const VkSwapchainKHR old_swapchain = m_swapchain;
+  create_swapchain(old_swapchain);
+  m_deletion_queue->retire(
+      [device = m_device, old_swapchain]() {
+        vkDestroySwapchainKHR(device, old_swapchain, nullptr);
+      },
+      frame_number);
 
   m_swapchain_image_views.resize(m_swapchain_images.size());
   for (auto i = 0; i < m_swapchain_images.size(); i++) {
@@ -1197,27 +1897,12 @@ void RendererVk::recreate_swapchain_and_depth_stencil() {
         VK_IMAGE_ASPECT_COLOR_BIT);
   }
 
-  // Recreate depth stencil (destroyed in cleanup_swapchain)
-  m_resource_manager->create_depth_stencil_texture(m_extent.width,
-                                                   m_extent.height);
-  const auto &depth_stencil = m_resource_manager->get_depth_stencil_texture();
-
-  m_swapchain_framebuffers.resize(m_swapchain_image_views.size());
-  for (auto i = 0; i < m_swapchain_image_views.size(); i++) {
-    m_swapchain_framebuffers[i] =
-        create_framebuffer(m_device, m_render_pass, m_swapchain_image_views[i],
-                           depth_stencil.view);
-  }
-
-  // Recreate UI framebuffers
-  m_ui_swapchain_framebuffers.resize(m_swapchain_image_views.size());
-  for (auto i = 0; i < m_swapchain_image_views.size(); i++) {
-    m_ui_swapchain_framebuffers[i] =
-        create_framebuffer(m_device, m_ui_render_pass,
-                           m_swapchain_image_views[i], depth_stencil.view);
-  }
+  // Retires the framebuffers and transients sized for the old extent. The
+  // render pass is cached, so pipelines and Noesis keep theirs.
+  m_render_graph->set_imported_images(m_swapchain_target, m_swapchain_images,
+                                      m_swapchain_image_views);
+  m_render_graph->compile(m_extent);
 
-  // CHANGED: Recreate per-image semaphores to match new swapchain image count
   m_finished_render_semaphores.resize(m_swapchain_images.size());
   VkSemaphoreCreateInfo semaphore_info{};
   semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -1235,5 +1920,6 @@ void RendererVk::recreate_swapchain_and_depth_stencil() {
 void RendererVk::OnWindowResize(glm::uvec2 new_dims) {
   m_pending_extent = {new_dims.x, new_dims.y};
   m_window_resize_is_pending = true;
+  m_resize_requested_ms = SDL_GetTicks();
 }
 } // namespace Expectre
\ No newline at end of file
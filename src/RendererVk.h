@@ -6,9 +6,14 @@
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_vulkan.h>
 #include <array>
+#include <filesystem>
 #include <assimp/Importer.hpp>
+#include <flecs.h>
 #include <glm/glm.hpp>
+#include <map>
 #include <optional>
+#include <unordered_map>
+#include <unordered_set>
 #include <stdexcept>
 #include <stdio.h>
 #include <string>
@@ -16,23 +21,32 @@
 
 #include <vma/vk_mem_alloc.h>
 
+#include "DeletionQueueVk.h"
+#include "DeviceFeaturesVk.h"
+#include "FramePacing.h"
+#include "GpuProfilerVk.h"
 #include "IRenderer.h"
+#include "Light.h"
+#include "LightClustersVk.h"
+#include "MaterialBufferVk.h"
+#include "PipelineCacheVk.h"
+#include "RenderGraphVk.h"
 #include "RenderResourceManager.h"
 #include "RenderableInfo.h"
+#include "ShaderCache.h"
+#include "ShaderFeatures.h"
 #include "ShaderFileWatcher.h"
 #include "Texture.h"
+#include "ThreadPool.h"
 #include "ToolsVk.h"
 #include "input/InputManager.h"
 #include "observer.h"
 
 #include <memory>
 
-#define MAX_CONCURRENT_FRAMES 2
-
 // Default fence timeout in nanoseconds
 #define DEFAULT_FENCE_TIMEOUT 100000000000
 
-#define PRESENT_MODE VK_PRESENT_MODE_MAILBOX_KHR
 namespace Expectre {
 
 class Camera;
@@ -41,6 +55,10 @@ struct MVP_uniform_object {
   glm::mat4 model;
   glm::mat4 view;
   glm::mat4 projection;
+  glm::vec4 camera_position; // xyz
+  // Light clusters, see LightClustersVk
+  glm::uvec4 cluster_grid;  // cluster counts xyz
+  glm::vec4 cluster_params; // tile pixels xy, depth slice scale and bias zw
 };
 struct UniformBuffer {
   AllocatedBuffer allocated_buffer{};
@@ -65,52 +83,65 @@ public:
              VkDevice &device, VmaAllocator &allocator, VkSurfaceKHR &surface,
              VkQueue &graphics_queue, uint32_t &graphics_queue_index,
              VkQueue &present_queue, uint32_t &present_queue_index,
-             uint32_t width, uint32_t height, InputManager &input_manager);
+             uint32_t width, uint32_t height,
+             const DeviceFeaturesVk &device_features,
+             const FramePacingConfig &frame_pacing,
+             InputManager &input_manager);
   ~RendererVk();
 
   bool is_ready() { return m_ready; }
   void update(uint64_t delta_t);
+  /// Blocks until the frame about to be recorded can reuse its slot, i.e.
+  /// the frame frames_in_flight before it has finished on the GPU
+  void wait_for_frame_slot();
   void draw_frame(const Camera &camera,
                   const std::vector<RenderableInfo> &renderables) override;
 
   void
   upload_pending_assets(const std::vector<RenderableInfo> &pending_renderables);
+  /// Drops the mesh and texture references upload_pending_assets() took
+  /// for these renderables and removes their draws
+  void
+  release_assets(const std::vector<RenderableInfo> &released_renderables);
+  /// Lights the next draw_frame() shades with
+  void set_lights(std::vector<LightInfo> lights);
 
   NoesisUI *GetNoesisUI() { return m_noesisUI.get(); }
+  /// Per pass GPU times and shader invocation counts, a few frames behind
+  const GpuProfilerVk &get_gpu_profiler() const { return *m_gpu_profiler; }
   void OnWindowResize(glm::uvec2 new_dims);
 
 private:
-  void create_swapchain();
+  // old_swapchain is retired by the new one, images it already handed out
+  // can still be presented
+  void create_swapchain(VkSwapchainKHR old_swapchain = VK_NULL_HANDLE);
 
-  VkCommandBuffer create_command_buffer(VkDevice device,
-                                        VkCommandPool command_pool);
+  VkCommandBuffer create_command_buffer(
+      VkDevice device, VkCommandPool command_pool,
+      VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
   VkImageView create_swapchain_and_image_views(VkDevice device, VkImage image,
                                                VkFormat format,
                                                VkImageAspectFlags flags);
 
-  VkCommandPool create_command_pool(VkDevice device,
-                                    uint32_t graphics_queue_family_index);
-
-  /// Configuration for a single render pass.
-  struct RenderPassConfig {
-    VkFormat colorFormat;
-    VkFormat depthFormat;
-    VkAttachmentLoadOp colorLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    VkImageLayout colorInitialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    VkImageLayout colorFinalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    VkAttachmentLoadOp depthLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    VkAttachmentLoadOp stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    VkImageLayout depthInitialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    VkImageLayout depthFinalLayout =
-        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-  };
-
-  VkRenderPass create_renderpass(VkDevice device,
-                                 const RenderPassConfig &config);
-
-  VkPipeline create_pipeline(VkDevice device, VkRenderPass renderpass,
-                             VkPipelineLayout pipeline_layout);
+  VkCommandPool create_command_pool(
+      VkDevice device, uint32_t graphics_queue_family_index,
+      VkCommandPoolCreateFlags flags =
+          VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+
+  // Declares the frame's passes and compiles the graph for m_extent, sets
+  // m_render_pass
+  void create_render_graph();
+  // Scene pass body: the UI secondary and every recorded chunk
+  void execute_scene_pass(const RenderGraphContext &context);
+
+  /// Generic pipeline when features is empty, otherwise the variant
+  /// specialized for exactly these material features. VK_NULL_HANDLE if a
+  /// shader doesn't compile.
+  VkPipeline
+  create_pipeline(VkDevice device, VkRenderPass renderpass,
+                  VkPipelineLayout pipeline_layout,
+                  std::optional<ShaderFeatures> features = std::nullopt);
 
   VkDescriptorPool
   create_descriptor_pool(VkDevice device,
@@ -122,16 +153,25 @@ private:
                                         VkDescriptorSetLayout descriptor_layout,
                                         VkBuffer buffer);
 
-  VkFramebuffer create_framebuffer(VkDevice device, VkRenderPass renderpass,
-                                   VkImageView view,
-                                   VkImageView depth_view = VK_NULL_HANDLE);
-
   void create_sync_objects();
 
   void record_draw_commands(VkCommandBuffer command_buffer,
                             uint32_t image_index,
                             const std::vector<RenderableInfo> &renderables);
 
+  // Residency, texture fallbacks and pipeline variant of every draw, into
+  // m_resolved_draws. Render thread only, recording threads just read them.
+  void resolve_draws();
+
+  // Records m_resolved_draws[first, first + count) into a secondary command
+  // buffer continuing m_render_pass. Safe on any thread as long as no other
+  // thread uses the buffer's pool. The first and last chunk also open and
+  // close the scene's GPU timestamps.
+  void record_draw_chunk(VkCommandBuffer command_buffer, size_t first,
+                         size_t count, uint32_t chunk, bool last_chunk);
+
+  void create_frame_recordings(uint32_t chunk_count);
+
   VkPipelineLayout
   create_pipeline_layout(VkDevice device,
                          VkDescriptorSetLayout descriptor_set_layout);
@@ -146,11 +186,38 @@ private:
 
   void update_uniform_buffer(const Camera &camera);
 
-  void cleanup_swapchain_and_depth_stencil();
+  // Draw preparation for texture streaming: reports each textured draw's
+  // screen-space UV footprint so the streamer knows which mips are needed
+  void request_texture_mips(const Camera &camera);
+
+  void cleanup_swapchain();
 
-  void recreate_swapchain_and_depth_stencil();
+  void recreate_swapchain();
 
-  void update_bindless_descriptors(std::vector<TextureAllocation> allocs);
+  // Queues descriptor writes for textures that were (re)uploaded, for every
+  // frame's descriptor set
+  void update_bindless_descriptors(
+      const std::vector<TextureAllocation> &allocs);
+  // Applies the queued writes to a frame's set, once it is out of flight
+  void flush_bindless_descriptors(uint32_t frame);
+  // Points a storage buffer binding of a frame's set at buffer
+  void write_storage_buffer_descriptor(uint32_t frame, uint32_t binding,
+                                       VkBuffer buffer, VkDeviceSize range);
+  // m_resolved_draws into the frame's draw data buffer, grown to fit. Only
+  // when the frame re-records, the buffer matches its recorded chunks.
+  void write_draw_data(uint32_t frame);
+
+  // Runs on a worker: recompiles what the changed file affects and builds a
+  // new pipeline without touching the one frames are drawn with
+  void reload_shader(const std::filesystem::path &changed);
+
+  // Frame boundary: swap in a reloaded pipeline and finished variants, the
+  // replaced ones go to the deletion queue
+  void apply_pending_pipeline();
+
+  // Specialized pipeline for these features if it is built, otherwise starts
+  // building it on a worker and returns the generic pipeline meanwhile
+  VkPipeline get_pipeline_variant(ShaderFeatures features);
 
   VkInstance &m_instance;
   VkPhysicalDevice &m_physical_device;
@@ -164,30 +231,43 @@ private:
   VkFormat m_swapchain_image_format{};
   VkExtent2D m_extent{};
   VkExtent2D m_pending_extent{};
-  std::vector<VkFramebuffer> m_swapchain_framebuffers{};
   std::vector<VkImageView> m_swapchain_image_views{};
 
+  // The scene pass's render pass, owned by m_render_graph. Pipelines, the
+  // recorded secondaries and Noesis are all built against it.
   VkRenderPass m_render_pass{};
-  VkRenderPass m_ui_render_pass{}; // Separate render pass for UI overlay
-  std::vector<VkFramebuffer>
-      m_ui_swapchain_framebuffers{}; // UI-specific framebuffers
   VkPipelineLayout m_pipeline_layout{};
   VkPipeline m_pipeline{};
   VkDescriptorPool m_descriptor_pool{};
-  VkPipelineCache m_pipeline_cache = VK_NULL_HANDLE;
+  std::unique_ptr<PipelineCacheVk> m_pipeline_cache;
   VkDescriptorSetLayout m_descriptor_set_layout{VK_NULL_HANDLE};
+  // Length of the bindless texture array, from the device limits
+  uint32_t m_bindless_capacity = 0;
+  // Bindless slot -> view still to be written into each frame's set
+  std::vector<std::map<uint32_t, VkImageView>> m_pending_bindless_writes{};
   VkSampler m_texture_sampler{VK_NULL_HANDLE};
 
   std::vector<VkSemaphore> m_available_image_semaphores{};
   std::vector<VkSemaphore> m_finished_render_semaphores{};
-  std::vector<VkFence> m_in_flight_fences{};
+  // Frame N signals N + 1 when it completes on the GPU
+  VkSemaphore m_frame_timeline = VK_NULL_HANDLE;
+  FramePacingConfig m_frame_pacing{};
+  // Clamped copy of m_frame_pacing.frames_in_flight, sizes the per-frame
+  // arrays below
+  uint32_t m_frames_in_flight = 0;
+  // Declared before the resource manager, which retires into it
+  std::unique_ptr<DeletionQueueVk> m_deletion_queue;
   std::unique_ptr<RenderResourceManager> m_resource_manager;
+  // Also retires into the deletion queue when it is recompiled
+  std::unique_ptr<RenderGraphVk> m_render_graph;
+  RenderGraphImage m_swapchain_target = kInvalidRenderGraphHandle;
+  RenderGraphPass m_scene_pass = kInvalidRenderGraphHandle;
   InputManager &m_input_manager;
 
-  std::array<struct UniformBuffer, MAX_CONCURRENT_FRAMES> m_uniform_buffers{};
+  std::vector<struct UniformBuffer> m_uniform_buffers{};
   VkPhysicalDeviceMemoryProperties m_phys_memory_properties{};
   VkCommandPool m_cmd_pool = VK_NULL_HANDLE;
-  std::array<VkCommandBuffer, MAX_CONCURRENT_FRAMES> m_cmd_buffers;
+  std::vector<VkCommandBuffer> m_cmd_buffers{};
   bool m_ready = false;
 
   VkSurfaceFormatKHR m_surface_format{};
@@ -198,22 +278,137 @@ private:
   float m_priority = 1.0f;
   bool m_layers_supported = false;
 
-  std::unique_ptr<ShaderFileWatcher> m_vert_shader_watcher = nullptr;
-  std::unique_ptr<ShaderFileWatcher> m_frag_shader_watcher = nullptr;
+  std::unique_ptr<ShaderCache> m_shader_cache;
+  std::unique_ptr<ShaderFileWatcher> m_shader_watcher = nullptr;
+  // Pipeline rebuilt by a shader reload job, swapped in by the render thread
+  // at the start of a frame. Guarded by m_pending_pipeline_mutex
+  SDL_Mutex *m_pending_pipeline_mutex = nullptr;
+  VkPipeline m_pending_pipeline = VK_NULL_HANDLE;
+  // Reload jobs run one at a time, so the last pipeline built is from the
+  // latest sources
+  SDL_Mutex *m_shader_reload_mutex = nullptr;
+
+  // vert_pulled.vert and no vertex input state, see GeometryConfig
+  bool m_vertex_pulling = false;
+
+  // Specialized pipelines per material feature set, render thread only.
+  // Rebuilt from scratch after a shader reload, m_shader_version tells
+  // variants built from the old shaders apart
+  std::unordered_map<ShaderFeatures, VkPipeline> m_pipeline_variants;
+  std::unordered_set<ShaderFeatures> m_compiling_variants;
+  uint32_t m_shader_version = 0;
+  struct FinishedVariant {
+    uint32_t shader_version = 0;
+    ShaderFeatures features = 0;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+  };
+  // Handed over by variant jobs, guarded by m_pending_pipeline_mutex
+  std::vector<FinishedVariant> m_finished_variants;
 
   std::unique_ptr<NoesisUI> m_noesisUI;
   std::shared_ptr<InputObserver> m_ns_input_adapter;
   uint64_t m_frameCounter = 0;
   double m_totalTimeSeconds = 0.0;
 
+  static constexpr float kFieldOfViewDegrees = 45.0f;
+  static constexpr float kNearPlane = 0.1f;
+  static constexpr float kFarPlane = 1000.0f;
+
   VmaAllocator &m_allocator;
   VkSurfaceKHR &m_surface;
   uint32_t &m_graphics_queue_index;
   uint32_t &m_present_queue_index;
 
   bool m_window_resize_is_pending = false;
-
-  std::vector<std::pair<MeshAllocation, int32_t>> m_draw_calls;
+  // SDL_GetTicks() of the last resize event. Dragging a window edge sends a
+  // burst of them, the swapchain is only rebuilt once they settle.
+  uint64_t m_resize_requested_ms = 0;
+  static constexpr uint64_t kResizeSettleMs = 50;
+
+  struct DrawCall {
+    uint32_t mesh_index = 0;  // into RenderResourceManager's mesh list
+    uint32_t material_id = 0; // into m_material_buffer
+    flecs::entity_t entity = 0;
+  };
+  std::vector<DrawCall> m_draw_calls;
+  // Renderable entity -> its index in m_draw_calls
+  std::unordered_map<flecs::entity_t, size_t> m_draw_call_indices;
+
+  // Materials as imported, with every texture's bindless slot. The buffer
+  // holds what is resident of them this frame.
+  std::vector<GpuMaterial> m_imported_materials;
+  // Renderables carry copies of their Material, identical ones share an ID
+  std::unordered_map<GpuMaterial, uint32_t, GpuMaterialHash> m_material_ids;
+  std::unique_ptr<MaterialBufferVk> m_material_buffer;
+
+  // Binned on a recording worker while the chunks record, the scene pass
+  // waits for it with them
+  std::vector<LightInfo> m_lights;
+  std::unique_ptr<LightClustersVk> m_light_clusters;
+
+  struct ResolvedDraw {
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    // Texture residency changes only the material buffer, not the draw
+    uint32_t material_id = 0;
+    uint32_t mesh_index = 0;
+    uint32_t index_count = 0;
+    uint32_t index_offset = 0;
+    uint32_t vertex_offset = 0;
+
+    bool operator==(const ResolvedDraw &other) const {
+      return pipeline == other.pipeline && material_id == other.material_id &&
+             mesh_index == other.mesh_index &&
+             index_count == other.index_count &&
+             index_offset == other.index_offset &&
+             vertex_offset == other.vertex_offset;
+    }
+  };
+  std::vector<ResolvedDraw> m_resolved_draws;
+  // What the chunks were last recorded from. Bumping m_draw_version makes
+  // every frame slot re-record, as long as it is unchanged the recorded
+  // secondaries are executed again and only the uniform data changes.
+  std::vector<ResolvedDraw> m_last_resolved_draws;
+  uint64_t m_draw_version = 1;
+
+  // Matches DrawData in scene_vertex.glsl (std430). Each draw passes its
+  // index in m_resolved_draws as firstInstance, the shaders look up its
+  // material and how to decode its vertices here.
+  struct GpuDrawData {
+    uint32_t material_id = 0;
+    uint32_t vertex_format = 0;
+    uint32_t padding[2]{};
+    glm::vec4 position_min{0.0f};
+    glm::vec4 position_scale{1.0f};
+    glm::vec4 uv_range{0.0f, 0.0f, 1.0f, 1.0f}; // min xy, scale zw
+  };
+  static_assert(sizeof(GpuDrawData) == 64, "must match scene_vertex.glsl");
+
+  // Scene draws are split into chunks recorded in parallel into secondary
+  // command buffers. Pools are externally synchronized, so every chunk has
+  // its own per frame slot and they are reset as a whole when the slot
+  // re-records.
+  struct FrameRecording {
+    std::vector<VkCommandPool> chunk_pools;
+    std::vector<VkCommandBuffer> chunk_buffers; // one from each pool
+    VkCommandBuffer ui_buffer = VK_NULL_HANDLE; // from m_cmd_pool
+    // Chunks holding m_draw_version's draws, 0 = must re-record
+    size_t chunk_count = 0;
+    uint64_t draw_version = 0;
+    // Host visible, rewritten with the chunks
+    AllocatedBuffer draw_data{};
+    GpuDrawData *draw_data_mapped = nullptr;
+    uint32_t draw_data_capacity = 0;
+  };
+  std::vector<FrameRecording> m_frame_recordings;
+  // Its own workers, recording must not queue behind background jobs
+  std::unique_ptr<ThreadPool> m_recording_pool;
+  // Queries are per frame slot with fixed indices, so the cached chunks keep
+  // writing the right ones
+  std::unique_ptr<GpuProfilerVk> m_gpu_profiler;
+  // Below this a chunk costs more in job and vkCmdExecuteCommands overhead
+  // than recording it in parallel saves
+  static constexpr size_t kMinDrawsPerChunk = 256;
+  static constexpr uint32_t kMaxRecordingThreads = 4;
 };
 
 } // namespace Expectre
@@ -0,0 +1,209 @@
+#include "ResidencyManagerVk.h"
+
+#include <algorithm>
+#include <cassert>
+#include <spdlog/spdlog.h>
+
+namespace Expectre {
+
+ResidencyManagerVk::ResidencyManagerVk(VmaAllocator allocator,
+                                       const ResidencyConfig &config)
+    : m_allocator(allocator), m_config(config) {
+  assert(m_config.eviction_target <= m_config.eviction_threshold);
+}
+
+ResidencyId ResidencyManagerVk::track(ResidencyPool pool,
+                                      VkDeviceSize size_bytes,
+                                      ResidencyCallbacks callbacks,
+                                      bool resident) {
+  ResidencyId id;
+  if (!m_free_ids.empty()) {
+    id = m_free_ids.back();
+    m_free_ids.pop_back();
+  } else {
+    id = static_cast<ResidencyId>(m_entries.size());
+    m_entries.emplace_back();
+  }
+
+  Entry &entry = m_entries[id];
+  entry.pool = pool;
+  entry.size_bytes = size_bytes;
+  entry.last_used_frame = m_frame_number;
+  entry.alive = true;
+  entry.resident = resident;
+  entry.restore_queued = false;
+  entry.callbacks = std::move(callbacks);
+  return id;
+}
+
+void ResidencyManagerVk::untrack(ResidencyId id) {
+  if (id >= m_entries.size() || !m_entries[id].alive) {
+    return;
+  }
+  // Any queued restore is skipped in process_restores() once alive is false
+  m_entries[id] = Entry{};
+  m_free_ids.push_back(id);
+}
+
+void ResidencyManagerVk::resize(ResidencyId id, VkDeviceSize size_bytes) {
+  if (id >= m_entries.size() || !m_entries[id].alive) {
+    return;
+  }
+  m_entries[id].size_bytes = size_bytes;
+}
+
+bool ResidencyManagerVk::use(ResidencyId id) {
+  if (id >= m_entries.size() || !m_entries[id].alive) {
+    return false;
+  }
+  Entry &entry = m_entries[id];
+  entry.last_used_frame = m_frame_number;
+
+  if (!entry.resident && !entry.restore_queued) {
+    entry.restore_queued = true;
+    m_restore_queue.push_back(id);
+  }
+  return entry.resident;
+}
+
+bool ResidencyManagerVk::is_resident(ResidencyId id) const {
+  return id < m_entries.size() && m_entries[id].alive &&
+         m_entries[id].resident;
+}
+
+bool ResidencyManagerVk::can_evict(const Entry &entry) const {
+  // The GPU may still be reading anything used by the last frames_in_flight
+  // frames, those are not safe to free yet
+  return entry.alive && entry.resident &&
+         entry.last_used_frame + m_config.frames_in_flight < m_frame_number;
+}
+
+VkDeviceSize ResidencyManagerVk::evict_lru(ResidencyPool pool,
+                                           VkDeviceSize bytes) {
+  std::vector<ResidencyId> candidates;
+  for (ResidencyId id = 0; id < m_entries.size(); id++) {
+    const Entry &entry = m_entries[id];
+    if (entry.pool == pool && can_evict(entry)) {
+      candidates.push_back(id);
+    }
+  }
+
+  // Oldest first
+  std::sort(candidates.begin(), candidates.end(),
+            [&](ResidencyId a, ResidencyId b) {
+              return m_entries[a].last_used_frame <
+                     m_entries[b].last_used_frame;
+            });
+
+  VkDeviceSize freed = 0;
+  for (ResidencyId id : candidates) {
+    if (freed >= bytes) {
+      break;
+    }
+    Entry &entry = m_entries[id];
+    entry.callbacks.evict();
+    entry.resident = false;
+    freed += entry.size_bytes;
+  }
+
+  if (freed > 0) {
+    spdlog::debug("[Residency] Evicted {} KB (requested {} KB)", freed / 1024,
+                  bytes / 1024);
+  } else if (bytes > 0) {
+    spdlog::warn("[Residency] Nothing evictable, {} KB over budget",
+                 bytes / 1024);
+  }
+  return freed;
+}
+
+ResidencyManagerVk::HeapUsage
+ResidencyManagerVk::query_device_local_usage() const {
+  const VkPhysicalDeviceMemoryProperties *memory_properties = nullptr;
+  vmaGetMemoryProperties(m_allocator, &memory_properties);
+
+  VmaBudget budgets[VK_MAX_MEMORY_HEAPS]{};
+  vmaGetHeapBudgets(m_allocator, budgets);
+
+  HeapUsage total{};
+  for (uint32_t i = 0; i < memory_properties->memoryHeapCount; i++) {
+    if (memory_properties->memoryHeaps[i].flags &
+        VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      total.usage += budgets[i].usage;
+      total.budget += budgets[i].budget;
+    }
+  }
+  return total;
+}
+
+void ResidencyManagerVk::evict_over_budget() {
+  const HeapUsage heap = query_device_local_usage();
+  if (heap.budget == 0) {
+    return;
+  }
+
+  const auto threshold = static_cast<VkDeviceSize>(
+      static_cast<double>(heap.budget) * m_config.eviction_threshold);
+  if (heap.usage <= threshold) {
+    return;
+  }
+
+  const auto target = static_cast<VkDeviceSize>(
+      static_cast<double>(heap.budget) * m_config.eviction_target);
+  evict_lru(ResidencyPool::DeviceMemory, heap.usage - target);
+}
+
+void ResidencyManagerVk::process_restores() {
+  VkDeviceSize uploaded = 0;
+
+  while (!m_restore_queue.empty()) {
+    const ResidencyId id = m_restore_queue.front();
+    Entry &entry = m_entries[id];
+
+    if (!entry.alive || entry.resident) {
+      m_restore_queue.pop_front();
+      entry.restore_queued = false;
+      continue;
+    }
+
+    // Always let at least one restore through, otherwise a single resource
+    // bigger than the per-frame budget would never come back
+    if (uploaded > 0 &&
+        uploaded + entry.size_bytes > m_config.upload_bytes_per_frame) {
+      break;
+    }
+
+    // Make room first so the reload itself doesn't push us over budget
+    if (entry.pool == ResidencyPool::DeviceMemory) {
+      const HeapUsage heap = query_device_local_usage();
+      const auto threshold = static_cast<VkDeviceSize>(
+          static_cast<double>(heap.budget) * m_config.eviction_threshold);
+      if (heap.budget > 0 && heap.usage + entry.size_bytes > threshold) {
+        evict_lru(ResidencyPool::DeviceMemory,
+                  heap.usage + entry.size_bytes - threshold);
+      }
+    }
+
+    m_restore_queue.pop_front();
+    entry.restore_queued = false;
+
+    if (!entry.callbacks.restore()) {
+      spdlog::warn("[Residency] Failed to restore resource {}", id);
+      continue;
+    }
+    entry.resident = true;
+    entry.last_used_frame = m_frame_number;
+    uploaded += entry.size_bytes;
+  }
+}
+
+void ResidencyManagerVk::begin_frame(uint64_t frame_number) {
+  m_frame_number = frame_number;
+
+  // Lets VMA refresh its cached VK_EXT_memory_budget numbers
+  vmaSetCurrentFrameIndex(m_allocator, static_cast<uint32_t>(frame_number));
+
+  evict_over_budget();
+  process_restores();
+}
+
+} // namespace Expectre
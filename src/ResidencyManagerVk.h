@@ -0,0 +1,118 @@
+#ifndef RESIDENCY_MANAGER_VK_H
+#define RESIDENCY_MANAGER_VK_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include <vma/vk_mem_alloc.h>
+#include <vulkan/vulkan.h>
+
+namespace Expectre {
+
+using ResidencyId = uint32_t;
+static constexpr ResidencyId kInvalidResidencyId = UINT32_MAX;
+
+/// Which budget a tracked resource counts against.
+enum class ResidencyPool : uint8_t {
+  // Dedicated VMA allocations (textures). Evicting these frees real VRAM.
+  DeviceMemory,
+  // Sub-allocations inside the shared vertex/index buffers. Evicting these
+  // frees space in the geometry arena so other meshes can be streamed in.
+  GeometryArena,
+};
+
+struct ResidencyConfig {
+  // Start evicting once device-local usage crosses this fraction of the
+  // budget reported by VK_EXT_memory_budget
+  float eviction_threshold = 0.90f;
+  // ...and keep evicting until usage is back under this fraction. The gap
+  // between the two stops us from thrashing right at the limit
+  float eviction_target = 0.80f;
+  // Upper bound on bytes re-uploaded per frame so reloads don't hitch
+  VkDeviceSize upload_bytes_per_frame = 16ull * 1024 * 1024;
+  // Resources used within this many frames may still be read by the GPU and
+  // are never evicted
+  uint32_t frames_in_flight = 2;
+};
+
+/// Hooks the owner of a resource gives the residency manager. Eviction must
+/// keep (or be able to re-read) a CPU copy so restore() can rebuild the GPU
+/// allocation later.
+struct ResidencyCallbacks {
+  std::function<void()> evict;
+  // Returns false if the GPU allocation could not be recreated
+  std::function<bool()> restore;
+};
+
+/// Tracks the last frame each GPU resource was used and keeps device-local
+/// memory under the VMA heap budget by evicting least-recently-used
+/// resources. Evicted resources are reloaded on demand, a few per frame.
+class ResidencyManagerVk {
+public:
+  ResidencyManagerVk() = delete;
+  ResidencyManagerVk(VmaAllocator allocator, const ResidencyConfig &config);
+
+  ResidencyManagerVk(const ResidencyManagerVk &) = delete;
+  ResidencyManagerVk &operator=(const ResidencyManagerVk &) = delete;
+
+  /// Starts tracking a resource. Pass resident = false if the owner could
+  /// not allocate it yet, it will then be restored on first use.
+  ResidencyId track(ResidencyPool pool, VkDeviceSize size_bytes,
+                    ResidencyCallbacks callbacks, bool resident = true);
+  void untrack(ResidencyId id);
+  /// Updates the size of a resource whose GPU allocation was rebuilt, e.g.
+  /// when the texture streamer changed its resident mips.
+  void resize(ResidencyId id, VkDeviceSize size_bytes);
+
+  /// Marks the resource as used by the frame being recorded. Returns false
+  /// (and queues a reload) if it is currently evicted, in which case the
+  /// caller must not reference it this frame.
+  bool use(ResidencyId id);
+  bool is_resident(ResidencyId id) const;
+
+  /// Evicts least-recently-used resources of pool until at least bytes have
+  /// been released, returns how many bytes were actually released.
+  VkDeviceSize evict_lru(ResidencyPool pool, VkDeviceSize bytes);
+
+  /// Call once per frame after the frame's slot is free on the GPU. Checks the
+  /// heap budget, evicts if needed, then reloads queued resources up to the
+  /// per-frame upload budget.
+  void begin_frame(uint64_t frame_number);
+
+  const ResidencyConfig &get_config() const { return m_config; }
+
+private:
+  struct Entry {
+    ResidencyPool pool = ResidencyPool::DeviceMemory;
+    VkDeviceSize size_bytes = 0;
+    uint64_t last_used_frame = 0;
+    bool alive = false;
+    bool resident = false;
+    bool restore_queued = false;
+    ResidencyCallbacks callbacks;
+  };
+
+  struct HeapUsage {
+    VkDeviceSize usage = 0;
+    VkDeviceSize budget = 0;
+  };
+
+  HeapUsage query_device_local_usage() const;
+  void evict_over_budget();
+  void process_restores();
+  bool can_evict(const Entry &entry) const;
+
+  VmaAllocator m_allocator = VK_NULL_HANDLE;
+  ResidencyConfig m_config{};
+  uint64_t m_frame_number = 0;
+
+  std::vector<Entry> m_entries;
+  std::vector<ResidencyId> m_free_ids;
+  std::deque<ResidencyId> m_restore_queue;
+};
+
+} // namespace Expectre
+
+#endif // RESIDENCY_MANAGER_VK_H
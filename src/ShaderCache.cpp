@@ -0,0 +1,237 @@
+#include "ShaderCache.h"
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <shaderc/shaderc.hpp>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <xxhash.h>
+
+namespace Expectre {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Bump when anything below changes what a given source compiles to
+constexpr uint32_t kShaderCacheVersion = 1;
+constexpr shaderc_optimization_level kOptimizationLevel =
+    shaderc_optimization_level_performance;
+
+bool read_text_file(const fs::path &path, std::string &out) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  out.assign(std::istreambuf_iterator<char>(file),
+             std::istreambuf_iterator<char>());
+  return true;
+}
+
+/// Resolves #include relative to the including file and records every file
+/// it opens, so a change to a header can be traced back to the shaders
+/// using it
+class TrackingIncluder : public shaderc::CompileOptions::IncluderInterface {
+public:
+  explicit TrackingIncluder(std::vector<fs::path> &included)
+      : m_included(included) {}
+
+  shaderc_include_result *GetInclude(const char *requested_source,
+                                     shaderc_include_type type,
+                                     const char *requesting_source,
+                                     size_t include_depth) override {
+    (void)type;
+    (void)include_depth;
+    auto include = std::make_unique<Include>();
+    const fs::path path = fs::weakly_canonical(
+        fs::path(requesting_source).parent_path() / requested_source);
+    if (read_text_file(path, include->content)) {
+      include->name = path.string();
+      if (std::find(m_included.begin(), m_included.end(), path) ==
+          m_included.end()) {
+        m_included.push_back(path);
+      }
+    } else {
+      // shaderc reports an empty name as a failed include, with the
+      // content as the error message
+      include->content = "Cannot open " + path.string();
+    }
+
+    include->result.source_name = include->name.c_str();
+    include->result.source_name_length = include->name.size();
+    include->result.content = include->content.c_str();
+    include->result.content_length = include->content.size();
+    include->result.user_data = include.get();
+    return &include.release()->result;
+  }
+
+  void ReleaseInclude(shaderc_include_result *data) override {
+    delete static_cast<Include *>(data->user_data);
+  }
+
+private:
+  struct Include {
+    shaderc_include_result result{};
+    std::string name;
+    std::string content;
+  };
+
+  std::vector<fs::path> &m_included;
+};
+
+} // namespace
+
+ShaderCache::ShaderCache(fs::path directory)
+    : m_directory(std::move(directory)) {
+  m_mutex = SDL_CreateMutex();
+  if (!m_mutex) {
+    throw std::runtime_error(
+        std::string("Failed to create shader cache mutex: ") + SDL_GetError());
+  }
+}
+
+ShaderCache::~ShaderCache() { SDL_DestroyMutex(m_mutex); }
+
+fs::path ShaderCache::default_directory() {
+  char *pref_path = SDL_GetPrefPath("Expectre", "Expectre");
+  if (!pref_path) {
+    spdlog::warn("No user pref path ({}), caching shaders in the temp dir",
+                 SDL_GetError());
+    return fs::temp_directory_path() / "expectre_shader_cache";
+  }
+  fs::path directory = fs::path(pref_path) / "shader_cache";
+  SDL_free(pref_path);
+  return directory;
+}
+
+fs::path ShaderCache::entry_path(uint64_t key) const {
+  return m_directory / fmt::format("{:016x}.spv", key);
+}
+
+std::optional<std::vector<uint32_t>>
+ShaderCache::get_spirv(const fs::path &source) {
+  shaderc_shader_kind kind;
+  if (source.extension() == ".vert") {
+    kind = shaderc_shader_kind::shaderc_vertex_shader;
+  } else if (source.extension() == ".frag") {
+    kind = shaderc_shader_kind::shaderc_fragment_shader;
+  } else {
+    spdlog::warn("Unknown shader stage for {}", source.string());
+    return std::nullopt;
+  }
+
+  const fs::path source_path = fs::weakly_canonical(source);
+  std::string shader_code;
+  if (!read_text_file(source_path, shader_code)) {
+    spdlog::warn("Failed to open shader file {}", source_path.string());
+    return std::nullopt;
+  }
+
+  std::vector<fs::path> dependencies{source_path};
+  shaderc::Compiler compiler;
+  shaderc::CompileOptions options;
+  options.SetOptimizationLevel(kOptimizationLevel);
+  options.SetIncluder(std::make_unique<TrackingIncluder>(dependencies));
+
+  // Includes are resolved here, so the key changes with any file the
+  // shader pulls in, not just the source itself
+  shaderc::PreprocessedSourceCompilationResult preprocessed =
+      compiler.PreprocessGlsl(shader_code, kind, source_path.string().c_str(),
+                              options);
+
+  // Recorded even if it fails, fixing a broken include has to trigger a
+  // reload too
+  SDL_LockMutex(m_mutex);
+  m_dependencies[source_path.string()] = dependencies;
+  SDL_UnlockMutex(m_mutex);
+
+  if (preprocessed.GetCompilationStatus() !=
+      shaderc_compilation_status_success) {
+    spdlog::error("Shader preprocessing failed: {}",
+                  preprocessed.GetErrorMessage());
+    return std::nullopt;
+  }
+  const std::string preprocessed_code(preprocessed.cbegin(),
+                                      preprocessed.cend());
+
+  XXH3_state_t *state = XXH3_createState();
+  XXH3_64bits_reset(state);
+  const uint32_t settings[] = {kShaderCacheVersion,
+                               static_cast<uint32_t>(kind),
+                               static_cast<uint32_t>(kOptimizationLevel)};
+  XXH3_64bits_update(state, settings, sizeof(settings));
+  XXH3_64bits_update(state, preprocessed_code.data(),
+                     preprocessed_code.size());
+  const uint64_t key = XXH3_64bits_digest(state);
+  XXH3_freeState(state);
+
+  const fs::path path = entry_path(key);
+  {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (file.is_open()) {
+      const size_t byte_count = static_cast<size_t>(file.tellg());
+      std::vector<uint32_t> spirv(byte_count / sizeof(uint32_t));
+      file.seekg(0);
+      file.read(reinterpret_cast<char *>(spirv.data()),
+                static_cast<std::streamsize>(byte_count));
+      if (file && byte_count > 0 && byte_count % sizeof(uint32_t) == 0) {
+        return spirv;
+      }
+      spdlog::warn("Ignoring unreadable shader cache entry {}", path.string());
+    }
+  }
+
+  shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(
+      preprocessed_code, kind, source_path.string().c_str(), options);
+  if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+    spdlog::error("Shader compilation failed: {}", result.GetErrorMessage());
+    return std::nullopt;
+  }
+  std::vector<uint32_t> spirv(result.cbegin(), result.cend());
+
+  // Temp file and rename like the other caches, a concurrent reader never
+  // sees half an entry
+  std::error_code error;
+  fs::create_directories(m_directory, error);
+  fs::path temp_path = path;
+  temp_path += ".tmp";
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(spirv.data()),
+              static_cast<std::streamsize>(spirv.size() * sizeof(uint32_t)));
+    if (!out) {
+      spdlog::warn("Failed writing {}", temp_path.string());
+      return spirv;
+    }
+  }
+  fs::rename(temp_path, path, error);
+  if (error) {
+    spdlog::warn("Failed to move {} into place: {}", path.string(),
+                 error.message());
+    fs::remove(temp_path, error);
+  }
+  spdlog::info("Compiled {} into the shader cache",
+               source_path.filename().string());
+  return spirv;
+}
+
+bool ShaderCache::is_dependency(const fs::path &path) const {
+  const fs::path canonical = fs::weakly_canonical(path);
+  SDL_LockMutex(m_mutex);
+  bool found = false;
+  for (const auto &[source, dependencies] : m_dependencies) {
+    if (std::find(dependencies.begin(), dependencies.end(), canonical) !=
+        dependencies.end()) {
+      found = true;
+      break;
+    }
+  }
+  SDL_UnlockMutex(m_mutex);
+  return found;
+}
+
+} // namespace Expectre
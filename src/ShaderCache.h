@@ -0,0 +1,53 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <SDL3/SDL.h>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Expectre {
+
+/// Compiled SPIR-V for GLSL sources, stored in the user cache dir under the
+/// hash of the preprocessed source, the shader stage and the compile
+/// options. Preprocessing is cheap next to a full compile, so unchanged
+/// shaders (and unchanged includes) are loaded straight from the cache.
+/// Nothing is ever written next to the sources.
+class ShaderCache {
+public:
+  explicit ShaderCache(std::filesystem::path directory = default_directory());
+  ~ShaderCache();
+
+  ShaderCache(const ShaderCache &) = delete;
+  ShaderCache &operator=(const ShaderCache &) = delete;
+
+  /// SPIR-V for a .vert/.frag source, compiled only if the cache has no
+  /// entry for its current contents. Logs and returns nothing if it doesn't
+  /// compile. Safe to call from several threads.
+  std::optional<std::vector<uint32_t>>
+  get_spirv(const std::filesystem::path &source);
+
+  /// True if the last get_spirv() of any source read this file, either as
+  /// the source itself or through an #include
+  bool is_dependency(const std::filesystem::path &path) const;
+
+  static std::filesystem::path default_directory();
+
+private:
+  std::filesystem::path entry_path(uint64_t key) const;
+
+  std::filesystem::path m_directory;
+
+  // Files each source read when it was last preprocessed, itself included.
+  // Guarded by m_mutex
+  mutable SDL_Mutex *m_mutex = nullptr;
+  std::unordered_map<std::string, std::vector<std::filesystem::path>>
+      m_dependencies;
+};
+
+} // namespace Expectre
+
+#endif // SHADER_CACHE_H
@@ -0,0 +1,24 @@
+#ifndef SHADER_FEATURES_H
+#define SHADER_FEATURES_H
+
+#include <cstdint>
+
+namespace Expectre {
+
+/// Material features a pipeline variant is specialized for. Bit i is the
+/// bool specialization constant i + 1 of frag.frag, constant 0 marks the
+/// generic pipeline that reads them from the draw's material instead.
+enum ShaderFeature : uint32_t {
+  kShaderFeatureAlbedoTexture = 1u << 0,
+  kShaderFeatureNormalMap = 1u << 1,
+  // Vertex color is the base color, used when there is no albedo texture
+  kShaderFeatureVertexColor = 1u << 2,
+  kShaderFeatureAlphaTest = 1u << 3,
+};
+using ShaderFeatures = uint32_t;
+
+static constexpr uint32_t kShaderFeatureCount = 4;
+
+} // namespace Expectre
+
+#endif // SHADER_FEATURES_H
@@ -0,0 +1,149 @@
+#include "ShaderFileWatcher.h"
+
+#include <algorithm>
+#include <map>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace Expectre {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// How often the watcher checks whether it should stop, and on platforms
+// without inotify how often it looks at the files
+constexpr int kWatchIntervalMs = 100;
+
+} // namespace
+
+ShaderFileWatcher::ShaderFileWatcher(std::vector<fs::path> directories,
+                                     ChangeCallback on_change)
+    : m_directories(std::move(directories)),
+      m_on_change(std::move(on_change)) {
+  for (const fs::path &directory : m_directories) {
+    if (!fs::is_directory(directory)) {
+      throw std::runtime_error("Filewatcher path not found: " +
+                               directory.string());
+    }
+  }
+
+  m_thread = SDL_CreateThread(static_watch_entry, "Shader Watcher",
+                              static_cast<void *>(this));
+  if (!m_thread) {
+    throw std::runtime_error(
+        std::string("Failed to create shader watcher thread: ") +
+        SDL_GetError());
+  }
+}
+
+ShaderFileWatcher::~ShaderFileWatcher() {
+  SDL_SetAtomicInt(&m_stopping, 1);
+  SDL_WaitThread(m_thread, nullptr);
+}
+
+int SDLCALL ShaderFileWatcher::static_watch_entry(void *ptr) {
+  static_cast<ShaderFileWatcher *>(ptr)->watch();
+  return 0;
+}
+
+#ifdef __linux__
+
+void ShaderFileWatcher::watch() {
+  const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    spdlog::warn("inotify unavailable, polling shader files instead");
+    poll_write_times();
+    return;
+  }
+
+  // Directories rather than the files themselves, editors that save by
+  // writing a new file and renaming it over the old one would otherwise
+  // leave us watching a deleted inode
+  std::unordered_map<int, fs::path> watched_dirs;
+  for (const fs::path &directory : m_directories) {
+    const int wd = inotify_add_watch(fd, directory.string().c_str(),
+                                     IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+      spdlog::warn("Failed to watch {}", directory.string());
+      continue;
+    }
+    watched_dirs[wd] = directory;
+  }
+
+  alignas(inotify_event) char buffer[4096];
+  while (!SDL_GetAtomicInt(&m_stopping)) {
+    pollfd poll_fd{fd, POLLIN, 0};
+    if (poll(&poll_fd, 1, kWatchIntervalMs) <= 0) {
+      continue;
+    }
+
+    // One save can produce several events, report each file once per read
+    std::vector<fs::path> changed;
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+      for (char *ptr = buffer; ptr < buffer + length;) {
+        const auto *event = reinterpret_cast<const inotify_event *>(ptr);
+        ptr += sizeof(inotify_event) + event->len;
+
+        auto dir = watched_dirs.find(event->wd);
+        if (event->len == 0 || dir == watched_dirs.end()) {
+          continue;
+        }
+        const fs::path path = dir->second / event->name;
+        if (std::find(changed.begin(), changed.end(), path) == changed.end()) {
+          changed.push_back(path);
+        }
+      }
+    }
+    for (const fs::path &path : changed) {
+      m_on_change(path);
+    }
+  }
+
+  close(fd);
+}
+
+#else
+
+void ShaderFileWatcher::watch() { poll_write_times(); }
+
+#endif
+
+void ShaderFileWatcher::poll_write_times() {
+  auto scan = [&](std::map<fs::path, fs::file_time_type> &write_times) {
+    std::error_code error;
+    for (const fs::path &directory : m_directories) {
+      for (const auto &entry : fs::directory_iterator(directory, error)) {
+        if (entry.is_regular_file(error)) {
+          write_times[entry.path()] = entry.last_write_time(error);
+        }
+      }
+    }
+  };
+
+  std::map<fs::path, fs::file_time_type> write_times;
+  scan(write_times);
+  while (!SDL_GetAtomicInt(&m_stopping)) {
+    SDL_Delay(kWatchIntervalMs);
+    std::map<fs::path, fs::file_time_type> current;
+    scan(current);
+    for (const auto &[path, write_time] : current) {
+      auto previous = write_times.find(path);
+      if (previous == write_times.end() || previous->second != write_time) {
+        m_on_change(path);
+      }
+    }
+    write_times = std::move(current);
+  }
+}
+
+} // namespace Expectre
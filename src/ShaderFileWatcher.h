@@ -1,97 +1,41 @@
 #ifndef SHADERFILEWATCHER_H
 #define SHADERFILEWATCHER_H
 
-#include <iostream>
-#include <fstream>
-#include <filesystem> 
-#include <shaderc/shaderc.hpp>
+#include <SDL3/SDL.h>
+#include <filesystem>
+#include <functional>
+#include <vector>
 
 namespace Expectre {
 
-	namespace fs = std::filesystem;
-
-	static bool ends_with(std::string_view str, std::string_view suffix) {
-		return str.size() >= suffix.size() &&
-		       str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
-	}
-
-	class ShaderFileWatcher {
-	public:
-		ShaderFileWatcher() = delete;
-		ShaderFileWatcher(const std::string& path) : m_path(path) {
-			// Check if path exists
-			bool exists = std::filesystem::exists(m_path);
-			// If not throw exception
-			if (!exists)
-				throw std::runtime_error("Filewatcher path not found");
-			// Use Win/Linux specific code to watch
-			// FILETIME 
-			m_last_write_time = std::filesystem::last_write_time(m_path);
-
-			if (ends_with(m_path, ".vert")) {
-				std::cout << "It's a vertex shader.\n";
-				m_shader_kind = shaderc_shader_kind::shaderc_vertex_shader;
-			}
-			else if (ends_with(m_path, ".frag")) {
-				std::cout << "It's a fragment shader.\n";
-				m_shader_kind = shaderc_shader_kind::shaderc_fragment_shader;
-			}
-
-		}
-
-		bool check_for_changes() {
-			auto write_time = fs::last_write_time(m_path);
-
-			if (write_time != m_last_write_time) {
-				compile();
-				m_last_write_time = write_time;
-				return true;
-			}
-
-			return false;
-		}
-
-
-	private:
-
-		fs::file_time_type m_last_write_time;
-		std::string m_path;
-		shaderc_shader_kind m_shader_kind;
-
-		std::string read_file() {
-			std::ifstream file(m_path);
-			if (!file) throw std::runtime_error("Failed to open shader file: " + m_path);
-			return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-		}
-
-		void compile() {
-			shaderc::Compiler compiler;
-			shaderc::CompileOptions options;
-			options.SetOptimizationLevel(shaderc_optimization_level::shaderc_optimization_level_performance);
-
-			std::string shader_code = read_file();
-			shaderc::CompilationResult result =
-				compiler.CompileGlslToSpv(
-					shader_code,
-					m_shader_kind,
-					m_path.c_str(),
-					options);
-
-			if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
-				throw std::runtime_error("Shader compilation failed: " + result.GetErrorMessage());
-			}
-
-			auto stem = std::filesystem::path(m_path).stem().string(); // removes extension
-			std::string filename = WORKSPACE_DIR + std::string("/shaders/") + stem + ".spv";
-
-			std::ofstream out(filename, std::ios::binary | std::ios::trunc);
-			out.write(reinterpret_cast<const char*>(result.cbegin()),
-				std::distance(result.cbegin(), result.cend()) * sizeof(uint32_t));
-			out.close();
-
-		}
-	};
-}
-
-
-#endif // FILEWATCHER_H
\ No newline at end of file
+/// Watches the shader directories on its own thread and reports every file
+/// written in them, sources and includes alike. Linux uses inotify, so
+/// nothing runs until a file is written. Other platforms poll modification
+/// times, still off the render thread.
+class ShaderFileWatcher {
+public:
+  /// Called on the watcher thread, once per changed file
+  using ChangeCallback = std::function<void(const std::filesystem::path &)>;
+
+  ShaderFileWatcher(std::vector<std::filesystem::path> directories,
+                    ChangeCallback on_change);
+  /// Stops the thread, a callback in progress finishes first
+  ~ShaderFileWatcher();
+
+  ShaderFileWatcher(const ShaderFileWatcher &) = delete;
+  ShaderFileWatcher &operator=(const ShaderFileWatcher &) = delete;
+
+private:
+  static int SDLCALL static_watch_entry(void *ptr);
+  void watch();
+  void poll_write_times();
+
+  std::vector<std::filesystem::path> m_directories;
+  ChangeCallback m_on_change;
+  SDL_Thread *m_thread = nullptr;
+  SDL_AtomicInt m_stopping{0};
+};
+
+} // namespace Expectre
+
+#endif // SHADERFILEWATCHER_H
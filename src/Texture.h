@@ -1,9 +1,12 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
+#include <memory>
 #include <stb_image.h>
 #include <string>
 #include <vulkan/vulkan.h>
 
+#include "MipChain.h"
+
 // #include "Resource.h"
 
 namespace Expectre {
@@ -14,7 +17,12 @@ struct Texture /*: public Resource*/ {
   uint32_t width = 0;
   uint32_t height = 0;
   uint8_t channels = 0;
+  // Matches channels, UNORM or sRGB depending on the texture's role
+  VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
   std::string name;
+  // Mips loaded from the cook output or the asset cache, data stays null
+  // when this is set
+  std::shared_ptr<const MipChain> cooked_mips;
 
   ~Texture() {
     if (data != nullptr)
@@ -25,8 +33,9 @@ struct Texture /*: public Resource*/ {
   Texture(Texture &&other) noexcept
       : /* Resource(std::move(other)),*/
         data(std::exchange(other.data, nullptr)), width(other.width),
-        height(other.height), channels(other.channels),
-        name(std::move(other.name)) {}
+        height(other.height), channels(other.channels), format(other.format),
+        name(std::move(other.name)),
+        cooked_mips(std::move(other.cooked_mips)) {}
 
   // Move Assignment Operator (i.e. t2 = std::move(t1); )
   Texture &operator=(Texture &&other) noexcept {
@@ -38,7 +47,9 @@ struct Texture /*: public Resource*/ {
       width = other.width;
       height = other.height;
       channels = other.channels;
+      format = other.format;
       name = std::move(other.name);
+      cooked_mips = std::move(other.cooked_mips);
     }
     return *this;
   }
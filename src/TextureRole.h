@@ -0,0 +1,65 @@
+#ifndef TEXTURE_ROLE_H
+#define TEXTURE_ROLE_H
+
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+namespace Expectre {
+
+/// What materials sample a texture for. Decides how many channels it keeps
+/// and whether it is stored as sRGB.
+enum class TextureRole : uint8_t {
+  Color,             // base color, emissive
+  Normal,            // tangent space x and y, z is rebuilt in the shader
+  MetallicRoughness, // glTF packing: occlusion R, roughness G, metallic B
+  Occlusion,         // red channel only
+};
+
+inline uint32_t texture_role_channels(TextureRole role) {
+  switch (role) {
+  case TextureRole::Normal:
+    return 2;
+  case TextureRole::Occlusion:
+    return 1;
+  case TextureRole::Color:
+  case TextureRole::MetallicRoughness:
+  default:
+    // Three channel formats are rarely sampleable, RGB data keeps an alpha
+    return 4;
+  }
+}
+
+/// Uncompressed format of decoded pixels in this role
+inline VkFormat texture_role_format(TextureRole role) {
+  switch (role) {
+  case TextureRole::Normal:
+    return VK_FORMAT_R8G8_UNORM;
+  case TextureRole::MetallicRoughness:
+    return VK_FORMAT_R8G8B8A8_UNORM;
+  case TextureRole::Occlusion:
+    return VK_FORMAT_R8_UNORM;
+  case TextureRole::Color:
+  default:
+    return VK_FORMAT_R8G8B8A8_SRGB;
+  }
+}
+
+/// Block compressed format ExpectreCook stores this role in
+inline VkFormat texture_role_bc_format(TextureRole role) {
+  switch (role) {
+  case TextureRole::Normal:
+    return VK_FORMAT_BC5_UNORM_BLOCK;
+  case TextureRole::MetallicRoughness:
+    return VK_FORMAT_BC7_UNORM_BLOCK;
+  case TextureRole::Occlusion:
+    return VK_FORMAT_BC4_UNORM_BLOCK;
+  case TextureRole::Color:
+  default:
+    return VK_FORMAT_BC7_SRGB_BLOCK;
+  }
+}
+
+} // namespace Expectre
+
+#endif // TEXTURE_ROLE_H
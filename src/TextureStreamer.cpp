@@ -0,0 +1,203 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <spdlog/spdlog.h>
+
+namespace Expectre {
+
+TextureStreamer::TextureStreamer(const TextureStreamingConfig &config)
+    : m_config(config) {}
+
+StreamId TextureStreamer::track(uint32_t width, uint32_t height,
+                                std::vector<VkDeviceSize> mip_bytes,
+                                uint32_t resident_mip,
+                                VkDeviceSize allocation_bytes,
+                                SetResidentMip set_resident_mip) {
+  StreamId id;
+  if (!m_free_ids.empty()) {
+    id = m_free_ids.back();
+    m_free_ids.pop_back();
+  } else {
+    id = static_cast<StreamId>(m_entries.size());
+    m_entries.emplace_back();
+  }
+
+  Entry &entry = m_entries[id];
+  entry.base_dimension = std::max(width, height);
+  entry.mip_bytes = std::move(mip_bytes);
+  entry.resident_mip = resident_mip;
+  entry.allocation_bytes = allocation_bytes;
+  entry.floor_mip = resident_mip;
+  entry.requested_mip = UINT32_MAX;
+  entry.wanted_mip = resident_mip;
+  entry.last_needed_frame = m_frame_number;
+  entry.alive = true;
+  entry.set_resident_mip = std::move(set_resident_mip);
+
+  m_resident_bytes += allocation_bytes;
+  return id;
+}
+
+void TextureStreamer::untrack(StreamId id) {
+  if (id >= m_entries.size() || !m_entries[id].alive) {
+    return;
+  }
+  m_resident_bytes -= m_entries[id].allocation_bytes;
+  m_entries[id] = Entry{};
+  m_free_ids.push_back(id);
+}
+
+uint32_t TextureStreamer::initial_mip(uint32_t width, uint32_t height,
+                                      uint32_t mip_count) const {
+  uint32_t mip = 0;
+  while (mip + 1 < mip_count &&
+         std::max(width >> mip, height >> mip) >
+             m_config.initial_max_dimension) {
+    mip++;
+  }
+  return mip;
+}
+
+uint32_t TextureStreamer::get_resident_mip(StreamId id) const {
+  if (id >= m_entries.size() || !m_entries[id].alive) {
+    return 0;
+  }
+  return m_entries[id].resident_mip;
+}
+
+void TextureStreamer::request_footprint(StreamId id, float uv_per_pixel) {
+  if (id >= m_entries.size() || !m_entries[id].alive) {
+    return;
+  }
+  Entry &entry = m_entries[id];
+
+  // One pixel covering uv_per_pixel * base_dimension texels of mip 0 means
+  // mip log2(that) has roughly one texel per pixel. Round down so we err on
+  // the side of detail.
+  const float texels_per_pixel =
+      uv_per_pixel * static_cast<float>(entry.base_dimension);
+  uint32_t mip = 0;
+  if (texels_per_pixel > 1.0f) {
+    mip = static_cast<uint32_t>(std::floor(std::log2(texels_per_pixel)));
+  }
+  mip = std::min(mip, static_cast<uint32_t>(entry.mip_bytes.size()) - 1);
+
+  entry.requested_mip = std::min(entry.requested_mip, mip);
+}
+
+bool TextureStreamer::set_resident_mip(Entry &entry, uint32_t first_mip) {
+  const VkDeviceSize allocation_bytes = entry.set_resident_mip(first_mip);
+  if (allocation_bytes == 0) {
+    return false;
+  }
+  m_resident_bytes -= entry.allocation_bytes;
+  m_resident_bytes += allocation_bytes;
+  entry.allocation_bytes = allocation_bytes;
+  entry.resident_mip = first_mip;
+  return true;
+}
+
+VkDeviceSize TextureStreamer::drop_unneeded(VkDeviceSize bytes,
+                                            const Entry *keep) {
+  std::vector<Entry *> candidates;
+  for (Entry &entry : m_entries) {
+    if (entry.alive && &entry != keep &&
+        entry.resident_mip < entry.wanted_mip) {
+      candidates.push_back(&entry);
+    }
+  }
+
+  // Textures that haven't needed their detail for the longest go first
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Entry *a, const Entry *b) {
+              return a->last_needed_frame < b->last_needed_frame;
+            });
+
+  VkDeviceSize released = 0;
+  for (Entry *entry : candidates) {
+    if (released >= bytes) {
+      break;
+    }
+    const VkDeviceSize before = entry->allocation_bytes;
+    if (set_resident_mip(*entry, entry->wanted_mip) &&
+        entry->allocation_bytes < before) {
+      released += before - entry->allocation_bytes;
+    }
+  }
+  return released;
+}
+
+void TextureStreamer::update(uint64_t frame_number) {
+  m_frame_number = frame_number;
+
+  std::vector<Entry *> wants_more;
+  for (Entry &entry : m_entries) {
+    if (!entry.alive) {
+      continue;
+    }
+    // Textures nobody drew this frame only need their floor mip
+    entry.wanted_mip =
+        std::min(entry.requested_mip == UINT32_MAX ? entry.floor_mip
+                                                   : entry.requested_mip,
+                 entry.floor_mip);
+    entry.requested_mip = UINT32_MAX;
+
+    if (entry.wanted_mip >= entry.resident_mip) {
+      if (entry.wanted_mip == entry.resident_mip) {
+        entry.last_needed_frame = frame_number;
+      } else if (frame_number - entry.last_needed_frame >=
+                 m_config.drop_delay_frames) {
+        // Over-detailed for a while, give the memory back
+        set_resident_mip(entry, entry.wanted_mip);
+      }
+      continue;
+    }
+
+    entry.last_needed_frame = frame_number;
+    wants_more.push_back(&entry);
+  }
+
+  // Biggest shortfall first, a texture 3 mips too blurry is more visible
+  // than one off by a single mip
+  std::sort(wants_more.begin(), wants_more.end(),
+            [](const Entry *a, const Entry *b) {
+              return a->resident_mip - a->wanted_mip >
+                     b->resident_mip - b->wanted_mip;
+            });
+
+  VkDeviceSize uploaded = 0;
+  for (Entry *entry : wants_more) {
+    // One mip per frame, so textures sharpen progressively instead of one
+    // texture eating the whole upload budget. Only the new level is
+    // uploaded, the resident ones are copied over on the GPU.
+    const uint32_t next_mip = entry->resident_mip - 1;
+    const VkDeviceSize next_bytes = entry->mip_bytes[next_mip];
+    // The new allocation's size is only known once it exists, the level's
+    // size estimates how much it grows
+    const VkDeviceSize grow_bytes = next_bytes;
+
+    // Always let at least one upload through, otherwise a mip larger than
+    // the per-frame budget would never stream in
+    if (uploaded > 0 &&
+        uploaded + next_bytes > m_config.upload_bytes_per_frame) {
+      break;
+    }
+
+    if (m_resident_bytes + grow_bytes > m_config.memory_budget) {
+      const VkDeviceSize over =
+          m_resident_bytes + grow_bytes - m_config.memory_budget;
+      if (drop_unneeded(over, entry) < over) {
+        spdlog::debug("[TextureStreamer] Memory budget full ({} MB)",
+                      m_resident_bytes / (1024 * 1024));
+        break;
+      }
+    }
+
+    if (set_resident_mip(*entry, next_mip)) {
+      uploaded += next_bytes;
+    }
+  }
+}
+
+} // namespace Expectre
@@ -0,0 +1,106 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace Expectre {
+
+using StreamId = uint32_t;
+static constexpr StreamId kInvalidStreamId = UINT32_MAX;
+
+struct TextureStreamingConfig {
+  // Total GPU bytes all streamed textures may occupy together, counted in
+  // the sizes of their actual allocations
+  VkDeviceSize memory_budget = 512ull * 1024 * 1024;
+  // Upper bound on texture bytes uploaded per frame so streaming doesn't
+  // hitch
+  VkDeviceSize upload_bytes_per_frame = 8ull * 1024 * 1024;
+  // Textures first become resident at the largest mip whose width and height
+  // fit in this, detail is streamed in once something draws them
+  uint32_t initial_max_dimension = 64;
+  // How long a texture has to be over-detailed before its extra mips are
+  // dropped, stops textures thrashing as the camera moves back and forth
+  uint32_t drop_delay_frames = 120;
+};
+
+/// Decides which mip level each texture should have resident. Draw
+/// preparation reports how many UV units each pixel covers, the streamer
+/// turns that into a required mip and calls back into the owner of the
+/// texture to make a different range of the mip chain resident, staying
+/// under the memory and per-frame upload budgets.
+class TextureStreamer {
+public:
+  /// Called with the new finest resident mip. Returns the size of the
+  /// texture's new allocation, 0 if the GPU texture could not be rebuilt
+  /// (e.g. it is currently evicted).
+  using SetResidentMip = std::function<VkDeviceSize(uint32_t first_mip)>;
+
+  TextureStreamer() = delete;
+  explicit TextureStreamer(const TextureStreamingConfig &config);
+
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+  /// mip_bytes holds the size of every level, finest first, which is what
+  /// growing a texture is estimated from. allocation_bytes is the size of
+  /// its allocation at resident_mip.
+  StreamId track(uint32_t width, uint32_t height,
+                 std::vector<VkDeviceSize> mip_bytes, uint32_t resident_mip,
+                 VkDeviceSize allocation_bytes,
+                 SetResidentMip set_resident_mip);
+  void untrack(StreamId id);
+
+  /// Reports that a draw this frame samples the texture with roughly
+  /// uv_per_pixel UV units covered by one screen pixel.
+  void request_footprint(StreamId id, float uv_per_pixel);
+
+  /// Applies this frame's requests, call once per frame after draw
+  /// preparation.
+  void update(uint64_t frame_number);
+
+  /// The mip a texture starts at when first uploaded.
+  uint32_t initial_mip(uint32_t width, uint32_t height,
+                       uint32_t mip_count) const;
+
+  uint32_t get_resident_mip(StreamId id) const;
+  VkDeviceSize get_resident_bytes() const { return m_resident_bytes; }
+  const TextureStreamingConfig &get_config() const { return m_config; }
+
+private:
+  struct Entry {
+    uint32_t base_dimension = 0; // max(width, height) of mip 0
+    std::vector<VkDeviceSize> mip_bytes;
+    uint32_t resident_mip = 0;
+    // Size of the texture's allocation, counted against the budget
+    VkDeviceSize allocation_bytes = 0;
+    // Never dropped below this, it is what the texture was uploaded with
+    uint32_t floor_mip = 0;
+    // Finest mip any draw asked for this frame, UINT32_MAX if none did
+    uint32_t requested_mip = UINT32_MAX;
+    uint32_t wanted_mip = 0;
+    // Last frame the resident mips were all actually needed
+    uint64_t last_needed_frame = 0;
+    bool alive = false;
+    SetResidentMip set_resident_mip;
+  };
+
+  bool set_resident_mip(Entry &entry, uint32_t first_mip);
+  // Drops mips from textures that have more detail than they need until
+  // bytes have been released, returns how many bytes were released
+  VkDeviceSize drop_unneeded(VkDeviceSize bytes, const Entry *keep);
+
+  TextureStreamingConfig m_config{};
+  uint64_t m_frame_number = 0;
+  VkDeviceSize m_resident_bytes = 0;
+
+  std::vector<Entry> m_entries;
+  std::vector<StreamId> m_free_ids;
+};
+
+} // namespace Expectre
+
+#endif // TEXTURE_STREAMER_H
@@ -0,0 +1,102 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace Expectre {
+
+ThreadPool::ThreadPool(uint32_t thread_count, const char *name) {
+  if (thread_count == 0) {
+    thread_count =
+        static_cast<uint32_t>(std::max(1, SDL_GetNumLogicalCPUCores() - 1));
+  }
+
+  m_mutex = SDL_CreateMutex();
+  m_job_available = SDL_CreateCondition();
+  m_idle = SDL_CreateCondition();
+  if (!m_mutex || !m_job_available || !m_idle) {
+    throw std::runtime_error(
+        std::string("Failed to create thread pool primitives: ") +
+        SDL_GetError());
+  }
+
+  for (uint32_t i = 0; i < thread_count; i++) {
+    SDL_Thread *thread =
+        SDL_CreateThread(static_worker_entry, name, static_cast<void *>(this));
+    if (!thread) {
+      throw std::runtime_error(std::string("Failed to create worker thread: ") +
+                               SDL_GetError());
+    }
+    m_threads.push_back(thread);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  SDL_LockMutex(m_mutex);
+  m_stopping = true;
+  SDL_BroadcastCondition(m_job_available);
+  SDL_UnlockMutex(m_mutex);
+
+  // Workers finish whatever is still queued before they exit
+  for (SDL_Thread *thread : m_threads) {
+    SDL_WaitThread(thread, nullptr);
+  }
+
+  SDL_DestroyCondition(m_idle);
+  SDL_DestroyCondition(m_job_available);
+  SDL_DestroyMutex(m_mutex);
+}
+
+ThreadPool &ThreadPool::Instance() {
+  static ThreadPool instance(0, "Job Worker");
+  return instance;
+}
+
+void ThreadPool::submit(Job job) {
+  SDL_LockMutex(m_mutex);
+  m_jobs.push_back(std::move(job));
+  SDL_SignalCondition(m_job_available);
+  SDL_UnlockMutex(m_mutex);
+}
+
+void ThreadPool::wait_idle() {
+  SDL_LockMutex(m_mutex);
+  while (!m_jobs.empty() || m_running_jobs > 0) {
+    SDL_WaitCondition(m_idle, m_mutex);
+  }
+  SDL_UnlockMutex(m_mutex);
+}
+
+int SDLCALL ThreadPool::static_worker_entry(void *ptr) {
+  static_cast<ThreadPool *>(ptr)->run_worker();
+  return 0;
+}
+
+void ThreadPool::run_worker() {
+  SDL_LockMutex(m_mutex);
+  while (true) {
+    while (m_jobs.empty() && !m_stopping) {
+      SDL_WaitCondition(m_job_available, m_mutex);
+    }
+    if (m_jobs.empty()) {
+      break; // stopping and nothing left to do
+    }
+
+    Job job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+    m_running_jobs++;
+
+    SDL_UnlockMutex(m_mutex);
+    job();
+    SDL_LockMutex(m_mutex);
+
+    m_running_jobs--;
+    if (m_jobs.empty() && m_running_jobs == 0) {
+      SDL_BroadcastCondition(m_idle);
+    }
+  }
+  SDL_UnlockMutex(m_mutex);
+}
+
+} // namespace Expectre
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <SDL3/SDL.h>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace Expectre {
+
+/// Fixed set of SDL worker threads pulling jobs off a shared FIFO queue.
+/// Jobs must not touch Vulkan queues or anything else owned by the render
+/// thread, they hand their results back and the render thread picks them up.
+class ThreadPool {
+public:
+  using Job = std::function<void()>;
+
+  /// thread_count = 0 uses one thread per logical core minus one, leaving a
+  /// core for the render thread.
+  explicit ThreadPool(uint32_t thread_count = 0, const char *name = "Worker");
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /// Shared pool for background jobs (mip generation, image decoding, ...).
+  static ThreadPool &Instance();
+
+  void submit(Job job);
+
+  /// Blocks until the queue is empty and every worker is idle.
+  void wait_idle();
+
+  uint32_t get_thread_count() const {
+    return static_cast<uint32_t>(m_threads.size());
+  }
+
+private:
+  static int SDLCALL static_worker_entry(void *ptr);
+  void run_worker();
+
+  std::vector<SDL_Thread *> m_threads;
+  SDL_Mutex *m_mutex = nullptr;
+  // Signaled when a job is queued or the pool is shutting down
+  SDL_Condition *m_job_available = nullptr;
+  // Signaled when the last running job finishes with an empty queue
+  SDL_Condition *m_idle = nullptr;
+
+  std::deque<Job> m_jobs;
+  uint32_t m_running_jobs = 0;
+  bool m_stopping = false;
+};
+
+} // namespace Expectre
+
+#endif // THREAD_POOL_H
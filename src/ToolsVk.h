@@ -8,6 +8,7 @@
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_vulkan.h>
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp> // Include this header for glm::pi<float>()
@@ -120,6 +121,22 @@ static VkVertexInputBindingDescription getBindingDescription() {
   return binding_description;
 }
 
+static VkShaderModule createShaderModule(const VkDevice &device,
+                                         const std::vector<uint32_t> &spirv) {
+  VkShaderModuleCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  createInfo.codeSize = spirv.size() * sizeof(uint32_t);
+  createInfo.pCode = spirv.data();
+
+  VkShaderModule shaderModule;
+  if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create shader module!");
+  }
+
+  return shaderModule;
+}
+
 static VkShaderModule createShaderModule(const VkDevice &device,
                                          const std::string &filename) {
   std::ifstream file(filename, std::ios::ate | std::ios::binary);
@@ -182,6 +199,23 @@ static VkSurfaceFormatKHR choose_swap_surface_format(
   return availableFormats[0];
 }
 
+// FIFO is the only mode every surface supports, and the only vsynced one
+static VkPresentModeKHR
+choose_swap_present_mode(const std::vector<VkPresentModeKHR> &available_modes,
+                         bool vsync) {
+  if (vsync) {
+    return VK_PRESENT_MODE_FIFO_KHR;
+  }
+  for (VkPresentModeKHR preferred :
+       {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR}) {
+    if (std::find(available_modes.begin(), available_modes.end(),
+                  preferred) != available_modes.end()) {
+      return preferred;
+    }
+  }
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
 struct SwapChainSupportDetails {
   VkSurfaceCapabilitiesKHR capabilities;
   std::vector<VkSurfaceFormatKHR> formats;
@@ -263,7 +297,8 @@ static QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device,
 
 static VkImageView create_image_view(VkDevice device, VkImage image,
                                      VkFormat format,
-                                     VkImageAspectFlags aspectFlags) {
+                                     VkImageAspectFlags aspectFlags,
+                                     uint32_t level_count = 1) {
   VkImageViewCreateInfo view_info{};
   view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
   view_info.image = image;
@@ -271,7 +306,7 @@ static VkImageView create_image_view(VkDevice device, VkImage image,
   view_info.format = format;
   view_info.subresourceRange.aspectMask = aspectFlags;
   view_info.subresourceRange.baseMipLevel = 0;
-  view_info.subresourceRange.levelCount = 1;
+  view_info.subresourceRange.levelCount = level_count;
   view_info.subresourceRange.baseArrayLayer = 0;
   view_info.subresourceRange.layerCount = 1;
 
@@ -403,38 +438,77 @@ static AllocatedBuffer create_buffer(VmaAllocator allocator, VkDeviceSize size,
   return result;
 }
 
-static void copy_buffer(VkDevice device, VkCommandPool command_pool,
-                        VkQueue graphics_queue, VkBuffer srcBuffer,
-                        VkBuffer dstBuffer, VkBufferCopy copy_region) {
-  VkCommandBuffer commandBuffer =
-      ToolsVk::begin_single_time_commands(device, command_pool);
+// Fills mips 1..mip_levels-1 by repeatedly blitting each level into the next
+// with linear filtering. Expects every level in TRANSFER_DST_OPTIMAL with
+// level 0 already written, leaves every level SHADER_READ_ONLY_OPTIMAL. The
+// format must support VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT.
+static void record_mip_blits(VkCommandBuffer cmd_buffer, VkImage image,
+                             uint32_t width, uint32_t height,
+                             uint32_t mip_levels) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+
+  int32_t mip_width = static_cast<int32_t>(width);
+  int32_t mip_height = static_cast<int32_t>(height);
 
-  vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copy_region);
+  for (uint32_t level = 1; level < mip_levels; level++) {
+    // Previous level: finished being written, becomes the blit source
+    barrier.subresourceRange.baseMipLevel = level - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+
+    const int32_t next_width = mip_width > 1 ? mip_width / 2 : 1;
+    const int32_t next_height = mip_height > 1 ? mip_height / 2 : 1;
+
+    VkImageBlit blit{};
+    blit.srcOffsets[1] = {mip_width, mip_height, 1};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.mipLevel = level - 1;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = 1;
+    blit.dstOffsets[1] = {next_width, next_height, 1};
+    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.mipLevel = level;
+    blit.dstSubresource.baseArrayLayer = 0;
+    blit.dstSubresource.layerCount = 1;
+    vkCmdBlitImage(cmd_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                   VK_FILTER_LINEAR);
+
+    // Previous level is done, hand it to the fragment shader
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &barrier);
 
-  ToolsVk::end_single_time_commands(device, command_pool, commandBuffer,
-                                    graphics_queue);
-}
+    mip_width = next_width;
+    mip_height = next_height;
+  }
 
-static void copy_buffer_to_image(VkDevice device, VkCommandPool cmd_pool,
-                                 VkQueue graphics_queue, VkBuffer buffer,
-                                 VkImage image, uint32_t width,
-                                 uint32_t height) {
-  VkCommandBuffer command_buffer = begin_single_time_commands(device, cmd_pool);
-
-  VkBufferImageCopy region{};
-  region.bufferOffset = 0;
-  region.bufferRowLength = 0;
-  region.bufferImageHeight = 0;
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount = 1;
-  region.imageOffset = {0, 0, 0};
-  region.imageExtent = {width, height, 1};
-
-  vkCmdCopyBufferToImage(command_buffer, buffer, image,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-  end_single_time_commands(device, cmd_pool, command_buffer, graphics_queue);
+  // The last level was only ever written to
+  barrier.subresourceRange.baseMipLevel = mip_levels - 1;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
 }
 
 static void set_object_name(VkDevice device, uint64_t objectHandle,
@@ -461,7 +535,8 @@ static VkSampler create_texture_sampler(VkPhysicalDevice physical_device,
   VkSamplerCreateInfo sampler_info{};
   sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
   sampler_info.magFilter = VK_FILTER_NEAREST;
-  sampler_info.minFilter = VK_FILTER_NEAREST;
+  // Linear minification so the mip chain is actually filtered (trilinear)
+  sampler_info.minFilter = VK_FILTER_LINEAR;
   sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
   sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
   sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
@@ -477,7 +552,9 @@ static VkSampler create_texture_sampler(VkPhysicalDevice physical_device,
   sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
   sampler_info.mipLodBias = 0.0f;
   sampler_info.minLod = 0.0f;
-  sampler_info.maxLod = 0.0f;
+  // Textures only contain their resident mips, let the view decide how many
+  // there are
+  sampler_info.maxLod = VK_LOD_CLAMP_NONE;
 
   VK_CHECK_RESULT(vkCreateSampler(device, &sampler_info, nullptr, &sampler));
   return sampler;
@@ -581,6 +658,22 @@ static VkPhysicalDevice select_physical_device(VkInstance instance) {
   return chosen_phys_device;
 }
 
+static bool device_supports_extension(VkPhysicalDevice phys_device,
+                                      const char *extension_name) {
+  uint32_t extension_count = 0;
+  vkEnumerateDeviceExtensionProperties(phys_device, nullptr, &extension_count,
+                                       nullptr);
+  std::vector<VkExtensionProperties> extensions(extension_count);
+  vkEnumerateDeviceExtensionProperties(phys_device, nullptr, &extension_count,
+                                       extensions.data());
+  for (const auto &extension : extensions) {
+    if (std::strcmp(extension.extensionName, extension_name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 static VkImageAspectFlags choose_aspect_flags(uint32_t num_channels) {
   if (num_channels == 3 || num_channels == 4) {
     return VK_IMAGE_ASPECT_COLOR_BIT;
@@ -595,13 +688,15 @@ static VkImageAspectFlags choose_aspect_flags(uint32_t num_channels) {
   return VK_IMAGE_ASPECT_COLOR_BIT;
 }
 
-static void transition_image_layout(VkDevice device, VkCommandPool cmd_pool,
-                                    VkQueue graphics_queue, VkImage image,
-                                    VkImageAspectFlags aspect_mask,
-                                    VkImageLayout old_layout,
-                                    VkImageLayout new_layout) {
-  VkCommandBuffer cmd_buffer = begin_single_time_commands(device, cmd_pool);
-
+// Records the barrier for one of the layout transitions below on levels
+// base_mip_level .. base_mip_level + level_count - 1
+static void record_image_layout_transition(VkCommandBuffer cmd_buffer,
+                                           VkImage image,
+                                           VkImageAspectFlags aspect_mask,
+                                           VkImageLayout old_layout,
+                                           VkImageLayout new_layout,
+                                           uint32_t base_mip_level,
+                                           uint32_t level_count) {
   VkImageMemoryBarrier barrier{};
   barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
   barrier.oldLayout = old_layout;
@@ -610,8 +705,8 @@ static void transition_image_layout(VkDevice device, VkCommandPool cmd_pool,
   barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
   barrier.image = image;
   barrier.subresourceRange.aspectMask = aspect_mask;
-  barrier.subresourceRange.baseMipLevel = 0;
-  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.baseMipLevel = base_mip_level;
+  barrier.subresourceRange.levelCount = level_count;
   barrier.subresourceRange.baseArrayLayer = 0;
   barrier.subresourceRange.layerCount = 1;
 
@@ -637,13 +732,29 @@ static void transition_image_layout(VkDevice device, VkCommandPool cmd_pool,
     barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
     source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
     dest_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  } else if (old_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL &&
+             new_layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+    barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    source_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dest_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
   } else {
     throw std::invalid_argument("unsupported layout transition!");
   }
 
   vkCmdPipelineBarrier(cmd_buffer, source_stage, dest_stage, 0, 0, nullptr, 0,
                        nullptr, 1, &barrier);
+}
 
+static void transition_image_layout(VkDevice device, VkCommandPool cmd_pool,
+                                    VkQueue graphics_queue, VkImage image,
+                                    VkImageAspectFlags aspect_mask,
+                                    VkImageLayout old_layout,
+                                    VkImageLayout new_layout,
+                                    uint32_t level_count = 1) {
+  VkCommandBuffer cmd_buffer = begin_single_time_commands(device, cmd_pool);
+  record_image_layout_transition(cmd_buffer, image, aspect_mask, old_layout,
+                                 new_layout, 0, level_count);
   end_single_time_commands(device, cmd_pool, cmd_buffer, graphics_queue);
 }
 
@@ -0,0 +1,157 @@
+// ExpectreCook: offline texture cooker.
+//
+// Usage: ExpectreCook [--force] <model.gltf>...
+//
+// Every PNG/JPEG a glTF references by uri is decoded, mipped, block
+// compressed and written next to the model as cooked/<uri>.ktx2, which
+// AssetImporter picks up instead of decoding the source at load time. The
+// BC format follows how materials use the image (see TextureRole):
+//   base color, emissive -> BC7 sRGB
+//   metallic-roughness   -> BC7 linear (also holds occlusion if shared)
+//   normal               -> BC5 (x, y; z is rebuilt in the shader)
+//   occlusion            -> BC4 (red channel)
+// Images whose cooked file is newer than the source are skipped unless
+// --force is passed.
+
+#define STB_IMAGE_IMPLEMENTATION // includes stb function bodies
+#include "BlockCompression.h"
+#include "Image.h"
+#include "Ktx2.h"
+#include "ThreadPool.h"
+#include "scene/GltfImageRoles.h"
+
+#include <fastgltf/core.hpp>
+#include <fastgltf/types.hpp>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+
+using namespace Expectre;
+
+namespace {
+
+bool is_up_to_date(const std::filesystem::path &source,
+                   const std::filesystem::path &cooked) {
+  std::error_code error;
+  if (!std::filesystem::exists(cooked, error)) {
+    return false;
+  }
+  const auto cooked_time = std::filesystem::last_write_time(cooked, error);
+  if (error) {
+    return false;
+  }
+  return cooked_time >= std::filesystem::last_write_time(source, error) &&
+         !error;
+}
+
+// Returns the number of images that failed to cook
+uint32_t cook_model(const std::filesystem::path &model_path, bool force,
+                    ThreadPool &pool) {
+  std::error_code error;
+  const std::filesystem::path gltf_path =
+      std::filesystem::canonical(model_path, error);
+  if (error) {
+    spdlog::error("Path not found: {}", model_path.string());
+    return 1;
+  }
+
+  auto data = fastgltf::GltfDataBuffer::FromPath(gltf_path);
+  if (data.error() != fastgltf::Error::None) {
+    spdlog::error("fastgltf failed to read raw file bytes: {}",
+                  gltf_path.string());
+    return 1;
+  }
+
+  // External buffers aren't loaded, only the image and material tables are
+  // needed
+  fastgltf::Parser parser;
+  auto asset_result = parser.loadGltf(data.get(), gltf_path.parent_path());
+  if (asset_result.error() != fastgltf::Error::None) {
+    spdlog::error("fastgltf failed to parse {}: {}", gltf_path.string(),
+                  fastgltf::getErrorMessage(asset_result.error()));
+    return 1;
+  }
+  const fastgltf::Asset &asset = asset_result.get();
+  const std::vector<TextureRole> roles = pick_gltf_image_roles(asset);
+
+  uint32_t failures = 0;
+  for (size_t i = 0; i < asset.images.size(); i++) {
+    const auto *uri =
+        std::get_if<fastgltf::sources::URI>(&asset.images[i].data);
+    if (uri == nullptr || !uri->uri.isLocalPath() ||
+        uri->fileByteOffset != 0) {
+      spdlog::info("Skipping image {}: only local files are cooked", i);
+      continue;
+    }
+
+    const std::filesystem::path source =
+        gltf_path.parent_path() / uri->uri.path();
+    const std::filesystem::path cooked =
+        cooked_texture_path(gltf_path, uri->uri.path());
+    if (!force && is_up_to_date(source, cooked)) {
+      spdlog::info("Up to date: {}", cooked.string());
+      continue;
+    }
+
+    Image image = import_from_file(source);
+    if (image.data == nullptr) {
+      failures++;
+      continue;
+    }
+
+    // Decoded as RGBA whatever the role, only color is filtered as sRGB
+    const VkFormat rgba_format = roles[i] == TextureRole::Color
+                                     ? VK_FORMAT_R8G8B8A8_SRGB
+                                     : VK_FORMAT_R8G8B8A8_UNORM;
+    const MipChain rgba_chain =
+        build_mip_chain(image.data, image.width, image.height, image.channels,
+                        rgba_format);
+    const MipChain bc_chain = compress_mip_chain(
+        rgba_chain, texture_role_bc_format(roles[i]), pool);
+
+    std::filesystem::create_directories(cooked.parent_path(), error);
+    if (bc_chain.levels.empty() || !write_ktx2(cooked, bc_chain)) {
+      failures++;
+      continue;
+    }
+    spdlog::info("Cooked {} ({}x{}, {} mips, {} KiB)", cooked.string(),
+                 image.width, image.height, bc_chain.level_count(),
+                 bc_chain.pixels.size() / 1024);
+  }
+  return failures;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  bool force = false;
+  std::vector<std::filesystem::path> models;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--force") {
+      force = true;
+    } else {
+      models.emplace_back(arg);
+    }
+  }
+
+  if (models.empty()) {
+    spdlog::error("Usage: {} [--force] <model.gltf>...", argv[0]);
+    return 1;
+  }
+
+  // Every core works on blocks, there is no render thread to leave room for
+  ThreadPool pool(static_cast<uint32_t>(SDL_GetNumLogicalCPUCores()),
+                  "Cook Worker");
+
+  uint32_t failures = 0;
+  for (const auto &model : models) {
+    failures += cook_model(model, force, pool);
+  }
+  if (failures > 0) {
+    spdlog::error("{} image(s) failed to cook", failures);
+    return 1;
+  }
+  return 0;
+}
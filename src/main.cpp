@@ -1,5 +1,6 @@
 ﻿#include "AppTime.h"
 #include "Engine.h"
+#include "FramePacing.h"
 #include "spdlog/spdlog.h"
 #include <iostream>
 
@@ -14,7 +15,8 @@ int main(int argc, char *argv[]) {
   spdlog::set_level(spdlog::level::debug);
   try {
     std::cout << "STARTING UP...." << std::endl;
-    Expectre::Engine engine{};
+    Expectre::Engine engine{
+        Expectre::FramePacingConfig::from_args(argc, argv)};
     engine.run();
   } catch (std::exception &e) {
     std::cout << "EXCEPTION: \n" << e.what() << std::endl;
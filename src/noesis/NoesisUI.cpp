@@ -200,7 +200,7 @@ void NoesisUI::PreRender(VkCommandBuffer cmd, uint64_t frameNumber,
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-void NoesisUI::Render() {
+void NoesisUI::Render(VkCommandBuffer cmd) {
   // Re-call SetCommandBuffer to invalidate VKRenderDevice's internal dynamic
   // state cache.  Between RenderOffscreen() and the onscreen pass our 3D
   // pipeline binds different state; without this the cached pipeline/stencil
@@ -211,7 +211,9 @@ void NoesisUI::Render() {
                  (uint64_t)m_renderPass, (int)m_sampleCount, (void*)m_view.GetPtr());
     logged = true;
   }
-  m_device->SetCommandBuffer(m_lastRecordingInfo);
+  NoesisApp::VKFactory::RecordingInfo rec = m_lastRecordingInfo;
+  rec.commandBuffer = cmd;
+  m_device->SetCommandBuffer(rec);
   m_device->SetRenderPass(m_renderPass, m_sampleCount);
   m_view->GetRenderer()->Render();
 }
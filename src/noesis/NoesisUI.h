@@ -49,8 +49,9 @@ public:
     void PreRender(VkCommandBuffer cmd, uint64_t frameNumber, double timeSeconds);
 
     /// Call once per frame INSIDE the render pass, after your scene draw.
-    /// Handles SetRenderPass + IRenderer::Render.
-    void Render();
+    /// Handles SetRenderPass + IRenderer::Render. cmd may be a secondary
+    /// command buffer continuing the pass rather than the PreRender() one.
+    void Render(VkCommandBuffer cmd);
 
     /// Resize the view (e.g. on swapchain recreate).
     void SetSize(uint32_t width, uint32_t height);
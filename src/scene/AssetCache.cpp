@@ -0,0 +1,321 @@
+#include "scene/AssetCache.h"
+
+#include "BlockCompression.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+
+#include <SDL3/SDL.h>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+namespace Expectre {
+
+namespace {
+
+constexpr char kCacheMagic[4] = {'E', 'X', 'P', 'C'};
+constexpr uint64_t kBlobAlignment = 16;
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+bool in_bounds(uint64_t offset, uint64_t byte_count, size_t file_size) {
+  return offset <= file_size && byte_count <= file_size - offset;
+}
+
+} // namespace
+
+std::shared_ptr<const MipChain>
+CachedModel::image(uint32_t image_index) const {
+  auto it = m_images.find(image_index);
+  if (it == m_images.end()) {
+    return nullptr;
+  }
+  const AssetCacheImageEntry &entry = *it->second;
+
+  auto chain = std::make_shared<MipChain>();
+  chain->format = static_cast<VkFormat>(entry.format);
+  chain->channels = entry.channels;
+  chain->levels.resize(entry.level_count);
+  size_t total_bytes = 0;
+  for (uint32_t level = 0; level < entry.level_count; level++) {
+    MipLevel &mip = chain->levels[level];
+    mip.width = std::max(1u, entry.width >> level);
+    mip.height = std::max(1u, entry.height >> level);
+    mip.byte_offset = total_bytes;
+    mip.byte_size =
+        format_level_byte_size(chain->format, mip.width, mip.height);
+    total_bytes += mip.byte_size;
+  }
+  if (total_bytes != entry.data_size) {
+    spdlog::warn("Asset cache image {} has the wrong size, ignoring it",
+                 image_index);
+    return nullptr;
+  }
+
+  chain->mapping = m_file;
+  chain->mapped_pixels = m_file->data() + entry.data_offset;
+  chain->mapped_byte_size = entry.data_size;
+  return chain;
+}
+
+uint64_t CachedModel::image_hash(uint32_t image_index) const {
+  auto it = m_images.find(image_index);
+  return it == m_images.end() ? 0 : it->second->content_hash;
+}
+
+uint64_t CachedModel::primitive_hash(uint32_t mesh_index,
+                                     uint32_t primitive_index) const {
+  const uint64_t id = (static_cast<uint64_t>(mesh_index) << 32) |
+                      primitive_index;
+  auto it = m_primitives.find(id);
+  return it == m_primitives.end() ? 0 : it->second->content_hash;
+}
+
+bool CachedModel::primitive(uint32_t mesh_index, uint32_t primitive_index,
+                            PendingPrimitiveUpload &out) const {
+  const uint64_t id = (static_cast<uint64_t>(mesh_index) << 32) |
+                      primitive_index;
+  auto it = m_primitives.find(id);
+  if (it == m_primitives.end()) {
+    return false;
+  }
+  const AssetCachePrimitiveEntry &entry = *it->second;
+
+  // Vertices are stored in their GPU layout, one copy each
+  out.vertices.resize(entry.vertex_count);
+  std::memcpy(out.vertices.data(), m_file->data() + entry.vertex_offset,
+              entry.vertex_count * sizeof(Vertex));
+  out.indices.resize(entry.index_count);
+  std::memcpy(out.indices.data(), m_file->data() + entry.index_offset,
+              entry.index_count * sizeof(uint32_t));
+  out.content_hash = entry.content_hash;
+  return true;
+}
+
+uint64_t CachedModelBuilder::append(const void *bytes, size_t byte_count) {
+  const uint64_t offset = align_up(m_blob.size(), kBlobAlignment);
+  m_blob.resize(offset + byte_count);
+  std::memcpy(m_blob.data() + offset, bytes, byte_count);
+  return offset;
+}
+
+void CachedModelBuilder::add_image(uint32_t image_index,
+                                   const MipChain &chain,
+                                   uint64_t content_hash) {
+  if (chain.levels.empty()) {
+    return;
+  }
+  AssetCacheImageEntry entry{};
+  entry.image_index = image_index;
+  entry.width = chain.levels[0].width;
+  entry.height = chain.levels[0].height;
+  entry.format = static_cast<uint32_t>(chain.format);
+  entry.level_count = chain.level_count();
+  entry.channels = chain.channels;
+  entry.data_size = chain.byte_size();
+  entry.data_offset = append(chain.data(), chain.byte_size());
+  entry.content_hash = content_hash;
+  m_images.push_back(entry);
+}
+
+void CachedModelBuilder::add_image(uint32_t image_index, const uint8_t *pixels,
+                                   uint32_t width, uint32_t height,
+                                   VkFormat format, uint64_t content_hash) {
+  const uint32_t texel_bytes = format_texel_bytes(format);
+  if (texel_bytes == 0) {
+    spdlog::warn("Asset cache can't store format {} of image {}, skipping it",
+                 static_cast<int>(format), image_index);
+    return;
+  }
+  AssetCacheImageEntry entry{};
+  entry.image_index = image_index;
+  entry.width = width;
+  entry.height = height;
+  entry.format = static_cast<uint32_t>(format);
+  entry.level_count = 1; // the renderer builds the rest of the chain
+  entry.channels = texel_bytes;
+  entry.data_size = static_cast<uint64_t>(width) * height * texel_bytes;
+  entry.data_offset = append(pixels, entry.data_size);
+  entry.content_hash = content_hash;
+  m_images.push_back(entry);
+}
+
+void CachedModelBuilder::add_primitive(
+    uint32_t mesh_index, uint32_t primitive_index,
+    const PendingPrimitiveUpload &primitive) {
+  AssetCachePrimitiveEntry entry{};
+  entry.mesh_index = mesh_index;
+  entry.primitive_index = primitive_index;
+  entry.vertex_count = static_cast<uint32_t>(primitive.vertices.size());
+  entry.index_count = static_cast<uint32_t>(primitive.indices.size());
+  entry.vertex_offset = append(primitive.vertices.data(),
+                               primitive.vertices.size() * sizeof(Vertex));
+  entry.index_offset = append(primitive.indices.data(),
+                              primitive.indices.size() * sizeof(uint32_t));
+  entry.content_hash = primitive.content_hash;
+  m_primitives.push_back(entry);
+}
+
+AssetCache::AssetCache(std::filesystem::path directory)
+    : m_directory(std::move(directory)) {}
+
+std::filesystem::path AssetCache::default_directory() {
+  char *pref_path = SDL_GetPrefPath("Expectre", "Expectre");
+  if (!pref_path) {
+    spdlog::warn("No user pref path ({}), caching assets in the temp dir",
+                 SDL_GetError());
+    return std::filesystem::temp_directory_path() / "expectre_asset_cache";
+  }
+  std::filesystem::path directory =
+      std::filesystem::path(pref_path) / "asset_cache";
+  SDL_free(pref_path);
+  return directory;
+}
+
+std::filesystem::path AssetCache::entry_path(uint64_t key) const {
+  return m_directory / fmt::format("{:016x}.expc", key);
+}
+
+std::unique_ptr<CachedModel> AssetCache::load(uint64_t key) const {
+  std::shared_ptr<const MappedFile> file = MappedFile::open(entry_path(key));
+  if (!file) {
+    return nullptr; // plain miss
+  }
+
+  const size_t file_size = file->size();
+  if (file_size < sizeof(AssetCacheHeader)) {
+    spdlog::warn("Asset cache entry {:016x} is truncated", key);
+    return nullptr;
+  }
+  const auto *header =
+      reinterpret_cast<const AssetCacheHeader *>(file->data());
+  if (std::memcmp(header->magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+      header->importer_version != kImporterVersion || header->key != key ||
+      header->vertex_stride != sizeof(Vertex) ||
+      !in_bounds(header->image_table_offset,
+                 header->image_count * sizeof(AssetCacheImageEntry),
+                 file_size) ||
+      !in_bounds(header->primitive_table_offset,
+                 header->primitive_count * sizeof(AssetCachePrimitiveEntry),
+                 file_size)) {
+    spdlog::warn("Asset cache entry {:016x} is stale or corrupt", key);
+    return nullptr;
+  }
+
+  auto model = std::make_unique<CachedModel>();
+  model->m_file = file;
+
+  const auto *images = reinterpret_cast<const AssetCacheImageEntry *>(
+      file->data() + header->image_table_offset);
+  for (uint32_t i = 0; i < header->image_count; i++) {
+    if (!in_bounds(images[i].data_offset, images[i].data_size, file_size)) {
+      spdlog::warn("Asset cache entry {:016x} is corrupt", key);
+      return nullptr;
+    }
+    model->m_images[images[i].image_index] = &images[i];
+  }
+
+  const auto *primitives = reinterpret_cast<const AssetCachePrimitiveEntry *>(
+      file->data() + header->primitive_table_offset);
+  for (uint32_t i = 0; i < header->primitive_count; i++) {
+    const AssetCachePrimitiveEntry &entry = primitives[i];
+    if (!in_bounds(entry.vertex_offset, entry.vertex_count * sizeof(Vertex),
+                   file_size) ||
+        !in_bounds(entry.index_offset, entry.index_count * sizeof(uint32_t),
+                   file_size)) {
+      spdlog::warn("Asset cache entry {:016x} is corrupt", key);
+      return nullptr;
+    }
+    const uint64_t id =
+        (static_cast<uint64_t>(entry.mesh_index) << 32) |
+        entry.primitive_index;
+    model->m_primitives[id] = &entry;
+  }
+
+  return model;
+}
+
+bool AssetCache::store(uint64_t key, const CachedModelBuilder &builder) const {
+  std::error_code error;
+  std::filesystem::create_directories(m_directory, error);
+  if (error) {
+    spdlog::warn("Failed to create asset cache dir {}: {}",
+                 m_directory.string(), error.message());
+    return false;
+  }
+
+  AssetCacheHeader header{};
+  std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+  header.importer_version = kImporterVersion;
+  header.key = key;
+  header.vertex_stride = sizeof(Vertex);
+  header.image_count = static_cast<uint32_t>(builder.m_images.size());
+  header.primitive_count = static_cast<uint32_t>(builder.m_primitives.size());
+  header.image_table_offset = sizeof(AssetCacheHeader);
+  header.primitive_table_offset =
+      header.image_table_offset +
+      builder.m_images.size() * sizeof(AssetCacheImageEntry);
+  const uint64_t blob_offset = align_up(
+      header.primitive_table_offset +
+          builder.m_primitives.size() * sizeof(AssetCachePrimitiveEntry),
+      kBlobAlignment);
+
+  // Entry offsets become file offsets
+  std::vector<AssetCacheImageEntry> images = builder.m_images;
+  for (auto &entry : images) {
+    entry.data_offset += blob_offset;
+  }
+  std::vector<AssetCachePrimitiveEntry> primitives = builder.m_primitives;
+  for (auto &entry : primitives) {
+    entry.vertex_offset += blob_offset;
+    entry.index_offset += blob_offset;
+  }
+
+  // Written to a temp file first so a crash or a second instance never
+  // leaves a half written entry under the real name
+  const std::filesystem::path path = entry_path(key);
+  std::filesystem::path temp_path = path;
+  temp_path += ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      spdlog::warn("Failed to open {}", temp_path.string());
+      return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(images.data()),
+               static_cast<std::streamsize>(images.size() *
+                                            sizeof(AssetCacheImageEntry)));
+    file.write(reinterpret_cast<const char *>(primitives.data()),
+               static_cast<std::streamsize>(
+                   primitives.size() * sizeof(AssetCachePrimitiveEntry)));
+    const uint64_t tables_end =
+        header.primitive_table_offset +
+        primitives.size() * sizeof(AssetCachePrimitiveEntry);
+    const char padding[kBlobAlignment] = {};
+    file.write(padding,
+               static_cast<std::streamsize>(blob_offset - tables_end));
+    file.write(reinterpret_cast<const char *>(builder.m_blob.data()),
+               static_cast<std::streamsize>(builder.m_blob.size()));
+    if (!file) {
+      spdlog::warn("Failed writing {}", temp_path.string());
+      return false;
+    }
+  }
+
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    spdlog::warn("Failed to move {} into place: {}", path.string(),
+                 error.message());
+    std::filesystem::remove(temp_path, error);
+    return false;
+  }
+  spdlog::info("Wrote asset cache entry {} ({} KiB)", path.string(),
+               (blob_offset + builder.m_blob.size()) / 1024);
+  return true;
+}
+
+} // namespace Expectre
@@ -0,0 +1,133 @@
+#ifndef SCENE_ASSET_CACHE_H
+#define SCENE_ASSET_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "MipChain.h"
+
+namespace Expectre {
+
+class MappedFile;
+struct PendingPrimitiveUpload;
+
+// On-disk layout, shared by reader and writer. Blobs are 16 byte aligned
+// so BC blocks and vertices can be copied straight out of the mapping.
+struct AssetCacheHeader {
+  char magic[4];
+  uint32_t importer_version;
+  uint64_t key;
+  uint32_t vertex_stride;
+  uint32_t image_count;
+  uint32_t primitive_count;
+  uint32_t reserved;
+  uint64_t image_table_offset;
+  uint64_t primitive_table_offset;
+};
+
+struct AssetCacheImageEntry {
+  uint32_t image_index; // into fastgltf::Asset::images
+  uint32_t width;
+  uint32_t height;
+  uint32_t format; // VkFormat
+  uint32_t level_count;
+  uint32_t channels;
+  uint64_t data_offset;
+  uint64_t data_size;
+  uint64_t content_hash; // Image::content_hash, saves rehashing on a hit
+};
+
+struct AssetCachePrimitiveEntry {
+  uint32_t mesh_index;
+  uint32_t primitive_index;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+  uint64_t content_hash; // PendingPrimitiveUpload::content_hash
+};
+
+/// A glTF's imported data read back from the cache. Everything points into
+/// a memory mapping, nothing is decoded.
+class CachedModel {
+public:
+  /// Mip chain of an image, sharing the mapping. nullptr if the image wasn't
+  /// cached (failed to load when the cache was written).
+  std::shared_ptr<const MipChain> image(uint32_t image_index) const;
+  /// Content hash stored with the image, 0 if it isn't cached
+  uint64_t image_hash(uint32_t image_index) const;
+
+  /// Fills out with the vertices and indices of a primitive. Returns false
+  /// if the primitive isn't in the cache.
+  bool primitive(uint32_t mesh_index, uint32_t primitive_index,
+                 PendingPrimitiveUpload &out) const;
+  /// Content hash stored with the primitive, 0 if it isn't cached. Lets a
+  /// duplicate be recognised without copying its vertices out.
+  uint64_t primitive_hash(uint32_t mesh_index,
+                          uint32_t primitive_index) const;
+
+private:
+  friend class AssetCache;
+
+  std::shared_ptr<const MappedFile> m_file;
+  std::unordered_map<uint32_t, const AssetCacheImageEntry *> m_images;
+  // Keyed by mesh_index << 32 | primitive_index
+  std::unordered_map<uint64_t, const AssetCachePrimitiveEntry *>
+      m_primitives;
+};
+
+/// Collects what a cold import produced so it can be written to the cache.
+class CachedModelBuilder {
+public:
+  /// Stores a whole chain, used for cooked (block compressed) images
+  void add_image(uint32_t image_index, const MipChain &chain,
+                 uint64_t content_hash);
+  /// Stores decoded 8 bit pixels (R8, RG8 or RGBA8) as a single level chain
+  void add_image(uint32_t image_index, const uint8_t *pixels, uint32_t width,
+                 uint32_t height, VkFormat format, uint64_t content_hash);
+  void add_primitive(uint32_t mesh_index, uint32_t primitive_index,
+                     const PendingPrimitiveUpload &primitive);
+
+private:
+  friend class AssetCache;
+
+  // Offsets are relative to m_blob, the cache adds the blob's file offset
+  uint64_t append(const void *bytes, size_t byte_count);
+
+  std::vector<AssetCacheImageEntry> m_images;
+  std::vector<AssetCachePrimitiveEntry> m_primitives;
+  std::vector<uint8_t> m_blob;
+};
+
+/// Content addressed cache of imported glTF data. Each model is one file
+/// named after its key, so a changed source or importer simply misses and
+/// old entries are never read again.
+class AssetCache {
+public:
+  /// Bump whenever the importer changes what it produces
+  static constexpr uint32_t kImporterVersion = 3;
+
+  explicit AssetCache(std::filesystem::path directory);
+
+  /// Per-user cache directory (SDL pref path), never the source tree
+  static std::filesystem::path default_directory();
+
+  /// nullptr on a miss or if the entry is corrupt
+  std::unique_ptr<CachedModel> load(uint64_t key) const;
+  /// Writes atomically (temp file + rename). Returns false on IO errors.
+  bool store(uint64_t key, const CachedModelBuilder &builder) const;
+
+private:
+  std::filesystem::path entry_path(uint64_t key) const;
+
+  std::filesystem::path m_directory;
+};
+
+} // namespace Expectre
+
+#endif // SCENE_ASSET_CACHE_H
@@ -5,22 +5,202 @@
 #include <fastgltf/types.hpp>
 #include <filesystem>
 #include <flecs.h>
+#include <fmt/format.h>
+#include <functional>
 #include <glm/gtc/type_ptr.hpp>
+#include <map>
 #include <spdlog/spdlog.h>
 #include <variant>
+#include <xxhash.h>
 
 #include "Component.h"
 #include "Entity.h"
 #define STB_IMAGE_IMPLEMENTATION // includes stb function bodies
+#include "BlockCompression.h"
 #include "Image.h"
+#include "Ktx2.h"
+#include "MappedFile.h"
 #include "Material.h"
 #include "Mesh.h"
 #include "RenderableInfo.h"
+#include "ThreadPool.h"
 #include "scene/AssetImporter.h"
+#include "scene/GltfImageRoles.h"
 #include "scene/TransformComponent.h"
 
 namespace Expectre {
 
+namespace {
+
+// Bytes of images that are queued, decoding, or decoded and not yet moved
+// into their entity. The importer waits for room before queueing another,
+// handing finished images off meanwhile, which bounds the decoded pixels
+// held at once however many images a file has.
+class DecodeBudget {
+public:
+  explicit DecodeBudget(size_t max_bytes) : m_max_bytes(max_bytes) {
+    m_mutex = SDL_CreateMutex();
+    m_changed = SDL_CreateCondition();
+  }
+  ~DecodeBudget() {
+    SDL_DestroyCondition(m_changed);
+    SDL_DestroyMutex(m_mutex);
+  }
+
+  // Takes bytes for the next decode once they fit, returning true. If a
+  // decode finishes first, returns false with the finished indices instead.
+  // An image bigger than the whole budget still goes through, alone.
+  bool acquire(size_t bytes, std::vector<size_t> &finished) {
+    SDL_LockMutex(m_mutex);
+    while (!fits(bytes) && m_finished.empty()) {
+      SDL_WaitCondition(m_changed, m_mutex);
+    }
+    const bool acquired = fits(bytes);
+    if (acquired) {
+      m_bytes += bytes;
+      m_held++;
+      m_decoding++;
+    } else {
+      finished.swap(m_finished);
+    }
+    SDL_UnlockMutex(m_mutex);
+    return acquired;
+  }
+
+  // Called by a decode job when it's done. Its pixels still hold their
+  // bytes until the importing thread releases them.
+  void finish(size_t index) {
+    SDL_LockMutex(m_mutex);
+    m_finished.push_back(index);
+    m_decoding--;
+    SDL_BroadcastCondition(m_changed);
+    SDL_UnlockMutex(m_mutex);
+  }
+
+  void release(size_t bytes) {
+    SDL_LockMutex(m_mutex);
+    m_bytes -= bytes;
+    m_held--;
+    SDL_UnlockMutex(m_mutex);
+  }
+
+  // Waits for more decodes to finish. Returns false once none are left.
+  bool wait_finished(std::vector<size_t> &finished) {
+    SDL_LockMutex(m_mutex);
+    while (m_finished.empty() && m_decoding > 0) {
+      SDL_WaitCondition(m_changed, m_mutex);
+    }
+    finished.swap(m_finished);
+    SDL_UnlockMutex(m_mutex);
+    return !finished.empty();
+  }
+
+private:
+  bool fits(size_t bytes) const {
+    return m_held == 0 || m_bytes + bytes <= m_max_bytes;
+  }
+
+  SDL_Mutex *m_mutex = nullptr;
+  SDL_Condition *m_changed = nullptr;
+  size_t m_max_bytes = 0;
+  size_t m_bytes = 0;
+  // Images holding bytes, from acquire until release
+  uint32_t m_held = 0;
+  uint32_t m_decoding = 0;
+  std::vector<size_t> m_finished;
+};
+
+// Decoded size of an image from its header alone, with the channels its
+// role keeps. 0 if it can't be read (the decode will fail and report it)
+size_t estimate_decoded_bytes(const fastgltf::Asset &asset,
+                              const fastgltf::Image &image,
+                              const std::filesystem::path &canonical_path,
+                              TextureRole role) {
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  std::visit(
+      fastgltf::visitor{
+          [&](const fastgltf::sources::URI &source) {
+            if (source.uri.isLocalPath()) {
+              const auto path =
+                  canonical_path.parent_path() / source.uri.path();
+              stbi_info(path.string().c_str(), &width, &height, &channels);
+            }
+          },
+          [&](const fastgltf::sources::Array &source) {
+            stbi_info_from_memory(
+                reinterpret_cast<const stbi_uc *>(source.bytes.data()),
+                static_cast<int>(source.bytes.size()), &width, &height,
+                &channels);
+          },
+          [&](const fastgltf::sources::BufferView &source) {
+            const auto &buffer_view = asset.bufferViews[source.bufferViewIndex];
+            const auto *buffer_source = std::get_if<fastgltf::sources::Array>(
+                &asset.buffers[buffer_view.bufferIndex].data);
+            if (buffer_source) {
+              stbi_info_from_memory(
+                  reinterpret_cast<const stbi_uc *>(
+                      buffer_source->bytes.data() + buffer_view.byteOffset),
+                  static_cast<int>(buffer_view.byteLength), &width, &height,
+                  &channels);
+            }
+          },
+          [&](const auto &) {}},
+      image.data);
+  return static_cast<size_t>(width) * static_cast<size_t>(height) *
+         texture_role_channels(role);
+}
+
+// Hash of an image's texels and the layout they're in, so the same bytes
+// read as a different size or format don't collide. 0 for an empty image.
+uint64_t hash_image(const Image &image) {
+  const uint8_t *bytes = image.data;
+  size_t byte_count =
+      static_cast<size_t>(image.width) * image.height * image.channels;
+  uint32_t format = static_cast<uint32_t>(image.format);
+  uint32_t level_count = 1;
+  if (image.cooked_mips) {
+    bytes = image.cooked_mips->data();
+    byte_count = image.cooked_mips->byte_size();
+    format = static_cast<uint32_t>(image.cooked_mips->format);
+    level_count = image.cooked_mips->level_count();
+  }
+  if (bytes == nullptr) {
+    return 0;
+  }
+  const uint32_t layout[] = {image.width, image.height, format, level_count};
+  return XXH3_64bits_withSeed(bytes, byte_count,
+                              XXH3_64bits(layout, sizeof(layout)));
+}
+
+uint64_t hash_primitive(const PendingPrimitiveUpload &primitive) {
+  const uint64_t counts[] = {primitive.vertices.size(),
+                             primitive.indices.size()};
+  const uint64_t vertex_hash = XXH3_64bits_withSeed(
+      primitive.vertices.data(), primitive.vertices.size() * sizeof(Vertex),
+      XXH3_64bits(counts, sizeof(counts)));
+  return XXH3_64bits_withSeed(primitive.indices.data(),
+                              primitive.indices.size() * sizeof(uint32_t),
+                              vertex_hash);
+}
+
+// Pixels of an image that is still 8 bits per channel, either decoded or a
+// cached top level. nullptr for block compressed images.
+const uint8_t *uncompressed_pixels(const Image &image, uint32_t &channels) {
+  if (image.data != nullptr) {
+    channels = image.channels;
+    return image.data;
+  }
+  if (image.cooked_mips && image.cooked_mips->channels > 0) {
+    channels = image.cooked_mips->channels;
+    return image.cooked_mips->level_data(0);
+  }
+  return nullptr;
+}
+
+} // namespace
+
 // void AssetImporter::import_model_helper(const aiScene *scene,
 //                                         const aiNode *node,
 //                                         const flecs::entity &parent,
@@ -172,12 +352,87 @@ std::string AssetImporter::sanitize_name(const std::string &name,
   return out_name;
 }
 
+void AssetImporter::read_gltf_primitive(const fastgltf::Asset &asset,
+                                        const fastgltf::Primitive &gltf_prim,
+                                        PendingPrimitiveUpload &out) {
+  if (gltf_prim.indicesAccessor.has_value()) {
+    // Read indices
+    const auto &index_accessor =
+        asset.accessors[gltf_prim.indicesAccessor.value()];
+
+    out.indices.resize(index_accessor.count);
+    fastgltf::iterateAccessorWithIndex<uint32_t>(
+        asset, index_accessor, [&](uint32_t raw_index, size_t out_idx) {
+          out.indices[out_idx] = raw_index;
+        });
+  }
+
+  // Position
+  const auto *pos_attr = gltf_prim.findAttribute("POSITION");
+  if (pos_attr != gltf_prim.attributes.end()) {
+    const fastgltf::Accessor &positions_accessor =
+        asset.accessors[pos_attr->accessorIndex];
+    out.vertices.resize(positions_accessor.count);
+
+    fastgltf::iterateAccessorWithIndex<glm::vec3>(
+        asset, positions_accessor,
+        [&](glm::vec3 pos, size_t idx) {
+          out.vertices[idx].pos = pos;
+        }
+
+    );
+  }
+
+  // Normals
+  const auto *norm_attr = gltf_prim.findAttribute("NORMAL");
+  if (norm_attr != gltf_prim.attributes.end()) {
+    const auto &norm_accessor = asset.accessors[norm_attr->accessorIndex];
+    fastgltf::iterateAccessorWithIndex<glm::vec3>(
+        asset, norm_accessor,
+        [&](glm::vec3 normal, size_t idx) {
+          out.vertices[idx].normal = normal;
+        }
+
+    );
+  } else {
+    compute_vertex_normals(out);
+  }
+
+  // UV Coords
+  const auto *uv_attr = gltf_prim.findAttribute("TEXCOORD_0");
+  if (uv_attr != gltf_prim.attributes.end()) {
+    const auto &uv_accessor = asset.accessors[uv_attr->accessorIndex];
+
+    fastgltf::iterateAccessorWithIndex<glm::vec2>(
+        asset, uv_accessor, [&](glm::vec2 uv, size_t idx) {
+          out.vertices[idx].tex_coord = uv;
+        });
+  }
+
+  // Vertex color
+  const auto *vert_color_attr = gltf_prim.findAttribute("COLOR_0");
+  if (vert_color_attr != gltf_prim.attributes.end()) {
+    const auto &vert_color_accessor =
+        asset.accessors[vert_color_attr->accessorIndex];
+
+    fastgltf::iterateAccessorWithIndex<glm::vec3>(
+        asset, vert_color_accessor, [&](glm::vec3 color, size_t idx) {
+          out.vertices[idx].color = color;
+        });
+  }
+}
+
 void AssetImporter::import_gltf_meshes(const fastgltf::Asset &asset,
                                        flecs::entity &file_entity,
-                                       flecs::world &world) {
+                                       flecs::world &world,
+                                       const CachedModel *cached,
+                                       CachedModelBuilder *cache_builder) {
 
   GltfFile &gltf_file = file_entity.get_mut<GltfFile>();
   gltf_file.meshes.resize(asset.meshes.size());
+  auto geometry_name = [](uint64_t content_hash) {
+    return fmt::format("geo_{:016x}", content_hash);
+  };
   for (size_t i = 0; i < asset.meshes.size(); i++) {
 
     const fastgltf::Mesh &gltf_mesh = asset.meshes[i];
@@ -200,70 +455,38 @@ void AssetImporter::import_gltf_meshes(const fastgltf::Asset &asset,
         prim.material = gltf_file.materials[gltf_prim.materialIndex.value()];
       }
 
-      if (gltf_prim.indicesAccessor.has_value()) {
-        // Read indices
-        const auto &index_accessor =
-            asset.accessors[gltf_prim.indicesAccessor.value()];
-
-        pending_prim_upload.indices.resize(index_accessor.count);
-        fastgltf::iterateAccessorWithIndex<uint32_t>(
-            asset, index_accessor, [&](uint32_t raw_index, size_t out_idx) {
-              pending_prim_upload.indices[out_idx] = raw_index;
-            });
+      // The geometry is shared by content. A warm cache knows the hash up
+      // front, so duplicates are found without copying their vertices.
+      const auto mesh_index = static_cast<uint32_t>(i);
+      const auto prim_index = static_cast<uint32_t>(j);
+      flecs::entity geometry;
+      if (cached) {
+        if (const uint64_t content_hash =
+                cached->primitive_hash(mesh_index, prim_index)) {
+          geometry = acquire_shared(world, gltf_file,
+                                    geometry_name(content_hash));
+        }
       }
-
-      // Position
-      const auto *pos_attr = gltf_prim.findAttribute("POSITION");
-      if (pos_attr != gltf_prim.attributes.end()) {
-        const fastgltf::Accessor &positions_accessor =
-            asset.accessors[pos_attr->accessorIndex];
-        pending_prim_upload.vertices.resize(positions_accessor.count);
-
-        fastgltf::iterateAccessorWithIndex<glm::vec3>(
-            asset, positions_accessor,
-            [&](glm::vec3 pos, size_t idx) {
-              pending_prim_upload.vertices[idx].pos = pos;
-            }
-
-        );
-      }
-
-      // Normals
-      const auto *norm_attr = gltf_prim.findAttribute("NORMAL");
-      if (norm_attr != gltf_prim.attributes.end()) {
-        const auto &norm_accessor = asset.accessors[norm_attr->accessorIndex];
-        fastgltf::iterateAccessorWithIndex<glm::vec3>(
-            asset, norm_accessor,
-            [&](glm::vec3 normal, size_t idx) {
-              pending_prim_upload.vertices[idx].normal = normal;
-            }
-
-        );
-      } else {
-        compute_vertex_normals(pending_prim_upload);
-      }
-
-      // UV Coords
-      const auto *uv_attr = gltf_prim.findAttribute("TEXCOORD_0");
-      if (uv_attr != gltf_prim.attributes.end()) {
-        const auto &uv_accessor = asset.accessors[uv_attr->accessorIndex];
-
-        fastgltf::iterateAccessorWithIndex<glm::vec2>(
-            asset, uv_accessor, [&](glm::vec2 uv, size_t idx) {
-              pending_prim_upload.vertices[idx].tex_coord = uv;
-            });
-      }
-
-      // Vertex color
-      const auto *vert_color_attr = gltf_prim.findAttribute("COLOR_0");
-      if (vert_color_attr != gltf_prim.attributes.end()) {
-        const auto &vert_color_accessor =
-            asset.accessors[vert_color_attr->accessorIndex];
-
-        fastgltf::iterateAccessorWithIndex<glm::vec3>(
-            asset, vert_color_accessor, [&](glm::vec3 color, size_t idx) {
-              pending_prim_upload.vertices[idx].color = color;
-            });
+      if (!geometry.is_valid()) {
+        if (!cached ||
+            !cached->primitive(mesh_index, prim_index, pending_prim_upload)) {
+          read_gltf_primitive(asset, gltf_prim, pending_prim_upload);
+          pending_prim_upload.content_hash =
+              hash_primitive(pending_prim_upload);
+          if (cache_builder) {
+            cache_builder->add_primitive(mesh_index, prim_index,
+                                         pending_prim_upload);
+          }
+        }
+
+        const uint64_t content_hash = pending_prim_upload.content_hash;
+        const std::string name = geometry_name(content_hash);
+        geometry = acquire_shared(world, gltf_file, name);
+        if (!geometry.is_valid()) {
+          geometry = create_shared(world, gltf_file, name, content_hash)
+                         .set<PendingPrimitiveUpload>(
+                             std::move(pending_prim_upload));
+        }
       }
 
       // Create primitive child entity
@@ -272,7 +495,7 @@ void AssetImporter::import_gltf_meshes(const fastgltf::Asset &asset,
       world.entity(prim_name.c_str())
           .child_of(mesh_ent)
           .set<Primitive>(std::move(prim))
-          .set<PendingPrimitiveUpload>(std::move(pending_prim_upload));
+          .add<UsesGeometry>(geometry);
     }
 
     gltf_file.meshes[i] = mesh_ent;
@@ -281,11 +504,76 @@ void AssetImporter::import_gltf_meshes(const fastgltf::Asset &asset,
   file_entity.modified<GltfFile>();
 }
 
+flecs::entity AssetImporter::pack_occlusion_roughness_metallic(
+    flecs::entity occlusion, flecs::entity metallic_roughness,
+    GltfFile &file, flecs::world &world) {
+  // Another file may already have packed the same pair
+  const std::string name = std::string("orm_") + occlusion.name().c_str() +
+                           "_" + metallic_roughness.name().c_str();
+  if (flecs::entity packed = acquire_shared(world, file, name);
+      packed.is_valid()) {
+    return packed;
+  }
+
+  const Image *occlusion_image = occlusion.try_get<Image>();
+  const Image *mr_image = metallic_roughness.try_get<Image>();
+  if (occlusion_image == nullptr || mr_image == nullptr ||
+      occlusion_image->width != mr_image->width ||
+      occlusion_image->height != mr_image->height) {
+    return {};
+  }
+  uint32_t occlusion_channels = 0;
+  uint32_t mr_channels = 0;
+  const uint8_t *occlusion_pixels =
+      uncompressed_pixels(*occlusion_image, occlusion_channels);
+  const uint8_t *mr_pixels = uncompressed_pixels(*mr_image, mr_channels);
+  if (occlusion_pixels == nullptr || mr_pixels == nullptr ||
+      mr_channels < 3) {
+    return {};
+  }
+
+  // Single level, the renderer builds the rest of the chain like it does for
+  // cached images
+  auto chain = std::make_shared<MipChain>();
+  chain->channels = 4;
+  chain->format = VK_FORMAT_R8G8B8A8_UNORM;
+  chain->levels.resize(1);
+  MipLevel &level = chain->levels[0];
+  level.width = mr_image->width;
+  level.height = mr_image->height;
+  level.byte_size = static_cast<size_t>(level.width) * level.height * 4;
+  chain->pixels.resize(level.byte_size);
+
+  const size_t pixel_count = static_cast<size_t>(level.width) * level.height;
+  uint8_t *packed = chain->pixels.data();
+  for (size_t i = 0; i < pixel_count; i++) {
+    packed[i * 4 + 0] = occlusion_pixels[i * occlusion_channels];
+    packed[i * 4 + 1] = mr_pixels[i * mr_channels + 1];
+    packed[i * 4 + 2] = mr_pixels[i * mr_channels + 2];
+    packed[i * 4 + 3] = 255;
+  }
+
+  Image image;
+  image.width = level.width;
+  image.height = level.height;
+  image.channels = 4;
+  image.format = chain->format;
+  image.name = name;
+  image.cooked_mips = std::move(chain);
+  image.content_hash = hash_image(image);
+  return create_shared(world, file, name, image.content_hash)
+      .set<Image>(std::move(image));
+}
+
 void AssetImporter::import_gltf_materials(const fastgltf::Asset &asset,
                                           flecs::entity &file_entity,
                                           flecs::world &world) {
   GltfFile &gltf_file = file_entity.get_mut<GltfFile>();
   gltf_file.materials.resize(asset.materials.size());
+  // Packed textures by (occlusion, metallic-roughness) image, materials
+  // sharing both maps share the packed one too
+  std::map<std::pair<flecs::entity_t, flecs::entity_t>, flecs::entity>
+      packed_orm;
 
   for (size_t i = 0; i < asset.materials.size(); i++) {
 
@@ -304,6 +592,8 @@ void AssetImporter::import_gltf_materials(const fastgltf::Asset &asset,
     material.emissive_factor =
         glm::make_vec3(gltf_material.emissiveFactor.data());
     material.emissive_strength = gltf_material.emissiveStrength;
+    material.alpha_test = gltf_material.alphaMode == fastgltf::AlphaMode::Mask;
+    material.alpha_cutoff = gltf_material.alphaCutoff;
 
     auto get_img_idx = [&](const auto &tex_info) -> size_t {
       auto tex_idx = tex_info.textureIndex;
@@ -341,6 +631,29 @@ void AssetImporter::import_gltf_materials(const fastgltf::Asset &asset,
       material.emissive = gltf_file.images[idx];
     }
 
+    // Separate occlusion and metallic-roughness maps are packed into one
+    // texture the way glTF lays out a shared one: occlusion R, roughness G,
+    // metallic B. Both slots then point at it.
+    if (material.occlusion.is_valid() &&
+        material.metallic_roughness.is_valid() &&
+        material.occlusion != material.metallic_roughness) {
+      const auto key = std::make_pair(material.occlusion.id(),
+                                      material.metallic_roughness.id());
+      auto it = packed_orm.find(key);
+      if (it == packed_orm.end()) {
+        it = packed_orm
+                 .emplace(key, pack_occlusion_roughness_metallic(
+                                   material.occlusion,
+                                   material.metallic_roughness, gltf_file,
+                                   world))
+                 .first;
+      }
+      if (it->second.is_valid()) {
+        material.occlusion = it->second;
+        material.metallic_roughness = it->second;
+      }
+    }
+
     world.entity(mat_name.c_str())
         .child_of(file_entity)
         .set<Material>(std::move(material));
@@ -349,93 +662,224 @@ void AssetImporter::import_gltf_materials(const fastgltf::Asset &asset,
   file_entity.modified<GltfFile>();
 }
 
-void AssetImporter::import_gltf_images(
-    const fastgltf::Asset &asset, flecs::entity &file_entity,
-    flecs::world &world, const std::filesystem::path &canonical_path) {
+Image AssetImporter::load_gltf_image(
+    const fastgltf::Asset &asset, const fastgltf::Image &image,
+    const std::string &img_name, const std::filesystem::path &canonical_path,
+    TextureRole role) {
+  Image result_image;
+
+  // Extract raw data
+  std::visit(
+      fastgltf::visitor{
+          [&](const std::monostate &) {
+            spdlog::error("glTF image {} has no data source", img_name);
+          },
+
+          [&](const fastgltf::sources::URI &source) {
+            if (!source.uri.isLocalPath()) {
+              spdlog::error("glTF image {} uses non-local URI", img_name);
+              return;
+            }
 
-  GltfFile &gltf_file = file_entity.get_mut<GltfFile>();
-  gltf_file.images.resize(asset.materials.size());
-  for (size_t i = 0; i < asset.images.size(); i++) {
+            if (source.fileByteOffset != 0) {
+              spdlog::error(
+                  "glTF image {} has fileByteOffset != 0, unsupported",
+                  img_name);
+              return;
+            }
 
-    const auto &image = asset.images[i];
+            // if canonical path is something like
+            // "/assets/models/character.gltf",
+            // source.uri.path() is something  like "textures/image.png"
+            // making full_path "/assets/model/textures/image.png"
+            const auto full_path = std::filesystem::canonical(
+                canonical_path.parent_path() / source.uri.path());
+
+            // Prefer the cooked KTX2 from ExpectreCook, it's already block
+            // compressed and mipped so there is nothing left to decode. A
+            // device that can't sample BC gets the source image.
+            const auto cooked_path =
+                cooked_texture_path(canonical_path, source.uri.path());
+            std::error_code error;
+            if (std::filesystem::exists(cooked_path, error) &&
+                std::filesystem::last_write_time(cooked_path, error) >=
+                    std::filesystem::last_write_time(full_path, error)) {
+              auto chain = std::make_shared<MipChain>();
+              if (read_ktx2(cooked_path, *chain) &&
+                  (m_supports_bc || bc_block_bytes(chain->format) == 0)) {
+                result_image.width = chain->levels[0].width;
+                result_image.height = chain->levels[0].height;
+                result_image.cooked_mips = std::move(chain);
+                return;
+              }
+            }
 
-    std::string img_name = "img_" + sanitize_name(image.name.c_str(), i);
-    Image result_image;
+            result_image = import_from_file(full_path, role);
+          },
+
+          [&](const fastgltf::sources::Array &source) {
+            result_image = import_from_memory(
+                img_name,
+                reinterpret_cast<const uint8_t *>(source.bytes.data()),
+                source.bytes.size(), role);
+          },
+
+          [&](const fastgltf::sources::BufferView &source) {
+            const auto &buffer_view =
+                asset.bufferViews[source.bufferViewIndex];
+            const auto &buffer = asset.buffers[buffer_view.bufferIndex];
+
+            std::visit(
+                fastgltf::visitor{
+                    [&](const fastgltf::sources::Array &buffer_source) {
+                      const uint8_t *start =
+                          reinterpret_cast<const uint8_t *>(
+                              buffer_source.bytes.data() +
+                              buffer_view.byteOffset);
+
+                      result_image = import_from_memory(
+                          img_name, start, buffer_view.byteLength, role);
+                    },
+
+                    [&](const auto &) {
+                      spdlog::error(
+                          "Unsupported buffer source for glTF image {}",
+                          img_name);
+                    }},
+                buffer.data);
+          },
+
+          [&](const auto &) {
+            spdlog::error("Unsupported source for glTF image {}", img_name);
+          }},
+      image.data);
+
+  return result_image;
+}
 
-    // Extract raw data
-    std::visit(
-        fastgltf::visitor{
-            [&](const std::monostate &) {
-              spdlog::error("glTF image {} has no data source", img_name);
-            },
+void AssetImporter::decode_gltf_images(
+    const fastgltf::Asset &asset, const std::vector<std::string> &img_names,
+    const std::vector<TextureRole> &roles,
+    const std::filesystem::path &canonical_path, std::vector<Image> &results,
+    const std::function<void(size_t)> &on_decoded) {
+  ThreadPool &pool = ThreadPool::Instance();
+  DecodeBudget budget(kMaxDecodeBytesInFlight);
+  std::vector<size_t> decoded_bytes(asset.images.size(), 0);
+  std::vector<size_t> finished;
+
+  // Pixels hold their bytes until on_decoded has moved them out of results
+  auto hand_off = [&]() {
+    for (size_t i : finished) {
+      on_decoded(i);
+      results[i] = Image{};
+      budget.release(decoded_bytes[i]);
+    }
+    finished.clear();
+  };
 
-            [&](const fastgltf::sources::URI &source) {
-              if (!source.uri.isLocalPath()) {
-                spdlog::error("glTF image {} uses non-local URI", img_name);
-                return;
-              }
+  // One job per image. Each writes only its own slot of results, and the
+  // asset is only read, so the jobs share nothing but the budget.
+  for (size_t i = 0; i < asset.images.size(); i++) {
+    decoded_bytes[i] = estimate_decoded_bytes(asset, asset.images[i],
+                                              canonical_path, roles[i]);
+    while (!budget.acquire(decoded_bytes[i], finished)) {
+      hand_off();
+    }
+    pool.submit([this, &asset, &img_names, &roles, &canonical_path,
+                 &results, &budget, i]() {
+      results[i] = load_gltf_image(asset, asset.images[i], img_names[i],
+                                   canonical_path, roles[i]);
+      results[i].content_hash = hash_image(results[i]);
+      budget.finish(i);
+    });
+  }
+  while (budget.wait_finished(finished)) {
+    hand_off();
+  }
+}
 
-              if (source.fileByteOffset != 0) {
-                spdlog::error(
-                    "glTF image {} has fileByteOffset != 0, unsupported",
-                    img_name);
-                return;
-              }
+void AssetImporter::import_gltf_images(
+    const fastgltf::Asset &asset, flecs::entity &file_entity,
+    flecs::world &world, const std::filesystem::path &canonical_path,
+    const CachedModel *cached, CachedModelBuilder *cache_builder) {
 
-              // if canonical path is something like
-              // "/assets/models/character.gltf",
-              // source.uri.path() is something  like "textures/image.png"
-              // making full_path "/assets/model/textures/image.png"
-              const auto full_path = std::filesystem::canonical(
-                  canonical_path.parent_path() / source.uri.path());
-
-              result_image = import_from_file(full_path);
-            },
-
-            [&](const fastgltf::sources::Array &source) {
-              result_image = import_from_memory(
-                  img_name,
-                  reinterpret_cast<const uint8_t *>(source.bytes.data()),
-                  source.bytes.size());
-            },
-
-            [&](const fastgltf::sources::BufferView &source) {
-              const auto &buffer_view =
-                  asset.bufferViews[source.bufferViewIndex];
-              const auto &buffer = asset.buffers[buffer_view.bufferIndex];
-
-              std::visit(
-                  fastgltf::visitor{
-                      [&](const fastgltf::sources::Array &buffer_source) {
-                        const uint8_t *start =
-                            reinterpret_cast<const uint8_t *>(
-                                buffer_source.bytes.data() +
-                                buffer_view.byteOffset);
-
-                        result_image = import_from_memory(
-                            img_name, start, buffer_view.byteLength);
-                      },
-
-                      [&](const auto &) {
-                        spdlog::error(
-                            "Unsupported buffer source for glTF image {}",
-                            img_name);
-                      }},
-                  buffer.data);
-            },
-
-            [&](const auto &) {
-              spdlog::error("Unsupported source for glTF image {}", img_name);
-            }},
-        image.data);
-
-    auto image_entity = world.entity(img_name.c_str()).child_of(file_entity);
-    gltf_file.images[i] = image_entity;
+  GltfFile &gltf_file = file_entity.get_mut<GltfFile>();
+  gltf_file.images.resize(asset.images.size());
 
-    if (result_image.data != nullptr) {
-      result_image.name = img_name;
-      image_entity.add<Image>(std::move(result_image));
+  std::vector<std::string> img_names(asset.images.size());
+  for (size_t i = 0; i < asset.images.size(); i++) {
+    img_names[i] = "img_" + sanitize_name(asset.images[i].name.c_str(), i);
+  }
+
+  auto shared_name = [](uint64_t content_hash) {
+    return fmt::format("img_{:016x}", content_hash);
+  };
+
+  // Identical images, from this file or any loaded earlier, end up as one
+  // shared entity. Entities are only touched on the importing thread.
+  std::vector<Image> results(asset.images.size());
+  auto create_image_entity = [&](size_t i) {
+    Image &result_image = results[i];
+    if (result_image.data == nullptr && !result_image.cooked_mips) {
+      // Failed to load, the entity only keeps the material slots valid
+      gltf_file.images[i] =
+          world.entity(img_names[i].c_str()).child_of(file_entity);
+      return;
+    }
+
+    const std::string name = shared_name(result_image.content_hash);
+    flecs::entity image_entity = acquire_shared(world, gltf_file, name);
+    if (!image_entity.is_valid()) {
+      result_image.name = img_names[i];
+      image_entity =
+          create_shared(world, gltf_file, name, result_image.content_hash)
+              .set<Image>(std::move(result_image));
+    }
+    gltf_file.images[i] = image_entity;
+  };
+
+  if (cached) {
+    // Cache hit: the image is whatever was stored, decoded or cooked. Its
+    // hash is stored too, so images another file already loaded are picked
+    // up without touching their pixels.
+    for (size_t i = 0; i < asset.images.size(); i++) {
+      const uint64_t content_hash =
+          cached->image_hash(static_cast<uint32_t>(i));
+      if (content_hash != 0) {
+        gltf_file.images[i] =
+            acquire_shared(world, gltf_file, shared_name(content_hash));
+        if (gltf_file.images[i].is_valid()) {
+          continue; // shared with a file loaded earlier
+        }
+      }
+      if (auto chain = cached->image(static_cast<uint32_t>(i))) {
+        results[i].width = chain->levels[0].width;
+        results[i].height = chain->levels[0].height;
+        results[i].channels = static_cast<uint8_t>(chain->channels);
+        results[i].format = chain->format;
+        results[i].cooked_mips = std::move(chain);
+        results[i].content_hash = content_hash;
+      }
+      create_image_entity(i);
     }
+  } else {
+    // Decoded pixels keep only the channels their role samples. Each image
+    // goes to the cache and into its entity as soon as it's decoded, which
+    // gives its share of the decode budget back.
+    const std::vector<TextureRole> roles = pick_gltf_image_roles(asset);
+    decode_gltf_images(
+        asset, img_names, roles, canonical_path, results, [&](size_t i) {
+          if (cache_builder && results[i].cooked_mips) {
+            cache_builder->add_image(static_cast<uint32_t>(i),
+                                     *results[i].cooked_mips,
+                                     results[i].content_hash);
+          } else if (cache_builder && results[i].data != nullptr) {
+            cache_builder->add_image(
+                static_cast<uint32_t>(i), results[i].data, results[i].width,
+                results[i].height, results[i].format, results[i].content_hash);
+          }
+          create_image_entity(i);
+        });
   }
 
   // Signal flecs that we finished modifing a component
@@ -519,17 +963,149 @@ void AssetImporter::import_gltf_model(const std::string &file_path,
   file_entity =
       world.entity(flecs_name.c_str()).set<GltfFile>({universal_path, {}});
 
+  // A warm cache has every image and primitive ready to copy, only the scene
+  // graph still comes from the glTF
+  const uint64_t cache_key = compute_cache_key(asset, canon_path);
+  std::unique_ptr<CachedModel> cached = m_cache.load(cache_key);
+  CachedModelBuilder cache_builder;
+  CachedModelBuilder *builder = cached ? nullptr : &cache_builder;
+  spdlog::info("Asset cache {} for {}", cached ? "hit" : "miss",
+               universal_path);
+
   // image importing
-  import_gltf_images(asset, file_entity, world, canon_path);
+  import_gltf_images(asset, file_entity, world, canon_path, cached.get(),
+                     builder);
 
   // material importing
   import_gltf_materials(asset, file_entity, world);
 
   // mesh importing
-  import_gltf_meshes(asset, file_entity, world);
+  import_gltf_meshes(asset, file_entity, world, cached.get(), builder);
 
   // node processing
   process_gltf_scenes(asset, file_entity, world);
+
+  if (!cached) {
+    m_cache.store(cache_key, cache_builder);
+  }
+}
+
+void AssetImporter::unload_gltf_model(const std::string &file_path,
+                                      flecs::world &world) {
+  flecs::entity file_entity = find_gltf_file(file_path, world);
+  if (!file_entity.is_valid()) {
+    return;
+  }
+
+  // Copied out, destroying entities can move the file's GltfFile
+  const std::vector<flecs::entity> shared = file_entity.get<GltfFile>().shared;
+  for (flecs::entity entity : shared) {
+    SharedContent &content = entity.get_mut<SharedContent>();
+    if (--content.ref_count == 0) {
+      entity.destruct();
+    } else {
+      entity.modified<SharedContent>();
+    }
+  }
+  // Materials, meshes and nodes are children of the file
+  file_entity.destruct();
+}
+
+flecs::entity AssetImporter::find_gltf_file(const std::string &file_path,
+                                            flecs::world &world) {
+  std::error_code error;
+  const std::filesystem::path canon_path =
+      std::filesystem::canonical(file_path, error);
+  if (error) {
+    spdlog::error("Path not found: {}", file_path);
+    return {};
+  }
+  const std::string flecs_name =
+      sanitize_name(canon_path.generic_string(), 0);
+  return world.lookup(flecs_name.c_str());
+}
+
+flecs::entity AssetImporter::shared_content_root(flecs::world &world) {
+  return world.entity("shared_content");
+}
+
+flecs::entity AssetImporter::acquire_shared(flecs::world &world,
+                                            GltfFile &file,
+                                            const std::string &name) {
+  flecs::entity entity = shared_content_root(world).lookup(name.c_str());
+  if (!entity.is_valid() || !entity.has<SharedContent>()) {
+    return {};
+  }
+  entity.get_mut<SharedContent>().ref_count++;
+  entity.modified<SharedContent>();
+  file.shared.push_back(entity);
+  return entity;
+}
+
+flecs::entity AssetImporter::create_shared(flecs::world &world,
+                                           GltfFile &file,
+                                           const std::string &name,
+                                           uint64_t content_hash) {
+  flecs::entity entity = world.entity(name.c_str())
+                             .child_of(shared_content_root(world))
+                             .set<SharedContent>({content_hash, 1});
+  file.shared.push_back(entity);
+  return entity;
+}
+
+uint64_t
+AssetImporter::compute_cache_key(const fastgltf::Asset &asset,
+                                 const std::filesystem::path &canonical_path) {
+  XXH3_state_t *state = XXH3_createState();
+  XXH3_64bits_reset_withSeed(state, AssetCache::kImporterVersion);
+
+  // The glTF itself (and a .glb's binary chunk) is hashed by content
+  if (auto file = MappedFile::open(canonical_path)) {
+    XXH3_64bits_update(state, file->data(), file->size());
+  }
+
+  // Missing files hash as size/mtime 0
+  auto hash_file_stamp = [&](const std::filesystem::path &path) {
+    std::error_code error;
+    const uint64_t size = std::filesystem::file_size(path, error);
+    const int64_t mtime = std::filesystem::last_write_time(path, error)
+                              .time_since_epoch()
+                              .count();
+    XXH3_64bits_update(state, &size, sizeof(size));
+    XXH3_64bits_update(state, &mtime, sizeof(mtime));
+  };
+
+  // External buffers and images by name, size and modification time, reading
+  // them all would cost about as much as importing them
+  auto hash_dependency = [&](const fastgltf::URI &uri) {
+    if (!uri.isLocalPath()) {
+      return;
+    }
+    const std::string path_string(uri.path());
+    XXH3_64bits_update(state, path_string.data(), path_string.size());
+    hash_file_stamp(canonical_path.parent_path() / uri.path());
+  };
+  for (const auto &buffer : asset.buffers) {
+    if (const auto *uri = std::get_if<fastgltf::sources::URI>(&buffer.data)) {
+      hash_dependency(uri->uri);
+    }
+  }
+  for (const auto &image : asset.images) {
+    const auto *uri = std::get_if<fastgltf::sources::URI>(&image.data);
+    if (uri && uri->uri.isLocalPath()) {
+      hash_dependency(uri->uri);
+      // Cooking the image changes what the importer loads for it
+      hash_file_stamp(cooked_texture_path(canonical_path, uri->uri.path()));
+    }
+  }
+
+  // Entries stored with cooked BC images can't be used without BC support
+  const uint8_t supports_bc = m_supports_bc ? 1 : 0;
+  XXH3_64bits_update(state, &supports_bc, sizeof(supports_bc));
+
+  const uint64_t key = XXH3_64bits_digest(state);
+  XXH3_freeState(state);
+  return key;
 }
 
 } // namespace Expectre
@@ -7,13 +7,17 @@
 #include <fastgltf/types.hpp>
 #include <filesystem>
 #include <flecs.h>
+#include <functional>
 #include <glm/gtc/type_ptr.hpp>
 #include <spdlog/spdlog.h>
 #include <variant>
 
 #include "Component.h"
 #include "Entity.h"
+#include "Image.h"
 #include "RenderableInfo.h"
+#include "TextureRole.h"
+#include "scene/AssetCache.h"
 #include "scene/TransformComponent.h"
 
 namespace Expectre {
@@ -23,6 +27,16 @@ struct GltfFile {
   std::vector<flecs::entity> images;
   std::vector<flecs::entity> materials;
   std::vector<flecs::entity> meshes;
+  // Shared content this file holds a reference on, once per reference
+  std::vector<flecs::entity> shared;
+};
+
+/// On image and geometry entities that are shared by content hash across
+/// glTF files. They live under the shared content root named after their
+/// hash, and are destroyed when the last file referencing them unloads.
+struct SharedContent {
+  uint64_t content_hash = 0;
+  uint32_t ref_count = 0;
 };
 
 class AssetImporter {
@@ -37,15 +51,50 @@ public:
   std::string sanitize_name(const std::string &name, size_t index);
   void import_model(const std::string &file_path, flecs::world &world);
 
+  // cached is set on a cache hit, cache_builder collects what was imported
+  // on a miss
   void import_gltf_meshes(const fastgltf::Asset &asset,
-                          flecs::entity &file_entity, flecs::world &world);
+                          flecs::entity &file_entity, flecs::world &world,
+                          const CachedModel *cached,
+                          CachedModelBuilder *cache_builder);
+  void read_gltf_primitive(const fastgltf::Asset &asset,
+                           const fastgltf::Primitive &gltf_prim,
+                           PendingPrimitiveUpload &out);
 
   void import_gltf_images(const fastgltf::Asset &asset,
                           flecs::entity &file_entity, flecs::world &world,
-                          const std::filesystem::path &canonical_path);
+                          const std::filesystem::path &canonical_path,
+                          const CachedModel *cached,
+                          CachedModelBuilder *cache_builder);
+  // role picks how many channels are kept and the format (see TextureRole)
+  Image load_gltf_image(const fastgltf::Asset &asset,
+                        const fastgltf::Image &image,
+                        const std::string &img_name,
+                        const std::filesystem::path &canonical_path,
+                        TextureRole role);
+  // Decodes every image on the shared thread pool into results[i], calling
+  // on_decoded(i) on this thread as each one finishes. results[i] is freed
+  // right after, so on_decoded moves out what it keeps. Returns once all of
+  // them are done.
+  void decode_gltf_images(const fastgltf::Asset &asset,
+                          const std::vector<std::string> &img_names,
+                          const std::vector<TextureRole> &roles,
+                          const std::filesystem::path &canonical_path,
+                          std::vector<Image> &results,
+                          const std::function<void(size_t)> &on_decoded);
+
+  // Cap on decoded bytes of images being decoded at once. A 4K RGBA8 image
+  // is 64 MiB, so this keeps a handful of them in flight.
+  static constexpr size_t kMaxDecodeBytesInFlight = size_t(512) << 20;
 
   void import_gltf_materials(const fastgltf::Asset &asset,
                              flecs::entity &file_entity, flecs::world &world);
+  // Shared image entity holding occlusion in R and roughness/metallic in
+  // G/B, referenced by file. Invalid if the two can't be packed (sizes
+  // differ, block compressed).
+  flecs::entity pack_occlusion_roughness_metallic(
+      flecs::entity occlusion, flecs::entity metallic_roughness,
+      GltfFile &file, flecs::world &world);
 
   void process_gltf_node(const fastgltf::Asset &asset,
                          flecs::entity file_entity, const size_t &node_idx,
@@ -53,9 +102,35 @@ public:
   void process_gltf_scenes(const fastgltf::Asset &asset,
                            flecs::entity &file_entity, flecs::world &world);
   void import_gltf_model(const std::string &file_path, flecs::world &world);
+  // Destroys the file's entities and drops its references on shared content
+  void unload_gltf_model(const std::string &file_path, flecs::world &world);
+  // The file's entity if it is loaded, otherwise an invalid entity
+  flecs::entity find_gltf_file(const std::string &file_path,
+                               flecs::world &world);
+
+  // Parent of every SharedContent entity
+  flecs::entity shared_content_root(flecs::world &world);
+  // The shared entity called name with one more reference held by file, or
+  // an invalid entity if nothing has that content yet
+  flecs::entity acquire_shared(flecs::world &world, GltfFile &file,
+                               const std::string &name);
+  // Creates the shared entity called name, referenced once by file
+  flecs::entity create_shared(flecs::world &world, GltfFile &file,
+                              const std::string &name, uint64_t content_hash);
+
+  // Hash of the glTF's bytes, the size and mtime of every external file it
+  // references and the importer version
+  uint64_t compute_cache_key(const fastgltf::Asset &asset,
+                             const std::filesystem::path &canonical_path);
+
+  /// Whether the device can sample BC formats. Without it cooked BC
+  /// textures are skipped and the source images decoded instead.
+  void set_supports_bc(bool supports_bc) { m_supports_bc = supports_bc; }
 
 private:
   fastgltf::Parser m_parser;
+  bool m_supports_bc = true;
+  AssetCache m_cache{AssetCache::default_directory()};
 };
 
 } // namespace Expectre
@@ -0,0 +1,64 @@
+#ifndef SCENE_GLTF_IMAGE_ROLES_H
+#define SCENE_GLTF_IMAGE_ROLES_H
+
+#include <fastgltf/types.hpp>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <vector>
+
+#include "TextureRole.h"
+
+namespace Expectre {
+
+/// Role of every image of a glTF, from the material slots it is bound to.
+/// An image used for both occlusion and metallic-roughness is already packed
+/// the glTF way and stays one texture. Images no material references are
+/// treated as color.
+inline std::vector<TextureRole>
+pick_gltf_image_roles(const fastgltf::Asset &asset) {
+  std::vector<std::optional<TextureRole>> roles(asset.images.size());
+
+  auto assign = [&](const auto &texture_info, TextureRole role) {
+    if (!texture_info.has_value()) {
+      return;
+    }
+    const auto &texture = asset.textures[texture_info->textureIndex];
+    if (!texture.imageIndex.has_value()) {
+      return;
+    }
+    std::optional<TextureRole> &image_role = roles[texture.imageIndex.value()];
+    if (!image_role.has_value() || *image_role == role) {
+      image_role = role;
+      return;
+    }
+    const bool packed_orm = (*image_role == TextureRole::Occlusion &&
+                             role == TextureRole::MetallicRoughness) ||
+                            (*image_role == TextureRole::MetallicRoughness &&
+                             role == TextureRole::Occlusion);
+    if (packed_orm) {
+      image_role = TextureRole::MetallicRoughness;
+      return;
+    }
+    spdlog::warn("Image {} is used in conflicting roles, keeping the first one",
+                 texture.imageIndex.value());
+  };
+
+  for (const fastgltf::Material &material : asset.materials) {
+    assign(material.pbrData.baseColorTexture, TextureRole::Color);
+    assign(material.emissiveTexture, TextureRole::Color);
+    assign(material.pbrData.metallicRoughnessTexture,
+           TextureRole::MetallicRoughness);
+    assign(material.normalTexture, TextureRole::Normal);
+    assign(material.occlusionTexture, TextureRole::Occlusion);
+  }
+
+  std::vector<TextureRole> result(roles.size());
+  for (size_t i = 0; i < roles.size(); i++) {
+    result[i] = roles[i].value_or(TextureRole::Color);
+  }
+  return result;
+}
+
+} // namespace Expectre
+
+#endif // SCENE_GLTF_IMAGE_ROLES_H
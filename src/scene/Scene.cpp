@@ -16,10 +16,15 @@ Scene::Scene(std::string scene_name) {
   m_world.component<Transform>();
   m_world.component<PendingPrimitiveUpload>();
   m_world.component<Material>();
+  m_world.component<PointLight>();
   m_world.component<UsesMaterial>()
       .add(flecs::Traversable)
       .add(flecs::Exclusive);
   m_world.component<UsesMesh>().add(flecs::Traversable).add(flecs::Exclusive);
+  m_world.component<UsesGeometry>()
+      .add(flecs::Traversable)
+      .add(flecs::Exclusive);
+  m_world.component<SharedContent>();
 
   /*
   m_renderables = m_world.query_builder<Transform>()
@@ -52,6 +57,15 @@ Scene::Scene(std::string scene_name) {
           .term_at(2)
           .up<UsesMaterial>()
           .build();
+  m_lights = m_world.query<Transform, PointLight>();
+
+  // Where the fragment shader's hard coded light used to be. Lights fall
+  // off with distance squared, 225 is full brightness at the origin.
+  m_world.entity("Default Light")
+      .set<Transform>(Transform(glm::vec3(10.0f, 10.0f, 5.0f),
+                                glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                                glm::vec3(1.0f)))
+      .set<PointLight>({glm::vec3(1.0f), 225.0f, 100.0f});
 
   auto teapot_dir = WORKSPACE_DIR + std::string("/assets/teapot/teapot.obj");
   auto bunny_dir = WORKSPACE_DIR + std::string("/assets/bunny.obj");
@@ -62,6 +76,28 @@ Scene::Scene(std::string scene_name) {
   // m_importer.import_gltf_model(usd_file_dir, m_world);
 }
 
+void Scene::unload_model(const std::string &file_path) {
+  flecs::entity file_entity = m_importer.find_gltf_file(file_path, m_world);
+  if (!file_entity.is_valid()) {
+    return;
+  }
+
+  // Renderables still pending were never uploaded, the renderer holds
+  // nothing for them
+  m_renderables.each(
+      [&](flecs::entity e, Transform trf, MeshHandle mh, Material mat) {
+        for (flecs::entity node = e; node.is_valid(); node = node.parent()) {
+          if (node == file_entity) {
+            m_released_renderables.push_back(
+                {mh, mat, trf.get_transform_matrix(), e.id()});
+            break;
+          }
+        }
+      });
+
+  m_importer.unload_gltf_model(file_path, m_world);
+}
+
 void Scene::Update(uint64_t delta_time, const InputManager &input_manager) {
   m_world.progress();
   m_camera.update(delta_time, input_manager);
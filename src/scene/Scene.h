@@ -2,6 +2,7 @@
 #define SCENE
 
 #include "AssetImporter.h"
+#include "Light.h"
 #include "MeshManager.h"
 #include "RenderableInfo.h"
 #include "TextureManager.h"
@@ -25,6 +26,10 @@ public:
   Scene &operator=(const Scene &other) = delete;
   void Update(uint64_t delta_time, const InputManager &input_manager);
   const Camera &get_camera() { return m_camera; }
+  /// Set before importing, see AssetImporter::set_supports_bc
+  void set_supports_bc(bool supports_bc) {
+    m_importer.set_supports_bc(supports_bc);
+  }
 
   std::vector<RenderableInfo> consume_pending_renderables() {
     std::vector<RenderableInfo> pending;
@@ -39,7 +44,7 @@ public:
 
     m_pending_renderables.each(
         [&](flecs::entity e, Transform trf, MeshHandle mh, Material mat) {
-          pending.push_back({mh, mat, trf.get_transform_matrix()});
+          pending.push_back({mh, mat, trf.get_transform_matrix(), e.id()});
 
           e.remove<PendingUpload>();
         });
@@ -49,6 +54,17 @@ public:
     return pending;
   }
 
+  /// Renderables of unloaded models the renderer had uploaded, it drops its
+  /// references on their meshes and textures
+  std::vector<RenderableInfo> consume_released_renderables() {
+    return std::move(m_released_renderables);
+  }
+
+  void load_model(const std::string &file_path) {
+    m_importer.import_gltf_model(file_path, m_world);
+  }
+  void unload_model(const std::string &file_path);
+
   std::vector<RenderableInfo> gather_renderables() {
     std::vector<RenderableInfo> pending;
 
@@ -58,6 +74,16 @@ public:
     return pending;
   }
 
+  std::vector<LightInfo> gather_lights() {
+    std::vector<LightInfo> lights;
+
+    m_lights.each([&](const Transform &trf, const PointLight &light) {
+      lights.push_back(
+          {trf.get_position(), light.color, light.intensity, light.range});
+    });
+    return lights;
+  }
+
 private:
   Camera m_camera;
   AssetImporter m_importer;
@@ -67,6 +93,9 @@ private:
   flecs::world m_world;
   flecs::query<Transform, MeshHandle, Material> m_renderables;
   flecs::query<Transform, MeshHandle, Material> m_pending_renderables;
+  flecs::query<Transform, PointLight> m_lights;
+  // Filled by unload_model(), until the renderer consumes them
+  std::vector<RenderableInfo> m_released_renderables;
 };
 } // namespace Expectre
 #endif // SCENE
\ No newline at end of file